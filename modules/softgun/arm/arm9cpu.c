@@ -65,10 +65,12 @@
 #include "arm9cpu.h"
 
 // Local/Private Headers
+#include "bbcache_arm.h"
 #include "idecode_arm.h"
 #include "instructions_arm.h"
 #include "mmu_arm9.h"
 #include "thumb_decode.h"
+#include "thumb_cache.h"
 
 // Leigun Core Headers
 #include "bus.h"
@@ -79,6 +81,10 @@
 #include "leigun/leigun.h"
 #include "leigun/device.h"
 #include "leigun/globalclock.h"
+#include "pacer.h"
+#include "hosttime.h"
+#include "snapshot.h"
+#include "sgstring.h"
 
 // External headers
 
@@ -93,6 +99,8 @@
 #include <string.h>
 #include <setjmp.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <time.h>
 #include <sys/time.h>
@@ -109,6 +117,7 @@
     "cpu_clock: 200000000\n" \
     "start_address: 0\n" \
     "dbgwait: 0\n" \
+    "bbcache: 1\n" \
     "\n"
 
 
@@ -120,13 +129,10 @@
 //==============================================================================
 //= Variables
 //==============================================================================
-ARM9 gcpu;
+__THREAD_LOCAL__ ARM9 *gcpu;
 
 uint32_t debugflags = 0;
-uint32_t mmu_vector_base = 0;
-uint32_t do_alignment_check = 0;
-
-CycleTimer htimer;
+static ARM9 *armCpus = NULL;
 
 
 //==============================================================================
@@ -151,14 +157,19 @@ static void hello_proc(void *cd);
 static void irq_change(SigNode * node, int value, void *clientData);
 static void fiq_change(SigNode * node, int value, void *clientData);
 static void arm_throttle(void *clientData);
-static void ARM_ThrottleInit(ARM9 * arm);
+static void ARM_ThrottleInit(ARM9 * arm, const char *name);
+static void ARM9_SaveState(void *owner, Snapshot_t * ss);
+static int ARM9_LoadState(void *owner, Snapshot_t * ss);
 static void dump_stack(void);
 static void dump_regs(void);
 static void Do_Debug(void);
+static void ARM_InvalidateTlbs(void);
 static inline void CheckSignals(void);
 static inline void debug_print_instruction(uint32_t icode);
 static void Thumb_Loop(void);
+static void Thumb_LoopCached(void);
 static void ARM9_Loop32(void);
+static void ARM9_LoopBlocks(void);
 
 static Device_MPU_t *create(void);
 static void run(GlobalClock_LocalClock_t *clk, void *data);
@@ -172,15 +183,20 @@ static void run(GlobalClock_LocalClock_t *clk, void *data);
  * ----------------------------------------------
  * First the operations for debugger access to the
  * ARM system. GDB expects registers to be in
- * target byteorder
+ * target byteorder. The operations are called in
+ * the debugger thread. The register and memory
+ * accessors work on gcpu, so it is selected for
+ * the call and restored afterwards.
  * ----------------------------------------------
  */
 static int
 debugger_getreg(void *clientData, uint8_t * data, uint32_t index, int maxlen)
 {
+	ARM9 *prev_cpu = gcpu;
 	uint32_t value;
 	if (maxlen < 4)
 		return -EINVAL;
+	gcpu = clientData;
 	if (index < 15) {
 		value = ARM9_ReadReg(index);
 	} else if (index == 15) {
@@ -195,8 +211,10 @@ debugger_getreg(void *clientData, uint8_t * data, uint32_t index, int maxlen)
 	} else if (index == 25) {
 		value = REG_CPSR;
 	} else {
+		gcpu = prev_cpu;
 		return 0;
 	}
+	gcpu = prev_cpu;
 	if (MMU_Byteorder() == BYTE_ORDER_BIG) {
 		BYTE_WriteToBe32(data, 0, value);
 	} else {
@@ -208,6 +226,7 @@ debugger_getreg(void *clientData, uint8_t * data, uint32_t index, int maxlen)
 static void
 debugger_setreg(void *clientData, const uint8_t * data, uint32_t index, int len)
 {
+	ARM9 *prev_cpu = gcpu;
 	uint32_t value;
 	if (len != 4)
 		return;
@@ -216,15 +235,13 @@ debugger_setreg(void *clientData, const uint8_t * data, uint32_t index, int len)
 	} else {
 		BYTE_WriteToLe32(&value, 0, *((uint32_t *)data));
 	}
+	gcpu = clientData;
 	if (index < 16) {
 		ARM9_WriteReg(value, index);
-	} else if (index < 25) {
-		return;
 	} else if (index == 25) {
 		SET_REG_CPSR(value);
-	} else {
-		return;
 	}
+	gcpu = prev_cpu;
 	return;
 }
 
@@ -258,39 +275,42 @@ debugger_get_bkpt_ins(void *clientData, uint8_t * ins, uint64_t addr, int len)
 static int
 debugger_stop(void *clientData)
 {
-
-	gcpu.dbg_state = DBG_STATE_STOP;
-	ARM_SigDebugMode(true);
+	ARM9 *arm = clientData;
+	arm->dbg_state = DBG_STATE_STOP;
+	ARM9_PostSignal(arm, ARM_SIG_DEBUGMODE);
 	return -1;
 }
 
 static int
 debugger_cont(void *clientData)
 {
+	ARM9 *arm = clientData;
 	//fprintf(stderr,"ARM cont\n");
-	gcpu.dbg_state = DBG_STATE_RUNNING;
+	arm->dbg_state = DBG_STATE_RUNNING;
 	/* Should only be called if there are no breakpoints */
-	ARM_SigDebugMode(false);
+	ARM9_UnPostSignal(arm, ARM_SIG_DEBUGMODE);
 	return 0;
 }
 
 static int
 debugger_step(void *clientData, uint64_t addr, int use_addr)
 {
+	ARM9 *arm = clientData;
 	if (use_addr) {
-		ARM_SET_NIA(addr);
+		arm->registers[15] = addr;
 	}
-	gcpu.dbg_steps = 1;
-	gcpu.dbg_state = DBG_STATE_STEP;
+	arm->dbg_steps = 1;
+	arm->dbg_state = DBG_STATE_STEP;
 	return -1;
 }
 
 static Dbg_TargetStat
 debugger_get_status(void *clientData)
 {
-	if (gcpu.dbg_state == DBG_STATE_STOPPED) {
+	ARM9 *arm = clientData;
+	if (arm->dbg_state == DBG_STATE_STOPPED) {
 		return DbgStat_SIGINT;
-	} else if (gcpu.dbg_state == DBG_STATE_RUNNING) {
+	} else if (arm->dbg_state == DBG_STATE_RUNNING) {
 		return DbgStat_RUNNING;
 	} else {
 		return -1;
@@ -306,12 +326,15 @@ debugger_get_status(void *clientData)
 static ssize_t
 debugger_getmem(void *clientData, uint8_t * data, uint64_t addr, uint32_t len)
 {
-	int count;
+	ARM9 *prev_cpu = gcpu;
+	volatile int count;
+	gcpu = clientData;
 	/* catch exceptions from MMU */
 	count = 0;
 	MMU_SetDebugMode(1);
-	if (setjmp(gcpu.abort_jump)) {
+	if (setjmp(gcpu->abort_jump)) {
 		MMU_SetDebugMode(0);
+		gcpu = prev_cpu;
 		return count;
 	}
 	for (; len >= 4; len -= 4, count += 4, data += 4) {
@@ -335,18 +358,22 @@ debugger_getmem(void *clientData, uint8_t * data, uint64_t addr, uint32_t len)
 		*data = value;
 	}
 	MMU_SetDebugMode(0);
+	gcpu = prev_cpu;
 	return count;
 }
 
 static ssize_t
 debugger_setmem(void *clientData, const uint8_t * data, uint64_t addr, uint32_t len)
 {
-	int count = 0;
+	ARM9 *prev_cpu = gcpu;
+	volatile int count = 0;
+	gcpu = clientData;
 	//fprintf(stderr,"ARM readmem\n");
 	/* catch exceptions from MMU */
 	MMU_SetDebugMode(1);
-	if (setjmp(gcpu.abort_jump)) {
+	if (setjmp(gcpu->abort_jump)) {
 		MMU_SetDebugMode(0);
+		gcpu = prev_cpu;
 		return count;
 	}
 	for (; len >= 4; len -= 4, count += 4, data += 4) {
@@ -370,6 +397,7 @@ debugger_setmem(void *clientData, const uint8_t * data, uint64_t addr, uint32_t
 		MMU_Write8(value, addr + count);
 	}
 	MMU_SetDebugMode(0);
+	gcpu = prev_cpu;
 	return count;
 }
 
@@ -597,87 +625,129 @@ hello_proc(void *cd)
 	struct timeval tv_now;
 	unsigned int time;
 	gettimeofday(&tv_now, NULL);
-	tv_start = &gcpu.starttime;
+	tv_start = &gcpu->starttime;
 	time = (tv_now.tv_sec - tv_start->tv_sec) * 1000
 	    + ((tv_now.tv_usec - tv_start->tv_usec) / 1000);
 	dbgprintf("\nSimulator speed %d kHz\n", (int)(CycleCounter_Get() / time));
 	//fprintf(stderr,"\nSimulator speed %d kHz\n",(int) (CycleCounter_Get()/time));
+	if (armBBCache) {
+		dbgprintf("Basic block cache: %" PRIu64 " hits, %" PRIu64 " misses, %"
+			  PRIu64 " uncached, %" PRIu64 " code page writes\n", armBBStats.hits,
+			  armBBStats.misses, armBBStats.uncached, armBBStats.page_writes);
+	}
+#ifdef DEBUG
+	if (stlb_read) {
+		MMU_PrintTlbStatistics();
+	}
+#endif
 #ifdef PROFILE
 	exit(0);
 #endif
-//      CycleTimer_Add(&htimer,10000000000LL,hello_proc,NULL);
+//      CycleTimer_Add(&gcpu->hello_timer,10000000000LL,hello_proc,NULL);
 }
 
+/*
+ * The interrupt inputs may change in any thread, only the signals
+ * of the CPU are touched, not the CPU of the calling thread
+ */
 static void
 irq_change(SigNode * node, int value, void *clientData)
 {
+	ARM9 *arm = clientData;
 	if ((value == SIG_LOW) || (value == SIG_PULLDOWN)) {
-		ARM_PostIrq();
+		ARM9_PostSignal(arm, ARM_SIG_IRQ);
 	} else {
-		ARM_UnPostIrq();
+		ARM9_UnPostSignal(arm, ARM_SIG_IRQ);
 	}
 }
 
 static void
 fiq_change(SigNode * node, int value, void *clientData)
 {
+	ARM9 *arm = clientData;
 	if ((value == SIG_LOW) || (value == SIG_PULLDOWN)) {
-		ARM_PostFiq();
+		ARM9_PostSignal(arm, ARM_SIG_FIQ);
 	} else {
-		ARM_UnPostFiq();
+		ARM9_UnPostSignal(arm, ARM_SIG_FIQ);
 	}
 }
 
 /*
  *************************************************************************+
- * Throttle timer for OS not using the halt instruction 
+ * Throttle timer: The pacer sleeps if the CPU is ahead of the real time
  *************************************************************************+
  */
 static void
 arm_throttle(void *clientData)
 {
-	ARM9 *arm = (ARM9 *) clientData;;
-	struct timespec tv_now;
-	uint32_t nsecs;
-	int64_t exp_cpu_cycles, done_cpu_cycles;
-	done_cpu_cycles = CycleCounter_Get() - arm->last_throttle_cycles;
-	arm->cycles_ahead += done_cpu_cycles;
-	do {
-		struct timespec tout;
-		tout.tv_nsec = 10000000;	/* 10 ms */
-		tout.tv_sec = 0;
-
-		clock_gettime(CLOCK_MONOTONIC, &tv_now);
-		nsecs = (tv_now.tv_nsec - arm->tv_last_throttle.tv_nsec) +
-		    (int64_t) 1000000000 *(tv_now.tv_sec - arm->tv_last_throttle.tv_sec);
-		exp_cpu_cycles = NanosecondsToCycles(nsecs);
-		if (arm->cycles_ahead > exp_cpu_cycles) {
-			// FIXME: FIO_WaitEventTimeout(&tout);
-		}
-	} while (arm->cycles_ahead > exp_cpu_cycles);
-	arm->cycles_ahead -= exp_cpu_cycles;
-	/*
-	 **********************************************************
-	 * Forget about catch up if CPU is more than on second
-	 * behind to avoid a longer phase of overspeed. Sound
-	 * doesn't like it !
-	 **********************************************************
-	 */
-	if (-arm->cycles_ahead > (CycleTimerRate_Get() >> 2)) {
-		arm->cycles_ahead = 0;
-	}
+	ARM9 *arm = (ARM9 *) clientData;
+	uint64_t cycles = CycleCounter_Get() - arm->last_throttle_cycles;
 	arm->last_throttle_cycles = CycleCounter_Get();
-	arm->tv_last_throttle = tv_now;
-	CycleTimer_Mod(&arm->throttle_timer, CycleTimerRate_Get() / 10);
-	return;
+	Pacer_Advance(arm->pacer, CyclesToNanoseconds(cycles));
+	CycleTimer_Mod(&arm->throttle_timer, CycleTimerRate_Get() / 100);
 }
 
 static void
-ARM_ThrottleInit(ARM9 * arm)
+ARM_ThrottleInit(ARM9 * arm, const char *name)
 {
-	clock_gettime(CLOCK_MONOTONIC, &arm->tv_last_throttle);
+	uint32_t catchup_ms = PACER_DEFAULT_MAX_LAG_NS / 1000000;
+	if (HostTime_Deterministic()) {
+		return;
+	}
+	Config_ReadUInt32(&catchup_ms, name, "throttle_catchup_ms");
+	arm->pacer = Pacer_New(name, (uint64_t) catchup_ms * 1000000);
+	if (!arm->pacer) {
+		exit(1);
+	}
 	arm->last_throttle_cycles = 0;
-	CycleTimer_Add(&arm->throttle_timer, CycleTimerRate_Get() / 25, arm_throttle, arm);
+	CycleTimer_Add(&arm->throttle_timer, CycleTimerRate_Get() / 100, arm_throttle, arm);
+}
+
+/*
+ * --------------------------------------------------------------------------
+ * Snapshot of the CPU: The registers of all banks, the CPSR and a
+ * pending wait for interrupt. The IRQ and FIQ inputs are not saved,
+ * they follow the signal nodes of the restored interrupt controller.
+ * --------------------------------------------------------------------------
+ */
+#define ARM9_STATE_START	offsetof(ARM9, registers)
+#define ARM9_STATE_END		(offsetof(ARM9, reg_dummy) + sizeof(uint32_t))
+
+static void
+ARM9_SaveState(void *owner, Snapshot_t * ss)
+{
+	ARM9 *arm = owner;
+	uint32_t wfi = arm->signals_raw & ARM_SIG_WFI;
+	Snapshot_Write(ss, (uint8_t *) arm + ARM9_STATE_START, ARM9_STATE_END - ARM9_STATE_START);
+	Snapshot_Write(ss, &wfi, sizeof(wfi));
+}
+
+static int
+ARM9_LoadState(void *owner, Snapshot_t * ss)
+{
+	ARM9 *arm = owner;
+	uint32_t wfi;
+	if ((Snapshot_Read(ss, (uint8_t *) arm + ARM9_STATE_START,
+			   ARM9_STATE_END - ARM9_STATE_START) < 0)
+	    || (Snapshot_Read(ss, &wfi, sizeof(wfi)) < 0)) {
+		return -1;
+	}
+	if (arm->reg_cpsr & FLAG_I) {
+		arm->signal_mask &= ~ARM_SIG_IRQ;
+	} else {
+		arm->signal_mask |= ARM_SIG_IRQ;
+	}
+	if (arm->reg_cpsr & FLAG_F) {
+		arm->signal_mask &= ~ARM_SIG_FIQ;
+	} else {
+		arm->signal_mask |= ARM_SIG_FIQ;
+	}
+	if (wfi & ARM_SIG_WFI) {
+		ARM9_PostSignal(arm, ARM_SIG_WFI);
+	} else {
+		ARM9_UnPostSignal(arm, ARM_SIG_WFI);
+	}
+	return 0;
 }
 
 static void
@@ -720,40 +790,40 @@ static void
 Do_Debug(void)
 {
 	fprintf(stderr, "one at %08x\n", ARM_NIA);
-	if (likely(gcpu.dbg_state == DBG_STATE_RUNNING)) {
+	if (likely(gcpu->dbg_state == DBG_STATE_RUNNING)) {
 		fprintf(stderr, "Debug mode is of, should not be called\n");
-	} else if (gcpu.dbg_state == DBG_STATE_STEP) {
-		if (gcpu.dbg_steps == 0) {
-			gcpu.dbg_state = DBG_STATE_STOPPED;
+	} else if (gcpu->dbg_state == DBG_STATE_STEP) {
+		if (gcpu->dbg_steps == 0) {
+			gcpu->dbg_state = DBG_STATE_STOPPED;
 			fprintf(stderr, "stopped at CIA %08x\n", ARM_GET_CIA);
-			if (gcpu.debugger) {
-				Debugger_Notify(gcpu.debugger, DbgStat_SIGTRAP);
+			if (gcpu->debugger) {
+				Debugger_Notify(gcpu->debugger, DbgStat_SIGTRAP);
 			}
 			ARM_RestartIdecoder();
 		} else {
 			fprintf(stderr, "step at CIA %08x\n", ARM_GET_CIA);
-			gcpu.dbg_steps--;
+			gcpu->dbg_steps--;
 		}
-	} else if (gcpu.dbg_state == DBG_STATE_STOP) {
+	} else if (gcpu->dbg_state == DBG_STATE_STOP) {
 		fprintf(stderr, "stopped at CIA %08x\n", ARM_GET_CIA);
-		gcpu.dbg_state = DBG_STATE_STOPPED;
-		if (gcpu.debugger) {
-			Debugger_Notify(gcpu.debugger, DbgStat_SIGTRAP);
+		gcpu->dbg_state = DBG_STATE_STOPPED;
+		if (gcpu->debugger) {
+			Debugger_Notify(gcpu->debugger, DbgStat_SIGTRAP);
 		}
 		ARM_RestartIdecoder();
-	} else if (gcpu.dbg_state == DBG_STATE_BREAK) {
+	} else if (gcpu->dbg_state == DBG_STATE_BREAK) {
 		fprintf(stderr, "break at CIA %08x\n", ARM_GET_CIA);
-		if (gcpu.debugger) {
+		if (gcpu->debugger) {
 			/* Stop only if the debugger shows a reaction */
-			if (Debugger_Notify(gcpu.debugger, DbgStat_SIGINT) > 0) {
-				gcpu.dbg_state = DBG_STATE_STOPPED;
+			if (Debugger_Notify(gcpu->debugger, DbgStat_SIGINT) > 0) {
+				gcpu->dbg_state = DBG_STATE_STOPPED;
 				ARM_RestartIdecoder();
 			}
 		}
 		ARM_Exception(EX_PABT, 4);
-		gcpu.dbg_state = DBG_STATE_RUNNING;
+		gcpu->dbg_state = DBG_STATE_RUNNING;
 	} else {
-		fprintf(stderr, "Unknown restart signal reason %d\n", gcpu.dbg_state);
+		fprintf(stderr, "Unknown restart signal reason %d\n", gcpu->dbg_state);
 	}
 }
 
@@ -764,20 +834,64 @@ Do_Debug(void)
  *	and for the signals IRQ and FIQ
  * -----------------------------------------------------------------------
  */
+/*
+ * ---------------------------------------------------------------------
+ * The CPU waits for an interrupt. Instead of executing the idle cycles
+ * the virtual time is skipped from one CycleTimer to the next until an
+ * IRQ or FIQ is pending. Interrupts wake up the CPU even when they are
+ * disabled in the CPSR, so the raw signals are checked.
+ * ---------------------------------------------------------------------
+ */
+static void
+ARM_Idle(void)
+{
+	while (!(__atomic_load_n(&gcpu->signals_raw, __ATOMIC_SEQ_CST) &
+		 (ARM_SIG_IRQ | ARM_SIG_FIQ | ARM_SIG_DEBUGMODE))) {
+		if (!CycleTimers_FastForward()) {
+			break;
+		}
+	}
+	ARM9_UnPostSignal(gcpu, ARM_SIG_WFI);
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * Another thread changed the memory map or traced a code page. The
+ * signal is removed first, so a request arriving meanwhile is not lost.
+ * ---------------------------------------------------------------------
+ */
+static void
+ARM_InvalidateTlbs(void)
+{
+	if (gcpu->signals & ARM_SIG_INVAL_TLB) {
+		ARM9_UnPostSignal(gcpu, ARM_SIG_INVAL_TLB | ARM_SIG_INVAL_WTLB);
+		MMU_InvalidateLocalTlb();
+	} else {
+		ARM9_UnPostSignal(gcpu, ARM_SIG_INVAL_WTLB);
+		MMU_InvalidateLocalWriteTlb();
+	}
+}
+
 static inline void
 CheckSignals(void)
 {
-	if (gcpu.signals) {
-		if (likely(gcpu.signals & ARM_SIG_IRQ)) {
+	if (gcpu->signals) {
+		if (unlikely(gcpu->signals & (ARM_SIG_INVAL_TLB | ARM_SIG_INVAL_WTLB))) {
+			ARM_InvalidateTlbs();
+		}
+		if (unlikely(gcpu->signals & ARM_SIG_WFI)) {
+			ARM_Idle();
+		}
+		if (likely(gcpu->signals & ARM_SIG_IRQ)) {
 			ARM_Exception(EX_IRQ, 4);
 		}
-		if (unlikely(gcpu.signals & ARM_SIG_FIQ)) {
+		if (unlikely(gcpu->signals & ARM_SIG_FIQ)) {
 			ARM_Exception(EX_FIQ, 4);
 		}
-		if (unlikely(gcpu.signals & ARM_SIG_DEBUGMODE)) {
+		if (unlikely(gcpu->signals & ARM_SIG_DEBUGMODE)) {
 			Do_Debug();
 		}
-		if (unlikely(gcpu.signals & ARM_SIG_RESTART_IDEC)) {
+		if (unlikely(gcpu->signals & ARM_SIG_RESTART_IDEC)) {
 			ARM_RestartIdecoder();
 		}
 	}
@@ -808,23 +922,65 @@ static void
 Thumb_Loop(void)
 {
 	ThumbInstructionProc *iproc;
-	ThumbInstruction *instr;
 	//fprintf(stderr,"Entering Thumb loop\n");
-	setjmp(gcpu.abort_jump);
+	setjmp(gcpu->abort_jump);
 	while (1) {
-		GlobalClock_ConsumeCycle(gcpu.clk, 2);
 		CycleCounter += 2;
 		CheckSignals();
 		ICODE = MMU_IFetch16(ARM_NIA);
 		ARM_NIA += 2;
-		instr = ThumbInstruction_Find(ICODE);
-		//fprintf(stderr,"Instruction %08x, name %s at %08x\n",ICODE,instr->name,ARM_NIA);
 		iproc = ThumbInstructionProc_Find(ICODE);
 		iproc();
 		CycleTimers_Check();
 	}
 }
 
+/*
+ * ------------------------------------------------------------------
+ * The Thumb main loop with predecoded page cache. As long as
+ * execution stays in the same page and the page is unmodified
+ * no MMU lookup and no decode table lookup is done.
+ * ------------------------------------------------------------------
+ */
+static void
+Thumb_LoopCached(void)
+{
+	ThumbInstructionProc *iproc;
+	ThumbPage *tp;
+	uint32_t slot;
+	setjmp(gcpu->abort_jump);
+	tp = NULL;
+	while (1) {
+		CycleCounter += 2;
+		CheckSignals();
+		if (unlikely(!ThumbPage_Valid(tp, ARM_NIA))) {
+			if (unlikely(gcpu->signals & ARM_SIG_DEBUGMODE)) {
+				tp = NULL;
+			} else {
+				tp = ThumbCache_Lookup(ARM_NIA);
+			}
+			if (unlikely(!tp)) {
+				/* Single step for debugger and for code from IO */
+				ICODE = MMU_IFetch16(ARM_NIA);
+				ARM_NIA += 2;
+				iproc = ThumbInstructionProc_Find(ICODE);
+				iproc();
+				CycleTimers_Check();
+				continue;
+			}
+		}
+		slot = THUMB_SLOT(ARM_NIA);
+		iproc = tp->iproc[slot];
+		if (unlikely(!iproc)) {
+			iproc = ThumbCache_DecodeSlot(tp, slot);
+		}
+		ICODE = tp->icode[slot];
+		ARM_NIA += 2;
+		iproc();
+		CycleTimers_Check();
+	}
+}
+
 /*
  * ---------------------------------------------
  * The main loop for 32Bit instruction set
@@ -835,13 +991,12 @@ ARM9_Loop32(void)
 {
 	InstructionProc *iproc;
 	/* Exceptions use goto (longjmp) */
-	setjmp(gcpu.abort_jump);
+	setjmp(gcpu->abort_jump);
 	while (1) {
 #if VERBOSE
 		fprintf(stdout, "CIA %08x\n", ARM_GET_CIA);
 #endif
 		CheckSignals();
-		GlobalClock_ConsumeCycle(gcpu.clk, 6);
 		CycleCounter += 6;
 		ICODE = MMU_IFetch(ARM_NIA);
 		ARM_NIA += 4;
@@ -873,6 +1028,58 @@ ARM9_Loop32(void)
 	}
 }
 
+/*
+ * ----------------------------------------------------------------
+ * The main loop for 32Bit instruction set with basic block cache.
+ * Signals, cycle accounting and timers are only handled
+ * between blocks. A block is left early when the PC does not
+ * proceed linearly or when a signal is pending.
+ * ----------------------------------------------------------------
+ */
+static void
+ARM9_LoopBlocks(void)
+{
+	InstructionProc *iproc;
+	ARM_BasicBlock *bb;
+	uint32_t nia;
+	uint32_t i;
+	/* Exceptions use goto (longjmp) */
+	setjmp(gcpu->abort_jump);
+	while (1) {
+		CheckSignals();
+		if (unlikely(gcpu->signals & ARM_SIG_DEBUGMODE)) {
+			bb = NULL;
+		} else {
+			bb = ARM_BBLookup(ARM_NIA);
+		}
+		if (unlikely(!bb)) {
+			/* Single step for debugger and for code from IO */
+			CycleCounter += 2;
+			ICODE = MMU_IFetch(ARM_NIA);
+			ARM_NIA += 4;
+			iproc = InstructionProcFind(ICODE);
+			debug_print_instruction(ICODE);
+			iproc();
+			CycleTimers_Check();
+			continue;
+		}
+		nia = bb->va;
+		for (i = 0; i < bb->len;) {
+			ICODE = bb->icode[i];
+			nia += 4;
+			ARM_NIA = nia;
+			debug_print_instruction(ICODE);
+			bb->iproc[i]();
+			i++;
+			if (unlikely((ARM_NIA != nia) || gcpu->signals)) {
+				break;
+			}
+		}
+		CycleCounter += i << 1;
+		CycleTimers_Check();
+	}
+}
+
 /*
  * -----------------------------------------------------
  * Create a new ARM9 CPU
@@ -881,23 +1088,50 @@ ARM9_Loop32(void)
 static Device_MPU_t *
 create(void)
 {
+	static int instances = 0;
 	uint32_t cpu_clock = 200000000;
+	uint32_t bbcache = 1;
+	uint32_t quantum_us = 0;
 	int i;
-	const char *instancename = "arm";
-	ARM9 *arm = &gcpu;
-	Device_MPU_t *dev = LEIGUN_NEW(dev);
+	char *instancename;
+	ARM9 *arm;
+	Device_MPU_t *dev;
+	arm = LEIGUN_NEW(arm);
+	dev = LEIGUN_NEW(dev);
 	dev->self = arm;
+	/* The first CPU keeps the name "arm", further ones are "arm1", "arm2" ... */
+	if (instances) {
+		instancename = sg_calloc(16);
+		snprintf(instancename, 16, "arm%d", instances);
+	} else {
+		instancename = sg_strdup("arm");
+	}
+	arm->next = armCpus;
+	armCpus = arm;
+	/* The devices created next belong to this CPU */
+	gcpu = arm;
 	Config_ReadUInt32(&cpu_clock, "global", "cpu_clock");
-	fprintf(stderr, "Creating ARM9 CPU with clock %d HZ\n", cpu_clock);
-	memset(arm, 0, sizeof(ARM9));
-	IDecoder_New();
-	ARM9_InitRegs(&gcpu);
-	InitInstructions();
-	ThumbDecoder_New();
+	fprintf(stderr, "Creating ARM9 CPU \"%s\" with clock %d HZ\n", instancename, cpu_clock);
+	/* The decoder tables are shared by all CPUs */
+	if (!instances++) {
+		IDecoder_New();
+		InitInstructions();
+		ThumbDecoder_New();
+	}
+	ARM9_InitRegs(arm);
+	MMU_ArmInit(instancename);
+	Config_ReadUInt32(&bbcache, "global", "bbcache");
+	if (bbcache) {
+		ARM_BBInit();
+		ThumbCache_Init();
+	}
 	SET_REG_CPSR(MODE_SVC | FLAG_F | FLAG_I);
-	GlobalClock_Registor(&run, dev, cpu_clock);
-	CycleTimers_Init(instancename, cpu_clock);
-	CycleTimer_Add(&htimer, 285000000, hello_proc, NULL);
+	/* A CPU with its own quantum in relaxed sync mode, 0 is the global one */
+	Config_ReadUInt32(&quantum_us, instancename, "clock_quantum_us");
+	GlobalClock_RegistorQuantum(&run, dev, cpu_clock,
+				    (uint64_t)quantum_us * 1000);
+	arm->timerDomain = CycleTimers_Init(instancename, cpu_clock);
+	CycleTimer_Add(&arm->hello_timer, 285000000, hello_proc, NULL);
 	arm->irqNode = SigNode_New("%s.irq", instancename);
 	arm->fiqNode = SigNode_New("%s.fiq", instancename);
 	if (!arm->irqNode || !arm->fiqNode) {
@@ -916,8 +1150,10 @@ create(void)
 	arm->dbgops.setmem = debugger_setmem;
 	arm->dbgops.get_bkpt_ins = debugger_get_bkpt_ins;
 	arm->debugger = Debugger_New(&arm->dbgops, arm);
-	gcpu.signal_mask |= ARM_SIG_RESTART_IDEC | ARM_SIG_DEBUGMODE;
-	ARM_ThrottleInit(arm);
+	gcpu->signal_mask |= ARM_SIG_RESTART_IDEC | ARM_SIG_DEBUGMODE | ARM_SIG_WFI;
+	gcpu->signal_mask |= ARM_SIG_INVAL_TLB | ARM_SIG_INVAL_WTLB;
+	ARM_ThrottleInit(arm, instancename);
+	Snapshot_RegisterState(instancename, ARM9_SaveState, ARM9_LoadState, arm);
 	for (i = 0; i < 16; i++) {
 		char regname[10];
 		uint32_t value;
@@ -935,8 +1171,12 @@ run(GlobalClock_LocalClock_t *clk, void *data)
 	ARM9 *arm = ((Device_MPU_t *)data)->self;
 	uint32_t addr = 0;
 	uint32_t dbgwait;
+	gcpu = arm;
 	arm->clk = clk;
-	if (Config_ReadUInt32(&addr, "global", "start_address") < 0) {
+	if (Snapshot_Restored()) {
+		/* Continue where the snapshot was taken */
+		addr = ARM_NIA;
+	} else if (Config_ReadUInt32(&addr, "global", "start_address") < 0) {
 		addr = 0;
 	}
 	if (Config_ReadUInt32(&dbgwait, "global", "dbgwait") < 0) {
@@ -944,19 +1184,19 @@ run(GlobalClock_LocalClock_t *clk, void *data)
 	}
 	if (dbgwait) {
 		fprintf(stderr, "CPU is waiting for debugger connection at %08x\n", addr);
-		gcpu.dbg_state = DBG_STATE_STOPPED;
+		gcpu->dbg_state = DBG_STATE_STOPPED;
 		ARM_SigDebugMode(true);
 	} else {
 		fprintf(stderr, "Starting CPU at %08x\n", addr);
 	}
-	gettimeofday(&gcpu.starttime, NULL);
+	gettimeofday(&gcpu->starttime, NULL);
+	CycleTimers_SyncGlobalClock(arm->timerDomain, clk);
 	ARM_NIA = addr;
 	/* A long jump to this label redecides which main loop is used  */
-	setjmp(gcpu.restart_idec_jump);
-	gcpu.signals &= ~ARM_SIG_RESTART_IDEC;
-	gcpu.signals_raw &= ~ARM_SIG_RESTART_IDEC;
+	setjmp(gcpu->restart_idec_jump);
+	ARM9_UnPostSignal(gcpu, ARM_SIG_RESTART_IDEC);
 	while (1) {
-		if (unlikely(gcpu.dbg_state == DBG_STATE_STOPPED)) {
+		if (unlikely(gcpu->dbg_state == DBG_STATE_STOPPED)) {
 			struct timespec tout;
 			tout.tv_nsec = 0;
 			tout.tv_sec = 10000;
@@ -964,7 +1204,13 @@ run(GlobalClock_LocalClock_t *clk, void *data)
 			sleep(1);
 		} else {
 			if (REG_CPSR & FLAG_T) {
-				Thumb_Loop();
+				if (thumbCache) {
+					Thumb_LoopCached();
+				} else {
+					Thumb_Loop();
+				}
+			} else if (armBBCache) {
+				ARM9_LoopBlocks();
 			} else {
 				ARM9_Loop32();
 			}
@@ -980,59 +1226,76 @@ void
 ARM_set_reg_cpsr(uint32_t new_cpsr)
 {
 	uint32_t bank = new_cpsr & 0x1f;
-	uint32_t diff_cpsr = new_cpsr ^ gcpu.reg_cpsr;
-	gcpu.reg_cpsr = new_cpsr;
-	if (gcpu.reg_bank != bank) {
-		if (likely(gcpu.reg_bank != MODE_FIQ)) {
+	uint32_t diff_cpsr = new_cpsr ^ gcpu->reg_cpsr;
+	gcpu->reg_cpsr = new_cpsr;
+	if (gcpu->reg_bank != bank) {
+		if (likely(gcpu->reg_bank != MODE_FIQ)) {
 			uint32_t *rp;
-			*gcpu.regSet[gcpu.reg_bank].r13 = gcpu.registers[13];
-			*gcpu.regSet[gcpu.reg_bank].r14 = gcpu.registers[14];
-			rp = gcpu.regSet[gcpu.reg_bank].spsr;
+			*gcpu->regSet[gcpu->reg_bank].r13 = gcpu->registers[13];
+			*gcpu->regSet[gcpu->reg_bank].r14 = gcpu->registers[14];
+			rp = gcpu->regSet[gcpu->reg_bank].spsr;
 			if (rp)
-				*rp = gcpu.registers[16];
+				*rp = gcpu->registers[16];
 		} else {
-			gcpu.r8_fiq = gcpu.registers[8];
-			gcpu.r9_fiq = gcpu.registers[9];
-			gcpu.r10_fiq = gcpu.registers[10];
-			gcpu.r11_fiq = gcpu.registers[11];
-			gcpu.r12_fiq = gcpu.registers[12];
-			gcpu.r13_fiq = gcpu.registers[13];
-			gcpu.r14_fiq = gcpu.registers[14];
-			gcpu.spsr_fiq = gcpu.registers[16];
+			gcpu->r8_fiq = gcpu->registers[8];
+			gcpu->r9_fiq = gcpu->registers[9];
+			gcpu->r10_fiq = gcpu->registers[10];
+			gcpu->r11_fiq = gcpu->registers[11];
+			gcpu->r12_fiq = gcpu->registers[12];
+			gcpu->r13_fiq = gcpu->registers[13];
+			gcpu->r14_fiq = gcpu->registers[14];
+			gcpu->spsr_fiq = gcpu->registers[16];
 		}
 		if (likely(bank != MODE_FIQ)) {
 			uint32_t *rp;
-			gcpu.registers[13] = *gcpu.regSet[bank].r13;
-			gcpu.registers[14] = *gcpu.regSet[bank].r14;
-			rp = gcpu.regSet[bank].spsr;
+			gcpu->registers[13] = *gcpu->regSet[bank].r13;
+			gcpu->registers[14] = *gcpu->regSet[bank].r14;
+			rp = gcpu->regSet[bank].spsr;
 			if (rp)
-				gcpu.registers[16] = *rp;
+				gcpu->registers[16] = *rp;
 		} else {
-			gcpu.registers[8] = gcpu.r8_fiq;
-			gcpu.registers[9] = gcpu.r9_fiq;
-			gcpu.registers[10] = gcpu.r10_fiq;
-			gcpu.registers[11] = gcpu.r11_fiq;
-			gcpu.registers[12] = gcpu.r12_fiq;
-			gcpu.registers[13] = gcpu.r13_fiq;
-			gcpu.registers[14] = gcpu.r14_fiq;
-			gcpu.registers[16] = gcpu.spsr_fiq;
+			gcpu->registers[8] = gcpu->r8_fiq;
+			gcpu->registers[9] = gcpu->r9_fiq;
+			gcpu->registers[10] = gcpu->r10_fiq;
+			gcpu->registers[11] = gcpu->r11_fiq;
+			gcpu->registers[12] = gcpu->r12_fiq;
+			gcpu->registers[13] = gcpu->r13_fiq;
+			gcpu->registers[14] = gcpu->r14_fiq;
+			gcpu->registers[16] = gcpu->spsr_fiq;
 		}
-		gcpu.signaling_mode = gcpu.reg_bank = bank;
+		gcpu->signaling_mode = gcpu->reg_bank = bank;
 	}
 	if (unlikely(new_cpsr & FLAG_I)) {
-		gcpu.signal_mask &= ~ARM_SIG_IRQ;
+		gcpu->signal_mask &= ~ARM_SIG_IRQ;
 	} else {
-		gcpu.signal_mask |= ARM_SIG_IRQ;
+		gcpu->signal_mask |= ARM_SIG_IRQ;
 	}
 	if (unlikely(new_cpsr & FLAG_F)) {
-		gcpu.signal_mask &= ~ARM_SIG_FIQ;
+		gcpu->signal_mask &= ~ARM_SIG_FIQ;
 	} else {
-		gcpu.signal_mask |= ARM_SIG_FIQ;
+		gcpu->signal_mask |= ARM_SIG_FIQ;
 	}
 	if (unlikely(diff_cpsr & FLAG_T)) {
 		ARM_PostRestartIdecoder();
 	}
-	gcpu.signals = gcpu.signals_raw & gcpu.signal_mask;
+	ARM9_UpdateSignals(gcpu);
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Post a signal to all ARM CPUs except one, used for requests which
+ * have to be executed in the thread of each CPU.
+ * ----------------------------------------------------------------------
+ */
+void
+ARM9_PostSignalAll(uint32_t signal, ARM9 * except)
+{
+	ARM9 *arm;
+	for (arm = armCpus; arm; arm = arm->next) {
+		if (arm != except) {
+			ARM9_PostSignal(arm, signal);
+		}
+	}
 }
 
 /*
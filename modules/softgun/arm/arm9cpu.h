@@ -8,9 +8,12 @@
 #include <xy_tree.h>
 #include <sys/time.h>
 #include <debugger.h>
+#include "compiler_extensions.h"
 #include "signode.h"
 #include "cycletimer.h"
 #include "globalclock.h"
+#include "pacer.h"
+#include "cpucache_arm.h"
 /*
  * ------------------------------------------------------
  * ARM9_RegPointerSet
@@ -40,8 +43,6 @@ typedef struct ARM9_RegPointerSet {
 } ARM9_RegPointerSet;
 
 extern uint64_t cpu_cyclecounter;
-extern uint32_t mmu_vector_base;
-extern uint32_t do_alignment_check;
 
 #define MODE_USER 	(0x10)
 #define MODE_FIQ  	(0x11)
@@ -159,15 +160,28 @@ typedef struct ARM9 {
 	DebugBackendOps dbgops;
 
 	/* Throttling cpu to real speed */
-	struct timespec tv_last_throttle;
+	Pacer_t *pacer;
 	CycleCounter_t last_throttle_cycles;
 	CycleTimer throttle_timer;
-	int64_t cycles_ahead;	/* Number of cycles ahead of real cpu */
 
 	uint32_t cpuArchitecture;
 	GlobalClock_LocalClock_t *clk;
+	CycleTimerDomain *timerDomain;
+	CycleTimer hello_timer;
+
+	/* TLBs and instruction caches, and the CP15 state they depend on */
+	ArmCpuCaches caches;
+	uint32_t mmuWordAddrXor;
+	uint32_t mmuByteAddrXor;
+	uint32_t mmuTranslationEnabled;
+	uint32_t mmuVectorBase;
+	uint32_t alignmentCheck;
+	struct ARM9 *next;	/* List of all ARM CPUs */
 } ARM9;
 
+#define mmu_vector_base		(gcpu->mmuVectorBase)
+#define do_alignment_check	(gcpu->alignmentCheck)
+
 #define ARCH_ARMV5		(0)
 #define ARCH_ARMV6		(1)
 #define ARCH_ARMV7		(2)
@@ -177,7 +191,14 @@ typedef struct ARM9 {
 #define DBG_STATE_STOPPED	(2)
 #define DBG_STATE_STEP		(3)
 #define DBG_STATE_BREAK		(4)
-extern ARM9 gcpu;
+
+/*
+ * The CPU the calling thread works on. It is set by the GlobalClock
+ * thread running the CPU, during board creation it is the CPU created
+ * last. Callbacks from other threads use the CPU from their clientData,
+ * the debugger operations select it only for the duration of the call.
+ */
+extern __THREAD_LOCAL__ ARM9 *gcpu;
 
 /*
  * Bit in field cpu_signals
@@ -186,39 +207,42 @@ extern ARM9 gcpu;
 #define ARM_SIG_FIQ		(1<<1)	/* Fast Interrupt */
 #define ARM_SIG_RESTART_IDEC	(1<<2)	/* Something changed in CPU or debugmode */
 #define ARM_SIG_DEBUGMODE	(1<<3)
-#define CPU_REGS (gcpu.regSet)
+#define ARM_SIG_WFI		(1<<4)	/* Wait for interrupt (halt) */
+#define ARM_SIG_INVAL_TLB	(1<<5)	/* Memory map changed by another thread */
+#define ARM_SIG_INVAL_WTLB	(1<<6)	/* Code page traced by another CPU */
+#define CPU_REGS (gcpu->regSet)
 
 void ARM_set_reg_cpsr(uint32_t val);
 
 #define PC_OFFSET (4)
 #define THUMB_PC_OFFSET (2)
-#define REG_LR	 ((gcpu.registers[14]))
+#define REG_LR	 ((gcpu->registers[14]))
 /*
  **********************************************************
  * NIA is power PC style: Next instruction address
  **********************************************************
  */
-#define ARM_NIA  		(gcpu.registers[15])
-#define ARM_GET_CIA  		(gcpu.registers[15] - PC_OFFSET)
-#define ARM_GET_NNIA  		(gcpu.registers[15] + PC_OFFSET)
-#define THUMB_GET_CIA 		(gcpu.registers[15] - PC_OFFSET)
-#define THUMB_NIA 		(gcpu.registers[15])
-#define THUMB_GET_NNIA 		(gcpu.registers[15] + THUMB_PC_OFFSET)
+#define ARM_NIA  		(gcpu->registers[15])
+#define ARM_GET_CIA  		(gcpu->registers[15] - PC_OFFSET)
+#define ARM_GET_NNIA  		(gcpu->registers[15] + PC_OFFSET)
+#define THUMB_GET_CIA 		(gcpu->registers[15] - PC_OFFSET)
+#define THUMB_NIA 		(gcpu->registers[15])
+#define THUMB_GET_NNIA 		(gcpu->registers[15] + THUMB_PC_OFFSET)
 
-#define ARM_SET_NIA(val)	({gcpu.registers[15]=(val);})
-#define REG_CPSR      (gcpu.reg_cpsr)
+#define ARM_SET_NIA(val)	({gcpu->registers[15]=(val);})
+#define REG_CPSR      (gcpu->reg_cpsr)
 
 #define SET_REG_CPSR(val) ARM_set_reg_cpsr(val);
-#define ARM_BANK     	(gcpu.reg_bank)
-#define ARM_SIGNALING_MODE     	(gcpu.signaling_mode)
-#define REG_SPSR	 (gcpu.registers[16])
-#define MODE_HAS_SPSR (gcpu.regSet[gcpu.reg_bank].spsr)
+#define ARM_BANK     	(gcpu->reg_bank)
+#define ARM_SIGNALING_MODE     	(gcpu->signaling_mode)
+#define REG_SPSR	 (gcpu->registers[16])
+#define MODE_HAS_SPSR (gcpu->regSet[gcpu->reg_bank].spsr)
 #define REG_NR_SPSR  (16)
 
-#define AM_SCRATCH1 (gcpu.am_scratch1)
-#define AM3_NEW_RN (gcpu.am_scratch2)
-#define AM3_UPDATE_RN (gcpu.am_scratch3)
-#define ICODE (gcpu.icode)
+#define AM_SCRATCH1 (gcpu->am_scratch1)
+#define AM3_NEW_RN (gcpu->am_scratch2)
+#define AM3_UPDATE_RN (gcpu->am_scratch3)
+#define ICODE (gcpu->icode)
 
 static inline void
 ARM9_RegisterCoprocessor(ArmCoprocessor * copro, unsigned int nr)
@@ -226,7 +250,7 @@ ARM9_RegisterCoprocessor(ArmCoprocessor * copro, unsigned int nr)
 	if (nr > 15) {
 		exit(2);
 	} else {
-		gcpu.copro[nr] = copro;
+		gcpu->copro[nr] = copro;
 	}
 }
 
@@ -234,9 +258,9 @@ static inline uint32_t
 Thumb_ReadReg(int nr)
 {
 	if (likely(nr != 15)) {
-		return gcpu.registers[nr];
+		return gcpu->registers[nr];
 	} else {
-		return gcpu.registers[15] + THUMB_PC_OFFSET;
+		return gcpu->registers[15] + THUMB_PC_OFFSET;
 	}
 }
 
@@ -244,16 +268,16 @@ static inline uint32_t
 Thumb_ReadHighReg(int nr)
 {
 	if (likely(nr != 15)) {
-		return gcpu.registers[nr];
+		return gcpu->registers[nr];
 	} else {
-		return gcpu.registers[15] + THUMB_PC_OFFSET;
+		return gcpu->registers[15] + THUMB_PC_OFFSET;
 	}
 }
 
 static inline void
 Thumb_WriteReg(uint32_t val, int nr)
 {
-	gcpu.registers[nr] = val;
+	gcpu->registers[nr] = val;
 }
 
 /*
@@ -266,22 +290,22 @@ static inline uint32_t
 ARM9_ReadReg(int nr)
 {
 	if (likely(nr != 15)) {
-		return gcpu.registers[nr];
+		return gcpu->registers[nr];
 	} else {
-		return gcpu.registers[15] + PC_OFFSET;
+		return gcpu->registers[15] + PC_OFFSET;
 	}
 }
 
 static inline uint32_t
 ARM9_ReadRegNot15(int nr)
 {
-	return gcpu.registers[nr];
+	return gcpu->registers[nr];
 }
 
 static inline void
 ARM9_WriteReg(uint32_t val, int nr)
 {
-	gcpu.registers[nr] = val;
+	gcpu->registers[nr] = val;
 }
 
 /*
@@ -297,7 +321,7 @@ ARM9_ReadRegBank(int nr, int bank)
 {
 	uint32_t **regpp;
 	regpp = (&CPU_REGS[bank].r0 + nr);
-	if (*regpp == *(&CPU_REGS[gcpu.reg_bank].r0 + nr)) {
+	if (*regpp == *(&CPU_REGS[gcpu->reg_bank].r0 + nr)) {
 		return ARM9_ReadReg(nr);
 	} else {
 		if (unlikely(nr == 15)) {
@@ -313,7 +337,7 @@ ARM9_WriteRegBank(uint32_t val, int nr, int bank)
 {
 	uint32_t **regpp;
 	regpp = (&CPU_REGS[bank].r0 + nr);
-	if (*regpp == *(&CPU_REGS[gcpu.reg_bank].r0 + nr)) {
+	if (*regpp == *(&CPU_REGS[gcpu->reg_bank].r0 + nr)) {
 		ARM9_WriteReg(val, nr);
 	} else {
 		**regpp = val;
@@ -321,70 +345,108 @@ ARM9_WriteRegBank(uint32_t val, int nr, int bank)
 }
 
 /*
- * -------------------------------------
- * Interrupt handling 
- * -------------------------------------
+ * -------------------------------------------------------------------
+ * Interrupt handling:
+ * The signals of a CPU are posted from other threads, for example
+ * by an interrupt controller in the AsyncManager thread or by the
+ * debugger. signals_raw is only changed atomically. The mask is
+ * changed by the CPU thread only, whoever stores the masked signals
+ * checks again afterwards so that a concurrent update is not lost.
+ * -------------------------------------------------------------------
  */
+static inline void
+ARM9_UpdateSignals(ARM9 * arm)
+{
+	uint32_t signals;
+	do {
+		signals = __atomic_load_n(&arm->signals_raw, __ATOMIC_SEQ_CST) &
+		    __atomic_load_n(&arm->signal_mask, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&arm->signals, signals, __ATOMIC_SEQ_CST);
+	} while (signals != (__atomic_load_n(&arm->signals_raw, __ATOMIC_SEQ_CST) &
+			     __atomic_load_n(&arm->signal_mask, __ATOMIC_SEQ_CST)));
+}
+
+static inline void
+ARM9_PostSignal(ARM9 * arm, uint32_t signal)
+{
+	__atomic_or_fetch(&arm->signals_raw, signal, __ATOMIC_SEQ_CST);
+	ARM9_UpdateSignals(arm);
+}
+
+static inline void
+ARM9_UnPostSignal(ARM9 * arm, uint32_t signal)
+{
+	__atomic_and_fetch(&arm->signals_raw, ~signal, __ATOMIC_SEQ_CST);
+	ARM9_UpdateSignals(arm);
+}
+
 static inline void
 ARM_PostIrq(void)
 {
-	gcpu.signals_raw |= ARM_SIG_IRQ;
-	gcpu.signals = gcpu.signals_raw & gcpu.signal_mask;
+	ARM9_PostSignal(gcpu, ARM_SIG_IRQ);
 }
 
 static inline void
 ARM_UnPostIrq(void)
 {
-	gcpu.signals_raw &= ~ARM_SIG_IRQ;
-	gcpu.signals = gcpu.signals_raw & gcpu.signal_mask;
+	ARM9_UnPostSignal(gcpu, ARM_SIG_IRQ);
 }
 
 static inline void
 ARM_PostFiq(void)
 {
-	gcpu.signals_raw |= ARM_SIG_FIQ;
-	gcpu.signals = gcpu.signals_raw & gcpu.signal_mask;
+	ARM9_PostSignal(gcpu, ARM_SIG_FIQ);
 }
 
 static inline void
 ARM_UnPostFiq(void)
 {
-	gcpu.signals_raw &= ~ARM_SIG_FIQ;
-	gcpu.signals = gcpu.signals_raw & gcpu.signal_mask;
+	ARM9_UnPostSignal(gcpu, ARM_SIG_FIQ);
 }
 
 static inline void
 ARM_PostRestartIdecoder(void)
 {
-	gcpu.signals_raw |= ARM_SIG_RESTART_IDEC;
-	gcpu.signals = gcpu.signals_raw & gcpu.signal_mask;
+	ARM9_PostSignal(gcpu, ARM_SIG_RESTART_IDEC);
 }
 
 static inline void
 ARM_SigDebugMode(bool value)
 {
 	if (value) {
-		gcpu.signals_raw |= ARM_SIG_DEBUGMODE;
+		ARM9_PostSignal(gcpu, ARM_SIG_DEBUGMODE);
 	} else {
-		gcpu.signals_raw &= ~ARM_SIG_DEBUGMODE;
+		ARM9_UnPostSignal(gcpu, ARM_SIG_DEBUGMODE);
 	}
-	gcpu.signals = gcpu.signals_raw & gcpu.signal_mask;
+}
+
+/*
+ * ----------------------------------------------------------
+ * Wait for interrupt: The CPU is halted in CheckSignals
+ * before the next instruction until an IRQ or FIQ arrives.
+ * ----------------------------------------------------------
+ */
+static inline void
+ARM_WaitForInterrupt(void)
+{
+	ARM9_PostSignal(gcpu, ARM_SIG_WFI);
 }
 
 static inline void
 ARM_Break(void)
 {
-	gcpu.dbg_state = DBG_STATE_BREAK;
+	gcpu->dbg_state = DBG_STATE_BREAK;
 	ARM_SigDebugMode(true);
 	ARM_PostRestartIdecoder();
 }
 
 void ARM_Exception(ARM_ExceptionID exception, int nia_offset);
+void ARM9_PostSignalAll(uint32_t signal, ARM9 * except);
 
 static inline void
 ARM_RestartIdecoder(void)
 {
-	longjmp(gcpu.restart_idec_jump, 1);
+	longjmp(gcpu->restart_idec_jump, 1);
 }
 
 #endif
@@ -41,6 +41,7 @@
 #include <string.h>
 #include "coprocessor.h"
 #include "arm9cpu.h"
+#include "sgstring.h"
 
 #define FPSCR_IOC		(1<<0)
 #define FPSCR_DZC		(1<<1)
@@ -81,32 +82,11 @@ typedef struct ArmVfp {
 	ArmCoprocessor copro11;
 } ArmVfp;
 
-/*
- * ------------------------------------
- * The instance of the ArmVfp 
- * ------------------------------------
- */
-static ArmVfp arm_vfp = {
-	.copro10 = {
-		    .mrc = NULL,
-		    .mcr = NULL,
-		    .cdp = NULL,
-		    .ldc = NULL,
-		    .stc = NULL,
-		    },
-	.copro11 = {
-		    .mrc = NULL,
-		    .mcr = NULL,
-		    .cdp = NULL,
-		    .ldc = NULL,
-		    .stc = NULL}
-
-};
-
 void
 ArmVfp_Init(char *vfpname)
 {
-	ArmVfp *vfp = &arm_vfp;
+	/* Every CPU gets its own VFP registers */
+	ArmVfp *vfp = sg_new(ArmVfp);
 	ARM9_RegisterCoprocessor(&vfp->copro10, 10);
 	ARM9_RegisterCoprocessor(&vfp->copro11, 11);
 	vfp->fpsid = 0x410101A0;	/* VFP 9 */
@@ -0,0 +1,182 @@
+//===-- arm/bbcache_arm.c -----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform : modules
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Basic block translation cache for the ARM 32 Bit instruction set
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Main Module Header
+#include "bbcache_arm.h"
+
+// Local/Private Headers
+
+// Leigun Core Headers
+#include "bus.h"
+#include "sgstring.h"
+
+// System headers
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+uint32_t armBBPageGen[ARM_BB_PGGEN_SIZE];
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+
+/*
+ * ---------------------------------------------------------------------
+ * Decide if an instruction terminates a basic block.
+ * Everything which might write the PC, change the mode or the
+ * MMU state ends a block. This is only an optimization, the
+ * main loop checks the NIA after every instruction anyway.
+ * ---------------------------------------------------------------------
+ */
+static inline int
+ends_block(uint32_t icode)
+{
+	if ((icode >> 28) == 0xf) {
+		/* Unconditional instruction space (BLX immediate, PLD) */
+		return 1;
+	}
+	if ((icode & 0x0e000000) == 0x0a000000) {
+		/* B, BL */
+		return 1;
+	}
+	if ((icode & 0x0f000000) == 0x0f000000) {
+		/* SWI */
+		return 1;
+	}
+	if ((icode & 0x0f000010) == 0x0e000010) {
+		/* MCR/MRC, may change the MMU state */
+		return 1;
+	}
+	if ((icode & 0x0fb000f0) == 0x01200000) {
+		/* MSR register */
+		return 1;
+	}
+	if ((icode & 0x0fb00000) == 0x03200000) {
+		/* MSR immediate */
+		return 1;
+	}
+	if ((icode & 0x0e108000) == 0x08108000) {
+		/* LDM with PC in the register list */
+		return 1;
+	}
+	if (((icode & 0x0c000000) != 0x08000000) && ((icode & 0x0000f000) == 0x0000f000)) {
+		/* Data processing or single data transfer with Rd = PC */
+		return 1;
+	}
+	return 0;
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+void
+ARM_BBInit(void)
+{
+	if (armBBCache) {
+		return;
+	}
+	armBBCache = sg_calloc(sizeof(ARM_BasicBlock) * ARM_BB_CACHE_SIZE);
+	Mem_SetCodeWriteCallback(ARM_BBInvalidatePage);
+	fprintf(stderr, "- Basic block cache with %d entries initialized\n", ARM_BB_CACHE_SIZE);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Decode a new basic block starting at va.
+ * The translation is done for an instruction fetch so that a
+ * prefetch abort is raised in the same way as without block cache.
+ * ------------------------------------------------------------------------
+ */
+ARM_BasicBlock *
+ARM_BBTranslate(uint32_t va)
+{
+	ARM_BasicBlock *bb = armBBCache + ARM_BB_INDEX(va);
+	uint32_t icode;
+	uint32_t pa;
+	uint32_t len, maxlen;
+	uint8_t *hva;
+	int result;
+	pa = MMU9_TranslateAddress(va, MMU_ACCESS_IFETCH | MMU_ACCESS_DATA_READ);
+	hva = Bus_GetHVARead(pa);
+	if (!hva) {
+		/* Instruction from IO (For example io-mapped flash) */
+		armBBStats.uncached++;
+		return NULL;
+	}
+	result = Mem_TraceCodePage(pa);
+	if (result < 0) {
+		armBBStats.uncached++;
+		return NULL;
+	} else if (result > 0) {
+		/* Cached write HVAs would bypass the trace */
+		MMU_InvalidateWriteTlb();
+	}
+	maxlen = (0x400 - (va & 0x3ff)) >> 2;
+	if (maxlen > ARM_BB_MAXLEN) {
+		maxlen = ARM_BB_MAXLEN;
+	}
+	for (len = 0; len < maxlen;) {
+		icode = HMemRead32(hva + (len << 2));
+		bb->icode[len] = icode;
+		bb->iproc[len] = InstructionProcFind(icode);
+		len++;
+		if (ends_block(icode)) {
+			break;
+		}
+	}
+	bb->va = va;
+	bb->pa = pa;
+	bb->len = len;
+	bb->cpu_mode = ARM_SIGNALING_MODE;
+	bb->version = stlb_version;
+	bb->pagegen = armBBPageGen[ARM_BB_PGGEN_INDEX(pa)];
+	armBBStats.misses++;
+	return bb;
+}
+
+/*
+ * -----------------------------------------------------------------------
+ * Called by the bus on the first write to a traced code page.
+ * The page may be larger than 1k, so all its 1k generations are bumped.
+ * -----------------------------------------------------------------------
+ */
+void
+ARM_BBInvalidatePage(uint32_t pgaddr)
+{
+	uint32_t size = (uint32_t)Mem_SmallPageSize();
+	uint32_t offs;
+	for (offs = 0; offs < size; offs += 0x400) {
+		armBBPageGen[ARM_BB_PGGEN_INDEX(pgaddr + offs)]++;
+	}
+	armBBStats.page_writes++;
+}
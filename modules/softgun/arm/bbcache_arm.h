@@ -0,0 +1,113 @@
+//===-- arm/bbcache_arm.h -----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform : modules
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Basic block translation cache for the ARM 32 Bit instruction set
+///
+/// A basic block is a sequence of predecoded instructions which is executed
+/// back to back without fetching and decoding again. Blocks never cross
+/// a 1k TLB page. They are keyed by the virtual address and the signaling
+/// mode and become invalid when the second level TLB is invalidated
+/// (stlb_version) or when the physical page holding the code is written.
+///
+//===----------------------------------------------------------------------===//
+#ifndef BBCACHE_ARM_H
+#define BBCACHE_ARM_H
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Local/Private Headers
+#include "arm9cpu.h"
+#include "idecode_arm.h"
+#include "mmu_arm9.h"
+
+// Leigun Core Headers
+#include "compiler_extensions.h"
+
+// System headers
+#include <stdint.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define ARM_BB_MAXLEN		(32)
+#define ARM_BB_CACHE_SIZE	(4096)
+#define ARM_BB_INDEX(va)	(((va) >> 2) & (ARM_BB_CACHE_SIZE - 1))
+
+/*
+ * Generation counters for code pages, hashed by 1k physical page.
+ * They describe the memory, not a CPU, so all CPUs share them: a write
+ * by one CPU has to invalidate the blocks cached by every CPU.
+ */
+#define ARM_BB_PGGEN_SIZE	(1024)
+#define ARM_BB_PGGEN_INDEX(pa)	(((pa) >> 10) & (ARM_BB_PGGEN_SIZE - 1))
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct ARM_BasicBlock {
+	uint32_t va;		/* ARM Virtual address of the first instruction */
+	uint32_t cpu_mode;	/* signaling mode when decoded */
+	uint32_t version;	/* stlb_version when decoded */
+	uint32_t pagegen;	/* generation of the code page when decoded */
+	uint32_t pa;		/* Physical address of the first instruction */
+	uint32_t len;
+	uint32_t icode[ARM_BB_MAXLEN];
+	InstructionProc *iproc[ARM_BB_MAXLEN];
+} ARM_BasicBlock;
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+/* The block cache of the CPU running in this thread */
+#define armBBCache	(gcpu->caches.bbCache)
+#define armBBStats	(gcpu->caches.bbStats)
+extern uint32_t armBBPageGen[ARM_BB_PGGEN_SIZE];
+
+
+//==============================================================================
+//= Functions
+//==============================================================================
+void ARM_BBInit(void);
+ARM_BasicBlock *ARM_BBTranslate(uint32_t va);
+void ARM_BBInvalidatePage(uint32_t pgaddr);
+
+/*
+ * ----------------------------------------------------------------
+ * Find the block starting at va. Decodes a new block on a miss.
+ * Returns NULL if the code can not be cached (code from IO).
+ * ----------------------------------------------------------------
+ */
+static inline ARM_BasicBlock *
+ARM_BBLookup(uint32_t va)
+{
+	ARM_BasicBlock *bb = armBBCache + ARM_BB_INDEX(va);
+	if (likely((bb->va == va) && (bb->cpu_mode == ARM_SIGNALING_MODE)
+		   && (bb->version == stlb_version)
+		   && (bb->pagegen == armBBPageGen[ARM_BB_PGGEN_INDEX(bb->pa)]))) {
+		armBBStats.hits++;
+		return bb;
+	}
+	return ARM_BBTranslate(va);
+}
+
+#endif
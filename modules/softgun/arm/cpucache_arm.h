@@ -0,0 +1,109 @@
+//===-- arm/cpucache_arm.h ----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform : modules
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Translation caches owned by one ARM CPU
+///
+/// Every ARM CPU has its own first and second level TLBs, basic block
+/// cache and Thumb page cache. They are embedded in the CPU and reached
+/// through the thread local gcpu, the MMU and cache headers map their
+/// old global names to the fields of the current CPU.
+///
+//===----------------------------------------------------------------------===//
+#ifndef CPUCACHE_ARM_H
+#define CPUCACHE_ARM_H
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Leigun Core Headers
+#include "bus.h"
+
+// System headers
+#include <stdint.h>
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+/*
+ * ---------------------------------------------------------
+ * Translation Lookaside buffer
+ *      caches Physical address for IO
+ *      accesses and Host Virtual Address for faster
+ *      memory access
+ * ---------------------------------------------------------
+ */
+typedef struct TlbEntry {
+	uint32_t cpu_mode;
+	uint32_t va;		// ARM Virtual Address
+	uint32_t pa;		// ARM Physical Address
+	uint8_t *hva;		// Host Virtual address
+	IOPage *iop;		// IO page of pa, NULL if none
+} TlbEntry;
+
+typedef struct STlbEntry {
+	uint32_t version;
+	uint32_t cpu_mode;
+	uint32_t va;		// ARM Virtual Address
+	uint8_t *hva;		// Host Virtual address
+} STlbEntry;
+
+/*
+ * -------------------------------------------------------------
+ * TLB statistics. Hits in the single entry TLBs are not
+ * counted to keep the fast path free, the remaining accesses
+ * are either second level hits or a table walk (miss).
+ * -------------------------------------------------------------
+ */
+typedef struct TlbStatistics {
+	uint64_t stlb_hits;
+	uint64_t misses;
+} TlbStatistics;
+
+typedef struct ARM_BBStatistics {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t uncached;	/* Instruction fetch from IO, not cacheable */
+	uint64_t page_writes;
+} ARM_BBStatistics;
+
+struct ARM_BasicBlock;
+struct ThumbPage;
+
+typedef struct ArmCpuCaches {
+	TlbEntry tlbeIFetch;
+	TlbEntry tlbeRead;
+	TlbEntry tlbeWrite;
+	STlbEntry *stlbIFetch;
+	STlbEntry *stlbRead;
+	STlbEntry *stlbWrite;
+	uint32_t stlbMask;
+	/* Invalidating the second level TLB is done by incrementing the version */
+	uint32_t stlbVersion;
+	TlbStatistics statsIFetch;
+	TlbStatistics statsRead;
+	TlbStatistics statsWrite;
+
+	/* NULL if the cache is disabled with "bbcache" */
+	struct ARM_BasicBlock *bbCache;
+	ARM_BBStatistics bbStats;
+	struct ThumbPage *thumbPages;
+} ArmCpuCaches;
+
+#endif
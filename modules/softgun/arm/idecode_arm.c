@@ -50,7 +50,7 @@ typedef struct IDecoder {
 } IDecoder;
 
 static Instruction *imem;
-InstructionProc **iProcTab;
+InstructionProc **armIProcTab;
 static IDecoder *idecoder;
 
 static int alloc_pointer = 0;
@@ -1724,6 +1724,10 @@ IDecoder_New()
 	int i;
 	Instruction *cursor;
 	IDecoder *dec;
+	if (armIProcTab) {
+		/* The tables are shared by all ARM CPUs */
+		return;
+	}
 	idecoder = dec = sg_new(IDecoder);
 	imem = sg_calloc(sizeof(Instruction) * MAX_INSTRUCTIONS);
 	memset(dec, 0, sizeof(IDecoder));
@@ -1735,8 +1739,8 @@ IDecoder_New()
 		}
 	}
 	fprintf(stderr, "- Instruction decoder Initialized: ");
-	iProcTab = sg_calloc(sizeof(InstructionProc *) * (INSTR_INDEX_MAX + 1));
-	if (!iProcTab) {
+	armIProcTab = sg_calloc(sizeof(InstructionProc *) * (INSTR_INDEX_MAX + 1));
+	if (!armIProcTab) {
 		fprintf(stderr, "Out of Memory");
 		exit(378);
 	}
@@ -1745,7 +1749,7 @@ IDecoder_New()
 		if (instr == NULL) {
 			instr = &undefined;
 		}
-		iProcTab[i] = instr->proc;
+		armIProcTab[i] = instr->proc;
 	}
 	fprintf(stderr, "\n");
 //      fprintf(stderr,"\nMedium Nr of Instructions %f\n",(float)sum/validcount);
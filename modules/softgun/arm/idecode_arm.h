@@ -14,7 +14,7 @@
 
 struct ARM9;
 typedef void InstructionProc(void);
-extern InstructionProc **iProcTab;
+extern InstructionProc **armIProcTab;
 
 typedef struct Instruction {
 	uint32_t mask;
@@ -31,7 +31,7 @@ static inline InstructionProc *
 InstructionProcFind(uint32_t icode)
 {
 	int index = INSTR_INDEX(icode);
-	InstructionProc *proc = iProcTab[index];
+	InstructionProc *proc = armIProcTab[index];
 	return proc;
 }
 #endif
@@ -1378,7 +1378,6 @@ armv5_lsm()
 				__LINE__);
 		}
 	}
-	GlobalClock_ConsumeCycle(gcpu.clk, (ones << 1));
 	CycleCounter += (ones << 1);
 	dbgprintf("Done LSM addr %08x L %d\n", start_address, L ? 1 : 0);
 }
@@ -1699,7 +1698,7 @@ armv5_cdp()
 		return;
 	}
 	cp = (icode >> 8) & 0xf;
-	copro = gcpu.copro[cp];
+	copro = gcpu->copro[cp];
 	if (!copro) {
 		dbgprintf("CDP: No ArmCoprocessor %d\n", cp);
 		ARM_Exception(EX_UNDEFINED, 0);
@@ -1858,7 +1857,7 @@ armv5_ldc()
 		return;
 	}
 	cp = (icode >> 8) & 0xf;
-	copro = gcpu.copro[cp];
+	copro = gcpu->copro[cp];
 	if (!copro) {
 		dbgprintf("LDC: No ArmCoprocessor %d\n", cp);
 		ARM_Exception(EX_UNDEFINED, 0);
@@ -1989,9 +1988,9 @@ armv5_ldrb()
 void
 armv5_ldrbt()
 {
-	gcpu.signaling_mode = MODE_USER;
+	gcpu->signaling_mode = MODE_USER;
 	armv5_ldrb();
-	gcpu.signaling_mode = REG_CPSR & 0x1f;
+	gcpu->signaling_mode = REG_CPSR & 0x1f;
 }
 
 void
@@ -2077,9 +2076,9 @@ armv5_ldrsh()
 void
 armv5_ldrt()
 {
-	gcpu.signaling_mode = MODE_USER;
+	gcpu->signaling_mode = MODE_USER;
 	armv5_ldr();
-	gcpu.signaling_mode = REG_CPSR & 0x1f;
+	gcpu->signaling_mode = REG_CPSR & 0x1f;
 }
 
 void
@@ -2094,7 +2093,7 @@ armv5_mcr()
 	}
 	cp_num = (icode >> 8) & 0xf;
 	rd = (icode >> 12) & 0xf;
-	copro = gcpu.copro[cp_num];
+	copro = gcpu->copro[cp_num];
 	if (copro && copro->mcr) {
 		Rd = ARM9_ReadReg(rd);
 		copro->mcr(copro, icode, Rd);
@@ -2189,7 +2188,7 @@ armv5_mrc()
 
 	rd = (icode >> 12) & 0xf;
 	cp_num = (icode >> 8) & 0xf;
-	copro = gcpu.copro[cp_num];
+	copro = gcpu->copro[cp_num];
 	if (copro && copro->mrc) {
 		Rd = copro->mrc(copro, icode);
 		if (rd == 15) {
@@ -2723,7 +2722,7 @@ armv5_stc()
 		return;
 	}
 	cp = (icode >> 8) & 0xf;
-	copro = gcpu.copro[cp];
+	copro = gcpu->copro[cp];
 	if (!copro) {
 		dbgprintf("STC: No ArmCoprocessor %d\n", cp);
 		ARM_Exception(EX_UNDEFINED, 0);
@@ -2753,9 +2752,9 @@ armv5_strb()
 void
 armv5_strbt()
 {
-	gcpu.signaling_mode = MODE_USER;
+	gcpu->signaling_mode = MODE_USER;
 	armv5_strwub();
-	gcpu.signaling_mode = REG_CPSR & 0x1f;
+	gcpu->signaling_mode = REG_CPSR & 0x1f;
 }
 
 void
@@ -2788,9 +2787,9 @@ armv5_strh()
 void
 armv5_strt()
 {
-	gcpu.signaling_mode = MODE_USER;
+	gcpu->signaling_mode = MODE_USER;
 	armv5_strwub();
-	gcpu.signaling_mode = REG_CPSR & 0x1f;
+	gcpu->signaling_mode = REG_CPSR & 0x1f;
 }
 
 void
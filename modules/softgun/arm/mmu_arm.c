@@ -32,6 +32,7 @@
  *
  *************************************************************************************************
  */
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -45,6 +46,7 @@
 #include "mmu_arm.h"
 #include "bus.h"
 #include "compiler_extensions.h"
+#include "configfile.h"
 #include "sgstring.h"
 
 #ifdef DEBUG
@@ -53,20 +55,11 @@
 #define dbgprintf(...)
 #endif
 
-/* Enter a Physical address to the Tlb */
-TlbEntry tlbe_read;
-TlbEntry tlbe_write;
-TlbEntry tlbe_ifetch;
-STlbEntry stlb_ifetch[STLB_SIZE];
-STlbEntry stlb_read[STLB_SIZE];
-STlbEntry stlb_write[STLB_SIZE];
-uint32_t stlb_version;
-
 static void
 stlb_init(void)
 {
-	int i;
-	for (i = 0; i < STLB_SIZE; i++) {
+	uint32_t i;
+	for (i = 0; i <= stlb_mask; i++) {
 		stlb_ifetch[i].version = 0;
 		stlb_read[i].version = 0;
 		stlb_write[i].version = 0;
@@ -117,6 +110,7 @@ enter_pa_to_tlbe_read(uint32_t va, uint32_t pa)
 	tlbe_read.pa = pa & 0xfffffc00;
 	tlbe_read.cpu_mode = ARM_SIGNALING_MODE;
 	tlbe_read.hva = NULL;
+	tlbe_read.iop = IOH_FindPage(pa);
 }
 
 static inline void
@@ -126,6 +120,7 @@ enter_pa_to_tlbe_write(uint32_t va, uint32_t pa)
 	tlbe_write.pa = pa & 0xfffffc00;
 	tlbe_write.cpu_mode = ARM_SIGNALING_MODE;
 	tlbe_write.hva = NULL;
+	tlbe_write.iop = IOH_FindPage(pa);
 }
 
 /*
@@ -135,13 +130,6 @@ enter_pa_to_tlbe_write(uint32_t va, uint32_t pa)
  * ---------------------------------------------------------------
  */
 
-static inline void
-enter_hva_to_tlbe_write(uint32_t va, uint8_t * hva)
-{
-	tlbe_write.va = va & 0xfffffc00;
-	tlbe_write.hva = hva - (va & 0x3ff);
-	tlbe_write.cpu_mode = ARM_SIGNALING_MODE;
-}
 
 static inline void
 invalidate_stlb()
@@ -166,14 +154,54 @@ invalidate_tlb()
  * -------------------------------------------------------------------
  * Invalidate TLB
  * 	for external access (Reset,Memory Controller reconfiguration)
+ *	The TLBs of all CPUs are invalidated before they execute
+ *	their next instruction.
  * -------------------------------------------------------------------
  */
 void
 MMU_InvalidateTlb()
+{
+	ARM9_PostSignalAll(ARM_SIG_INVAL_TLB, NULL);
+}
+
+/*
+ * -------------------------------------------------------------------
+ * Invalidate the TLB of the CPU in the calling thread only. Used
+ * for changes of its own MMU registers.
+ * -------------------------------------------------------------------
+ */
+void
+MMU_InvalidateLocalTlb(void)
 {
 	invalidate_tlb();
 }
 
+/*
+ * -------------------------------------------------------------------
+ * Invalidate only the write TLB
+ * 	Used when a page gets traced for detection of writes
+ *	to code. Read and Instruction fetch entries stay valid.
+ *	The other CPUs drop their write TLB before their next
+ *	instruction.
+ * -------------------------------------------------------------------
+ */
+void
+MMU_InvalidateLocalWriteTlb(void)
+{
+	uint32_t i;
+	tlbe_write.cpu_mode = ~0;
+	for (i = 0; i <= stlb_mask; i++) {
+		stlb_write[i].cpu_mode = ~0;
+	}
+}
+
+void
+MMU_InvalidateWriteTlb(void)
+{
+	MMU_InvalidateLocalWriteTlb();
+	ARM9_PostSignalAll(ARM_SIG_INVAL_WTLB, gcpu);
+}
+
 #define FLPD_TYPE_FAULT   (0)
 #define FLPD_TYPE_COARSE  (1)
 #define FLPD_TYPE_SECTION (2)
@@ -193,6 +221,7 @@ _MMU_Read32(uint32_t addr)
 	if (likely(TLB_MATCH(tlbe_read, addr))) {
 		taddr = tlbe_read.pa | ((addr) & 0x3ff);
 	} else {
+		tlbStatsRead.misses++;
 		taddr = MMU9_TranslateAddress(addr, MMU_ACCESS_DATA_READ);
 		hva = Bus_GetHVARead(taddr);
 		if (hva) {
@@ -202,6 +231,9 @@ _MMU_Read32(uint32_t addr)
 			enter_pa_to_tlbe_read(addr, taddr);
 		}
 	}
+	if (tlbe_read.iop) {
+		return IOH_Read32(IOPage_Handler(tlbe_read.iop, taddr), taddr);
+	}
 	return IO_Read32(taddr);
 }
 
@@ -214,6 +246,7 @@ _MMU_Read16(uint32_t addr)
 	if (likely(TLB_MATCH(tlbe_read, addr))) {
 		taddr = tlbe_read.pa | ((addr) & 0x3ff);
 	} else {
+		tlbStatsRead.misses++;
 		taddr = MMU9_TranslateAddress(addr, MMU_ACCESS_DATA_READ);
 		hva = Bus_GetHVARead(taddr);
 		if (hva) {
@@ -223,6 +256,9 @@ _MMU_Read16(uint32_t addr)
 			enter_pa_to_tlbe_read(addr, taddr);
 		}
 	}
+	if (tlbe_read.iop) {
+		return IOH_Read16(IOPage_Handler(tlbe_read.iop, taddr), taddr);
+	}
 	return IO_Read16(taddr);
 }
 
@@ -235,6 +271,7 @@ _MMU_Read8(uint32_t addr)
 		taddr = tlbe_read.pa | ((addr) & 0x3ff);
 	} else {
 		uint8_t *hva;
+		tlbStatsRead.misses++;
 		taddr = MMU9_TranslateAddress(addr, MMU_ACCESS_DATA_READ);
 		hva = Bus_GetHVARead(taddr);
 		if (hva) {
@@ -244,27 +281,28 @@ _MMU_Read8(uint32_t addr)
 			enter_pa_to_tlbe_read(addr, taddr);
 		}
 	}
+	if (tlbe_read.iop) {
+		return IOH_Read8(IOPage_Handler(tlbe_read.iop, taddr), taddr);
+	}
 	return IO_Read8(taddr);
 }
 
+/*
+ * ---------------------------------------------------------------
+ * Second part of MMU_Write32. The HVA is already checked in
+ * the inline part, and for 8/16 Bit the address is already
+ * swapped.
+ * ---------------------------------------------------------------
+ */
 void
-MMU_Write32(uint32_t value, uint32_t addr)
+_MMU_Write32(uint32_t value, uint32_t addr)
 {
 	uint32_t taddr;
 	uint8_t *hva;
 	if (likely(TLB_MATCH(tlbe_write, addr))) {
-		if (TLBE_IS_HVA(tlbe_write)) {
-			hva = tlbe_write.hva + (addr & 0x3ff);
-			HMemWrite32(value, hva);
-			return;
-		} else {
-			taddr = tlbe_write.pa | ((addr) & 0x3ff);
-		}
-	} else if ((hva = STLB_MATCH_HVA(stlb_write, addr))) {
-		enter_hva_to_tlbe_write(addr, hva);
-		HMemWrite32(value, hva);
-		return;
+		taddr = tlbe_write.pa | ((addr) & 0x3ff);
 	} else {
+		tlbStatsWrite.misses++;
 		taddr = MMU9_TranslateAddress(addr, MMU_ACCESS_DATA_WRITE);
 		hva = Bus_GetHVAWrite(taddr);
 		if (hva) {
@@ -275,28 +313,29 @@ MMU_Write32(uint32_t value, uint32_t addr)
 			enter_pa_to_tlbe_write(addr, taddr);
 		}
 	}
+	if (tlbe_write.iop) {
+		IOH_Write32(IOPage_Handler(tlbe_write.iop, taddr), value, taddr);
+		return;
+	}
 	IO_Write32(value, taddr);
 }
 
+/*
+ * ---------------------------------------------------------------
+ * Second part of MMU_Write16. The HVA is already checked in
+ * the inline part, and for 8/16 Bit the address is already
+ * swapped.
+ * ---------------------------------------------------------------
+ */
 void
-MMU_Write16(uint16_t value, uint32_t addr)
+_MMU_Write16(uint16_t value, uint32_t addr)
 {
-	uint8_t *hva;
 	uint32_t taddr;
-	addr = addr ^ mmu_word_addr_xor;
+	uint8_t *hva;
 	if (likely(TLB_MATCH(tlbe_write, addr))) {
-		if (TLBE_IS_HVA(tlbe_write)) {
-			hva = tlbe_write.hva + (addr & 0x3ff);
-			HMemWrite16(value, hva);
-			return;
-		} else {
-			taddr = tlbe_write.pa | ((addr) & 0x3ff);
-		}
-	} else if ((hva = STLB_MATCH_HVA(stlb_write, addr))) {
-		enter_hva_to_tlbe_write(addr, hva);
-		HMemWrite16(value, hva);
-		return;
+		taddr = tlbe_write.pa | ((addr) & 0x3ff);
 	} else {
+		tlbStatsWrite.misses++;
 		taddr = MMU9_TranslateAddress(addr, MMU_ACCESS_DATA_WRITE);
 		hva = Bus_GetHVAWrite(taddr);
 		if (hva) {
@@ -307,28 +346,29 @@ MMU_Write16(uint16_t value, uint32_t addr)
 			enter_pa_to_tlbe_write(addr, taddr);
 		}
 	}
+	if (tlbe_write.iop) {
+		IOH_Write16(IOPage_Handler(tlbe_write.iop, taddr), value, taddr);
+		return;
+	}
 	IO_Write16(value, taddr);
 }
 
+/*
+ * ---------------------------------------------------------------
+ * Second part of MMU_Write8. The HVA is already checked in
+ * the inline part, and for 8/16 Bit the address is already
+ * swapped.
+ * ---------------------------------------------------------------
+ */
 void
-MMU_Write8(uint8_t value, uint32_t addr)
+_MMU_Write8(uint8_t value, uint32_t addr)
 {
+	uint32_t taddr;
 	uint8_t *hva;
-	uint32_t taddr = addr;
-	addr = addr ^ mmu_byte_addr_xor;
 	if (likely(TLB_MATCH(tlbe_write, addr))) {
-		if (TLBE_IS_HVA(tlbe_write)) {
-			hva = tlbe_write.hva + (addr & 0x3ff);
-			HMemWrite8(value, hva);
-			return;
-		} else {
-			taddr = tlbe_write.pa | ((addr) & 0x3ff);
-		}
-	} else if ((hva = STLB_MATCH_HVA(stlb_write, addr))) {
-		enter_hva_to_tlbe_write(addr, hva);
-		HMemWrite8(value, hva);
-		return;
+		taddr = tlbe_write.pa | ((addr) & 0x3ff);
 	} else {
+		tlbStatsWrite.misses++;
 		taddr = MMU9_TranslateAddress(addr, MMU_ACCESS_DATA_WRITE);
 		hva = Bus_GetHVAWrite(taddr);
 		if (hva) {
@@ -339,11 +379,51 @@ MMU_Write8(uint8_t value, uint32_t addr)
 			enter_pa_to_tlbe_write(addr, taddr);
 		}
 	}
+	if (tlbe_write.iop) {
+		IOH_Write8(IOPage_Handler(tlbe_write.iop, taddr), value, taddr);
+		return;
+	}
 	IO_Write8(value, taddr);
 }
 
+/*
+ * ---------------------------------------------------------------------
+ * Print the TLB statistics, used for sizing the second level TLB
+ * ---------------------------------------------------------------------
+ */
 void
-MMU_ArmInit(void)
+MMU_PrintTlbStatistics(void)
 {
+	fprintf(stderr, "TLB (%u entries): ifetch %" PRIu64 " stlb hits %" PRIu64 " misses, "
+		"read %" PRIu64 " stlb hits %" PRIu64 " misses, write %" PRIu64
+		" stlb hits %" PRIu64 " misses\n", stlb_mask + 1,
+		tlbStatsIFetch.stlb_hits, tlbStatsIFetch.misses,
+		tlbStatsRead.stlb_hits, tlbStatsRead.misses,
+		tlbStatsWrite.stlb_hits, tlbStatsWrite.misses);
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * Allocate the second level TLB of the current CPU. The CPU creates a
+ * default one for boards without MMU, the MMU replaces it by its own.
+ * ---------------------------------------------------------------------
+ */
+void
+MMU_ArmInit(const char *name)
+{
+	uint32_t size = STLB_DEFAULT_SIZE;
+	Config_ReadUInt32(&size, name, "stlb_size");
+	if ((size == 0) || (size & (size - 1))) {
+		fprintf(stderr, "%s: stlb_size %u is not a power of two\n", name, size);
+		exit(1);
+	}
+	sg_free(stlb_ifetch);
+	sg_free(stlb_read);
+	sg_free(stlb_write);
+	stlb_mask = size - 1;
+	stlb_ifetch = sg_calloc(sizeof(STlbEntry) * size);
+	stlb_read = sg_calloc(sizeof(STlbEntry) * size);
+	stlb_write = sg_calloc(sizeof(STlbEntry) * size);
 	stlb_init();
+	fprintf(stderr, "- Second level TLB with %u entries\n", size);
 }
@@ -7,8 +7,11 @@
  *
  * ----------------------------------------------------
  */
+#ifndef MMU_ARM_H
+#define MMU_ARM_H
 
 #include <bus.h>
+#include "arm9cpu.h"
 #include <sys/time.h>
 #include <time.h>
 
@@ -24,20 +27,13 @@
 /*
  * ---------------------------------------------------------
  * Translation Lookaside buffer
- *      caches Physical address for IO
- *      accesses and Host Virtual Address for faster
- *      memory access
+ *      The TLBs belong to the CPU running in the calling
+ *      thread, the types are in cpucache_arm.h
  * ---------------------------------------------------------
  */
-typedef struct TlbEntry {
-	uint32_t cpu_mode;
-	uint32_t va;		// ARM Virtual Address
-	uint32_t pa;		// ARM Physical Address
-	uint8_t *hva;		// Host Virtual address
-} TlbEntry;
-
-extern TlbEntry tlbe_ifetch;
-extern TlbEntry tlbe_read;
+#define tlbe_ifetch	(gcpu->caches.tlbeIFetch)
+#define tlbe_read	(gcpu->caches.tlbeRead)
+#define tlbe_write	(gcpu->caches.tlbeWrite)
 
 extern uint32_t mmu_enabled;
 
@@ -48,26 +44,27 @@ extern uint32_t mmu_enabled;
 #define TLB_MATCH_HVA(tlbe,addr) ((((addr)&0xfffffc00)==(tlbe).va) && ((tlbe).cpu_mode==ARM_SIGNALING_MODE) && TLBE_IS_HVA(tlbe))
 
 /* 
- * -----------------------------------------------
+ * ------------------------------------------------------------
  * The second Level TLB cache
- * -----------------------------------------------
+ *	Direct mapped, the number of entries is a power of two
+ *	and can be configured with "stlb_size" in the section
+ *	of the MMU.
+ * ------------------------------------------------------------
  */
-#define STLB_SIZE (128)
-#define STLB_INDEX(addr) (((addr)>>10) & (STLB_SIZE-1))
+#define STLB_DEFAULT_SIZE (1024)
+#define STLB_INDEX(addr) (((addr)>>10) & stlb_mask)
 
-typedef struct STlbEntry {
-	uint32_t version;
-	uint32_t cpu_mode;
-	uint32_t va;		// ARM Virtual Address
-	uint8_t *hva;		// Host Virtual address
-} STlbEntry;
+#define stlb_ifetch	(gcpu->caches.stlbIFetch)
+#define stlb_read	(gcpu->caches.stlbRead)
+#define stlb_write	(gcpu->caches.stlbWrite)
+#define stlb_mask	(gcpu->caches.stlbMask)
 
-extern STlbEntry stlb_ifetch[STLB_SIZE];
-extern STlbEntry stlb_read[STLB_SIZE];
-extern STlbEntry stlb_write[STLB_SIZE];
+#define tlbStatsIFetch	(gcpu->caches.statsIFetch)
+#define tlbStatsRead	(gcpu->caches.statsRead)
+#define tlbStatsWrite	(gcpu->caches.statsWrite)
 
 /* Invalidating the second level TLB is done by incrementing the stlb_version */
-extern uint32_t stlb_version;
+#define stlb_version	(gcpu->caches.stlbVersion)
 
 static inline uint8_t *
 STLB_MATCH_HVA(STlbEntry * stlb, uint32_t addr)
@@ -112,6 +109,14 @@ enter_hva_to_tlbe_read(uint32_t va, uint8_t * hva)
 	tlbe_read.cpu_mode = ARM_SIGNALING_MODE;
 }
 
+static inline void
+enter_hva_to_tlbe_write(uint32_t va, uint8_t * hva)
+{
+	tlbe_write.va = va & 0xfffffc00;
+	tlbe_write.hva = hva - (va & 0x3ff);
+	tlbe_write.cpu_mode = ARM_SIGNALING_MODE;
+}
+
 static inline void
 mmu_enter_hva_to_both_tlbe_ifetch(uint32_t va, uint8_t * hva)
 {
@@ -142,9 +147,11 @@ MMU_IFetch(uint32_t addr)
 		hva = tlbe_ifetch.hva + (addr & 0x3ff);
 		return HMemRead32(hva);
 	} else if ((hva = STLB_MATCH_HVA(stlb_ifetch, addr))) {
+		tlbStatsIFetch.stlb_hits++;
 		mmu_enter_hva_to_tlbe_ifetch(addr, hva);
 		return HMemRead32(hva);
 	} else {
+		tlbStatsIFetch.misses++;
 		taddr = MMU9_TranslateAddress(addr, MMU_ACCESS_IFETCH | MMU_ACCESS_DATA_READ);
 		hva = Bus_GetHVARead(taddr);
 		if (likely(hva)) {
@@ -171,9 +178,11 @@ MMU_IFetch16(uint32_t addr)
 		hva = tlbe_ifetch.hva + (addr & 0x3ff);
 		return HMemRead16(hva);
 	} else if ((hva = STLB_MATCH_HVA(stlb_ifetch, addr))) {
+		tlbStatsIFetch.stlb_hits++;
 		mmu_enter_hva_to_tlbe_ifetch(addr, hva);
 		return HMemRead16(hva);
 	} else {
+		tlbStatsIFetch.misses++;
 		taddr = MMU9_TranslateAddress(addr, MMU_ACCESS_IFETCH | MMU_ACCESS_DATA_READ);
 		hva = Bus_GetHVARead(taddr);
 		if (likely(hva)) {
@@ -187,8 +196,8 @@ MMU_IFetch16(uint32_t addr)
 }
 
 uint32_t _MMU_Read32(uint32_t addr);	/* second part of above */
-extern uint32_t mmu_byte_addr_xor;
-extern uint32_t mmu_word_addr_xor;
+#define mmu_byte_addr_xor	(gcpu->mmuByteAddrXor)
+#define mmu_word_addr_xor	(gcpu->mmuWordAddrXor)
 
 static inline uint32_t
 MMU_Read32(uint32_t addr)
@@ -198,6 +207,7 @@ MMU_Read32(uint32_t addr)
 		hva = tlbe_read.hva + (addr & 0x3ff);
 		return HMemRead32(hva);
 	} else if ((hva = STLB_MATCH_HVA(stlb_read, addr))) {
+		tlbStatsRead.stlb_hits++;
 		enter_hva_to_tlbe_read(addr, hva);
 		return HMemRead32(hva);
 	} else {
@@ -215,6 +225,7 @@ MMU_Read16(uint32_t addr)
 		hva = tlbe_read.hva + (addr & 0x3ff);
 		return HMemRead16(hva);
 	} else if ((hva = STLB_MATCH_HVA(stlb_read, addr))) {
+		tlbStatsRead.stlb_hits++;
 		enter_hva_to_tlbe_read(addr, hva);
 		return HMemRead16(hva);
 	} else {
@@ -232,6 +243,7 @@ MMU_Read8(uint32_t addr)
 		hva = tlbe_read.hva + (addr & 0x3ff);
 		return HMemRead8(hva);
 	} else if ((hva = STLB_MATCH_HVA(stlb_read, addr))) {
+		tlbStatsRead.stlb_hits++;
 		enter_hva_to_tlbe_read(addr, hva);
 		return HMemRead8(hva);
 	} else {
@@ -239,11 +251,72 @@ MMU_Read8(uint32_t addr)
 	}
 }
 
-void MMU_Write32(uint32_t value, uint32_t addr);
-void MMU_Write16(uint16_t value, uint32_t addr);
-void MMU_Write8(uint8_t value, uint32_t addr);
+/*
+ * --------------------------------------------------------------
+ * Inline part of the writes: Only the HVA case is done here,
+ * IO writes and table walks are done in the second part.
+ * --------------------------------------------------------------
+ */
+void _MMU_Write32(uint32_t value, uint32_t addr);
+static inline void
+MMU_Write32(uint32_t value, uint32_t addr)
+{
+	uint8_t *hva;
+	if (likely(TLB_MATCH_HVA(tlbe_write, addr))) {
+		hva = tlbe_write.hva + (addr & 0x3ff);
+		HMemWrite32(value, hva);
+	} else if ((hva = STLB_MATCH_HVA(stlb_write, addr))) {
+		tlbStatsWrite.stlb_hits++;
+		enter_hva_to_tlbe_write(addr, hva);
+		HMemWrite32(value, hva);
+	} else {
+		_MMU_Write32(value, addr);
+	}
+}
+
+void _MMU_Write16(uint16_t value, uint32_t addr);
+static inline void
+MMU_Write16(uint16_t value, uint32_t addr)
+{
+	uint8_t *hva;
+	addr ^= mmu_word_addr_xor;
+	if (likely(TLB_MATCH_HVA(tlbe_write, addr))) {
+		hva = tlbe_write.hva + (addr & 0x3ff);
+		HMemWrite16(value, hva);
+	} else if ((hva = STLB_MATCH_HVA(stlb_write, addr))) {
+		tlbStatsWrite.stlb_hits++;
+		enter_hva_to_tlbe_write(addr, hva);
+		HMemWrite16(value, hva);
+	} else {
+		_MMU_Write16(value, addr);
+	}
+}
+
+void _MMU_Write8(uint8_t value, uint32_t addr);
+static inline void
+MMU_Write8(uint8_t value, uint32_t addr)
+{
+	uint8_t *hva;
+	addr ^= mmu_byte_addr_xor;
+	if (likely(TLB_MATCH_HVA(tlbe_write, addr))) {
+		hva = tlbe_write.hva + (addr & 0x3ff);
+		HMemWrite8(value, hva);
+	} else if ((hva = STLB_MATCH_HVA(stlb_write, addr))) {
+		tlbStatsWrite.stlb_hits++;
+		enter_hva_to_tlbe_write(addr, hva);
+		HMemWrite8(value, hva);
+	} else {
+		_MMU_Write8(value, addr);
+	}
+}
+
 void MMU_AlignmentException(uint32_t far);
 void MMU_InvalidateTlb(void);
+void MMU_InvalidateLocalTlb(void);
+void MMU_InvalidateWriteTlb(void);
+void MMU_InvalidateLocalWriteTlb(void);
 void MMU_SetDebugMode(int val);
 int MMU_Byteorder();
-void MMU_ArmInit(void);
+void MMU_ArmInit(const char *name);
+void MMU_PrintTlbStatistics(void);
+#endif
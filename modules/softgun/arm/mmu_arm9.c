@@ -32,6 +32,7 @@
  *
  *************************************************************************************************
  */
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,6 +47,7 @@
 #include "bus.h"
 #include "compiler_extensions.h"
 #include "sgstring.h"
+#include "snapshot.h"
 
 #include "byteorder.h"
 
@@ -67,11 +69,10 @@ typedef struct SystemCopro {
 	uint32_t mtlblck;
 	uint32_t mpid;
 
-	int64_t saved_cycles;	/* Halt Instruction */
-	CycleCounter_t last_halt_cycles;
-	struct timespec last_halt;
 	SigNode *endianNode;
 	int debugmode;
+	ARM9 *cpu;
+	ArmCoprocessor copro;
 
 	/* The registers */
 	McrProc *mcrProc[16];
@@ -80,11 +81,12 @@ typedef struct SystemCopro {
 
 } SystemCopro;
 
-static uint32_t translation_enabled = 0;
-static uint32_t ttbl_base = 0;
-static uint32_t sys_rom_protection = 0;
-static uint32_t domain_access_reg;
-static SystemCopro *gmmu;
+/* The MMU of the CPU running in this thread */
+#define gmmu			((SystemCopro *)gcpu->copro[15]->owner)
+#define translation_enabled	(gcpu->mmuTranslationEnabled)
+#define ttbl_base		(gmmu->mtbase)
+#define sys_rom_protection	(((gmmu->ctrl >> 8) & 0x3) << SYS_ROM_SHIFT)
+#define domain_access_reg	(gmmu->mdac)
 
 #ifdef DEBUG
 #define dbgprintf(...) { if(unlikely(debugflags & DEBUG_MMU)) { fprintf(stderr,__VA_ARGS__); } }
@@ -165,9 +167,6 @@ static uint8_t permissionTable[64] = {
 	0, 0, 0, 1
 };
 
-uint32_t mmu_word_addr_xor;
-uint32_t mmu_byte_addr_xor;
-
 void
 MMU_SetDebugMode(int val)
 {
@@ -195,14 +194,14 @@ update_byteorder(SystemCopro * mmu)
 {
 	if (mmu->ctrl & MCTRL_BE) {
 		fprintf(stderr, "MMU: Byteorder is now BE\n");
-		mmu_byte_addr_xor = 0x3;
-		mmu_word_addr_xor = 0x2;
+		mmu->cpu->mmuByteAddrXor = 0x3;
+		mmu->cpu->mmuWordAddrXor = 0x2;
 		SigNode_Set(mmu->endianNode, SIG_HIGH);
 		fprintf(stderr, "pc %08x\n", ARM_GET_NNIA);
 	} else {
 		fprintf(stderr, "MMU: Byteorder is now LE\n");
-		mmu_byte_addr_xor = 0;
-		mmu_word_addr_xor = 0;
+		mmu->cpu->mmuByteAddrXor = 0;
+		mmu->cpu->mmuWordAddrXor = 0;
 		SigNode_Set(mmu->endianNode, SIG_LOW);
 	}
 }
@@ -262,7 +261,7 @@ MMU_translation_fault_section(uint32_t access_type, uint32_t far)
 			ARM_Exception(EX_DABT, 4);
 		}
 	}
-	longjmp(gcpu.abort_jump, 1);
+	longjmp(gcpu->abort_jump, 1);
 }
 
 static inline void
@@ -283,7 +282,7 @@ MMU_translation_fault_page(uint32_t access_type, uint32_t far, uint32_t domain)
 			ARM_Exception(EX_DABT, 4);
 		}
 	}
-	longjmp(gcpu.abort_jump, 1);
+	longjmp(gcpu->abort_jump, 1);
 }
 
 /*
@@ -309,7 +308,7 @@ MMU_permission_fault_page(uint32_t access_type, uint32_t far, uint32_t domain)
 			ARM_Exception(EX_DABT, 4);
 		}
 	}
-	longjmp(gcpu.abort_jump, 1);
+	longjmp(gcpu->abort_jump, 1);
 }
 
 static inline void
@@ -331,7 +330,7 @@ MMU_permission_fault_section(uint32_t access_type, uint32_t far, uint32_t domain
 			ARM_Exception(EX_DABT, 4);
 		}
 	}
-	longjmp(gcpu.abort_jump, 1);
+	longjmp(gcpu->abort_jump, 1);
 }
 
 /*
@@ -351,7 +350,7 @@ MMU_AlignmentException(uint32_t far)
 	MMU_FAR = far;
 	MMU_DFSR = (MMU_DFSR & ~(FSR_FS_MASK)) | FS_ALIGN_EX;
 	ARM_Exception(EX_DABT, 4);
-	longjmp(gcpu.abort_jump, 1);
+	longjmp(gcpu->abort_jump, 1);
 }
 
 #define FLPD_TYPE_FAULT   (0)
@@ -741,9 +740,8 @@ ctrl_write(void *clientData, uint32_t icode, uint32_t value)
 		mmu_vector_base = 0;
 	}
 	do_alignment_check = value & MCTRL_ALGNCHK;
-	sys_rom_protection = ((value >> 8) & 0x3) << SYS_ROM_SHIFT;
 	if (diff & (3 << 8)) {
-		MMU_InvalidateTlb();
+		MMU_InvalidateLocalTlb();
 	}
 #if 0
 	if (value & MCTRL_LABT) {
@@ -774,12 +772,11 @@ mtbase_write(void *clientData, uint32_t icode, uint32_t value)
 {
 	SystemCopro *mmu = (SystemCopro *) clientData;
 	mmu->mtbase = value;
-	ttbl_base = value;
 	dbgprintf("Setting Page table base to %08x\n", value);
 	if (value & 0x3fff) {
 		fprintf(stderr, "Bad page table base 0x%08x\n", value);
 	}
-	MMU_InvalidateTlb();
+	MMU_InvalidateLocalTlb();
 	return;
 }
 
@@ -798,9 +795,8 @@ mdac_write(void *clientData, uint32_t icode, uint32_t value)
 	dbgprintf("Load Domain Access Control Register with %08x\n", value);
 	diff = mmu->mdac ^ value;
 	mmu->mdac = value;
-	domain_access_reg = value;
 	if (diff) {
-		MMU_InvalidateTlb();
+		MMU_InvalidateLocalTlb();
 	}
 	return;
 
@@ -875,65 +871,11 @@ mcctrl_read(void *clientData, uint32_t icode)
 static void
 mcctrl_write(void *clientData, uint32_t icode, uint32_t value)
 {
-	SystemCopro *mmu = (SystemCopro *) clientData;
 	uint32_t crm = icode & 0xf;
 	uint32_t opcode_2 = (icode >> 5) & 0x7;
 	/* Wait for Interrupt instruction (halt) */
 	if ((crm == 0) && (opcode_2 == 4)) {
-		uint64_t nsecs;
-		struct timespec *last_halt, tv_now;
-		last_halt = &mmu->last_halt;
-		clock_gettime(CLOCK_MONOTONIC, &tv_now);
-		nsecs =
-		    tv_now.tv_nsec - last_halt->tv_nsec + (int64_t) 1000000000 *(tv_now.tv_sec -
-										 last_halt->tv_sec);
-		mmu->saved_cycles = mmu->saved_cycles
-		    /* Subtract the  cycles which should have simulated since the last halt */
-		    - (CycleTimerRate_Get() / 1000000) * (nsecs / 1000) +
-		    /* Add the cycles which really have been simulated since last halt */
-		    (CycleCounter_Get() - mmu->last_halt_cycles);
-
-		*last_halt = tv_now;
-
-		/* 
-		 * Catch up a maximum of one half of a second if emulator is 
-		 * slower than real system 
-		 */
-		if (mmu->saved_cycles < -(int64_t) (CycleTimerRate_Get() / 2)) {
-			mmu->saved_cycles = -(int64_t) (CycleTimerRate_Get() >> 1);
-		} else if (mmu->saved_cycles > (int64_t) CycleTimerRate_Get()) {
-			mmu->saved_cycles = CycleTimerRate_Get();
-		}
-		/* Jump over CPU cycles if not enough saved for sleeping 1 timeslice */
-		while (mmu->saved_cycles < (CycleTimerRate_Get() / 100)
-		       && (firstCycleTimerTimeout != ~(uint64_t) 0)) {
-
-			/* leave halt even if an IRQ arrives when irqs are disabled in CPSR */
-			if (gcpu.signals_raw & (ARM_SIG_IRQ | ARM_SIG_FIQ)) {
-				mmu->last_halt_cycles = CycleCounter_Get();
-				return;
-			}
-			mmu->saved_cycles += firstCycleTimerTimeout - CycleCounter_Get();
-			CycleCounter = firstCycleTimerTimeout;
-			CycleTimers_Check();
-		}
-		mmu->last_halt_cycles = CycleCounter_Get();
-		/* Jump over time (sleep) if we have saved enough CPU cycles for sleeping 1 timeslice */
-		while (mmu->saved_cycles >= (CycleTimerRate_Get() / 100)) {
-			struct timespec tout;
-			tout.tv_nsec = 10000000;	/* 10 ms */
-			tout.tv_sec = 0;
-			if (gcpu.signals_raw & (ARM_SIG_IRQ | ARM_SIG_FIQ)) {
-				return;
-			}
-			// FIXME: FIO_WaitEventTimeout(&tout);
-			clock_gettime(CLOCK_MONOTONIC, &tv_now);
-			nsecs =
-			    tv_now.tv_nsec - last_halt->tv_nsec +
-			    (int64_t) 1000000000 *(tv_now.tv_sec - last_halt->tv_sec);
-			mmu->saved_cycles -= (CycleTimerRate_Get() / 1000000) * (nsecs / 1000);
-			*last_halt = tv_now;
-		}
+		ARM_WaitForInterrupt();
 	} else {
 		dbgprintf("Ignore Cache settings\n");
 	}
@@ -952,7 +894,7 @@ static void
 mtlbctrl_write(void *clientData, uint32_t icode, uint32_t value)
 {
 	//fprintf(stderr,"inv op2 %08x crm %08x,data %08x\n",opcode_2,crm,data);
-	MMU_InvalidateTlb();
+	MMU_InvalidateLocalTlb();
 	dbgprintf("Invalidate TLB\n");
 	return;
 
@@ -1039,6 +981,48 @@ mpid_write(void *clientData, uint32_t icode, uint32_t value)
 	fprintf(stderr, "MMU: MVA addressing mode PID not implemented\n");
 }
 
+/*
+ * ---------------------------------------------------------------------
+ * Snapshot of the system coprocessor registers. The control, table
+ * base and domain registers are restored through their write procs,
+ * so the derived translation state and the TLB are updated.
+ * ---------------------------------------------------------------------
+ */
+static void
+MMU9_SaveState(void *owner, Snapshot_t * ss)
+{
+	SystemCopro *mmu = owner;
+	Snapshot_Write(ss, &mmu->id, offsetof(SystemCopro, endianNode));
+}
+
+static int
+MMU9_LoadState(void *owner, Snapshot_t * ss)
+{
+	SystemCopro *mmu = owner;
+	SystemCopro saved;
+	ARM9 *prev_cpu = gcpu;
+	if (Snapshot_Read(ss, &saved.id, offsetof(SystemCopro, endianNode)) < 0) {
+		return -1;
+	}
+	/* The register writes update the TLBs of the CPU owning this MMU */
+	gcpu = mmu->cpu;
+	ctrl_write(mmu, 0, saved.ctrl);
+	mtbase_write(mmu, 0, saved.mtbase);
+	mdac_write(mmu, 0, saved.mdac);
+	mmu->dfsr = saved.dfsr;
+	mmu->ifsr = saved.ifsr;
+	mmu->far = saved.far;
+	mmu->mcctrl = saved.mcctrl;
+	mmu->mtlbctrl = saved.mtlbctrl;
+	mmu->dclck = saved.dclck;
+	mmu->iclck = saved.iclck;
+	mmu->mtlblck = saved.mtlblck;
+	mmu->mpid = saved.mpid;
+	MMU_InvalidateLocalTlb();
+	gcpu = prev_cpu;
+	return 0;
+}
+
 /* 
  * ---------------------------------------------
  * MMU MRC - Move from ArmCoprocessor to register
@@ -1085,21 +1069,18 @@ MMUmcr(ArmCoprocessor * copro, uint32_t icode, uint32_t data)
 	}
 }
 
-static ArmCoprocessor copro = {
-	.mrc = MMUmrc,
-	.mcr = MMUmcr,
-	.cdp = NULL,
-	.ldc = NULL,
-	.stc = NULL
-};
-
 ArmCoprocessor *
 MMU9_Create(const char *name, int endian, uint32_t mmu_type)
 {
 	SystemCopro *mmu;
 //      uint32_t variant = mmu_type & 0xffff;
 	uint32_t type = mmu_type & 0xffff0000;
-	gmmu = mmu = sg_new(SystemCopro);
+	mmu = sg_new(SystemCopro);
+	/* The MMU belongs to the CPU created last */
+	mmu->cpu = gcpu;
+	mmu->copro.mrc = MMUmrc;
+	mmu->copro.mcr = MMUmcr;
+	mmu->copro.owner = mmu;
 	mmu->ctrl = 0x50078;
 	mmu->iclck = 0x0000fff0;
 	mmu->dclck = 0x0000fff0;
@@ -1114,8 +1095,7 @@ MMU9_Create(const char *name, int endian, uint32_t mmu_type)
 		mmu->ctrl |= MCTRL_BE;
 	}
 	update_byteorder(mmu);
-	copro.owner = mmu;
-	MMU_ArmInit();
+	MMU_ArmInit(name);
 	switch (type) {
 	    case MMU_ARM926EJS:
 		    CrnHandler_New(mmu, SYSCPR_ID, arm926ejs_id_read, id_write, mmu);
@@ -1137,6 +1117,7 @@ MMU9_Create(const char *name, int endian, uint32_t mmu_type)
 	CrnHandler_New(mmu, SYSCPR_MCLCK, mclck_read, mclck_write, mmu);
 	CrnHandler_New(mmu, SYSCPR_MTLBLCK, mtlblck_read, mtlblck_write, mmu);
 	CrnHandler_New(mmu, SYSCPR_MPID, mpid_read, mpid_write, mmu);
+	Snapshot_RegisterState(name, MMU9_SaveState, MMU9_LoadState, mmu);
 
-	return &copro;
+	return &mmu->copro;
 }
@@ -7,6 +7,8 @@
  *
  * ----------------------------------------------------
  */
+#ifndef MMU_ARM9_H
+#define MMU_ARM9_H
 
 #include <bus.h>
 #include "arm9cpu.h"
@@ -83,3 +85,4 @@ void MMU_AlignmentException(uint32_t far);
 void MMU_InvalidateTlb();
 void MMU_SetDebugMode(int val);
 int MMU_Byteorder();
+#endif
@@ -0,0 +1,120 @@
+//===-- arm/thumb_cache.c -----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform : modules
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Predecoded page cache for the Thumb instruction set
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Main Module Header
+#include "thumb_cache.h"
+
+// Local/Private Headers
+
+// Leigun Core Headers
+#include "bus.h"
+#include "sgstring.h"
+
+// System headers
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+
+/*
+ * ------------------------------------------------------------------
+ * The Thumb cache shares the code page tracing and the page
+ * generations with the ARM basic block cache, so ARM_BBInit
+ * has to be called first.
+ * ------------------------------------------------------------------
+ */
+void
+ThumbCache_Init(void)
+{
+	if (thumbCache) {
+		return;
+	}
+	thumbCache = sg_calloc(sizeof(ThumbPage) * THUMB_CACHE_SIZE);
+	fprintf(stderr, "- Thumb page cache with %d pages initialized\n", THUMB_CACHE_SIZE);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Find the page holding va. On a miss the page is translated for an
+ * instruction fetch, so a prefetch abort is raised as without cache.
+ * Returns NULL if the code can not be cached (code from IO).
+ * ------------------------------------------------------------------------
+ */
+ThumbPage *
+ThumbCache_Lookup(uint32_t va)
+{
+	ThumbPage *tp = thumbCache + THUMB_CACHE_INDEX(va);
+	uint32_t pgva = va & ~UINT32_C(0x3ff);
+	uint32_t pa;
+	uint8_t *hva;
+	int result;
+	if ((tp->va == pgva) && (tp->cpu_mode == ARM_SIGNALING_MODE)
+	    && (tp->version == stlb_version)
+	    && (tp->pagegen == armBBPageGen[tp->pgidx])) {
+		armBBStats.hits++;
+		return tp;
+	}
+	pa = MMU9_TranslateAddress(va, MMU_ACCESS_IFETCH | MMU_ACCESS_DATA_READ);
+	hva = Bus_GetHVARead(pa);
+	if (!hva) {
+		armBBStats.uncached++;
+		return NULL;
+	}
+	result = Mem_TraceCodePage(pa);
+	if (result < 0) {
+		armBBStats.uncached++;
+		return NULL;
+	} else if (result > 0) {
+		MMU_InvalidateWriteTlb();
+	}
+	tp->va = pgva;
+	tp->cpu_mode = ARM_SIGNALING_MODE;
+	tp->version = stlb_version;
+	tp->pgidx = ARM_BB_PGGEN_INDEX(pa);
+	tp->pagegen = armBBPageGen[tp->pgidx];
+	tp->hva = hva - (va & 0x3ff);
+	memset(tp->iproc, 0, sizeof(tp->iproc));
+	armBBStats.misses++;
+	return tp;
+}
+
+/*
+ * --------------------------------------------------------------
+ * Decode a slot of a page on its first execution
+ * --------------------------------------------------------------
+ */
+ThumbInstructionProc *
+ThumbCache_DecodeSlot(ThumbPage * tp, uint32_t slot)
+{
+	uint16_t icode = HMemRead16(tp->hva + (slot << 1));
+	tp->icode[slot] = icode;
+	tp->iproc[slot] = ThumbInstructionProc_Find(icode);
+	return tp->iproc[slot];
+}
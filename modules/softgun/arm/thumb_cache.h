@@ -0,0 +1,99 @@
+//===-- arm/thumb_cache.h -----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform : modules
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Predecoded page cache for the Thumb instruction set
+///
+/// Every cached 1k page of Thumb code holds the instruction codes and the
+/// instruction procs of its 512 halfwords. Slots are decoded lazily on the
+/// first execution. Pages are validated in the same way as the ARM basic
+/// blocks: by virtual address, signaling mode, stlb_version and the
+/// generation counter of the physical code page.
+///
+//===----------------------------------------------------------------------===//
+#ifndef THUMB_CACHE_H
+#define THUMB_CACHE_H
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Local/Private Headers
+#include "bbcache_arm.h"
+#include "thumb_decode.h"
+
+// Leigun Core Headers
+#include "compiler_extensions.h"
+
+// System headers
+#include <stdint.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define THUMB_PAGE_SLOTS	(512)
+#define THUMB_CACHE_SIZE	(256)
+#define THUMB_CACHE_INDEX(va)	(((va) >> 10) & (THUMB_CACHE_SIZE - 1))
+#define THUMB_SLOT(va)		(((va) & 0x3ff) >> 1)
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct ThumbPage {
+	uint32_t va;		/* 1k aligned virtual address of the page */
+	uint32_t cpu_mode;	/* signaling mode when decoded */
+	uint32_t version;	/* stlb_version when decoded */
+	uint32_t pagegen;	/* generation of the code page when decoded */
+	uint32_t pgidx;		/* index into the page generation table */
+	uint8_t *hva;		/* Host address of the page start */
+	uint16_t icode[THUMB_PAGE_SLOTS];
+	ThumbInstructionProc *iproc[THUMB_PAGE_SLOTS];
+} ThumbPage;
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+/* The page cache of the CPU running in this thread */
+#define thumbCache	(gcpu->caches.thumbPages)
+
+
+//==============================================================================
+//= Functions
+//==============================================================================
+void ThumbCache_Init(void);
+ThumbPage *ThumbCache_Lookup(uint32_t va);
+ThumbInstructionProc *ThumbCache_DecodeSlot(ThumbPage * tp, uint32_t slot);
+
+/*
+ * ----------------------------------------------------------------------
+ * Check if the current page can still be used for the instruction at va.
+ * The signaling mode can not change without leaving the Thumb loop,
+ * so it is only checked on lookup.
+ * ----------------------------------------------------------------------
+ */
+static inline int
+ThumbPage_Valid(ThumbPage * tp, uint32_t va)
+{
+	return tp && ((va & ~UINT32_C(0x3ff)) == tp->va)
+	    && (tp->version == stlb_version)
+	    && (tp->pagegen == armBBPageGen[tp->pgidx]);
+}
+
+#endif
@@ -137,7 +137,7 @@ ThumbDecoder_New()
 	int icode;
 	ThumbInstruction *cursor;
 	if (thumbIProcTab) {
-		fprintf(stderr, "Warning: Thumb Instruction decoder is already initialized\n");
+		/* The tables are shared by all ARM CPUs */
 		return;
 	}
 	thumbIProcTab = sg_calloc(sizeof(ThumbInstructionProc *) * 65536);
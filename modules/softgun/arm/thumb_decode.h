@@ -1,3 +1,5 @@
+#ifndef THUMB_DECODE_H
+#define THUMB_DECODE_H
 #include <stdint.h>
 
 typedef void ThumbInstructionProc(void);
@@ -30,3 +32,4 @@ struct ThumbInstruction {
 };
 
 void ThumbDecoder_New();
+#endif
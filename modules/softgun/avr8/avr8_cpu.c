@@ -218,9 +218,8 @@ AVR8_Variant avr8_variants[] = {
 	 }
 };
 
-AVR8_Cpu gavr8;
+__THREAD_LOCAL__ AVR8_Cpu *gavr8;
 
-CycleTimer exit_timer;
 
 static uint16_t pcbuf[1024];
 static int pcbuf_wp = 0;
@@ -280,6 +279,7 @@ static void run(GlobalClock_LocalClock_t *clk, void *data);
 static void
 debugger_setreg(void *clientData, const uint8_t * data, uint32_t index, int len)
 {
+	gavr8 = clientData;
 	if (index < 32) {
 		if (len != 1) {
 			return;
@@ -319,6 +319,7 @@ static int
 debugger_getreg(void *clientData, uint8_t * data, uint32_t index, int maxlen)
 {
 	int retval = 0;
+	gavr8 = clientData;
 	if (index < 32) {
 		if (maxlen < 1) {
 			return -EINVAL;
@@ -365,6 +366,7 @@ static ssize_t
 debugger_getmem(void *clientData, uint8_t * data, uint64_t addr, uint32_t count)
 {
 	uint32_t i;
+	gavr8 = clientData;
 	/* catch exceptions from MMU */
 	if ((addr & DBG_AVR_MEM_MASK) == DBG_AVR_IMEM_START) {
 		for (i = 0; i < count; i++) {
@@ -382,6 +384,7 @@ static ssize_t
 debugger_setmem(void *clientData, const uint8_t * data, uint64_t addr, uint32_t count)
 {
 	uint32_t i;
+	gavr8 = clientData;
 	/* catch exceptions from MMU */
 	if ((addr & DBG_AVR_MEM_MASK) == DBG_AVR_IMEM_START) {
 		for (i = 0; i < count; i++) {
@@ -398,8 +401,8 @@ debugger_setmem(void *clientData, const uint8_t * data, uint64_t addr, uint32_t
 static int
 debugger_stop(void *clientData)
 {
-
-	gavr8.dbg_state = AVRDBG_STOP;
+	gavr8 = clientData;
+	gavr8->dbg_state = AVRDBG_STOP;
 	AVR8_PostSignal(AVR8_SIG_DBG);
 	return -1;
 }
@@ -407,7 +410,8 @@ debugger_stop(void *clientData)
 static int
 debugger_cont(void *clientData)
 {
-	gavr8.dbg_state = AVRDBG_RUNNING;
+	gavr8 = clientData;
+	gavr8->dbg_state = AVRDBG_RUNNING;
 	/* Should only be called if there are no breakpoints */
 	AVR8_UnpostSignal(AVR8_SIG_DBG);
 	return 0;
@@ -416,20 +420,22 @@ debugger_cont(void *clientData)
 static int
 debugger_step(void *clientData, uint64_t addr, int use_addr)
 {
+	gavr8 = clientData;
 	if (use_addr) {
 		SET_REG_PC(addr >> 1);
 	}
-	gavr8.dbg_steps = 1;
-	gavr8.dbg_state = AVRDBG_STEP;
+	gavr8->dbg_steps = 1;
+	gavr8->dbg_state = AVRDBG_STEP;
 	return -1;
 }
 
 static Dbg_TargetStat
 debugger_get_status(void *clientData)
 {
-	if (gavr8.dbg_state == AVRDBG_STOPPED) {
+	gavr8 = clientData;
+	if (gavr8->dbg_state == AVRDBG_STOPPED) {
 		return DbgStat_SIGINT;
-	} else if (gavr8.dbg_state == AVRDBG_RUNNING) {
+	} else if (gavr8->dbg_state == AVRDBG_RUNNING) {
 		return DbgStat_RUNNING;
 	} else {
 		return -1;
@@ -456,36 +462,36 @@ debugger_get_bkpt_ins(void *clientData, uint8_t * ins, uint64_t addr, int len)
 static void
 Do_Debug(void)
 {
-	if (gavr8.dbg_state == AVRDBG_RUNNING) {
+	if (gavr8->dbg_state == AVRDBG_RUNNING) {
 		fprintf(stderr, "Debug mode is off, should not be called\n");
-	} else if (gavr8.dbg_state == AVRDBG_STEP) {
-		if (gavr8.dbg_steps == 0) {
-			gavr8.dbg_state = AVRDBG_STOPPED;
-			if (gavr8.debugger) {
-				Debugger_Notify(gavr8.debugger, DbgStat_SIGTRAP);
+	} else if (gavr8->dbg_state == AVRDBG_STEP) {
+		if (gavr8->dbg_steps == 0) {
+			gavr8->dbg_state = AVRDBG_STOPPED;
+			if (gavr8->debugger) {
+				Debugger_Notify(gavr8->debugger, DbgStat_SIGTRAP);
 			}
 			AVR8_RestartIdecoder();
 		} else {
-			gavr8.dbg_steps--;
+			gavr8->dbg_steps--;
 		}
-	} else if (gavr8.dbg_state == AVRDBG_STOP) {
-		gavr8.dbg_state = AVRDBG_STOPPED;
-		if (gavr8.debugger) {
-			Debugger_Notify(gavr8.debugger, DbgStat_SIGINT);
+	} else if (gavr8->dbg_state == AVRDBG_STOP) {
+		gavr8->dbg_state = AVRDBG_STOPPED;
+		if (gavr8->debugger) {
+			Debugger_Notify(gavr8->debugger, DbgStat_SIGINT);
 		}
 		AVR8_RestartIdecoder();
-	} else if (gavr8.dbg_state == AVRDBG_BREAK) {
-		if (gavr8.debugger) {
-			if (Debugger_Notify(gavr8.debugger, DbgStat_SIGTRAP) > 0) {
-				gavr8.dbg_state = AVRDBG_STOPPED;
+	} else if (gavr8->dbg_state == AVRDBG_BREAK) {
+		if (gavr8->debugger) {
+			if (Debugger_Notify(gavr8->debugger, DbgStat_SIGTRAP) > 0) {
+				gavr8->dbg_state = AVRDBG_STOPPED;
 				AVR8_RestartIdecoder();
 			}	/* Else no debugger session open */
 		} else {
 			//AVR Exception break
-			gavr8.dbg_state = AVRDBG_RUNNING;
+			gavr8->dbg_state = AVRDBG_RUNNING;
 		}
 	} else {
-		fprintf(stderr, "Unknown restart signal reason %d\n", gavr8.dbg_state);
+		fprintf(stderr, "Unknown restart signal reason %d\n", gavr8->dbg_state);
 	}
 }
 #endif
@@ -497,31 +503,29 @@ AVR8_Interrupt(void *irqData)
 	uint32_t pc = GET_REG_PC;
 	uint8_t sreg = GET_SREG;
 	int irqvect;
-	for (irqvect = 0; irqvect < gavr8.nr_intvects; irqvect++) {
-		if (SigNode_Val(gavr8.irqNode[irqvect]) == SIG_LOW) {
+	for (irqvect = 0; irqvect < gavr8->nr_intvects; irqvect++) {
+		if (SigNode_Val(gavr8->irqNode[irqvect]) == SIG_LOW) {
 			break;
 		}
 	}
-	if (irqvect == gavr8.nr_intvects) {
-		gavr8.cpu_signals_raw &= ~AVR8_SIG_IRQ;
+	if (irqvect == gavr8->nr_intvects) {
+		gavr8->cpu_signals_raw &= ~AVR8_SIG_IRQ;
 		AVR8_UpdateCpuSignals();
 		return;
 	}
-	SigNode_Set(gavr8.irqAckNode[irqvect], SIG_LOW);
-	SigNode_Set(gavr8.irqAckNode[irqvect], SIG_HIGH);
+	SigNode_Set(gavr8->irqAckNode[irqvect], SIG_LOW);
+	SigNode_Set(gavr8->irqAckNode[irqvect], SIG_HIGH);
 
 	AVR8_WriteMem8(pc & 0xff, sp--);
 	AVR8_WriteMem8((pc >> 8) & 0xff, sp--);
-	if (gavr8.pc24bit) {
+	if (gavr8->pc24bit) {
 		AVR8_WriteMem8((pc >> 16) & 0xff, sp--);
-		GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 		CycleCounter += 1;
 	}
 	sreg &= ~FLG_I;
 	SET_SREG(sreg);		// SET SREG should be a proc with influence on cpu_signals
 	AVR8_UpdateCpuSignals();
 	SET_REG_SP(sp);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 4);
 	CycleCounter += 4;
 	SET_REG_PC(irqvect << 1);
 }
@@ -529,21 +533,21 @@ AVR8_Interrupt(void *irqData)
 static inline void
 CheckSignals(void)
 {
-  if (likely(!gavr8.cpu_signals)) {
+  if (likely(!gavr8->cpu_signals)) {
     return;
   }
-	if (likely(gavr8.cpu_signals & AVR8_SIG_IRQ)) {
-		gavr8.avrAckIrq(gavr8.avrIrqData);
-	} else if (gavr8.cpu_signals & AVR8_SIG_IRQENABLE) {
-		gavr8.cpu_signals_raw &= ~AVR8_SIG_IRQENABLE;
+	if (likely(gavr8->cpu_signals & AVR8_SIG_IRQ)) {
+		gavr8->avrAckIrq(gavr8->avrIrqData);
+	} else if (gavr8->cpu_signals & AVR8_SIG_IRQENABLE) {
+		gavr8->cpu_signals_raw &= ~AVR8_SIG_IRQENABLE;
 		AVR8_UpdateCpuSignals();
 	}
 #ifndef NO_DEBUGGER
-	if (unlikely(gavr8.cpu_signals & AVR8_SIG_DBG)) {
+	if (unlikely(gavr8->cpu_signals & AVR8_SIG_DBG)) {
 		Do_Debug();
 	}
 #endif
-	if (unlikely(gavr8.cpu_signals & AVR8_SIG_RESTART_IDEC)) {
+	if (unlikely(gavr8->cpu_signals & AVR8_SIG_RESTART_IDEC)) {
 		AVR8_RestartIdecoder();
 	}
 }
@@ -571,25 +575,25 @@ avr8_write_unknown(void *clientData, uint8_t value, uint32_t address)
 static uint8_t
 avr8_read_rampz(void *clientData, uint32_t address)
 {
-	return gavr8.rampz;
+	return gavr8->rampz;
 }
 
 static void
 avr8_write_rampz(void *clientData, uint8_t value, uint32_t address)
 {
-	gavr8.rampz = value;
+	gavr8->rampz = value;
 }
 
 static uint8_t
 avr8_read_eind(void *clientData, uint32_t address)
 {
-	return gavr8.regEIND;
+	return gavr8->regEIND;
 }
 
 static void
 avr8_write_eind(void *clientData, uint8_t value, uint32_t address)
 {
-	gavr8.regEIND = value;
+	gavr8->regEIND = value;
 }
 
 /*
@@ -601,6 +605,7 @@ avr8_write_eind(void *clientData, uint8_t value, uint32_t address)
 static void
 AVR8_IrqTrace(SigNode * sig, int value, void *clientData)
 {
+	gavr8 = clientData;
 	if (value == SIG_LOW) {
 		AVR8_PostSignal(AVR8_SIG_IRQ);
 	}
@@ -712,12 +717,13 @@ AVR8_Reti(void *eventData)
 static Device_MPU_t *
 create(void)
 {
-	AVR8_Cpu *avr = &gavr8;
+	AVR8_Cpu *avr = LEIGUN_NEW(avr);
 	AVR8_Variant *var;
 	char *variantname;
 	char *flashname;
 	char *imagedir;
 	uint32_t cpu_clock = 20000000;
+	uint32_t quantum_us = 0;
 	const char *instancename = "avr";
 	int nr_variants = sizeof(avr8_variants) / sizeof(AVR8_Variant);
 	int i;
@@ -739,7 +745,8 @@ create(void)
 		fprintf(stderr, "Unknown AVR8 CPU \"%s\"\n", variantname);
 		exit(1);
 	}
-	memset(avr, 0, sizeof(*avr));
+	/* The devices created next belong to this CPU */
+	gavr8 = avr;
 	imagedir = Config_ReadVar("global", "imagedir");
 	if (!imagedir) {
 		fprintf(stderr, "No directory given for AVR8 flash diskimage\n");
@@ -796,14 +803,16 @@ create(void)
 		SigNode_Trace(avr->irqNode[i], AVR8_IrqTrace, avr);
 	}
 	if (var->pc_width > 16) { 
-	    AVR8_IDecoderNew(AVR8_VARIANT_PC24);
+	    avr->idec = AVR8_IDecoderNew(AVR8_VARIANT_PC24);
     } else {
-	    AVR8_IDecoderNew(AVR8_VARIANT_PC16);
+	    avr->idec = AVR8_IDecoderNew(AVR8_VARIANT_PC16);
     }
 	AVR8_InitInstructions(avr);
 	Config_ReadUInt32(&cpu_clock, "global", "cpu_clock");
-	GlobalClock_Registor(&run, dev, cpu_clock);
-	CycleTimers_Init(instancename, cpu_clock);
+	Config_ReadUInt32(&quantum_us, instancename, "clock_quantum_us");
+	GlobalClock_RegistorQuantum(&run, dev, cpu_clock,
+				    (uint64_t)quantum_us * 1000);
+	avr->timerDomain = CycleTimers_Init(instancename, cpu_clock);
 	for (i = 0; i < 32; i++) {
 		AVR8_RegisterIOHandler(i, avr8_read_reg, avr8_write_reg, avr);
 	}
@@ -816,7 +825,7 @@ create(void)
 	SET_REG_SP(avr->sram_end - 1);
 	SET_SREG(0);		/* ??? */
 	avr->throttle = Throttle_New(instancename);
-	CycleTimer_Add(&exit_timer, CycleTimerRate_Get() * 30, avr_exit, avr);
+	CycleTimer_Add(&avr->exit_timer, CycleTimerRate_Get() * 30, avr_exit, avr);
 	Signodes_SetConflictProc(AVR8_SignalLevelConflict);
 	avr->avrAckIrq = AVR8_Interrupt;
 	avr->avrReti = AVR8_Reti;
@@ -848,11 +857,13 @@ run(GlobalClock_LocalClock_t *clk, void *data)
 	AVR8_Cpu *avr = ((Device_MPU_t *)data)->self;
 	uint32_t addr = 0;
 	AVR8_InstructionProc *iproc;
+	gavr8 = avr;
 	avr->lclk = clk;
 	if (Config_ReadUInt32(&addr, "global", "start_address") < 0) {
 		addr = 0;
 	}
 	SET_REG_PC(addr);
+	CycleTimers_SyncGlobalClock(avr->timerDomain, clk);
 	setjmp(avr->restart_idec_jump);
 #ifndef NO_DEBUGGER
 	while (avr->dbg_state == AVRDBG_STOPPED) {
@@ -869,7 +880,7 @@ run(GlobalClock_LocalClock_t *clk, void *data)
 		ICODE = AVR8_ReadAppMem(GET_REG_PC);
 		//logPC();
 		SET_REG_PC(GET_REG_PC + 1);
-		iproc = AVR8_InstructionProcFind(ICODE);
+		iproc = AVR8_InstructionProcFind(avr->idec, ICODE);
 		iproc();
 	}
 }
@@ -881,12 +892,12 @@ run(GlobalClock_LocalClock_t *clk, void *data)
 void
 AVR8_UpdateCpuSignals(void)
 {
-	if (gavr8.sreg & FLG_I) {
-		gavr8.cpu_signal_mask |= AVR8_SIG_IRQ;
+	if (gavr8->sreg & FLG_I) {
+		gavr8->cpu_signal_mask |= AVR8_SIG_IRQ;
 	} else {
-		gavr8.cpu_signal_mask &= ~AVR8_SIG_IRQ;
+		gavr8->cpu_signal_mask &= ~AVR8_SIG_IRQ;
 	}
-	gavr8.cpu_signals = gavr8.cpu_signals_raw & gavr8.cpu_signal_mask;
+	gavr8->cpu_signals = gavr8->cpu_signals_raw & gavr8->cpu_signal_mask;
 }
 
 void
@@ -920,7 +931,7 @@ AVR8_RegisterIOHandler(uint32_t addr, AVR8_IoReadProc * readproc, AVR8_IoWritePr
 {
 
 	AVR8_Iohandler *ioh;
-	AVR8_Cpu *avr = &gavr8;
+	AVR8_Cpu *avr = gavr8;
 	if (addr >= avr->io_registers) {
 		fprintf(stderr, "Bug: registering IO-Handler outside of IO address space of CPU: %u\n", 
             addr);
@@ -947,9 +958,9 @@ AVR8_RegisterIOHandler(uint32_t addr, AVR8_IoReadProc * readproc, AVR8_IoWritePr
 void
 AVR8_RegisterIntco(void (*ackProc) (void *), void (*retiProc) (void *), void *eventData)
 {
-	gavr8.avrAckIrq = ackProc;
-	gavr8.avrReti = retiProc;
-	gavr8.avrIrqData = eventData;
+	gavr8->avrAckIrq = ackProc;
+	gavr8->avrReti = retiProc;
+	gavr8->avrIrqData = eventData;
 
 }
 
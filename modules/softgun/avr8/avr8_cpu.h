@@ -41,14 +41,14 @@
 #define AVR8_SIG_RESTART_IDEC    (1 << 2)	/* Restart the Idecoder at end of Check signals. */
 #define AVR8_SIG_DBG             (1 << 3)	/* Communicates in check signal with debugger. */
 
-#define GET_REG_PC (gavr8.pc)
-#define RAMPZ	(gavr8.rampz)
-#define GET_REG_SP (gavr8.sp)
-#define SET_REG_PC(val) (gavr8.pc = (val))
-#define SET_REG_SP(val) (gavr8.sp = (val))
-#define ICODE	(gavr8.icode)
-#define GET_SREG  (gavr8.sreg)
-#define SET_SREG(val) 	(gavr8.sreg = (val))
+#define GET_REG_PC (gavr8->pc)
+#define RAMPZ	(gavr8->rampz)
+#define GET_REG_SP (gavr8->sp)
+#define SET_REG_PC(val) (gavr8->pc = (val))
+#define SET_REG_SP(val) (gavr8->sp = (val))
+#define ICODE	(gavr8->icode)
+#define GET_SREG  (gavr8->sreg)
+#define SET_SREG(val) 	(gavr8->sreg = (val))
 
 /* Two byte register number */
 #define NR_REG_X (26)
@@ -104,6 +104,7 @@ typedef struct AVR8_Cpu {
 
 	/* The current instruction */
 	uint16_t icode;
+	AVR8_IDecoder *idec;
 	int nr_intvects;
 	SigNode **irqNode;
 	SigNode **irqAckNode;
@@ -123,65 +124,67 @@ typedef struct AVR8_Cpu {
 	void (*avrReti) (void *);
 	void *avrIrqData;
 	GlobalClock_LocalClock_t *lclk;
+	CycleTimerDomain *timerDomain;
+	CycleTimer exit_timer;
 } AVR8_Cpu;
 
 void AVR8_DumpPcBuf(void);
 void AVR8_DumpRegisters(void);
 
-extern AVR8_Cpu gavr8;
+extern __THREAD_LOCAL__ AVR8_Cpu *gavr8;
 static inline uint8_t
 AVR8_ReadReg(unsigned int reg)
 {
-	return gavr8.gpr[reg];
+	return gavr8->gpr[reg];
 }
 
 static inline uint16_t
 AVR8_ReadReg16(unsigned int reg)
 {
-	return BYTE_ReadFromLe16(gavr8.gpr, reg);
+	return BYTE_ReadFromLe16(gavr8->gpr, reg);
 }
 
 static inline void
 AVR8_WriteReg(uint8_t val, unsigned int reg)
 {
-	gavr8.gpr[reg] = val;
+	gavr8->gpr[reg] = val;
 }
 
 static inline void
 AVR8_WriteReg16(uint16_t val, unsigned int reg)
 {
-	BYTE_WriteToLe16(gavr8.gpr, reg, val);
+	BYTE_WriteToLe16(gavr8->gpr, reg, val);
 }
 
 static inline void
 AVR8_WriteMem8(uint8_t val, uint32_t addr)
 {
-	if (addr < gavr8.io_registers) {
+	if (addr < gavr8->io_registers) {
 		AVR8_Iohandler *ioh;
-		ioh = gavr8.mmioHandler[addr];
+		ioh = gavr8->mmioHandler[addr];
 		ioh->ioWriteProc(ioh->clientData, val, addr);
 #if 0
-	This is only required on XMega because of EEPROM} else if (addr < gavr8.sram_start) {
+	This is only required on XMega because of EEPROM} else if (addr < gavr8->sram_start) {
 		fprintf(stderr, "Write to nonexistent %04x\n", addr);
 #endif
-	} else if (addr < gavr8.sram_end) {
-		gavr8.sram[addr - gavr8.sram_start] = val;
+	} else if (addr < gavr8->sram_end) {
+		gavr8->sram[addr - gavr8->sram_start] = val;
 	}
 }
 
 static inline uint8_t
 AVR8_ReadMem8(uint32_t addr)
 {
-	if (addr < gavr8.io_registers) {
+	if (addr < gavr8->io_registers) {
 		AVR8_Iohandler *ioh;
-		ioh = gavr8.mmioHandler[addr];
+		ioh = gavr8->mmioHandler[addr];
 		return ioh->ioReadProc(ioh->clientData, addr);
 #if 0
-	This is only required on XMega because of EEPROM} else if (addr < gavr8.sram_start) {
+	This is only required on XMega because of EEPROM} else if (addr < gavr8->sram_start) {
 		return 0;
 #endif
-	} else if (addr < gavr8.sram_end) {
-		return gavr8.sram[addr - gavr8.sram_start];
+	} else if (addr < gavr8->sram_end) {
+		return gavr8->sram[addr - gavr8->sram_start];
 	} else {
 		return 0;
 	}
@@ -192,7 +195,7 @@ AVR8_WriteIO8(uint8_t val, uint32_t addr)
 {
 	AVR8_Iohandler *ioh;
 	addr += 0x20;
-	ioh = gavr8.mmioHandler[addr];
+	ioh = gavr8->mmioHandler[addr];
 	ioh->ioWriteProc(ioh->clientData, val, addr);
 }
 
@@ -201,7 +204,7 @@ AVR8_ReadIO8(uint32_t addr)
 {
 	AVR8_Iohandler *ioh;
 	addr += 0x20;
-	ioh = gavr8.mmioHandler[addr];
+	ioh = gavr8->mmioHandler[addr];
 	return ioh->ioReadProc(ioh->clientData, addr);
 }
 
@@ -226,13 +229,13 @@ AVR8_WriteMem16(uint16_t value, int addr)
 static inline uint16_t
 AVR8_ReadAppMem(uint32_t word_addr)
 {
-	return gavr8.appmem[word_addr & gavr8.appmem_word_mask];
+	return gavr8->appmem[word_addr & gavr8->appmem_word_mask];
 }
 
 static inline uint8_t
 AVR8_ReadAppMem8(uint32_t byte_addr)
 {
-	return gavr8.appmem_byte[byte_addr & gavr8.appmem_byte_mask];
+	return gavr8->appmem_byte[byte_addr & gavr8->appmem_byte_mask];
 }
 
 /*
@@ -245,7 +248,7 @@ AVR8_ReadAppMem8(uint32_t byte_addr)
 static inline void
 AVR8_WriteAppMem8(uint8_t value, uint32_t byte_addr)
 {
-	gavr8.appmem_byte[byte_addr & gavr8.appmem_byte_mask] = value;
+	gavr8->appmem_byte[byte_addr & gavr8->appmem_byte_mask] = value;
 }
 
 void AVR8_RegisterIOHandler(uint32_t addr, AVR8_IoReadProc *, AVR8_IoWriteProc *, void *clientData);
@@ -258,36 +261,35 @@ AVR8_SkipInstruction(void)
 {
 	AVR8_Instruction *instr;
 	ICODE = AVR8_ReadAppMem(GET_REG_PC);
-	instr = AVR8_InstructionFind(ICODE);
+	instr = AVR8_InstructionFind(gavr8->idec, ICODE);
 	SET_REG_PC(GET_REG_PC + instr->length);
-	GlobalClock_ConsumeCycle(gavr8.lclk, instr->length);
 	CycleCounter += instr->length;
 }
 
 static inline void
 AVR8_PostSignal(uint32_t sig)
 {
-	gavr8.cpu_signals_raw |= sig;
-	gavr8.cpu_signals = gavr8.cpu_signals_raw & gavr8.cpu_signal_mask;
+	gavr8->cpu_signals_raw |= sig;
+	gavr8->cpu_signals = gavr8->cpu_signals_raw & gavr8->cpu_signal_mask;
 }
 
 static inline void
 AVR8_UnpostSignal(uint32_t sig)
 {
-	gavr8.cpu_signals_raw &= ~sig;
-	gavr8.cpu_signals = gavr8.cpu_signals_raw & gavr8.cpu_signal_mask;
+	gavr8->cpu_signals_raw &= ~sig;
+	gavr8->cpu_signals = gavr8->cpu_signals_raw & gavr8->cpu_signal_mask;
 }
 
 static inline void
 AVR8_RestartIdecoder(void)
 {
-	longjmp(gavr8.restart_idec_jump, 1);
+	longjmp(gavr8->restart_idec_jump, 1);
 }
 
 static inline void
 AVR8_Break(void)
 {
-	gavr8.dbg_state = AVRDBG_BREAK;
+	gavr8->dbg_state = AVRDBG_BREAK;
 	SET_REG_PC(GET_REG_PC - 1);
 	AVR8_PostSignal(AVR8_SIG_DBG);
 	AVR8_RestartIdecoder();
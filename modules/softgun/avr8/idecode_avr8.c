@@ -42,8 +42,7 @@
 #include "idecode_avr8.h"
 #include "sgstring.h"
 
-AVR8_InstructionProc **avr8_iProcTab = NULL;
-AVR8_Instruction **avr8_instrTab = NULL;
+static AVR8_IDecoder *avr8_decoders[2];
 
 /*
  **********************************************************
@@ -954,33 +953,48 @@ static AVR8_Instruction instrlist[] = {
      },
 };
 
-void
+AVR8_IDecoder *
 AVR8_IDecoderNew(uint32_t cpuVariant)
 {
+    AVR8_IDecoder *idec;
+    AVR8_InstructionProc **iProcTab;
+    AVR8_Instruction **instrTab;
     uint32_t icode;
     int j;
     int num_instr = sizeof(instrlist) / sizeof(AVR8_Instruction);
-    avr8_iProcTab = sg_calloc(sizeof(AVR8_InstructionProc *) * 0x10000);
-    avr8_instrTab = sg_calloc(sizeof(AVR8_Instruction *) * 0x10000);
+    for (j = 0; j < (int)array_size(avr8_decoders) && avr8_decoders[j]; j++) {
+        if (avr8_decoders[j]->cpuVariant == cpuVariant) {
+            return avr8_decoders[j];
+        }
+    }
+    if (j == (int)array_size(avr8_decoders)) {
+        fprintf(stderr, "Bug: Too many AVR8 decoder variants\n");
+        exit(1);
+    }
+    idec = avr8_decoders[j] = sg_new(AVR8_IDecoder);
+    idec->cpuVariant = cpuVariant;
+    iProcTab = idec->iProcTab = sg_calloc(sizeof(AVR8_InstructionProc *) * 0x10000);
+    instrTab = idec->instrTab = sg_calloc(sizeof(AVR8_Instruction *) * 0x10000);
     for (icode = 0; icode < 65536; icode++) {
         for (j = num_instr - 1; j >= 0; j--) {
             AVR8_Instruction *instr = &instrlist[j];
             if ((instr->cpuVariant & cpuVariant) != 0) {
                 if ((icode & instr->mask) == instr->opcode) {
-                    if (avr8_iProcTab[icode]) {
+                    if (iProcTab[icode]) {
                         fprintf(stdout, "conflict at %04x %s\n", icode, instr->name);
                     } else {
-                        avr8_iProcTab[icode] = instr->iproc;
-                        avr8_instrTab[icode] = instr;
+                        iProcTab[icode] = instr->iproc;
+                        instrTab[icode] = instr;
                     }
                 }
             }
         }
-        if (avr8_iProcTab[icode] == NULL) {
-            avr8_iProcTab[icode] = avr8_undef;
+        if (iProcTab[icode] == NULL) {
+            iProcTab[icode] = avr8_undef;
         }
     }
     fprintf(stderr, "AVR8 instruction decoder with %d Instructions created\n", num_instr);
+    return idec;
 }
 
 #ifdef TEST
@@ -17,19 +17,26 @@ typedef struct AVR8_Instruction {
     uint32_t cpuVariant;
 } AVR8_Instruction;
 
-extern AVR8_InstructionProc **avr8_iProcTab;
-extern AVR8_Instruction **avr8_instrTab;
-void AVR8_IDecoderNew(uint32_t cpuVariant);
+/*
+ * The decoder tables of a CPU variant, shared by all CPUs of the variant
+ */
+typedef struct AVR8_IDecoder {
+	uint32_t cpuVariant;
+	AVR8_InstructionProc **iProcTab;
+	AVR8_Instruction **instrTab;
+} AVR8_IDecoder;
+
+AVR8_IDecoder *AVR8_IDecoderNew(uint32_t cpuVariant);
 
 static inline AVR8_InstructionProc *
-AVR8_InstructionProcFind(uint16_t icode)
+AVR8_InstructionProcFind(const AVR8_IDecoder * idec, uint16_t icode)
 {
-	return avr8_iProcTab[icode];
+	return idec->iProcTab[icode];
 }
 
 static inline AVR8_Instruction *
-AVR8_InstructionFind(uint16_t icode)
+AVR8_InstructionFind(const AVR8_IDecoder * idec, uint16_t icode)
 {
-	return avr8_instrTab[icode];
+	return idec->instrTab[icode];
 }
 #endif
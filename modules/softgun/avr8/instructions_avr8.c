@@ -221,7 +221,7 @@ add8_flags(uint32_t op1, uint32_t op2, uint32_t result)
 	uint8_t sreg;
 	uint8_t flags;
 	unsigned int idx = (op1 >> 3) | ((op2 & 0xf8) << 2) | ((result & 0xf8) << 7);
-	flags = gavr8.add_flags[idx];
+	flags = gavr8->add_flags[idx];
 	sreg = GET_SREG;
 	sreg = (sreg & ~(FLG_V | FLG_S | FLG_Z | FLG_C | FLG_H | FLG_N)) | flags;
 	if (result == 0) {
@@ -235,7 +235,7 @@ sub8_flags(uint8_t op1, uint8_t op2, uint8_t result)
 {
 	unsigned int idx = (op1 >> 3) | ((op2 & 0xf8) << 2) | ((result & 0xf8) << 7);
 	uint8_t flags;
-	flags = gavr8.sub_flags[idx];
+	flags = gavr8->sub_flags[idx];
 	SET_SREG((GET_SREG & ~(FLG_V | FLG_S | FLG_C | FLG_H)) | flags);
 }
 
@@ -245,7 +245,7 @@ sub16_flags(uint16_t op1, uint16_t op2, uint16_t result)
 	unsigned int idx =
 	    ((op1 & 0xf800) >> 11) | ((op2 & 0xf800) >> 6) | ((result & 0xf800) >> 1);
 	uint8_t flags;
-	flags = gavr8.sub_flags[idx];
+	flags = gavr8->sub_flags[idx];
 	SET_SREG((GET_SREG & ~(FLG_V | FLG_S | FLG_C | FLG_H)) | flags);
 }
 
@@ -270,7 +270,6 @@ avr8_adc(void)
 	R = Rd + Rr + C;
 	AVR8_WriteReg(R, rd);
 	add8_flags(Rd, Rr, R);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -293,7 +292,6 @@ avr8_add(void)
 	R = Rd + Rr;
 	AVR8_WriteReg(R, rd);
 	add8_flags(Rd, Rr, R);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -322,7 +320,6 @@ avr8_adiw(void)
 	}
 	sreg |= flg_sign(sreg);
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -350,7 +347,6 @@ avr8_and(void)
 	sreg |= flg_zero(R);
 	sreg |= flg_sign(sreg);
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -376,7 +372,6 @@ avr8_andi(void)
 	sreg |= flg_zero(R);
 	sreg |= flg_sign(sreg);
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -404,7 +399,6 @@ avr8_asr(void)
 	sreg |= ((sreg << 1) ^ (sreg << 3)) & FLG_V;
 	sreg |= flg_sign(sreg);
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -425,7 +419,6 @@ avr8_bclr(void)
 	if (s == 7) {
 		AVR8_UpdateCpuSignals();
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -450,7 +443,6 @@ avr8_bld(void)
 		Rd &= ~(1 << b);
 	}
 	AVR8_WriteReg(Rd, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -471,10 +463,8 @@ avr8_brbc(void)
 	/* Sign extend from signed 7 to signed 8 Bit */
 	if (!(sreg & (1 << s))) {
 		SET_REG_PC(GET_REG_PC + k);
-		GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 		CycleCounter += 2;
 	} else {
-		GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 		CycleCounter += 1;
 	}
 }
@@ -496,10 +486,8 @@ avr8_brbs(void)
 	/* Sign extend from signed 7 to signed 8 Bit */
 	if ((sreg & (1 << s))) {
 		SET_REG_PC(GET_REG_PC + k);
-		GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 		CycleCounter += 2;
 	} else {
-		GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 		CycleCounter += 1;
 	}
 }
@@ -508,7 +496,6 @@ void
 avr8_break(void)
 {
 	fprintf(stderr, "avr8_break not implemented\n");
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 	AVR8_Break();
 }
@@ -532,7 +519,7 @@ avr8_bset(void)
 		if (!(sreg & (1 << 7))) {
 			//fprintf(stderr,"sei ******************** in %02x\n",GET_REG_PC << 1);
 			sreg |= (1 << 7);
-			gavr8.cpu_signals_raw |= AVR8_SIG_IRQENABLE;
+			gavr8->cpu_signals_raw |= AVR8_SIG_IRQENABLE;
 			/* Update CPU signals before setting SREG ! This makes it delayed */
 			AVR8_UpdateCpuSignals();
 			SET_SREG(sreg);
@@ -541,7 +528,6 @@ avr8_bset(void)
 		sreg |= (1 << s);
 		SET_SREG(sreg);
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -567,7 +553,6 @@ avr8_bst(void)
 		sreg &= ~FLG_T;
 	}
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -594,7 +579,6 @@ avr8_call(void)
 	AVR8_WriteMem8((nia >> 8) & 0xff, sp--);
 	SET_REG_SP(sp);
 	SET_REG_PC(k);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 4);
 	CycleCounter += 4;
 }
 
@@ -612,12 +596,10 @@ avr8_call_24(void)
 	AVR8_WriteMem8(nia & 0xff, sp--);
 	AVR8_WriteMem8((nia >> 8) & 0xff, sp--);
 	AVR8_WriteMem8((nia >> 16) & 0xff, sp--);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 	SET_REG_SP(sp);
 //      fprintf(stderr,"Call %04x at %04x\n",k << 1,GET_REG_PC << 1);
 	SET_REG_PC(k);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 4);
 	CycleCounter += 4;
 }
 
@@ -637,7 +619,6 @@ avr8_cbi(void)
 	uint8_t ioval = AVR8_ReadIO8(A);
 	ioval &= ~(1 << b);
 	AVR8_WriteIO8(ioval, A);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -662,7 +643,6 @@ avr8_com(void)
 	sreg |= flg_zero(Rd);
 	sreg |= flg_sign(sreg);
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -685,7 +665,6 @@ avr8_cp(void)
 	R = Rd - Rr;
 	sub8_flags(Rd, Rr, R);
 	SET_SREG((GET_SREG & ~FLG_Z) | flg_zero(R));
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -713,7 +692,6 @@ avr8_cpc(void)
 	if (R != 0) {
 		SET_SREG(GET_SREG & ~FLG_Z);
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -735,7 +713,6 @@ avr8_cpi(void)
 	R = Rd - K;
 	sub8_flags(Rd, K, R);
 	SET_SREG((GET_SREG & ~FLG_Z) | flg_zero(R));
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -756,7 +733,6 @@ avr8_cpse(void)
 	if (Rd == Rr) {
 		AVR8_SkipInstruction();
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -785,7 +761,6 @@ avr8_dec(void)
 	sreg |= flg_zero(R);
 	sreg |= flg_sign(sreg);
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -813,7 +788,6 @@ avr8_eicall(void)
 	AVR8_WriteMem8((pc >> 16) & 0xff, sp--);
 	SET_REG_SP(sp);
 	SET_REG_PC(addr);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 4);
 	CycleCounter += 4;
 }
 
@@ -834,7 +808,6 @@ avr8_eijmp(void)
 	eind = AVR8_ReadMem8(IOA_EIND);
 	addr = (eind << 16) | z;
 	SET_REG_PC(addr);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -883,7 +856,6 @@ avr8_elpm2(void)
 	addr = (rampz << 16) | z;
 	R = AVR8_ReadAppMem8(addr);
 	AVR8_WriteReg(R, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 }
 
@@ -914,7 +886,6 @@ avr8_elpm3(void)
 	z = addr & 0xffff;
 	RAMPZ = rampz;
 	AVR8_WriteReg16(z, NR_REG_Z);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 }
 
@@ -943,7 +914,6 @@ avr8_eor(void)
 	sreg |= flg_sign(sreg);
 	SET_SREG(sreg);
 	AVR8_WriteReg(R, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -976,7 +946,6 @@ avr8_fmul(void)
 	SET_SREG(sreg);
 	AVR8_WriteReg(R >> 8, 1);
 	AVR8_WriteReg(R & 0xff, 0);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1010,7 +979,6 @@ avr8_fmuls(void)
 	SET_SREG(sreg);
 	AVR8_WriteReg(R >> 8, 1);
 	AVR8_WriteReg(R & 0xff, 0);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1043,7 +1011,6 @@ avr8_fmulsu(void)
 	SET_SREG(sreg);
 	AVR8_WriteReg(R >> 8, 1);
 	AVR8_WriteReg(R & 0xff, 0);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1066,7 +1033,6 @@ avr8_icall(void)
 	AVR8_WriteMem8((pc >> 8) & 0xff, sp--);
 	SET_REG_SP(sp);
 	SET_REG_PC(z);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 }
 
@@ -1080,11 +1046,9 @@ avr8_icall_24(void)
 	AVR8_WriteMem8(pc & 0xff, sp--);
 	AVR8_WriteMem8((pc >> 8) & 0xff, sp--);
 	AVR8_WriteMem8((pc >> 16) & 0xff, sp--);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 	SET_REG_SP(sp);
 	SET_REG_PC(z);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 4);
 	CycleCounter += 4;
 }
 
@@ -1102,7 +1066,6 @@ avr8_ijmp(void)
 	uint16_t z;
 	z = AVR8_ReadReg16(NR_REG_Z);
 	SET_REG_PC(z);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1121,7 +1084,6 @@ avr8_in(void)
 	int rd = (icode >> 4) & 0x1f;
 	uint8_t in = AVR8_ReadIO8(a);
 	AVR8_WriteReg(in, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -1151,7 +1113,6 @@ avr8_inc(void)
 	sreg |= flg_zero(result);
 	sreg |= flg_sign(sreg);
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -1168,7 +1129,6 @@ avr8_jmp(void)
 {
 	uint16_t k = AVR8_ReadAppMem(GET_REG_PC);
 	SET_REG_PC(k);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 }
 
@@ -1180,7 +1140,6 @@ avr8_jmp_24(void)
 	uint32_t k;
 	k = icode2 | (((icode1 & 1) | ((icode1 >> 3) & 0x3e)) << 16);
 	SET_REG_PC(k);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 }
 
@@ -1202,7 +1161,6 @@ avr8_ld1(void)
 	uint16_t x = AVR8_ReadReg16(NR_REG_X);
 	Rd = AVR8_ReadMem8(x);
 	AVR8_WriteReg(Rd, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1226,7 +1184,6 @@ avr8_ld2(void)
 	AVR8_WriteReg(Rd, rd);
 	x++;
 	AVR8_WriteReg16(x, NR_REG_X);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1248,7 +1205,6 @@ avr8_ld3(void)
 	AVR8_WriteReg16(x, NR_REG_X);
 	Rd = AVR8_ReadMem8(x);
 	AVR8_WriteReg(Rd, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1271,7 +1227,6 @@ avr8_ldy2(void)
 	AVR8_WriteReg(Rd, rd);
 	y++;
 	AVR8_WriteReg16(y, NR_REG_Y);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1295,7 +1250,6 @@ avr8_ldy3(void)
 	AVR8_WriteReg16(y, NR_REG_Y);
 	Rd = AVR8_ReadMem8(y);
 	AVR8_WriteReg(Rd, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1320,7 +1274,6 @@ avr8_ldy4(void)
 	addr = (y + q) & 0xffff;
 	Rd = AVR8_ReadMem8(addr);
 	AVR8_WriteReg(Rd, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1343,7 +1296,6 @@ avr8_ldz2(void)
 	AVR8_WriteReg(Rd, rd);
 	z = z + 1;
 	AVR8_WriteReg16(z, NR_REG_Z);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1366,7 +1318,6 @@ avr8_ldz3(void)
 	AVR8_WriteReg16(z, NR_REG_Z);
 	Rd = AVR8_ReadMem8(z);
 	AVR8_WriteReg(Rd, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1391,7 +1342,6 @@ avr8_ldz4(void)
 	addr = (z + q) & 0xffff;
 	Rd = AVR8_ReadMem8(addr);
 	AVR8_WriteReg(Rd, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1409,7 +1359,6 @@ avr8_ldi(void)
 	uint8_t K = (icode & 0xf) | ((icode >> 4) & 0xf0);
 	int rd = ((icode >> 4) & 0xf) | 0x10;
 	AVR8_WriteReg(K, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -1432,7 +1381,6 @@ avr8_lds(void)
 	SET_REG_PC(GET_REG_PC + 1);
 	Rd = AVR8_ReadMem8(addr);
 	AVR8_WriteReg(Rd, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1451,7 +1399,6 @@ avr8_lpm1(void)
 	addr = AVR8_ReadReg16(NR_REG_Z);
 	pm = AVR8_ReadAppMem8(addr);
 	AVR8_WriteReg(pm, 0);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 }
 
@@ -1465,7 +1412,6 @@ avr8_lpm1_24(void)
 	addr |= (rampz << 16);
 	pm = AVR8_ReadAppMem8(addr);
 	AVR8_WriteReg(pm, 0);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 }
 
@@ -1488,7 +1434,6 @@ avr8_lpm2(void)
 	addr = AVR8_ReadReg16(NR_REG_Z);
 	pm = AVR8_ReadAppMem8(addr);
 	AVR8_WriteReg(pm, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 	//fprintf(stderr,"LPM2 %02x from %04x at %04x\n",pm,addr,GET_REG_PC << 1);
 }
@@ -1505,7 +1450,6 @@ avr8_lpm2_24(void)
 	addr |= (rampz << 16);
 	pm = AVR8_ReadAppMem8(addr);
 	AVR8_WriteReg(pm, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 	//fprintf(stderr,"LPM2 %02x from %04x at %04x\n",pm,addr,GET_REG_PC << 1);
 }
@@ -1530,7 +1474,6 @@ avr8_lpm3(void)
 	AVR8_WriteReg(pm, rd);
 	z++;
 	AVR8_WriteReg16(z, NR_REG_Z);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 }
 
@@ -1549,7 +1492,6 @@ avr8_lpm3_24(void)
 	AVR8_WriteReg(pm, rd);
 	addr = addr + 1;	/* No effect on RAMPZ ! */
 	AVR8_WriteReg16(addr & 0xffff, NR_REG_Z);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 }
 
@@ -1581,7 +1523,6 @@ avr8_lsr(void)
 		sreg |= FLG_Z;
 	}
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -1603,7 +1544,6 @@ avr8_mov(void)
 	rr = (icode & 0xf) | ((icode >> 5) & 0x10);
 	Rr = AVR8_ReadReg(rr);
 	AVR8_WriteReg(Rr, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -1626,7 +1566,6 @@ avr8_movw(void)
 	AVR8_WriteReg(Rr, rd + 1);
 	Rr = AVR8_ReadReg(rr);
 	AVR8_WriteReg(Rr, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -1660,7 +1599,6 @@ avr8_mul(void)
 		sreg |= FLG_Z;
 	}
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1693,7 +1631,6 @@ avr8_muls(void)
 		sreg |= FLG_Z;
 	}
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1728,7 +1665,6 @@ avr8_mulsu(void)
 		sreg |= FLG_Z;
 	}
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1750,7 +1686,6 @@ avr8_neg(void)
 	AVR8_WriteReg(result, rd);
 	sub8_flags(0, Rd, result);
 	SET_SREG((GET_SREG & ~FLG_Z) | flg_zero(result));
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -1765,7 +1700,6 @@ void
 avr8_nop(void)
 {
 	/* Do nothing */
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -1793,7 +1727,6 @@ avr8_or(void)
 	sreg |= flg_zero(R);
 	sreg |= flg_sign(sreg);
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -1820,7 +1753,6 @@ avr8_ori(void)
 	sreg |= flg_zero(R);
 	sreg |= flg_sign(sreg);
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -1839,7 +1771,6 @@ avr8_out(void)
 	int addr = (icode & 0xf) | ((icode >> 5) & 0x30);
 	uint8_t Rr = AVR8_ReadReg(rr);
 	AVR8_WriteIO8(Rr, addr);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 	//fprintf(stderr,"avr8_out: icode %04x at %04x: reg %02x, value %02x\n",icode,GET_REG_PC << 1,addr+0x20,Rr);
 }
@@ -1863,7 +1794,6 @@ avr8_pop(void)
 	Rd = AVR8_ReadMem8(sp);
 	AVR8_WriteReg(Rd, rd);
 	SET_REG_SP(sp);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1886,7 +1816,6 @@ avr8_push(void)
 	AVR8_WriteMem8(Rd, sp);
 	sp--;
 	SET_REG_SP(sp);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -1912,7 +1841,6 @@ avr8_rcall(void)
 	}
 	AVR8_WriteMem8(pc & 0xff, sp--);
 	AVR8_WriteMem8(pc >> 8, sp--);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 3);
 	CycleCounter += 3;
 	pc += k;
 	SET_REG_PC(pc);
@@ -1935,7 +1863,6 @@ avr8_rcall_24(void)
 	AVR8_WriteMem8(pc & 0xff, sp--);
 	AVR8_WriteMem8((pc >> 8) & 0xff, sp--);
 	AVR8_WriteMem8((pc >> 16) & 0xff, sp--);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 4);
 	CycleCounter += 4;
 	pc += k;
 	SET_REG_PC(pc);
@@ -1958,7 +1885,6 @@ avr8_ret(void)
 	pc |= AVR8_ReadMem8(++sp);
 	SET_REG_SP(sp);
 	SET_REG_PC(pc);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 4);
 	CycleCounter += 4;
 }
 
@@ -1972,7 +1898,6 @@ avr8_ret_24(void)
 	pc |= AVR8_ReadMem8(++sp);
 	SET_REG_SP(sp);
 	SET_REG_PC(pc);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 5);
 	CycleCounter += 5;
 }
 
@@ -1998,11 +1923,10 @@ avr8_reti(void)
 	 * reti proc on atmega. For xmega the reti proc is more complicated
 	 **************************************************************************
 	 */
-	if (gavr8.avrReti) {
-		gavr8.avrReti(gavr8.avrIrqData);
+	if (gavr8->avrReti) {
+		gavr8->avrReti(gavr8->avrIrqData);
 	}
 	AVR8_UpdateCpuSignals();
-	GlobalClock_ConsumeCycle(gavr8.lclk, 4);
 	CycleCounter += 4;
 }
 
@@ -2020,7 +1944,6 @@ avr8_reti_24(void)
 	SET_REG_PC(pc);
 	SET_SREG(sreg);
 	AVR8_UpdateCpuSignals();
-	GlobalClock_ConsumeCycle(gavr8.lclk, 5);
 	CycleCounter += 5;
 }
 
@@ -2039,7 +1962,6 @@ avr8_rjmp(void)
 	uint16_t pc = GET_REG_PC;
 	pc += k;
 	SET_REG_PC(pc);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2078,7 +2000,6 @@ avr8_ror(void)
 	sreg |= flg_sign(sreg);
 	AVR8_WriteReg(R, rd);
 	SET_SREG(sreg);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -2108,7 +2029,6 @@ avr8_sbc(void)
 	if (R != 0) {
 		SET_SREG(GET_SREG & ~FLG_Z);
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -2134,7 +2054,6 @@ avr8_sbci(void)
 	if (R != 0) {
 		SET_SREG(GET_SREG & ~FLG_Z);
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -2155,7 +2074,6 @@ avr8_sbi(void)
 	val = AVR8_ReadIO8(a);
 	val |= (1 << bit);
 	AVR8_WriteIO8(val, a);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2176,7 +2094,6 @@ avr8_sbic(void)
 	if (!(val & (1 << bit))) {
 		AVR8_SkipInstruction();
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -2197,7 +2114,6 @@ avr8_sbis(void)
 	if (val & (1 << bit)) {
 		AVR8_SkipInstruction();
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -2224,7 +2140,6 @@ avr8_sbiw(void)
 	} else {
 		SET_SREG(GET_SREG & ~FLG_Z);
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2245,7 +2160,6 @@ avr8_sbrc(void)
 	if (!(Rr & (1 << bit))) {
 		AVR8_SkipInstruction();
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -2267,22 +2181,34 @@ avr8_sbrs(void)
 	if (Rr & (1 << bit)) {
 		AVR8_SkipInstruction();
 	}
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
+/*
+ * -----------------------------------------------------------------------
+ * The sleep mode control registers differ between the AVR families and
+ * are not modeled, so every sleep is an idle sleep. The virtual time is
+ * skipped to the next CycleTimer until an enabled interrupt wakes up
+ * the CPU.
+ * -----------------------------------------------------------------------
+ */
 void
 avr8_sleep(void)
 {
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
-	fprintf(stderr, "avr8_sleep not implemented\n");
+	while (!(gavr8->cpu_signals_raw & AVR8_SIG_DBG)) {
+		if ((gavr8->cpu_signals_raw & AVR8_SIG_IRQ) && (GET_SREG & FLG_I)) {
+			break;
+		}
+		if (!CycleTimers_FastForward()) {
+			break;
+		}
+	}
 }
 
 void
 avr8_spm(void)
 {
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 	fprintf(stderr, "avr8_spm not implemented\n");
 }
@@ -2305,7 +2231,6 @@ avr8_st1(void)
 	Rr = AVR8_ReadReg(rr);
 	x = AVR8_ReadReg16(NR_REG_X);
 	AVR8_WriteMem8(Rr, x);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2330,7 +2255,6 @@ avr8_st2(void)
 	AVR8_WriteMem8(Rr, x);
 	x++;
 	AVR8_WriteReg16(x, NR_REG_X);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2353,7 +2277,6 @@ avr8_st3(void)
 	x--;
 	AVR8_WriteReg16(x, NR_REG_X);
 	AVR8_WriteMem8(Rr, x);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2377,7 +2300,6 @@ avr8_sty2(void)
 	AVR8_WriteMem8(Rr, y);
 	y++;
 	AVR8_WriteReg16(y, NR_REG_Y);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2401,7 +2323,6 @@ avr8_sty3(void)
 	y--;
 	AVR8_WriteReg16(y, NR_REG_Y);
 	AVR8_WriteMem8(Rr, y);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2426,7 +2347,6 @@ avr8_sty4(void)
 	y = AVR8_ReadReg16(NR_REG_Y);
 	addr = (y + q);
 	AVR8_WriteMem8(Rr, addr);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2451,7 +2371,6 @@ avr8_stz2(void)
 	AVR8_WriteMem8(Rr, z);
 	z++;
 	AVR8_WriteReg16(z, NR_REG_Z);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2475,7 +2394,6 @@ avr8_stz3(void)
 	z--;
 	AVR8_WriteReg16(z, NR_REG_Z);
 	AVR8_WriteMem8(Rr, z);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2504,7 +2422,6 @@ avr8_stz4(void)
 	   addr |= rampz << 16;
 	 */
 	AVR8_WriteMem8(Rr, addr);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2524,7 +2441,6 @@ avr8_sts(void)
 	SET_REG_PC(GET_REG_PC + 1);
 	Rr = AVR8_ReadReg(rr);
 	AVR8_WriteMem8(Rr, k);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 2);
 	CycleCounter += 2;
 }
 
@@ -2547,7 +2463,6 @@ avr8_sub(void)
 	AVR8_WriteReg(R, rd);
 	sub8_flags(Rd, Rr, R);
 	SET_SREG((GET_SREG & ~FLG_Z) | flg_zero(R));
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -2570,7 +2485,6 @@ avr8_subi(void)
 	AVR8_WriteReg(R, rd);
 	sub8_flags(Rd, k, R);
 	SET_SREG((GET_SREG & ~FLG_Z) | flg_zero(R));
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
@@ -2582,16 +2496,14 @@ avr8_swap(void)
 	uint8_t Rd = AVR8_ReadReg(rd);
 	Rd = ((Rd & 0xf) << 4) | ((Rd & 0xf0) >> 4);
 	AVR8_WriteReg(Rd, rd);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 	CycleCounter += 1;
 }
 
 void
 avr8_wdr(void)
 {
-	SigNode_Set(gavr8.wdResetNode, SIG_LOW);
-	SigNode_Set(gavr8.wdResetNode, SIG_HIGH);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 1);
+	SigNode_Set(gavr8->wdResetNode, SIG_LOW);
+	SigNode_Set(gavr8->wdResetNode, SIG_HIGH);
 	CycleCounter += 1;
 }
 
@@ -130,7 +130,7 @@ update_interrupts(ATM644_Timer0 * tm)
 	}
 	if (diff & TIMSK_OCIEA) {
 		if (ints & TIMSK_OCIEA) {
-			//fprintf(stderr,"Post ociea, raw %04x, sig %04x\n",gavr8.cpu_signals_raw,gavr8.cpu_signals);
+			//fprintf(stderr,"Post ociea, raw %04x, sig %04x\n",gavr8->cpu_signals_raw,gavr8->cpu_signals);
 			SigNode_Set(tm->compaIrq, SIG_LOW);
 		} else {
 			//fprintf(stderr,"UnPost ociea\n");
@@ -136,7 +136,7 @@ Pmic_SearchForInt(PMic * pmic)
 		}
 	}
 	pmic->nextIrq = NULL;
-	gavr8.cpu_signals_raw &= ~AVR8_SIG_IRQ;
+	gavr8->cpu_signals_raw &= ~AVR8_SIG_IRQ;
 	AVR8_UpdateCpuSignals();
 	AVR8_UnpostSignal(AVR8_SIG_IRQ);
 }
@@ -160,14 +160,13 @@ Pmic_Interrupt(void *irqData)
 		return;
 	}
 	//SendAckToIrqOwner;
-	//SigNode_Set(gavr8.irqAckNode[irqvect],SIG_LOW);
-	//SigNode_Set(gavr8.irqAckNode[irqvect],SIG_HIGH);
+	//SigNode_Set(gavr8->irqAckNode[irqvect],SIG_LOW);
+	//SigNode_Set(gavr8->irqAckNode[irqvect],SIG_HIGH);
 
 	AVR8_WriteMem8(pc & 0xff, sp--);
 	AVR8_WriteMem8((pc >> 8) & 0xff, sp--);
-	if (gavr8.pc24bit) {
+	if (gavr8->pc24bit) {
 		AVR8_WriteMem8((pc >> 16) & 0xff, sp--);
-		GlobalClock_ConsumeCycle(gavr8.lclk, 1);
 		CycleCounter += 1;
 	}
 	/* XMega does not clear Interrupt flag ! */
@@ -192,7 +191,6 @@ Pmic_Interrupt(void *irqData)
 	/* Search for higher level ints and evenutally unpost irq signal to cpu */
 	Pmic_SearchForInt(pmic);
 	SET_REG_SP(sp);
-	GlobalClock_ConsumeCycle(gavr8.lclk, 4);
 	CycleCounter += 4;
 	SET_REG_PC((irq->irqvect_no) << 1);
 }
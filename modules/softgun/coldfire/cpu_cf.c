@@ -103,7 +103,7 @@
 //==============================================================================
 //= Variables
 //==============================================================================
-CFCpu g_CFCpu;
+__THREAD_LOCAL__ CFCpu *g_CFCpu;
 
 
 //==============================================================================
@@ -123,8 +123,8 @@ static inline void
 CheckSignals(void)
 {
 #if 0
-	if (g_CFCpu.signals) {
-		if (likely(g_CFCpu.signals & CF_SIG_IRQ)) {
+	if (g_CFCpu->signals) {
+		if (likely(g_CFCpu->signals & CF_SIG_IRQ)) {
 			CF_Exception();
 		}
 	}
@@ -143,16 +143,22 @@ static Device_MPU_t *
 create(void)
 {
 	int32_t cpu_clock = 66000000;
+	uint32_t quantum_us = 0;
 	const char *instancename = "coldfire";
+	CFCpu *cf = LEIGUN_NEW(cf);
 	Device_MPU_t *dev = LEIGUN_NEW(dev);
-	dev->self = &g_CFCpu;
-	g_CFCpu.reg_D = &g_CFCpu.reg_GP[0];
-	g_CFCpu.reg_A = &g_CFCpu.reg_GP[8];
+	dev->self = cf;
+	/* The devices created next belong to this CPU */
+	g_CFCpu = cf;
+	cf->reg_D = &cf->reg_GP[0];
+	cf->reg_A = &cf->reg_GP[8];
 	Config_ReadInt32(&cpu_clock, "global", "cpu_clock");
 	CF_IDecoderNew();
 	cf_init_condition_tab();
-	GlobalClock_Registor(&run, dev, cpu_clock);
-	CycleTimers_Init(instancename, cpu_clock);
+	Config_ReadUInt32(&quantum_us, instancename, "clock_quantum_us");
+	GlobalClock_RegistorQuantum(&run, dev, cpu_clock,
+				    (uint64_t)quantum_us * 1000);
+	cf->timerDomain = CycleTimers_Init(instancename, cpu_clock);
 	fprintf(stderr, "Initialized Coldfire CPU with %d HZ\n", cpu_clock);
 	CF_SetRegPC(0);
 	CF_SetRegD(HWCONFIG_D0_MFC5282, 0);
@@ -167,11 +173,13 @@ run(GlobalClock_LocalClock_t *clk, void *data)
 	Device_MPU_t *dev = data;
 	InstructionProc *iproc;
 	uint32_t pc, sp;
+	g_CFCpu = dev->self;
 	sp = CF_MemRead32(0);
 	pc = CF_MemRead32(4);
 	CF_SetRegA(sp, 7);
 	CF_SetRegPC(pc);
 	fprintf(stderr, "Starting Coldfire CPU at 0x%08x\n", pc);
+	CycleTimers_SyncGlobalClock(g_CFCpu->timerDomain, clk);
 	while (1) {
 		pc = CF_GetRegPC();
 		ICODE = CF_MemRead16(pc);
@@ -179,7 +187,6 @@ run(GlobalClock_LocalClock_t *clk, void *data)
 		dump_instruction();
 		CF_SetRegPC(pc + 2);
 		iproc();
-		GlobalClock_ConsumeCycle(clk, 2);
 		CycleCounter += 2;	/* Should be moved to iprocs */
 		CycleTimers_Check();
 		CheckSignals();
@@ -195,29 +202,29 @@ CF_SetRegCR(uint32_t value, int reg)
 {
 	switch (reg) {
 	    case CR_REG_CACR:
-		    g_CFCpu.reg_CACR = value;
+		    g_CFCpu->reg_CACR = value;
 		    break;
 	    case CR_REG_ASID:
-		    g_CFCpu.reg_ASID = value;
+		    g_CFCpu->reg_ASID = value;
 		    break;
 	    case CR_REG_ACR0:
-		    g_CFCpu.reg_ACR[0] = value;
+		    g_CFCpu->reg_ACR[0] = value;
 		    break;
 	    case CR_REG_ACR1:
-		    g_CFCpu.reg_ACR[1] = value;
+		    g_CFCpu->reg_ACR[1] = value;
 		    break;
 	    case CR_REG_ACR2:
-		    g_CFCpu.reg_ACR[2] = value;
+		    g_CFCpu->reg_ACR[2] = value;
 		    break;
 	    case CR_REG_ACR3:
-		    g_CFCpu.reg_ACR[3] = value;
+		    g_CFCpu->reg_ACR[3] = value;
 		    break;
 	    case CR_REG_MMUBAR:
-		    g_CFCpu.reg_MMUBAR = value;
+		    g_CFCpu->reg_MMUBAR = value;
 		    break;
 
 	    case CR_REG_VBR:
-		    g_CFCpu.reg_VBR = value;
+		    g_CFCpu->reg_VBR = value;
 		    break;
 
 	    case CR_REG_PC:
@@ -227,13 +234,13 @@ CF_SetRegCR(uint32_t value, int reg)
 
 	    case CR_REG_FLASHBAR:
 		    fprintf(stderr, "CPU FLASHBAR 0x%08x\n", value);
-		    g_CFCpu.reg_FLASHBAR = value;
+		    g_CFCpu->reg_FLASHBAR = value;
 		    break;
 
 		    /* MCF5282 implements RAMBAR1 (0xc05) */
 	    case CR_REG_RAMBAR:
 		    fprintf(stderr, "CPU RAMBAR 0x%08x\n", value);
-		    g_CFCpu.reg_RAMBAR = value;
+		    g_CFCpu->reg_RAMBAR = value;
 		    break;
 
 	    case CR_REG_MPCR:
@@ -243,7 +250,7 @@ CF_SetRegCR(uint32_t value, int reg)
 		    break;
 
 	    case CR_REG_MBAR:
-		    g_CFCpu.reg_MBAR = value;
+		    g_CFCpu->reg_MBAR = value;
 		    break;
 
 	    case CR_REG_PCR1U0:
@@ -270,35 +277,35 @@ CF_GetRegCR(int reg)
 	uint32_t value = 0;
 	switch (reg) {
 	    case CR_REG_CACR:
-		    value = g_CFCpu.reg_CACR;
+		    value = g_CFCpu->reg_CACR;
 		    break;
 
 	    case CR_REG_ASID:
-		    value = g_CFCpu.reg_ASID;
+		    value = g_CFCpu->reg_ASID;
 		    break;
 
 	    case CR_REG_ACR0:
-		    value = g_CFCpu.reg_ACR[0];
+		    value = g_CFCpu->reg_ACR[0];
 		    break;
 
 	    case CR_REG_ACR1:
-		    value = g_CFCpu.reg_ACR[1];
+		    value = g_CFCpu->reg_ACR[1];
 		    break;
 
 	    case CR_REG_ACR2:
-		    value = g_CFCpu.reg_ACR[2];
+		    value = g_CFCpu->reg_ACR[2];
 		    break;
 
 	    case CR_REG_ACR3:
-		    value = g_CFCpu.reg_ACR[3];
+		    value = g_CFCpu->reg_ACR[3];
 		    break;
 
 	    case CR_REG_MMUBAR:
-		    value = g_CFCpu.reg_MMUBAR;
+		    value = g_CFCpu->reg_MMUBAR;
 		    break;
 
 	    case CR_REG_VBR:
-		    value = g_CFCpu.reg_VBR;
+		    value = g_CFCpu->reg_VBR;
 		    break;
 
 	    case CR_REG_PC:
@@ -307,11 +314,11 @@ CF_GetRegCR(int reg)
 		    break;
 
 	    case CR_REG_FLASHBAR:
-		    value = g_CFCpu.reg_RAMBAR;
+		    value = g_CFCpu->reg_RAMBAR;
 		    break;
 
 	    case CR_REG_RAMBAR:
-		    value = g_CFCpu.reg_RAMBAR;
+		    value = g_CFCpu->reg_RAMBAR;
 		    break;
 
 	    case CR_REG_MPCR:
@@ -321,7 +328,7 @@ CF_GetRegCR(int reg)
 		    break;
 
 	    case CR_REG_MBAR:
-		    value = g_CFCpu.reg_MBAR;
+		    value = g_CFCpu->reg_MBAR;
 		    break;
 
 	    case CR_REG_PCR1U0:
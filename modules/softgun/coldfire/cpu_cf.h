@@ -1,4 +1,6 @@
 #include <stdint.h>
+#include "compiler_extensions.h"
+#include "cycletimer.h"
 #include "coldfire/mem_cf.h"
 
 #define CR_REG_CACR	(2)
@@ -85,6 +87,7 @@ typedef struct {
 	uint32_t reg_FLASHBAR;	// device specific
 	uint32_t reg_RAMBAR;	// device specific
 	uint32_t reg_MBAR;	// device specific
+	CycleTimerDomain *timerDomain;
 } CFCpu;
 
 /* CCR Register Bitfield */
@@ -168,125 +171,125 @@ typedef struct {
 #define HWCONFIG_D0_MFC5282	(0xcf206080)
 #define HWCONFIG_D1_MFC5282	(0x13b01080)
 
-extern CFCpu g_CFCpu;
+extern __THREAD_LOCAL__ CFCpu *g_CFCpu;
 
-#define CF_REG_CCR (g_CFCpu.reg_CCR)
-#define CF_REG_MACSR (g_CFCpu.reg_macSR)
+#define CF_REG_CCR (g_CFCpu->reg_CCR)
+#define CF_REG_MACSR (g_CFCpu->reg_macSR)
 
-#define ICODE g_CFCpu.icode
+#define ICODE g_CFCpu->icode
 
 static inline int
 CF_IsSupervisor(void)
 {
-	return !!(g_CFCpu.reg_CCR & CCRS_S);
+	return !!(g_CFCpu->reg_CCR & CCRS_S);
 }
 
 static inline uint32_t
 CF_GetRegOtherA7(void)
 {
-	return g_CFCpu.reg_OTHER_A7;
+	return g_CFCpu->reg_OTHER_A7;
 }
 
 static inline void
 CF_SetRegOtherA7(uint32_t value)
 {
-	g_CFCpu.reg_OTHER_A7 = value;
+	g_CFCpu->reg_OTHER_A7 = value;
 }
 
 static inline void
 CF_SetRegSR(uint16_t value)
 {
-	uint32_t diff = g_CFCpu.reg_CCR ^ value;
+	uint32_t diff = g_CFCpu->reg_CCR ^ value;
 	if (diff & CCRS_S) {
-		uint32_t tmp = g_CFCpu.reg_OTHER_A7;
-		g_CFCpu.reg_OTHER_A7 = g_CFCpu.reg_A[7];
-		g_CFCpu.reg_A[7] = tmp;
+		uint32_t tmp = g_CFCpu->reg_OTHER_A7;
+		g_CFCpu->reg_OTHER_A7 = g_CFCpu->reg_A[7];
+		g_CFCpu->reg_A[7] = tmp;
 	}
-	g_CFCpu.reg_CCR = value;
+	g_CFCpu->reg_CCR = value;
 }
 
 static inline uint32_t
 CF_GetReg(int reg)
 {
-	return g_CFCpu.reg_GP[reg];
+	return g_CFCpu->reg_GP[reg];
 }
 
 static inline uint32_t
 CF_GetRegA(int reg)
 {
-	return g_CFCpu.reg_A[reg];
+	return g_CFCpu->reg_A[reg];
 }
 
 static inline uint32_t
 CF_GetRegD(int reg)
 {
-	return g_CFCpu.reg_D[reg];
+	return g_CFCpu->reg_D[reg];
 }
 
 static inline void
 CF_SetReg(uint32_t value, int reg)
 {
-	g_CFCpu.reg_GP[reg] = value;
+	g_CFCpu->reg_GP[reg] = value;
 }
 
 static inline void
 CF_SetRegA(uint32_t value, int reg)
 {
-	g_CFCpu.reg_A[reg] = value;
+	g_CFCpu->reg_A[reg] = value;
 }
 
 static inline void
 CF_SetRegD(uint32_t value, int reg)
 {
-	g_CFCpu.reg_D[reg] = value;
+	g_CFCpu->reg_D[reg] = value;
 }
 
 static inline void
 CF_SetRegPC(uint32_t value)
 {
-	g_CFCpu.reg_PC = value;
+	g_CFCpu->reg_PC = value;
 }
 
 static inline uint32_t
 CF_GetRegPC(void)
 {
-	return g_CFCpu.reg_PC;
+	return g_CFCpu->reg_PC;
 }
 
 static inline void
 CF_SetRegMacAcc(uint32_t value)
 {
-	g_CFCpu.reg_macACC = value;
+	g_CFCpu->reg_macACC = value;
 }
 
 static inline uint32_t
 CF_GetRegMacAcc(void)
 {
-	return g_CFCpu.reg_macACC;
+	return g_CFCpu->reg_macACC;
 }
 
 static inline void
 CF_SetRegMacSr(uint32_t value)
 {
-	g_CFCpu.reg_macSR = value;
+	g_CFCpu->reg_macSR = value;
 }
 
 static inline uint32_t
 CF_GetRegMacSr(void)
 {
-	return g_CFCpu.reg_macSR;
+	return g_CFCpu->reg_macSR;
 }
 
 static inline void
 CF_SetRegMacMask(uint32_t value)
 {
-	g_CFCpu.reg_macMASK = value;
+	g_CFCpu->reg_macMASK = value;
 }
 
 static inline uint32_t
 CF_GetRegMacMask(void)
 {
-	return g_CFCpu.reg_macMASK;
+	return g_CFCpu->reg_macMASK;
 }
 
 void CF_SetRegCR(uint32_t value, int reg);
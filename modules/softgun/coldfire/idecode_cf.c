@@ -19,7 +19,7 @@
 #include "instructions_cf.h"
 #include "sgstring.h"
 
-InstructionProc **iProcTab;
+InstructionProc **cfIProcTab;
 typedef struct IDecoder {
 	Instruction *instr[0x10000];
 } IDecoder;
@@ -153,16 +153,21 @@ CF_IDecoderNew()
 {
 	int i, j;
 	int nr_instructions = sizeof(instrlist) / sizeof(Instruction);
-	IDecoder *idec = sg_new(IDecoder);
+	IDecoder *idec;
+	if (cfIProcTab) {
+		/* The tables are shared by all ColdFire CPUs */
+		return;
+	}
+	idec = sg_new(IDecoder);
 	s_idec = idec;
-	iProcTab = sg_calloc(0x10000 * sizeof(InstructionProc *));
+	cfIProcTab = sg_calloc(0x10000 * sizeof(InstructionProc *));
 	for (i = 0; i < 0x10000; i++) {
 		for (j = 0; j < nr_instructions; j++) {
 			Instruction *instr = &instrlist[j];
 			if ((i & instr->mask) == instr->icode) {
 				if (!idec->instr[i]) {
 					idec->instr[i] = instr;
-					iProcTab[i] = instr->proc;
+					cfIProcTab[i] = instr->proc;
 				} else {
 					uint16_t mask = idec->instr[i]->mask & instr->mask;
 					if (idec->instr[i]->mask == instr->mask) {
@@ -178,7 +183,7 @@ CF_IDecoderNew()
 						 */
 					} else if (mask == idec->instr[i]->mask) {
 						idec->instr[i] = instr;
-						iProcTab[i] = instr->proc;
+						cfIProcTab[i] = instr->proc;
 					} else {
 						fprintf(stderr,
 							"Can not decide %s(%04x) %s(%04x) \n",
@@ -190,7 +195,7 @@ CF_IDecoderNew()
 		}
 		if (idec->instr[i] == NULL) {
 			idec->instr[i] = &instr_undefined;
-			iProcTab[i] = cf_undefined;
+			cfIProcTab[i] = cf_undefined;
 		}
 	}
 	fprintf(stderr, "Coldfire Instruction decoder created\n");
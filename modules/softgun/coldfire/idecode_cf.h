@@ -1,7 +1,7 @@
 #include <stdint.h>
 
 typedef void InstructionProc(void);
-extern InstructionProc **iProcTab;
+extern InstructionProc **cfIProcTab;
 
 typedef struct Instruction {
 	uint16_t mask;
@@ -15,7 +15,7 @@ void CF_IDecoderNew();
 static inline InstructionProc *
 InststructionProcFind(uint16_t icode)
 {
-	return iProcTab[icode];
+	return cfIProcTab[icode];
 }
 
 Instruction *CF_InstructionFind(uint16_t icode);
@@ -36,6 +36,7 @@
  */
 
 #include <errno.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
@@ -44,6 +45,7 @@
 #include "configfile.h"
 #include "at91_aic.h"
 #include "sgstring.h"
+#include "snapshot.h"
 
 #if 0
 #define dbgprintf(...) { fprintf(stderr,__VA_ARGS__); }
@@ -728,6 +730,35 @@ AT91Aic_UnMap(void *owner, uint32_t base, uint32_t mask)
 
 }
 
+/*
+ * ------------------------------------------------------------------
+ * Snapshot: The registers and the priority stack. The outputs
+ * are updated from the restored state.
+ * ------------------------------------------------------------------
+ */
+#define AIC_STATE_START	offsetof(AT91Aic, stack_irqn)
+#define AIC_STATE_END	(offsetof(AT91Aic, regDCR) + sizeof(uint32_t))
+
+static void
+AT91Aic_SaveState(void *owner, Snapshot_t * ss)
+{
+	AT91Aic *aic = owner;
+	Snapshot_Write(ss, (uint8_t *) aic + AIC_STATE_START, AIC_STATE_END - AIC_STATE_START);
+}
+
+static int
+AT91Aic_LoadState(void *owner, Snapshot_t * ss)
+{
+	AT91Aic *aic = owner;
+	if (Snapshot_Read(ss, (uint8_t *) aic + AIC_STATE_START,
+			  AIC_STATE_END - AIC_STATE_START) < 0) {
+		return -1;
+	}
+	update_ipr(aic);
+	update_interrupts(aic);
+	return 0;
+}
+
 BusDevice *
 AT91Aic_New(const char *name)
 {
@@ -767,6 +798,7 @@ AT91Aic_New(const char *name)
 	aic->bdev.UnMap = AT91Aic_UnMap;
 	aic->bdev.owner = aic;
 	aic->bdev.hw_flags = MEM_FLAG_WRITABLE | MEM_FLAG_READABLE;
+	Snapshot_RegisterState(name, AT91Aic_SaveState, AT91Aic_LoadState, aic);
 	fprintf(stderr, "AT91 AIC \"%s\" created\n", name);
 	return &aic->bdev;
 }
@@ -51,6 +51,7 @@
 #include "cycletimer.h"
 #include "sgstring.h"
 #include "linux-tap.h"
+#include "framering.h"
 
 #include "asyncmanager.h"
 
@@ -60,6 +61,10 @@
 #define dbgprintf(...)
 #endif
 
+#define RX_RING_FRAMES	(64)
+#define TX_RING_FRAMES	(32)
+#define TX_FLUSH_NS	(10000)	/* Frames sent within 10 us are written together */
+
 #define ETH_CTL(base)	((base)+0)
 #define		CTL_BP		(1<<8)
 #define		CTL_WES		(1<<7)
@@ -219,6 +224,9 @@ typedef struct AT91Emac {
 	BusDevice bdev;
 	int ether_fd;
 	PollHandle_t *input_fh;
+	FrameRing *rxRing;
+	FrameRing *txRing;
+	NetCapture *capture;
 	int receiver_is_enabled;
 	PHY_Device *phy[MAX_PHYS];
 	CycleTimer rcvDelayTimer;
@@ -332,7 +340,7 @@ match_address(AT91Emac * emac, uint8_t * packet)
 #define RBF_OWNER	(1<<0)	/* 1 = software owned */
 #define RBF_WRAP	(1<<1)
 #define RBF_ADDR	(0xfffffffc)
-static void
+static int
 dma_write_packet(AT91Emac * emac, uint8_t * buf, int count, uint32_t matchflags)
 {
 	uint32_t rba, rbstat;
@@ -346,7 +354,7 @@ dma_write_packet(AT91Emac * emac, uint8_t * buf, int count, uint32_t matchflags)
 		emac->isr |= ISR_RBNA;
 		emac->rsr |= RSR_BNA;
 		update_interrupt(emac);
-		return;
+		return -1;
 	}
 	Bus_Write((rba & RBF_ADDR), buf, count);
 	Bus_Write32(rba | RBF_OWNER, descr_addr);
@@ -358,44 +366,58 @@ dma_write_packet(AT91Emac * emac, uint8_t * buf, int count, uint32_t matchflags)
 	} else {
 		emac->rbdscr_offs += 8;
 	}
+	return 0;
 }
 
+/*
+ * -------------------------------------------------------------------------
+ * All pending frames are received in one batch with one interrupt. The
+ * receiver is disabled for the wire time of the batch.
+ * -------------------------------------------------------------------------
+ */
 static void
 input_event(PollHandle_t *handle, int status, int events, void *clientdata)
 {
 	AT91Emac *emac = clientdata;
-	int result;
-	uint8_t buf[1522];
+	uint8_t *buf;
+	unsigned int len;
 	uint32_t matchflags;
-	while (emac->receiver_is_enabled) {
-		result = read(emac->ether_fd, buf, 1522);
-		if (result > 0) {
-			matchflags = match_address(emac, buf);
-			if (!matchflags && !(emac->cfg & CFG_CAF)) {
-				fprintf(stderr, "no mac match, continue\n");
-				continue;
-			}
-			if ((result > (1522 - 4)) && !(emac->cfg & CFG_BIG)) {
-				fprintf(stderr, "BIG PACKET\n");	// jk
-				continue;
-			}
-			if (result < 60) {
-				dma_write_packet(emac, buf, 60, matchflags);
-			} else {
-				dma_write_packet(emac, buf, result, matchflags);
-			}
-			emac->isr |= ISR_RCOM;
-			emac->rsr |= RSR_REC;
-			emac->ok++;
-			update_interrupt(emac);
-			disable_receiver(emac);
-			CycleTimer_Mod(&emac->rcvDelayTimer, NanosecondsToCycles(result * 100));
+	uint32_t bytes = 0;
+	if (FrameRing_Receive(emac->rxRing) < 0) {
+		return;
+	}
+	while ((buf = FrameRing_Peek(emac->rxRing, &len))) {
+		matchflags = match_address(emac, buf);
+		if (!matchflags && !(emac->cfg & CFG_CAF)) {
+			fprintf(stderr, "no mac match, continue\n");
+			FrameRing_Pop(emac->rxRing);
+			continue;
+		}
+		if ((len > (1522 - 4)) && !(emac->cfg & CFG_BIG)) {
+			fprintf(stderr, "BIG PACKET\n");	// jk
+			FrameRing_Pop(emac->rxRing);
+			continue;
+		}
+		if (len < 60) {
+			memset(buf + len, 0, 60 - len);
+			len = 60;
+		}
+		if (dma_write_packet(emac, buf, len, matchflags) < 0) {
+			/* No receive buffer, the rest of the batch is lost */
+			FrameRing_Clear(emac->rxRing);
 			break;
-		} else {
-			return;
 		}
+		FrameRing_Pop(emac->rxRing);
+		emac->ok++;
+		bytes += len;
+	}
+	if (bytes) {
+		emac->isr |= ISR_RCOM;
+		emac->rsr |= RSR_REC;
+		update_interrupt(emac);
+		disable_receiver(emac);
+		CycleTimer_Mod(&emac->rcvDelayTimer, NanosecondsToCycles(bytes * 100));
 	}
-	return;
 }
 
 static void
@@ -431,7 +453,7 @@ transmit_packet(AT91Emac * emac)
 		memset(buf + len, 0x00, 60 - len);
 		len = 60;
 	}
-	if (write(emac->ether_fd, buf, len) == len) {
+	if (FrameRing_Queue(emac->txRing, buf, len) == 0) {
 		emac->fra++;
 	}
 	emac->isr |= ISR_TCOM | ISR_TIDLE;
@@ -1238,6 +1260,12 @@ AT91Emac_New(const char *name)
 	AT91Emac *emac = sg_new(AT91Emac);
 	emac->ether_fd = Net_CreateInterface(name);
 	emac->input_fh = AsyncManager_PollInit(emac->ether_fd);
+	emac->rxRing = FrameRing_New(emac->ether_fd, RX_RING_FRAMES);
+	emac->txRing = FrameRing_New(emac->ether_fd, TX_RING_FRAMES);
+	FrameRing_SetFlushDelay(emac->txRing, TX_FLUSH_NS);
+	emac->capture = NetCapture_New(name);
+	FrameRing_SetCapture(emac->rxRing, emac->capture);
+	FrameRing_SetCapture(emac->txRing, emac->capture);
 	emac->irqNode = SigNode_New("%s.irq", name);
 	if (!emac->irqNode) {
 		fprintf(stderr, "AT91Emac: Can't create interrupt request line\n");
@@ -52,6 +52,7 @@
 #include "sgstring.h"
 #include "crc32.h"
 #include "linux-tap.h"
+#include "netcapture.h"
 
 #include "asyncmanager.h"
 
@@ -248,6 +249,7 @@
 typedef struct AT91Emacb {
 	BusDevice bdev;
 	int ether_fd;
+	NetCapture *capture;
 	PollHandle_t *input_fh;
 	int receiver_is_enabled;
 	PHY_Device *phy[MAX_PHYS];
@@ -379,6 +381,7 @@ transmit_pkt(AT91Emacb * emac)
 				memset(pkt + pktsize, 0x00, 60 - pktsize);
 				pktsize = 60;
 			}
+			NetCapture_Frame(emac->capture, NETCAPTURE_TX, pkt, pktsize);
 			if (write(emac->ether_fd, pkt, pktsize) == pktsize) {
 				//emac->fra++;
 				emac->regTSR |= TSR_COMP;
@@ -609,6 +612,7 @@ input_event(PollHandle_t *handle, int status, int events, void *clientdata)
 	while (emac->receiver_is_enabled) {
 		result = read(emac->ether_fd, buf, 1532);
 		if (result > 0) {
+			NetCapture_Frame(emac->capture, NETCAPTURE_RX, buf, result);
 			if (result < 60) {
 				/* PAD with 0 */
 				memset(buf + result, 0, 60 - result);
@@ -1638,6 +1642,7 @@ AT91Emacb_New(const char *name)
 {
 	AT91Emacb *emac = sg_new(AT91Emacb);
 	emac->ether_fd = Net_CreateInterface(name);
+	emac->capture = NetCapture_New(name);
 	emac->input_fh = AsyncManager_PollInit(emac->ether_fd);
 	emac->irqNode = SigNode_New("%s.irq", name);
 	if (!emac->irqNode) {
@@ -80,12 +80,6 @@
 #define LCDC_LCD_IRR(base)	((base) + 0x864)
 #define LCDC_LUT_ENTRY(base,x)	((base) + 0xc00 + ((x) << 2))
 
-#define UPDATE_FIFO_SIZE        (512)
-#define UPDATE_FIFO_MASK        (UPDATE_FIFO_SIZE-1)
-#define UPDATE_FIFO_RP(lcdc)	((lcdc)->updateFifoRp & UPDATE_FIFO_MASK)
-#define UPDATE_FIFO_WP(lcdc)	((lcdc)->updateFifoWp & UPDATE_FIFO_MASK)
-#define UPDATE_FIFO_COUNT(lcdc) ((lcdc)->updateFifoWp - (lcdc)->updateFifoRp)
-
 typedef struct AT91Lcdc {
 	BusDevice bdev;
 	uint32_t regDMABADDR1;
@@ -121,55 +115,45 @@ typedef struct AT91Lcdc {
 	uint32_t regLCD_IRR;
 	uint32_t regLUT[256];
 
-	uint32_t pageSize;
-	uint32_t updateFifo[UPDATE_FIFO_SIZE];
-	uint64_t updateFifoWp;
-	uint64_t updateFifoRp;
 	FbDisplay *display;
 	CycleTimer updateTimer;
 	uint32_t traceStart;
 	uint32_t traceLength;
+	BusDirtyMap *dirtyMap;
 } AT91Lcdc;
 
+static void
+update_range(void *clientData, uint32_t addr, uint8_t * hva, uint32_t len)
+{
+	AT91Lcdc *lcdc = (AT91Lcdc *) clientData;
+	FbUpdateRequest fbudrq;
+	fbudrq.offset = addr - lcdc->regDMABADDR1;
+	fbudrq.count = len;
+	fbudrq.fbdata = hva;
+	//fprintf(stderr,"UDRQ, offs %08x\n",fbudrq.offset);
+	FbDisplay_UpdateRequest(lcdc->display, &fbudrq);
+}
+
 /*
  ******************************************************************
- * This event handler is called by the Timer about 10ms after
- * a page was modified or if the update fifo is full.
- * It reinstalls the Memory trace
+ * This event handler is called by the Timer about 15ms after
+ * the first write to the framebuffer. It sends the dirty
+ * parts to the display and reinstalls the Memory trace
  ******************************************************************
  */
 static void
 update_display(void *clientData)
 {
 	AT91Lcdc *lcdc = (AT91Lcdc *) clientData;
-	uint32_t addr;
-	uint8_t *data;
-	FbUpdateRequest fbudrq;
-	while (UPDATE_FIFO_COUNT(lcdc) > 0) {
-		addr = lcdc->updateFifo[UPDATE_FIFO_RP(lcdc)];
-		addr &= ~(lcdc->pageSize - 1);
-		Mem_TracePage(addr);
-		lcdc->updateFifoRp++;
-		data = Bus_GetHVARead(addr);
-		if (data) {
-			fbudrq.offset = addr - lcdc->regDMABADDR1;
-			fbudrq.count = lcdc->pageSize;
-			fbudrq.fbdata = data;
-			//fprintf(stderr,"UDRQ, offs %08x\n",fbudrq.offset);
-			FbDisplay_UpdateRequest(lcdc->display, &fbudrq);
-		}
+	if (lcdc->dirtyMap) {
+		Mem_DirtyMapDrain(lcdc->dirtyMap, update_range, lcdc);
 	}
 }
 
 static void
-lcdc_mem_trace(void *clientData, uint32_t value, uint32_t addr, int rqlen)
+lcdc_fb_dirty(void *clientData)
 {
 	AT91Lcdc *lcdc = (AT91Lcdc *) clientData;
-	if (UPDATE_FIFO_COUNT(lcdc) == UPDATE_FIFO_SIZE) {
-		update_display(lcdc);
-	}
-	lcdc->updateFifo[UPDATE_FIFO_WP(lcdc)] = addr;
-	lcdc->updateFifoWp++;
 	if (!CycleTimer_IsActive(&lcdc->updateTimer)) {
 		CycleTimer_Mod(&lcdc->updateTimer, MillisecondsToCycles(15));
 	}
@@ -214,7 +198,6 @@ update_memory_traces(AT91Lcdc * lcdc)
 	unsigned int height, width;
 	unsigned int bipp, length;
 	uint32_t startAddr;
-	uint32_t i;
 	width = (lcdc->regLCDFRMCFG >> 21 & 0x7ff) + 1;
 	height = (lcdc->regLCDFRMCFG & 0x7ff) + 1;
 	startAddr = lcdc->regDMABADDR1;
@@ -223,9 +206,9 @@ update_memory_traces(AT91Lcdc * lcdc)
 	if ((lcdc->traceLength == length) && (lcdc->traceStart == startAddr)) {
 		return;
 	}
-	if (lcdc->traceLength) {
-		IOH_DeleteRegion(lcdc->traceStart, lcdc->traceLength);
-		Mem_UntraceRegion(lcdc->traceStart, lcdc->traceLength);
+	if (lcdc->dirtyMap) {
+		Mem_DirtyMapDelete(lcdc->dirtyMap);
+		lcdc->dirtyMap = NULL;
 		lcdc->traceLength = lcdc->traceStart = 0;
 	}
 	fprintf(stderr, "start 0x%08x %ux%u, length %u\n", startAddr, width, height, length);
@@ -237,18 +220,10 @@ update_memory_traces(AT91Lcdc * lcdc)
 		return;
 	}
 	fprintf(stderr, "Tracing memory at %08x, len %u\n", startAddr, length);
-	/* Clear all outstanding updates */
-	lcdc->updateFifoRp = lcdc->updateFifoWp;
-	IOH_NewRegion(startAddr, length, NULL, lcdc_mem_trace, 0, lcdc);
 	lcdc->traceLength = length;
 	lcdc->traceStart = startAddr;
-	/* 
-	 * Trigger the trace a first time because all pages are dirty 
-	 * after address change 
-	 */
-	for (i = 0; i < length; i += lcdc->pageSize) {
-		lcdc_mem_trace(lcdc, 0, i + startAddr, 0);
-	}
+	/* All pages are dirty after an address change */
+	lcdc->dirtyMap = Mem_DirtyMapNew(startAddr, length, lcdc_fb_dirty, lcdc);
 }
 
 /**
@@ -945,7 +920,6 @@ AT91Lcdc_New(const char *name, FbDisplay * display)
 	lcdc->bdev.owner = lcdc;
 	lcdc->bdev.hw_flags = MEM_FLAG_WRITABLE | MEM_FLAG_READABLE;
 	lcdc->display = display;
-	lcdc->pageSize = Mem_SmallPageSize();
 	lcdc->traceLength = lcdc->traceStart = 0;
 	CycleTimer_Init(&lcdc->updateTimer, update_display, lcdc);
 	update_fbformat(lcdc);
@@ -44,6 +44,7 @@
 #include "cycletimer.h"
 #include "clock.h"
 #include "senseless.h"
+#include "snapshot.h"
 
 #define PIT_MR(base)	((base) + 0x00)
 #define		MR_PITIEN	(1 << 25)
@@ -259,6 +260,35 @@ AT91Pit_UnMap(void *owner, uint32_t base, uint32_t mask)
 	IOH_Delete32(PIT_PIIR(base));
 }
 
+static void
+AT91Pit_SaveState(void *owner, Snapshot_t * ss)
+{
+	AT91Pit *pit = owner;
+	Snapshot_Write(ss, &pit->regMR, sizeof(pit->regMR));
+	Snapshot_Write(ss, &pit->regSR, sizeof(pit->regSR));
+	Snapshot_Write(ss, &pit->regPIVR, sizeof(pit->regPIVR));
+	Snapshot_Write(ss, &pit->lastActualizeCycles, sizeof(pit->lastActualizeCycles));
+	Snapshot_Write(ss, &pit->accCycles, sizeof(pit->accCycles));
+	Snapshot_WriteTimer(ss, &pit->eventTimer);
+}
+
+static int
+AT91Pit_LoadState(void *owner, Snapshot_t * ss)
+{
+	AT91Pit *pit = owner;
+	if ((Snapshot_Read(ss, &pit->regMR, sizeof(pit->regMR)) < 0)
+	    || (Snapshot_Read(ss, &pit->regSR, sizeof(pit->regSR)) < 0)
+	    || (Snapshot_Read(ss, &pit->regPIVR, sizeof(pit->regPIVR)) < 0)
+	    || (Snapshot_Read(ss, &pit->lastActualizeCycles,
+			      sizeof(pit->lastActualizeCycles)) < 0)
+	    || (Snapshot_Read(ss, &pit->accCycles, sizeof(pit->accCycles)) < 0)
+	    || (Snapshot_ReadTimer(ss, &pit->eventTimer) < 0)) {
+		return -1;
+	}
+	update_interrupt(pit);
+	return 0;
+}
+
 BusDevice *
 AT91Pit_New(const char *name)
 {
@@ -278,6 +308,7 @@ AT91Pit_New(const char *name)
 	CycleTimer_Init(&pit->eventTimer, timer_event, pit);
 	Clock_MakeDerived(pit->clkPit, pit->clkIn, 1, 16);
 	update_interrupt(pit);
+	Snapshot_RegisterState(name, AT91Pit_SaveState, AT91Pit_LoadState, pit);
 	fprintf(stderr, "AT91 PIT \"%s\" created\n", name);
 	return &pit->bdev;
 }
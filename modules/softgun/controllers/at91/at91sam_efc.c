@@ -40,6 +40,7 @@
 #include <configfile.h>
 #include <ctype.h>
 #include <at91sam_efc.h>
+#include <snapshot.h>
 
 typedef struct Efc {
 	BusDevice efcdev;
@@ -126,6 +127,8 @@ AT91SAM7_EfcNew(BusDevice ** flash, BusDevice ** efcdev, const char *efcname, co
 			exit(42);
 		}
 		efc->host_mem = DiskImage_Mmap(efc->disk_image);
+		/* The controller has no registers, the flash contents are its state */
+		Snapshot_RegisterMemory(flashname, efc, efc->host_mem, efc->size);
 	}
 	efc->efcdev.first_mapping = NULL;
 	efc->efcdev.Map = AT91Efc_Map;
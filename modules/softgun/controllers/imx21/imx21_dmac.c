@@ -380,6 +380,36 @@ dma_write(DMAChan * chan, int dmod, int dsiz)
 	}
 }
 
+/*
+ * -----------------------------------------------------------------------
+ * Memory to memory transfer between linear addresses.
+ * Copies span by span as long as source and destination are memory.
+ * The rest (IO or an unaligned end) is left to the element loop.
+ * -----------------------------------------------------------------------
+ */
+static void
+dma_copy_linear(DMAChan * chan, int ssiz, int dsiz)
+{
+	uint32_t elem = ((ssiz > dsiz) ? ssiz : dsiz) >> 3;
+	uint32_t len, rlen, wlen;
+	uint8_t *src, *dst;
+	while (chan->ccnr < chan->cntr) {
+		len = chan->cntr - chan->ccnr;
+		rlen = Bus_GetReadSpan(chan->sar + chan->ccnr, len, &src);
+		wlen = Bus_GetWriteSpan(chan->dar + chan->ccnr, len, &dst);
+		if (!src || !dst) {
+			return;
+		}
+		len = (rlen < wlen) ? rlen : wlen;
+		len -= len % elem;
+		if (!len) {
+			return;
+		}
+		memmove(dst, src, len);
+		chan->ccnr += len;
+	}
+}
+
 static void
 do_dma(DMAChan * chan)
 {
@@ -424,6 +454,9 @@ do_dma(DMAChan * chan)
 		fprintf(stderr, "i.MX21 DMAC: downwards DMA direction not implemented\n");
 		return;
 	}
+	if ((smod == CCR_SMOD_LINEAR) && (dmod == CCR_DMOD_LINEAR) && !(chan->ccr & CCR_REN)) {
+		dma_copy_linear(chan, ssiz, dsiz);
+	}
 	while ((chan->ccnr < chan->cntr)
 	       && ((SigNode_Val(chan->currReqLine) == SIG_LOW) || !(chan->ccr & CCR_REN))) {
 		chan->xferbuf_wp = 0;
@@ -229,9 +229,6 @@
 #define		LGWDCR_GWTM_MASK	(0xf<<0)
 #define		LGWDCR_GWTM_SHIFT	(0)
 
-#define UPDATE_FIFO_SIZE	(2048)
-#define UPDATE_FIFO_MASK	(UPDATE_FIFO_SIZE-1)
-#define	UPDATE_FIFO_COUNT(lcdc)	((lcdc)->update_fifo_wp - (lcdc)->update_fifo_rp)
 typedef struct ScreenInfo {
 	int fb_width;
 	int fb_height;
@@ -267,42 +264,38 @@ typedef struct IMXLcdc {
 	uint32_t lgwpr;
 	uint32_t lgwcr;
 	uint32_t lgwdcr;
-	/* Currently traced IO-Region */
+	/* Currently traced framebuffer */
 	uint32_t trace_start;
 	uint32_t trace_length;
+	BusDirtyMap *dirtyMap;
 
 	CycleTimer updateTimer;
-	int page_size;
-	uint32_t dirty_addr[UPDATE_FIFO_SIZE];
-	uint64_t update_fifo_wp;
-	uint64_t update_fifo_rp;
 	FbDisplay *display;
 } IMXLcdc;
 
+static void
+update_range(void *clientData, uint32_t addr, uint8_t * hva, uint32_t len)
+{
+	IMXLcdc *lcdc = (IMXLcdc *) clientData;
+	FbUpdateRequest fbudrq;
+	fbudrq.offset = addr - lcdc->trace_start;
+	fbudrq.count = len;
+	fbudrq.fbdata = hva;
+	FbDisplay_UpdateRequest(lcdc->display, &fbudrq);
+}
+
 /*
- * -------------------------------------------
- * The event handler called by the Timer 
- * -------------------------------------------
+ * -------------------------------------------------------------
+ * The event handler called by the Timer 10ms after the
+ * first write to the framebuffer
+ * -------------------------------------------------------------
  */
 static void
 update_display(void *clientData)
 {
 	IMXLcdc *lcdc = (IMXLcdc *) clientData;
-	uint32_t addr;
-	uint8_t *data;
-	FbUpdateRequest fbudrq;
-	while (UPDATE_FIFO_COUNT(lcdc) > 0) {
-		addr = lcdc->dirty_addr[lcdc->update_fifo_rp & UPDATE_FIFO_MASK];
-		addr &= ~(lcdc->page_size - 1);
-		Mem_TracePage(addr);
-		lcdc->update_fifo_rp++;
-		data = Bus_GetHVARead(addr);
-		if (data) {
-			fbudrq.offset = addr - lcdc->lssar;
-			fbudrq.count = lcdc->page_size;
-			fbudrq.fbdata = data;
-			FbDisplay_UpdateRequest(lcdc->display, &fbudrq);
-		}
+	if (lcdc->dirtyMap) {
+		Mem_DirtyMapDrain(lcdc->dirtyMap, update_range, lcdc);
 	}
 }
 
@@ -361,18 +354,12 @@ update_fbformat(IMXLcdc * lcdc)
 }
 
 static void
-lcdc_mem_trace(void *clientData, uint32_t value, uint32_t addr, int rqlen)
+lcdc_fb_dirty(void *clientData)
 {
 	IMXLcdc *lcdc = (IMXLcdc *) clientData;
-	if (UPDATE_FIFO_COUNT(lcdc) == UPDATE_FIFO_SIZE) {
-		update_display(lcdc);
-	}
-	lcdc->dirty_addr[lcdc->update_fifo_wp & UPDATE_FIFO_MASK] = addr;
-	lcdc->update_fifo_wp++;
 	if (!CycleTimer_IsActive(&lcdc->updateTimer)) {
 		CycleTimer_Mod(&lcdc->updateTimer, MillisecondsToCycles(10));
 	}
-//      fprintf(stderr,"Update at address %08x\n",addr);
 }
 
 static void
@@ -380,7 +367,6 @@ update_memory_traces(IMXLcdc * lcdc)
 {
 	uint32_t start, end, length;
 	int vpw, height;
-	int i;
 
 	vpw = lcdc->lvpwr & LVPWR_VPW_MASK;
 	height = ((lcdc->lsr & LSR_YMAX_MASK));
@@ -390,28 +376,19 @@ update_memory_traces(IMXLcdc * lcdc)
 	if ((lcdc->trace_length == length) && (lcdc->trace_start == start)) {
 		return;
 	}
-	if (lcdc->trace_length) {
-		IOH_DeleteRegion(lcdc->trace_start, lcdc->trace_length);
-		Mem_UntraceRegion(lcdc->trace_start, lcdc->trace_length);
+	if (lcdc->dirtyMap) {
+		Mem_DirtyMapDelete(lcdc->dirtyMap);
+		lcdc->dirtyMap = NULL;
 	}
 	if (!lcdc->display) {
 		return;
 	}
-	/* Clear all outstanding updates */
-	lcdc->update_fifo_rp = lcdc->update_fifo_wp;
-
 	if ((start >= 0xc0000000) && (end <= 0xc7ffffff) && (length > 0)) {
 		dbgprintf("updating traced page list %08x to %08x\n", start, end);
-		IOH_NewRegion(start, length, NULL, lcdc_mem_trace, 0, lcdc);
 		lcdc->trace_length = length;
 		lcdc->trace_start = start;
-		/* 
-		 * Trigger the trace a first time because all pages are dirty 
-		 * after address change 
-		 */
-		for (i = 0; i < length; i += lcdc->page_size) {
-			lcdc_mem_trace(lcdc, 0, i + start, 0);
-		}
+		/* All pages are dirty after an address change */
+		lcdc->dirtyMap = Mem_DirtyMapNew(start, length, lcdc_fb_dirty, lcdc);
 	}
 }
 
@@ -1129,7 +1106,6 @@ IMX21_LcdcNew(const char *name, FbDisplay * display)
 		exit(1);
 	}
 	lcdc->display = display;
-	lcdc->page_size = Mem_SmallPageSize();
 	lcdc->ldcr = 0x80080004;
 	CycleTimer_Init(&lcdc->updateTimer, update_display, lcdc);
 	lcdc->bdev.first_mapping = NULL;
@@ -46,6 +46,7 @@
 #include "cycletimer.h"
 #include "diskimage.h"
 #include "sgstring.h"
+#include "hosttime.h"
 
 #define RTC_HOURMIN(base) 	((base) + 0x00)
 #define RTC_SECONDS(base)	((base) + 0x04)
@@ -122,7 +123,7 @@ diff_systime(IMX21Rtc * rtc)
 		return 0;
 	}
 
-	gettimeofday(&tv, NULL);
+	HostTime_Get(&tv);
 	sys_utc_time = tv.tv_sec;
 
 	offset = rtc_time - sys_utc_time;
@@ -152,7 +153,7 @@ read_systemtime(IMX21Rtc * rtc)
 	int32_t offset;
 	time_t time;
 	//struct tm tm;
-	gettimeofday(&tv, NULL);
+	HostTime_Get(&tv);
 	time = tv.tv_sec;
 	offset = rtc->time_offset[0] | (rtc->time_offset[1] << 8)
 	    | (rtc->time_offset[2] << 16) | (rtc->time_offset[3] << 24);
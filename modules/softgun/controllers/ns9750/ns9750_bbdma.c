@@ -322,30 +322,14 @@ DMA_ChannelSpec ns9750_dma_channels[] = {
 static void
 load_descriptor(BufDescr * bd, uint32_t addr)
 {
-	uint32_t src = addr;
-	int i;
-	uint32_t *data = (uint32_t *) bd;
 	dbgprintf("load descriptor from 0x%08x\n", addr);
-	for (i = 0; i < 4; i++) {
-		*data = Bus_Read32(src);
-		//Bus_Read(data,src,4);
-		fprintf(stderr, "LD: %08x from %08x\n", *data, src);
-		data++;
-		src += 4;
-	}
+	Bus_Read((uint8_t *) bd, addr, 16);
 }
 
 static void
 store_descriptor(BufDescr * bd, uint32_t addr)
 {
-	int i;
-	uint32_t src = addr;
-	uint32_t *data = (uint32_t *) bd;
-	for (i = 0; i < 4; i++) {
-		Bus_Write32(*data, src);
-		data++;
-		src += 4;
-	}
+	Bus_Write(addr, (uint8_t *) bd, 16);
 }
 
 static void
@@ -56,6 +56,7 @@
 #include "clock.h"
 #include "sgstring.h"
 #include "linux-tap.h"
+#include "netcapture.h"
 #include "ns9750_timer.h"
 
 #include "asyncmanager.h"
@@ -94,6 +95,7 @@ typedef struct NS9750eth {
 	BusDevice bdev;
 	PHY_Device *phy[MAX_PHYS];
 	int ether_fd;
+	NetCapture *capture;
 	PollHandle_t *input_fh;
 	int receiver_is_enabled;
 	int rxint_posted;
@@ -632,10 +634,15 @@ fill_rxfifo(NS9750eth * eth)
 		dbgprintf("Dropping paket because rxfifo is full !\n");
 		eth->eintr |= IR_RXOVFL_DATA;
 		update_rx_interrupt(eth);
-		return read(eth->ether_fd, buf, 2048);
+		result = read(eth->ether_fd, buf, 2048);
+		if (result > 0) {
+			NetCapture_Frame(eth->capture, NETCAPTURE_RX, buf, result);
+		}
+		return result;
 	}
 	result = read(eth->ether_fd, eth->rxfifo, 2048 - 4);	// leave room for FCS
 	if (result > 0) {
+		NetCapture_Frame(eth->capture, NETCAPTURE_RX, eth->rxfifo, result);
 		eth->rxfifo_count = result;
 	}
 	return result;
@@ -970,6 +977,7 @@ transmit_frame(NS9750eth * eth)
 			int count = 0;
 			int len = eth->txfifo_count;
 			dbgprintf("Send the packet\n");
+			NetCapture_Frame(eth->capture, NETCAPTURE_TX, eth->txfifo, len);
 			do {
 				int result;
 				result =
@@ -2652,6 +2660,7 @@ NS9750_EthInit(const char *devname)
 {
 	NS9750eth *eth = sg_new(NS9750eth);
 	eth->ether_fd = Net_CreateInterface(devname);
+	eth->capture = NetCapture_New(devname);
 	eth->input_fh = AsyncManager_PollInit(eth->ether_fd);
 
 	eth->bdev.first_mapping = NULL;
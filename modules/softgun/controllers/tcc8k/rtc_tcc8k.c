@@ -46,6 +46,7 @@
 #include "cycletimer.h"
 #include "configfile.h"
 #include "diskimage.h"
+#include "hosttime.h"
 
 #define RTC_IMAGESIZE	(128)
 
@@ -229,7 +230,7 @@ diff_systime(TccRtc * rtc)
 		fprintf(stderr, "mktime failed\n");
 		return 0;
 	}
-	gettimeofday(&now, NULL);
+	HostTime_Get(&now);
 	sys_utc_time = now.tv_sec;
 
 	offset = ((int64_t) rtc_time - (int64_t) sys_utc_time) * (int64_t) 1000000;
@@ -363,7 +364,7 @@ update_time(TccRtc * rtc)
 	if (rtc->regRtccon & RTCCON_STARTB) {
 		return;
 	}
-	gettimeofday(&host_tv, NULL);
+	HostTime_Get(&host_tv);
 	time = host_tv.tv_sec;
 	time += (rtc->time_offset / (int64_t) 1000000);
 	useconds = host_tv.tv_usec + (rtc->time_offset % 1000000);
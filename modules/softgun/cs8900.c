@@ -53,6 +53,7 @@
 #include "bus.h"
 #include "signode.h"
 #include "linux-tap.h"
+#include "netcapture.h"
 #include "m93c46.h"
 #include "sgstring.h"
 
@@ -237,6 +238,7 @@
 typedef struct CS8900 {
 	BusDevice bdev;
 	int ether_fd;
+	NetCapture *capture;
 	PollHandle_t *handle;
 	int pktsrc_is_enabled;
 	int interrupt_posted;
@@ -389,6 +391,7 @@ input_event(PollHandle_t *handle, int status, int events, void *cd)
 		int indiva = cs->rxctl & RXCTL_INDIVIDUALA;
 		int broada = cs->rxctl & RXCTL_BROADCASTA;
 		int rxoka = cs->rxctl & RXCTL_RXOKA;
+		NetCapture_Frame(cs->capture, NETCAPTURE_RX, rxbuf, result);
 		rxev = cs->rxevent;
 		//fprintf(stderr,"RX event ind %d bc %d prom %d\n",indiv,broadcast,promisc);
 		if (result < 64) {
@@ -480,6 +483,7 @@ transmit(CS8900 * cs)
 			cs->txlength, cs->tx_fifo_wp);
 		goto out;
 	}
+	NetCapture_Frame(cs->capture, NETCAPTURE_TX, cs->txbuf, cs->txlength);
 	//fcntl(cs->ether_fd,F_SETFL,0);
 	result = write(cs->ether_fd, cs->txbuf, cs->txlength);
 	//fcntl(cs->ether_fd,F_SETFL,O_NONBLOCK);
@@ -2022,6 +2026,7 @@ CS8900_New(const char *devname)
 	}
 	cs->txbuf = cs->memwin + 0x600;
 	cs->ether_fd = Net_CreateInterface(devname);
+	cs->capture = NetCapture_New(devname);
 	fcntl(cs->ether_fd, F_SETFL, O_NONBLOCK);
 	cs->handle = AsyncManager_PollInit(cs->ether_fd);
 	sprintf(eepromname, "%s.eeprom", devname);
@@ -54,6 +54,7 @@
 #include "configfile.h"
 #include "devices/phy/phy.h"
 #include "linux-tap.h"
+#include "framering.h"
 #include "m93c46.h"
 #include "sgstring.h"
 #include "signode.h"
@@ -67,6 +68,10 @@
 #define dbgprintf(...)
 #endif
 
+#define RX_RING_FRAMES	(64)
+#define TX_RING_FRAMES	(32)
+#define TX_FLUSH_NS	(10000)	/* Frames sent within 10 us are written together */
+
 #define DM_NCR 		(0)
 #define		NCR_EXT_PHY	(1<<7)
 #define		NCR_WAKEEN	(1<<6)
@@ -265,6 +270,10 @@ struct DM9000 {
 	BusDevice bdev;
 	int ether_fd;
 	PollHandle_t *input_fh;
+	AsyncHandle_t *rxWakeup;	/* Frames left in the rxRing */
+	FrameRing *rxRing;
+	FrameRing *txRing;
+	NetCapture *capture;
 	int receiver_is_enabled;
 
 	DMReadProc *read_reg[256];
@@ -531,45 +540,65 @@ match_address(DM9000 * dm, uint8_t * packet)
 	return 3;
 }
 
+/*
+ * --------------------------------------------------------------
+ * rx_deliver
+ * 	Put the frames of the rxRing to the rxfifo in the SRAM
+ *	until the fifo is full. One interrupt for the batch.
+ * --------------------------------------------------------------
+ */
+static void
+rx_deliver(DM9000 * dm)
+{
+	uint8_t *buf;
+	unsigned int len;
+	int received = 0;
+	while (dm->receiver_is_enabled && (buf = FrameRing_Peek(dm->rxRing, &len))) {
+		if (phy_is_enabled(dm) && match_address(dm, buf)
+		    && !((len > (1522 - 4)) && (dm->rcr & RCR_DIS_LONG))) {
+			if (len < 60) {
+				memset(buf + len, 0, 60 - len);
+				len = 60;
+			}
+			rxfifo_put_packet(dm, buf, len);
+			received++;
+			update_receiver_status(dm);
+		}
+		FrameRing_Pop(dm->rxRing);
+	}
+	if (received) {
+		dm->isr |= ISR_PRS;
+		update_interrupts(dm);
+	}
+}
+
 /*
  * --------------------------------------------------------------
  * input_event
- * 	The Event handler which reads the incoming datastream and
- * 	puts it to the rxfifo in the SRAM
+ * 	The Event handler which reads all pending frames of the
+ *	network backend into the rxRing
  * --------------------------------------------------------------
  */
 static void
 input_event(PollHandle_t *handle, int status, int events, void *clientdata)
 {
 	DM9000 *dm = clientdata;
-	int result;
-	uint8_t buf[2048];
-	do {
-		result = read(dm->ether_fd, buf, 2048);
-		if (result > 0) {
-			if (!phy_is_enabled(dm)) {
-				continue;
-			}
-			if (!match_address(dm, buf)) {
-				continue;
-			}
-			if ((result > (1522 - 4)) && (dm->rcr & RCR_DIS_LONG)) {
-				continue;
-			}
-			if (result < 60) {
-				rxfifo_put_packet(dm, buf, 60);
-			} else {
-				rxfifo_put_packet(dm, buf, result);
-			}
-			dm->isr |= ISR_PRS;
-			update_interrupts(dm);
-			update_receiver_status(dm);
-		}
-		if (!dm->receiver_is_enabled) {
-			break;
-		}
-	} while (result > 0);
-	return;
+	if (FrameRing_Receive(dm->rxRing) < 0) {
+		return;
+	}
+	rx_deliver(dm);
+}
+
+/*
+ * --------------------------------------------------------------
+ * The receiver was enabled again: Deliver the frames which
+ * did not fit into the rxfifo before.
+ * --------------------------------------------------------------
+ */
+static void
+rx_wakeup(AsyncHandle_t *handle, void *clientdata)
+{
+	rx_deliver(clientdata);
 }
 
 /*  
@@ -604,6 +633,7 @@ enable_receiver(DM9000 * dm)
 		dbgprintf("DM9000: enable receiver\n");
 		AsyncManager_PollStart(dm->input_fh, ASYNCMANAGER_EVENT_READABLE, &input_event, dm);
 		dm->receiver_is_enabled = 1;
+		AsyncManager_AsyncSend(dm->rxWakeup);
 	}
 }
 
@@ -707,11 +737,11 @@ transmit_packet(DM9000 * dm)
 			dm->txfifo_rp = (dm->txfifo_rp + 1) % (3 * 1024);
 		}
 		if (phy_is_enabled(dm)) {
-			result = write(dm->ether_fd, packet, len);
+			result = FrameRing_Queue(dm->txRing, packet, len);
 		}
 	} else {
 		if (phy_is_enabled(dm)) {
-			result = write(dm->ether_fd, &dm->sram[dm->txfifo_rp], len);
+			result = FrameRing_Queue(dm->txRing, &dm->sram[dm->txfifo_rp], len);
 		}
 		dm->txfifo_rp = (dm->txfifo_rp + len) % (3 * 1024);
 	}
@@ -2050,6 +2080,13 @@ DM9000_New(const char *devname, int register_spacing)
 	char *epromname = (char *)alloca(strlen(devname) + 20);
 	dm->ether_fd = Net_CreateInterface(devname);
 	dm->input_fh = AsyncManager_PollInit(dm->ether_fd);
+	dm->rxRing = FrameRing_New(dm->ether_fd, RX_RING_FRAMES);
+	dm->txRing = FrameRing_New(dm->ether_fd, TX_RING_FRAMES);
+	FrameRing_SetFlushDelay(dm->txRing, TX_FLUSH_NS);
+	dm->capture = NetCapture_New(devname);
+	FrameRing_SetCapture(dm->rxRing, dm->capture);
+	FrameRing_SetCapture(dm->txRing, dm->capture);
+	dm->rxWakeup = AsyncManager_AsyncInit(&rx_wakeup, dm);
 
 	dm->bdev.first_mapping = NULL;
 	dm->bdev.Map = DM9000_Map;
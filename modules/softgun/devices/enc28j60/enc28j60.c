@@ -52,6 +52,7 @@
 #include "cycletimer.h"
 #include "configfile.h"
 #include "linux-tap.h"
+#include "netcapture.h"
 #include "crc32.h"
 #include "signode.h"
 #include "sgstring.h"
@@ -353,6 +354,7 @@ struct Enc28j60 {
 	int state;
 	uint32_t chksum;
 	int ether_fd;
+	NetCapture *capture;
 	PollHandle_t *input_fh;
 	int rx_is_enabled;
 	CycleTimer miCmdTimer;
@@ -965,6 +967,7 @@ rx_event(PollHandle_t *handle, int status, int events, void *clientdata)
 		if (result <= 0) {
 			continue;
 		}
+		NetCapture_Frame(enc->capture, NETCAPTURE_RX, buf, result);
         receive_pkt(enc, buf, result);
 	} while (result > 0);
 	return;
@@ -1236,6 +1239,7 @@ do_transmit(void *eventData)
 				fprintf(stdout, "Drop TX packet\n");
 			} else {
                 if (!(enc->phyrPHCON1 & PHCON1_PLOOPBK) && !(enc->phyrPHCON2 & PHCON2_TXDIS)) {
+                    NetCapture_Frame(enc->capture, NETCAPTURE_TX, pktbuf, pktlen);
                     fcntl(enc->ether_fd, F_SETFL, 0);
                     result = write(enc->ether_fd, pktbuf, pktlen);
                     fcntl(enc->ether_fd, F_SETFL, O_NONBLOCK);
@@ -2692,6 +2696,7 @@ Enc28j60_New(const char *name)
 	SigNode_Set(enc->sigIrq, SIG_PULLUP);
 	enc->CsNTrace = SigNode_Trace(enc->sigCsN, spi_cs_change, enc);
 	enc->ether_fd = Net_CreateInterface(name);
+	enc->capture = NetCapture_New(name);
 	enc->input_fh = AsyncManager_PollInit(enc->ether_fd);
 	enc_system_reset(enc);
 	test_hash_calculator();
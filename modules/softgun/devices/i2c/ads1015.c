@@ -45,6 +45,7 @@
 #include "ads1015.h"
 #include "sgstring.h"
 #include "cycletimer.h"
+#include "hosttime.h"
 
 #if 0
 #define dbgprintf(...) { fprintf(stderr,__VA_ARGS__); }
@@ -254,7 +255,7 @@ ADC_Read(ADS1015 * ads)
 	int16_t adval;
 	float full_scale = ads1015_get_full_scale(ads);
 	uint8_t channel = (ads->regConf & CONF_MUX_MSK) >> CONF_MUX_SHIFT;
-	gettimeofday(&tv, NULL);
+	HostTime_Get(&tv);
 	random = ((tv.tv_usec + (tv.tv_usec >> 8)) & 0x1f) / 1000.;
 	float volt;
 	//fprintf(stderr,"Read channel %d\n",channel);
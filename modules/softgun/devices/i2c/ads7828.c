@@ -44,6 +44,7 @@
 #include "i2c.h"
 #include "ads7828.h"
 #include "sgstring.h"
+#include "hosttime.h"
 
 #if 0
 #define dbgprintf(...) { fprintf(stderr,__VA_ARGS__); }
@@ -94,7 +95,7 @@ ads7828_read(void *dev, uint8_t * data)
 		if (pd != 3) {
 			fprintf(stderr, "ADS7828 Power Down mode %d not implemented\n", pd);
 		}
-		gettimeofday(&tv, NULL);
+		HostTime_Get(&tv);
 		random = tv.tv_usec & 0xff;
 		switch (chsel) {
 		    case 0:
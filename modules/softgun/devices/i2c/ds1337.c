@@ -45,6 +45,7 @@
 #include "configfile.h"
 #include "diskimage.h"
 #include "sgstring.h"
+#include "hosttime.h"
 
 #if 0
 #define dbgprintf(...) { fprintf(stderr,__VA_ARGS__); }
@@ -190,7 +191,7 @@ diff_systime(DS1337 * ds)
 		return 0;
 	}
 
-	gettimeofday(&now, NULL);
+	HostTime_Get(&now);
 	sys_utc_time = now.tv_sec;
 
 	offset = ((int64_t) rtc_time - (int64_t) sys_utc_time) * (int64_t) 1000000;
@@ -217,7 +218,7 @@ update_time(DS1337 * ds)
 	if (ds->control_reg & CONTROL_NEOSC) {
 		return;
 	}
-	gettimeofday(&host_tv, NULL);
+	HostTime_Get(&host_tv);
 	time = host_tv.tv_sec;
 	time += (ds->time_offset / (int64_t) 1000000);
 	ds->useconds = host_tv.tv_usec + (ds->time_offset % 1000000);
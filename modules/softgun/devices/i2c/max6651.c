@@ -44,6 +44,7 @@
 #include "i2c.h"
 #include "max6651.h"
 #include "sgstring.h"
+#include "hosttime.h"
 
 #if 0
 #define dbgprintf(...) { fprintf(stderr,__VA_ARGS__); }
@@ -141,7 +142,7 @@ update_fanspeed(MAX6651 * max, unsigned int fan)
 	if (fan > 3) {
 		return;
 	}
-	gettimeofday(&tv, NULL);
+	HostTime_Get(&tv);
 	max->tach[fan] = 170 + (tv.tv_usec & 0xf);
 
 }
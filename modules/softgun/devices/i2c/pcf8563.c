@@ -47,6 +47,7 @@
 #include "configfile.h"
 #include "diskimage.h"
 #include "sgstring.h"
+#include "hosttime.h"
 
 #if 0
 #define dbgprintf(...) { fprintf(stderr,__VA_ARGS__); }
@@ -133,7 +134,7 @@ read_systemtime(PCF8563 * pcf)
 	int32_t offset;
 	time_t time;
 	struct tm tm;
-	gettimeofday(&tv, NULL);
+	HostTime_Get(&tv);
 	time = tv.tv_sec;
 	offset = pcf->time_offset[0] | (pcf->time_offset[1] << 8)
 	    | (pcf->time_offset[2] << 16) | (pcf->time_offset[3] << 24);
@@ -192,7 +193,7 @@ diff_systime(PCF8563 * pcf)
 		return 0;
 	}
 
-	gettimeofday(&tv, NULL);
+	HostTime_Get(&tv);
 	sys_utc_time = tv.tv_sec;
 
 	offset = rtc_time - sys_utc_time;
@@ -84,6 +84,10 @@
 #define RST_STARTED 		(8)
 #define RST_DONE 		(9)
 
+/* Busy time of an erase: fixed part + erased bytes / rate */
+#define ERASE_BUSY_USEC		(1000)
+#define ERASE_BYTES_PER_USEC	(4096)
+
 #ifndef O_LARGEFILE
 /* O_LARGEFILE does not exist and is not neededon FreeBSD, define
  * it so that it does not have any effect*/
@@ -1310,6 +1314,8 @@ struct MMCard {
 	CycleCounter_t reset_start_time;
 	CycleTimer transmissionTimer;
 	Listener *listener_head;
+	int erase_pending;	/* Background erase is running, card is in STATE_PRG */
+	int deleted;		/* Delete was called while an erase was pending */
 };
 
 /*
@@ -3142,10 +3148,35 @@ mmc_erase_group_end(MMCard * card, uint32_t cmd, uint32_t arg, MMCResponse * res
 	return MMC_ERR_NONE;
 }
 
+/*
+ * ---------------------------------------------------------------------------
+ * End of the busy time of an erase
+ * ---------------------------------------------------------------------------
+ */
+static void
+mmc_erase_done(void *clientData, int result)
+{
+	MMCard *card = clientData;
+	card->erase_pending = 0;
+	if (card->deleted) {
+		free(card);
+		return;
+	}
+	if (result < 0) {
+		fprintf(stderr, "Writing to diskimage failed\n");
+	}
+	if (card->state == STATE_PRG) {
+		card->state = STATE_TRANSFER;
+	} else if (card->state == STATE_DIS) {
+		card->state = STATE_STBY;
+	}
+}
+
 /*
  * ---------------------------------------------------------------------------
  * CMD38 ERASE
- * This command should be reimplemented to work in the Background !
+ * The image is filled in the background, the card stays in PRG state
+ * until the modeled erase time is over.
  * erase previously selected blocks
  * arg: none
  * State Transfer -> PRG -> (some time) Transfer
@@ -3159,7 +3190,7 @@ mmc_erase(MMCard * card, uint32_t cmd, uint32_t arg, MMCResponse * resp)
 	uint32_t card_status = GET_STATUS(card);
 	uint64_t start = card->erase_start;
 	uint64_t end = card->erase_end | (card->blocklen - 1);
-	uint8_t buf[256];
+	CycleCounter_t busy;
 	if (start > card->capacity) {
 		start = card->capacity;
 	}
@@ -3167,21 +3198,13 @@ mmc_erase(MMCard * card, uint32_t cmd, uint32_t arg, MMCResponse * resp)
 		fprintf(stderr, "Warning: erasing past end of card\n");
 		end = card->capacity;
 	}
-	if ((end - start) > 256 * 1024 * 1024) {
-		fprintf(stderr, "Warning: Erase (CMD%d) should be implemented in Background\n",
-			cmd);
-	}
-	memset(buf, 0xff, sizeof(buf));
-	while (start < end) {
-		uint64_t count = end - start;
-		if (count > sizeof(buf)) {
-			count = sizeof(buf);
-		}
-		if (DiskImage_Write(card->disk_image, start, buf, count) < count) {
-			fprintf(stderr, "Writing to diskimage failed\n");
-			break;
-		}
-		start += count;
+	if (start < end) {
+		/* The card is busy until the image is filled in the background */
+		busy = MicrosecondsToCycles(ERASE_BUSY_USEC + (end - start) / ERASE_BYTES_PER_USEC);
+		card->erase_pending = 1;
+		card->state = STATE_PRG;
+		DiskImage_FillAsync(card->disk_image, start, 0xff, end - start, busy,
+				    mmc_erase_done, card);
 	}
 	card->card_status &= ~(0xfd3fc020);
 	resp->len = 6;
@@ -3191,7 +3214,7 @@ mmc_erase(MMCard * card, uint32_t cmd, uint32_t arg, MMCResponse * resp)
 	resp->data[3] = (card_status >> 8) & 0xff;
 	resp->data[4] = card_status & 0xff;
 	resp->data[5] = MMC_RespCRCByte(resp);
-	fprintf(stderr, "erase done\n");
+	fprintf(stderr, "erase started\n");
 	return MMC_ERR_NONE;
 }
 
@@ -3872,9 +3895,7 @@ MMCard_Write(MMCDev * dev, const uint8_t * buf, int count)
 		if ((address + count) > card->capacity) {
 			count = card->capacity - address;
 		}
-		if (DiskImage_Write(card->disk_image, address, buf, count) < count) {
-			fprintf(stderr, "MMCard: Error writing to diskimage\n");
-		}
+		DiskImage_WriteAsync(card->disk_image, address, buf, count, 0, NULL, NULL);
 		card->transfer_count += count;
 		if (card->transfer_count == card->blocklen) {
 			card->state = STATE_TRANSFER;
@@ -3886,9 +3907,7 @@ MMCard_Write(MMCDev * dev, const uint8_t * buf, int count)
 		if ((address + count) > card->capacity) {
 			count = card->capacity - address;
 		}
-		if (DiskImage_Write(card->disk_image, address, buf, count) < count) {
-			fprintf(stderr, "MMCard: Error writing to diskimage\n");
-		}
+		DiskImage_WriteAsync(card->disk_image, address, buf, count, 0, NULL, NULL);
 		card->transfer_count += count;
 		if ((address & ~(card->blocklen - 1)) !=
 		    ((address + count) & ~(card->blocklen - 1))) {
@@ -3908,9 +3927,7 @@ MMCard_Write(MMCDev * dev, const uint8_t * buf, int count)
 		if ((address + count) > card->capacity) {
 			count = card->capacity - address;
 		}
-		if (DiskImage_Write(card->disk_image, address, buf, count) < count) {
-			fprintf(stderr, "MMCard: Error writing to diskimage\n");
-		}
+		DiskImage_WriteAsync(card->disk_image, address, buf, count, 0, NULL, NULL);
 		card->transfer_count += count;
 		if (card->blocklen) {
 			card->well_written_blocks = card->transfer_count / card->blocklen;
@@ -4544,6 +4561,11 @@ MMCard_Delete(MMCDev * mmcdev)
 	MMCard *card = container_of(mmcdev, MMCard, mmcdev);
 	DiskImage_Close(card->disk_image);
 	card->disk_image = NULL;
+	if (card->erase_pending) {
+		/* freed by mmc_erase_done */
+		card->deleted = 1;
+		return;
+	}
 	free(card);
 }
 
@@ -4627,7 +4649,8 @@ MMCard_New(const char *name)
 			init_auto_card_from_filesize(card, imagename);
 		}
 		card->disk_image =
-		    DiskImage_Open(imagename, card->capacity, DI_RDWR | DI_CREAT_FF | DI_SPARSE);
+		    DiskImage_Open(imagename, card->capacity,
+				   DI_RDWR | DI_CREAT_FF | DI_SPARSE | DI_CACHE);
 		if (!card->disk_image) {
 			fprintf(stderr, "Failed to open disk_image \"%s\"\n", imagename);
 			perror("msg");
@@ -46,6 +46,7 @@
 #include "ds1302.h"
 #include "cycletimer.h"
 #include "sgstring.h"
+#include "hosttime.h"
 
 #define REG_SECONDS	(0x80)
 #define	REG_MINUTES	(0x82)
@@ -186,7 +187,7 @@ update_time(DS1302 * ds)
 	struct timeval host_tv;
 	time_t time;
 	struct tm tm;
-	gettimeofday(&host_tv, NULL);
+	HostTime_Get(&host_tv);
 	time = host_tv.tv_sec;
 	time += (ds->time_offset / (int64_t) 1000000);
 	ds->useconds = host_tv.tv_usec + (ds->time_offset % 1000000);
@@ -298,7 +299,7 @@ diff_systemtime(DS1302 * ds)
 		return 0;
 	}
 
-	gettimeofday(&now, NULL);
+	HostTime_Get(&now);
 	sys_utc_time = now.tv_sec;
 
 	offset = ((int64_t) rtc_time - (int64_t) sys_utc_time) * (int64_t) 1000000;
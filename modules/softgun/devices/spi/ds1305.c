@@ -47,6 +47,7 @@
 #include "ds1305.h"
 #include "cycletimer.h"
 #include "sgstring.h"
+#include "hosttime.h"
 
 #define DIR_NONE (1)
 #define DIR_IN (2)
@@ -208,7 +209,7 @@ update_time(DS1305 * ds)
 	if (ds->control_reg & CONTROL_NEOSC) {
 		return;
 	}
-	gettimeofday(&host_tv, NULL);
+	HostTime_Get(&host_tv);
 	time = host_tv.tv_sec;
 	time += (ds->time_offset / (int64_t) 1000000);
 	ds->useconds = host_tv.tv_usec + (ds->time_offset % 1000000);
@@ -320,7 +321,7 @@ diff_systemtime(DS1305 * ds)
 		return 0;
 	}
 
-	gettimeofday(&now, NULL);
+	HostTime_Get(&now);
 	sys_utc_time = now.tv_sec;
 
 	offset = ((int64_t) rtc_time - (int64_t) sys_utc_time) * (int64_t) 1000000;
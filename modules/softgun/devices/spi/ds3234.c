@@ -44,6 +44,7 @@
 #include "ds1305.h"
 #include "cycletimer.h"
 #include "sgstring.h"
+#include "hosttime.h"
 
 #if 0
 #define dbgprintf(...) { fprintf(stderr,__VA_ARGS__); }
@@ -284,7 +285,7 @@ update_time(DS3234 * ds)
 	struct timeval host_tv;
 	time_t time;
 	struct tm tm;
-	gettimeofday(&host_tv, NULL);
+	HostTime_Get(&host_tv);
 	time = host_tv.tv_sec;
 	time += (ds->time_offset / (int64_t) 1000000);
 	ds->useconds = host_tv.tv_usec + (ds->time_offset % 1000000);
@@ -393,7 +394,7 @@ diff_systemtime(DS3234 * ds)
 		return 0;
 	}
 
-	gettimeofday(&now, NULL);
+	HostTime_Get(&now);
 	sys_utc_time = now.tv_sec;
 
 	offset = ((int64_t) rtc_time - (int64_t) sys_utc_time) * (int64_t) 1000000;
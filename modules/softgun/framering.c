@@ -0,0 +1,349 @@
+//===-- framering.c -----------------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Preallocated frame rings for the Ethernet MAC models
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Main Module Header
+#include "framering.h"
+
+// Local/Private Headers
+#include "sgstring.h"
+
+// System headers
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+struct FrameRing {
+	int fd;
+	int no_socket;		/* TAP device, use read/write */
+	unsigned int nr_frames;	/* Power of 2 */
+	unsigned int head;	/* Oldest frame */
+	unsigned int count;
+	uint8_t *data;
+	uint16_t *len;
+	struct mmsghdr *msg;
+	struct iovec *iov;
+	CycleTimer flushTimer;
+	uint32_t flush_nsecs;
+	FrameRing_Stats stats;
+	NetCapture *capture;
+};
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static inline unsigned int
+slot_index(FrameRing * fr, unsigned int n)
+{
+	return (fr->head + n) & (fr->nr_frames - 1);
+}
+
+static inline uint8_t *
+slot_data(FrameRing * fr, unsigned int idx)
+{
+	return fr->data + (size_t) idx * FRAMERING_FRAME_SIZE;
+}
+
+static void
+flush_timeout(void *clientData)
+{
+	FrameRing_Flush(clientData);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Fallback for TAP devices: one read per frame
+ * ------------------------------------------------------------------------
+ */
+static int
+receive_single(FrameRing * fr)
+{
+	int received = 0;
+	ssize_t result;
+	unsigned int idx;
+	while (fr->count < fr->nr_frames) {
+		idx = slot_index(fr, fr->count);
+		result = read(fr->fd, slot_data(fr, idx), FRAMERING_FRAME_SIZE);
+		if (result <= 0) {
+			break;
+		}
+		fr->len[idx] = result;
+		NetCapture_Frame(fr->capture, NETCAPTURE_RX, slot_data(fr, idx), result);
+		fr->count++;
+		fr->stats.frames++;
+		fr->stats.bytes += result;
+		received++;
+	}
+	if (received) {
+		fr->stats.batches++;
+	}
+	return received;
+}
+
+static void
+flush_single(FrameRing * fr)
+{
+	unsigned int idx;
+	while (fr->count) {
+		idx = slot_index(fr, 0);
+		if (write(fr->fd, slot_data(fr, idx), fr->len[idx]) == fr->len[idx]) {
+			fr->stats.frames++;
+			fr->stats.bytes += fr->len[idx];
+		} else {
+			fr->stats.drops++;
+		}
+		FrameRing_Pop(fr);
+	}
+	fr->stats.batches++;
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+FrameRing *
+FrameRing_New(int fd, unsigned int nr_frames)
+{
+	FrameRing *fr = sg_new(FrameRing);
+	unsigned int size = 1;
+	while (size < nr_frames) {
+		size <<= 1;
+	}
+	fr->fd = fd;
+	fr->nr_frames = size;
+	fr->data = sg_calloc((size_t) size * FRAMERING_FRAME_SIZE);
+	fr->len = sg_calloc(size * sizeof(*fr->len));
+	fr->msg = sg_calloc(size * sizeof(*fr->msg));
+	fr->iov = sg_calloc(size * sizeof(*fr->iov));
+	CycleTimer_Init(&fr->flushTimer, flush_timeout, fr);
+	return fr;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Transmit rings only: Time from the first queued frame to the write.
+ * 0 writes every frame immediately.
+ * ------------------------------------------------------------------------
+ */
+void
+FrameRing_SetFlushDelay(FrameRing * fr, uint32_t nsecs)
+{
+	fr->flush_nsecs = nsecs;
+}
+
+void
+FrameRing_SetCapture(FrameRing * fr, NetCapture * cap)
+{
+	fr->capture = cap;
+}
+
+void
+FrameRing_GetStats(FrameRing * fr, FrameRing_Stats * stats)
+{
+	*stats = fr->stats;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Read all pending frames into the free slots. Returns the number of
+ * new frames, -1 if the backend failed.
+ * ------------------------------------------------------------------------
+ */
+int
+FrameRing_Receive(FrameRing * fr)
+{
+	unsigned int nr_free = fr->nr_frames - fr->count;
+	unsigned int i, idx;
+	int received = 0;
+	int result;
+	if ((fr->fd < 0) || !nr_free) {
+		return 0;
+	}
+	if (fr->no_socket) {
+		return receive_single(fr);
+	}
+	for (i = 0; i < nr_free; i++) {
+		idx = slot_index(fr, fr->count + i);
+		fr->iov[i].iov_base = slot_data(fr, idx);
+		fr->iov[i].iov_len = FRAMERING_FRAME_SIZE;
+		memset(&fr->msg[i].msg_hdr, 0, sizeof(fr->msg[i].msg_hdr));
+		fr->msg[i].msg_hdr.msg_iov = &fr->iov[i];
+		fr->msg[i].msg_hdr.msg_iovlen = 1;
+	}
+	result = recvmmsg(fr->fd, fr->msg, nr_free, MSG_DONTWAIT, NULL);
+	if (result < 0) {
+		if (errno == ENOTSOCK) {
+			fr->no_socket = 1;
+			return receive_single(fr);
+		}
+		if ((errno == EAGAIN) || (errno == EINTR)) {
+			return 0;
+		}
+		return -1;
+	}
+	for (i = 0; i < (unsigned int)result; i++) {
+		if (fr->msg[i].msg_hdr.msg_flags & MSG_TRUNC) {
+			fr->stats.drops++;
+			continue;
+		}
+		idx = slot_index(fr, fr->count);
+		if (slot_data(fr, idx) != fr->iov[i].iov_base) {
+			/* Close the gap of a dropped frame */
+			memcpy(slot_data(fr, idx), fr->iov[i].iov_base, fr->msg[i].msg_len);
+		}
+		fr->len[idx] = fr->msg[i].msg_len;
+		NetCapture_Frame(fr->capture, NETCAPTURE_RX, slot_data(fr, idx), fr->len[idx]);
+		fr->count++;
+		fr->stats.frames++;
+		fr->stats.bytes += fr->msg[i].msg_len;
+		received++;
+	}
+	if (result) {
+		fr->stats.batches++;
+	}
+	return received;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * The oldest frame of the ring or NULL if the ring is empty
+ * ------------------------------------------------------------------------
+ */
+uint8_t *
+FrameRing_Peek(FrameRing * fr, unsigned int *len)
+{
+	unsigned int idx;
+	if (!fr->count) {
+		return NULL;
+	}
+	idx = slot_index(fr, 0);
+	*len = fr->len[idx];
+	return slot_data(fr, idx);
+}
+
+void
+FrameRing_Pop(FrameRing * fr)
+{
+	if (fr->count) {
+		fr->head = (fr->head + 1) & (fr->nr_frames - 1);
+		fr->count--;
+	}
+}
+
+void
+FrameRing_Clear(FrameRing * fr)
+{
+	fr->head = 0;
+	fr->count = 0;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Queue a frame for transmission. Frames longer than a slot are dropped.
+ * ------------------------------------------------------------------------
+ */
+int
+FrameRing_Queue(FrameRing * fr, const void *frame, unsigned int len)
+{
+	unsigned int idx;
+	NetCapture_Frame(fr->capture, NETCAPTURE_TX, frame, len);
+	if (len > FRAMERING_FRAME_SIZE) {
+		fr->stats.drops++;
+		return -1;
+	}
+	if (fr->count == fr->nr_frames) {
+		FrameRing_Flush(fr);
+	}
+	idx = slot_index(fr, fr->count);
+	memcpy(slot_data(fr, idx), frame, len);
+	fr->len[idx] = len;
+	fr->count++;
+	if (!fr->flush_nsecs || (fr->count == fr->nr_frames)) {
+		return FrameRing_Flush(fr);
+	}
+	if (!CycleTimer_IsActive(&fr->flushTimer)) {
+		CycleTimer_Mod(&fr->flushTimer, NanosecondsToCycles(fr->flush_nsecs));
+	}
+	return 0;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Write all queued frames. Frames which the backend does not take are
+ * lost like on a congested link.
+ * ------------------------------------------------------------------------
+ */
+int
+FrameRing_Flush(FrameRing * fr)
+{
+	unsigned int i, idx;
+	unsigned int count = fr->count;
+	int result;
+	CycleTimer_Remove(&fr->flushTimer);
+	if (!count) {
+		return 0;
+	}
+	if (fr->fd < 0) {
+		fr->stats.drops += count;
+		FrameRing_Clear(fr);
+		return -1;
+	}
+	if (fr->no_socket) {
+		flush_single(fr);
+		return 0;
+	}
+	for (i = 0; i < count; i++) {
+		idx = slot_index(fr, i);
+		fr->iov[i].iov_base = slot_data(fr, idx);
+		fr->iov[i].iov_len = fr->len[idx];
+		memset(&fr->msg[i].msg_hdr, 0, sizeof(fr->msg[i].msg_hdr));
+		fr->msg[i].msg_hdr.msg_iov = &fr->iov[i];
+		fr->msg[i].msg_hdr.msg_iovlen = 1;
+	}
+	result = sendmmsg(fr->fd, fr->msg, count, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if ((result < 0) && (errno == ENOTSOCK)) {
+		fr->no_socket = 1;
+		flush_single(fr);
+		return 0;
+	}
+	if (result < 0) {
+		result = 0;
+	}
+	for (i = 0; i < (unsigned int)result; i++) {
+		fr->stats.frames++;
+		fr->stats.bytes += fr->msg[i].msg_len;
+	}
+	fr->stats.drops += count - result;
+	fr->stats.batches++;
+	FrameRing_Clear(fr);
+	return 0;
+}
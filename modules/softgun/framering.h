@@ -0,0 +1,87 @@
+//===-- framering.h -----------------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Preallocated frame rings for the Ethernet MAC models
+///
+/// A receive ring drains all frames which are pending on the fd of the
+/// network backend with one recvmmsg call per wakeup. The MAC model takes
+/// them from the ring in a batch and raises its receive interrupt once
+/// per batch.
+///
+/// A transmit ring collects the frames sent by the guest and writes them
+/// with one sendmmsg call when the ring is full or when the flush delay
+/// (emulated time) after the first queued frame is over.
+///
+/// TAP devices are no sockets, on them the rings fall back to one read
+/// or write per frame.
+///
+/// With a NetCapture set the ring captures every received frame when it
+/// is read from the backend and every transmitted frame when it is queued.
+///
+//===----------------------------------------------------------------------===//
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Local/Private Headers
+#include "cycletimer.h"
+#include "netcapture.h"
+
+// System headers
+#include <stdint.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define FRAMERING_FRAME_SIZE	(2048)
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct FrameRing FrameRing;
+
+typedef struct FrameRing_Stats {
+	uint64_t batches;	/* recvmmsg/sendmmsg calls which moved frames */
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t drops;		/* Truncated or not sent */
+} FrameRing_Stats;
+
+
+//==============================================================================
+//= Functions
+//==============================================================================
+FrameRing *FrameRing_New(int fd, unsigned int nr_frames);
+void FrameRing_SetFlushDelay(FrameRing * fr, uint32_t nsecs);
+void FrameRing_GetStats(FrameRing * fr, FrameRing_Stats * stats);
+void FrameRing_SetCapture(FrameRing * fr, NetCapture * cap);
+
+int FrameRing_Receive(FrameRing * fr);
+uint8_t *FrameRing_Peek(FrameRing * fr, unsigned int *len);
+void FrameRing_Pop(FrameRing * fr);
+void FrameRing_Clear(FrameRing * fr);
+
+int FrameRing_Queue(FrameRing * fr, const void *frame, unsigned int len);
+int FrameRing_Flush(FrameRing * fr);
+
+#endif
@@ -49,6 +49,8 @@
 #include <linux/netlink.h>
 #include <linux/if_tun.h>
 #include <configfile.h>
+#include "exithandler.h"
+#include "vswitch.h"
 
 static void
 exec_ifconfig(const char *ifname, const char *ipaddr)
@@ -172,8 +174,8 @@ tap_open(const char *name)
 
 static int ifcounter = 0;
 
-int
-Net_CreateInterface(const char *devname)
+static int
+tap_create_interface(const char *devname)
 {
 	int fd;
 	int result;
@@ -195,6 +197,69 @@ Net_CreateInterface(const char *devname)
 	return fd;
 }
 
+static void
+vswitch_report(void *data)
+{
+	VSwitch_DumpStats(data, stderr);
+}
+
+/*
+ * --------------------------------------------------------------------
+ * The switch is created by the first interface attached to it. Its
+ * own configfile section may contain the unix socket for the
+ * simulators in other processes, and "stats: 1" prints the frame
+ * counters of the ports on exit.
+ * --------------------------------------------------------------------
+ */
+static int
+vswitch_create_interface(const char *devname, const char *swname)
+{
+	VSwitch *vs;
+	char *path;
+	uint32_t stats = 0;
+	vs = VSwitch_Find(swname);
+	if (!vs) {
+		vs = VSwitch_New(swname);
+		if (!vs) {
+			return -1;
+		}
+		path = Config_ReadVar(swname, "socket");
+		if (path && (VSwitch_Listen(vs, path) < 0)) {
+			return -1;
+		}
+		Config_ReadUInt32(&stats, swname, "stats");
+		if (stats) {
+			ExitHandler_Register(vswitch_report, vs);
+		}
+	}
+	return VSwitch_Attach(vs, devname);
+}
+
+/*
+ * --------------------------------------------------------------------
+ * Create the host side of an emulated network interface. The
+ * configfile section of the interface selects the backend:
+ *	switch: <name>		In process virtual switch
+ *	switch_socket: <path>	Virtual switch of another simulator
+ *	host_ifname: <name>	TAP device of the host
+ * --------------------------------------------------------------------
+ */
+int
+Net_CreateInterface(const char *devname)
+{
+	char *swname;
+	char *path;
+	swname = Config_ReadVar(devname, "switch");
+	if (swname) {
+		return vswitch_create_interface(devname, swname);
+	}
+	path = Config_ReadVar(devname, "switch_socket");
+	if (path) {
+		return VSwitch_Connect(path);
+	}
+	return tap_create_interface(devname);
+}
+
 #ifdef TAPTEST
 int
 main()
@@ -81,7 +81,7 @@
 //==============================================================================
 //= Variables
 //==============================================================================
-MCS51Cpu g_mcs51;
+__THREAD_LOCAL__ MCS51Cpu *g_mcs51;
 
 
 //==============================================================================
@@ -120,9 +120,9 @@ static void run(GlobalClock_LocalClock_t *clk, void *data);
 static void
 MCS51_UpdateIPL(void)
 {
-	if (g_mcs51.maxPendingIpl > g_mcs51.currentIpl) {
-		dbgprintf("Post signal IRQ, maxpending %d, currentIpl %d\n", g_mcs51.maxPendingIpl,
-			  g_mcs51.currentIpl);
+	if (g_mcs51->maxPendingIpl > g_mcs51->currentIpl) {
+		dbgprintf("Post signal IRQ, maxpending %d, currentIpl %d\n", g_mcs51->maxPendingIpl,
+			  g_mcs51->currentIpl);
 		//usleep(100000);
 		MCS51_PostSignal(MCS51_SIG_IRQ);
 	} else {
@@ -139,7 +139,7 @@ MCS51_UpdateIPL(void)
 static inline void
 MCS51_PushIpl(void)
 {
-	MCS51Cpu *mcs51 = &g_mcs51;
+	MCS51Cpu *mcs51 = g_mcs51;
 	if (mcs51->iplStackP < array_size(mcs51->iplStack)) {
 		mcs51->iplStack[mcs51->iplStackP] = mcs51->currentIpl;
 		dbgprintf("Pushed IPL %d onto stackP  %u\n", mcs51->currentIpl, mcs51->iplStackP);
@@ -158,14 +158,14 @@ MCS51_PushIpl(void)
 static void
 MCS51_Interrupt(void)
 {
-	uint16_t addr = g_mcs51.pendingVectAddr;
+	uint16_t addr = g_mcs51->pendingVectAddr;
 	uint16_t sp;
-	dbgprintf("Interrupt !,vect %x\n", g_mcs51.pendingVectAddr);
+	dbgprintf("Interrupt !,vect %x\n", g_mcs51->pendingVectAddr);
 	MCS51_PushIpl();
-	g_mcs51.currentIpl = g_mcs51.maxPendingIpl;
+	g_mcs51->currentIpl = g_mcs51->maxPendingIpl;
 	MCS51_UnpostSignal(MCS51_SIG_IRQ);
-	SigNode_Set(g_mcs51.sigAckIntOut, SIG_LOW);
-	SigNode_Set(g_mcs51.sigAckIntOut, SIG_HIGH);
+	SigNode_Set(g_mcs51->sigAckIntOut, SIG_LOW);
+	SigNode_Set(g_mcs51->sigAckIntOut, SIG_HIGH);
 	sp = MCS51_GetRegSP();
 	sp++;
 	MCS51_WriteMemIndirect(GET_REG_PC & 0xff, sp);
@@ -178,7 +178,7 @@ MCS51_Interrupt(void)
 static inline void
 CheckSignals(void)
 {
-	if (g_mcs51.signals & MCS51_SIG_IRQ) {
+	if (g_mcs51->signals & MCS51_SIG_IRQ) {
 		MCS51_Interrupt();
 	}
 }
@@ -308,13 +308,16 @@ dph_write(void *eventData, uint8_t addr, uint8_t value)
 static Device_MPU_t *
 create(void)
 {
-	MCS51Cpu *mcs51 = &g_mcs51;
+	MCS51Cpu *mcs51 = LEIGUN_NEW(mcs51);
 	char *imagedir, *flashname;
 	uint32_t cpu_clock = 1000000;
+	uint32_t quantum_us = 0;
 	const char *instancename = "mcs51";
 	uint32_t cycle_mult = 12;
 	Device_MPU_t *dev = LEIGUN_NEW(dev);
 	dev->self = mcs51;
+	/* The devices created next belong to this CPU */
+	g_mcs51 = mcs51;
 	MCS51_SetPSW(0);
 	SET_REG_PC(0);
 	Config_ReadUInt32(&cycle_mult,instancename, "cycle_mult");
@@ -332,7 +335,7 @@ create(void)
 		fprintf(stderr, "Can not create Ack signal for Interrupts\n");
 		exit(1);
 	}
-	SigNode_Set(g_mcs51.sigAckIntOut, SIG_HIGH);
+	SigNode_Set(mcs51->sigAckIntOut, SIG_HIGH);
 	mcs51->approm_size = 65536;
 	mcs51->flash_di = DiskImage_Open(flashname, mcs51->approm_size, DI_RDWR | DI_CREAT_FF);
 	if (!mcs51->flash_di) {
@@ -343,8 +346,10 @@ create(void)
 	mcs51->approm = DiskImage_Mmap(mcs51->flash_di);
 	Loader_RegisterBus("bus", load_to_bus, mcs51);
 	Config_ReadUInt32(&cpu_clock, "global", "cpu_clock");
-	GlobalClock_Registor(&run, dev, cpu_clock);
-	CycleTimers_Init(instancename, cpu_clock);
+	Config_ReadUInt32(&quantum_us, instancename, "clock_quantum_us");
+	GlobalClock_RegistorQuantum(&run, dev, cpu_clock,
+				    (uint64_t)quantum_us * 1000);
+	mcs51->timerDomain = CycleTimers_Init(instancename, cpu_clock);
 	mcs51->throttle = Throttle_New(instancename);
 	MCS51_RegisterSFR(SFR_REG_ACC, acc_read, NULL, acc_write, mcs51);
 	MCS51_RegisterSFR(SFR_REG_B, b_read, NULL, b_write, mcs51);
@@ -372,10 +377,12 @@ run(GlobalClock_LocalClock_t *clk, void *data)
 	Device_MPU_t *dev = data;
 	uint32_t addr = 0;
 	MCS51_Instruction *instr;
+	g_mcs51 = dev->self;
 	if (Config_ReadUInt32(&addr, "global", "start_address") < 0) {
 		addr = 0;
 	}
 	SET_REG_PC(addr);
+	CycleTimers_SyncGlobalClock(g_mcs51->timerDomain, clk);
 
 	while (1) {
 		ICODE = MCS51_ReadPgmMem(GET_REG_PC);
@@ -386,7 +393,6 @@ run(GlobalClock_LocalClock_t *clk, void *data)
 		SET_REG_PC(GET_REG_PC + 1);
 		instr = MCS51_InstructionFind(ICODE);
 		instr->iproc();
-		GlobalClock_ConsumeCycle(clk, 2);
 		/* meassurement gave 422566543/268435456*12 = 18.890 */
 		CycleCounter += instr->cycles;
 		CycleTimers_Check();
@@ -406,10 +412,10 @@ MCS51_RegisterSFR(uint8_t byte_addr, C51_SfrReadProc * readProc, C51_SfrReadProc
 		fprintf(stderr, "Registering illegal SFR register 0x%02x\n", byte_addr);
 		exit(1);
 	} else {
-		g_mcs51.sfrDev[byte_addr & 0x7f] = cbData;
-		g_mcs51.sfrRead[byte_addr & 0x7f] = readProc;
-		g_mcs51.sfrLatchedRead[byte_addr & 0x7f] = latchedRead;
-		g_mcs51.sfrWrite[byte_addr & 0x7f] = writeProc;
+		g_mcs51->sfrDev[byte_addr & 0x7f] = cbData;
+		g_mcs51->sfrRead[byte_addr & 0x7f] = readProc;
+		g_mcs51->sfrLatchedRead[byte_addr & 0x7f] = latchedRead;
+		g_mcs51->sfrWrite[byte_addr & 0x7f] = writeProc;
 	}
 	return;
 }
@@ -423,7 +429,7 @@ MCS51_RegisterSFR(uint8_t byte_addr, C51_SfrReadProc * readProc, C51_SfrReadProc
 void
 MCS51_PopIpl(void)
 {
-	MCS51Cpu *mcs51 = &g_mcs51;
+	MCS51Cpu *mcs51 = g_mcs51;
 	if (mcs51->iplStackP > 0) {
 		mcs51->iplStackP--;
 		mcs51->currentIpl = mcs51->iplStack[mcs51->iplStackP];
@@ -437,8 +443,8 @@ MCS51_PopIpl(void)
 void
 MCS51_PostILvl(int ilvl, uint16_t vectAddr)
 {
-	g_mcs51.maxPendingIpl = ilvl;
-	g_mcs51.pendingVectAddr = vectAddr;
+	g_mcs51->maxPendingIpl = ilvl;
+	g_mcs51->pendingVectAddr = vectAddr;
 	MCS51_UpdateIPL();
 }
 
@@ -5,8 +5,10 @@
 #include <stdlib.h>
 #include "diskimage.h"
 #include "throttle.h"
+#include "compiler_extensions.h"
 #include "signode.h"
 #include "clock.h"
+#include "cycletimer.h"
 
 #define PSW_CY	(1<<7)
 #define PSW_AC	(1<<6)
@@ -68,31 +70,32 @@ typedef struct MCS51Cpu {
 	Clock_t *clock1;
 	Clock_t *clock6;
 	Clock_t *clock12;
+	CycleTimerDomain *timerDomain;
 } MCS51Cpu;
 
-#define ICODE   (g_mcs51.icode)
-#define GET_REG_PC 	(g_mcs51.pc)
-#define SET_REG_PC(val) ((g_mcs51.pc) = (val))
-#define PSW (g_mcs51.psw)
+#define ICODE   (g_mcs51->icode)
+#define GET_REG_PC 	(g_mcs51->pc)
+#define SET_REG_PC(val) ((g_mcs51->pc) = (val))
+#define PSW (g_mcs51->psw)
 
-extern MCS51Cpu g_mcs51;
+extern __THREAD_LOCAL__ MCS51Cpu *g_mcs51;
 
 static inline void
 MCS51_SetPSW(uint8_t val)
 {
-	g_mcs51.psw = val;
+	g_mcs51->psw = val;
 	switch (val & (PSW_RS0 | PSW_RS1)) {
 	    case 0:
-		    g_mcs51.r0p = &g_mcs51.iram[0];
+		    g_mcs51->r0p = &g_mcs51->iram[0];
 		    break;
 	    case PSW_RS0:
-		    g_mcs51.r0p = &g_mcs51.iram[8];
+		    g_mcs51->r0p = &g_mcs51->iram[8];
 		    break;
 	    case PSW_RS1:
-		    g_mcs51.r0p = &g_mcs51.iram[16];
+		    g_mcs51->r0p = &g_mcs51->iram[16];
 		    break;
 	    case PSW_RS0 | PSW_RS1:
-		    g_mcs51.r0p = &g_mcs51.iram[24];
+		    g_mcs51->r0p = &g_mcs51->iram[24];
 		    break;
 	    default:
 		    break;
@@ -105,8 +108,8 @@ void MCS51_RegisterSFR(uint8_t byte_addr, C51_SfrReadProc * readProc, C51_SfrRea
 static inline uint8_t
 MCS51_ReadPgmMem(uint16_t addr)
 {
-	if (addr < g_mcs51.approm_size) {
-		return g_mcs51.approm[addr];
+	if (addr < g_mcs51->approm_size) {
+		return g_mcs51->approm[addr];
 	} else {
 		return 0;
 	}
@@ -122,12 +125,12 @@ static inline uint8_t
 MCS51_ReadMemDirect(uint8_t byte_addr)
 {
 	if (byte_addr < 128) {
-		return g_mcs51.iram[byte_addr];
+		return g_mcs51->iram[byte_addr];
 	} else {
 		C51_SfrReadProc *sfrRead;
 		void *dev;
-		dev = g_mcs51.sfrDev[byte_addr & 0x7f];
-		sfrRead = g_mcs51.sfrRead[byte_addr & 0x7f];
+		dev = g_mcs51->sfrDev[byte_addr & 0x7f];
+		sfrRead = g_mcs51->sfrRead[byte_addr & 0x7f];
 		if (sfrRead) {
 			return sfrRead(dev, byte_addr);
 		} else {
@@ -141,14 +144,14 @@ static inline uint8_t
 MCS51_ReadLatchedMemDirect(uint8_t byte_addr)
 {
 	if (byte_addr < 128) {
-		return g_mcs51.iram[byte_addr];
+		return g_mcs51->iram[byte_addr];
 	} else {
 		C51_SfrReadProc *sfrRead;
 		void *dev;
-		dev = g_mcs51.sfrDev[byte_addr & 0x7f];
-		sfrRead = g_mcs51.sfrLatchedRead[byte_addr & 0x7f];
+		dev = g_mcs51->sfrDev[byte_addr & 0x7f];
+		sfrRead = g_mcs51->sfrLatchedRead[byte_addr & 0x7f];
 		if (!sfrRead) {
-			sfrRead = g_mcs51.sfrRead[byte_addr & 0x7f];
+			sfrRead = g_mcs51->sfrRead[byte_addr & 0x7f];
 		}
 		if (sfrRead) {
 			return sfrRead(dev, byte_addr);
@@ -162,19 +165,19 @@ MCS51_ReadLatchedMemDirect(uint8_t byte_addr)
 static inline uint8_t
 MCS51_ReadMemIndirect(uint8_t byte_addr)
 {
-	return g_mcs51.iram[byte_addr];
+	return g_mcs51->iram[byte_addr];
 }
 
 static inline void
 MCS51_WriteMemDirect(uint8_t val, uint8_t byte_addr)
 {
 	if (byte_addr < 128) {
-		g_mcs51.iram[byte_addr] = val;
+		g_mcs51->iram[byte_addr] = val;
 	} else {
 		C51_SfrWriteProc *writeProc;
 		void *dev;
-		writeProc = g_mcs51.sfrWrite[byte_addr & 0x7f];
-		dev = g_mcs51.sfrDev[byte_addr & 0x7f];
+		writeProc = g_mcs51->sfrWrite[byte_addr & 0x7f];
+		dev = g_mcs51->sfrDev[byte_addr & 0x7f];
 		if (writeProc) {
 			writeProc(dev, byte_addr, val);
 		} else {
@@ -186,7 +189,7 @@ MCS51_WriteMemDirect(uint8_t val, uint8_t byte_addr)
 static inline void
 MCS51_WriteMemIndirect(uint8_t val, uint8_t byte_addr)
 {
-	g_mcs51.iram[byte_addr] = val;
+	g_mcs51->iram[byte_addr] = val;
 }
 
 static inline uint8_t
@@ -255,8 +258,8 @@ static inline uint8_t
 MCS51_ReadExmem(uint16_t word_addr)
 {
 	unsigned int entryNr = word_addr >> EXMEM_MAP_ENTRY_SHIFT;
-	if (g_mcs51.exmemReadProc[entryNr]) {
-		return g_mcs51.exmemReadProc[entryNr] (g_mcs51.exmemDev[entryNr], word_addr);
+	if (g_mcs51->exmemReadProc[entryNr]) {
+		return g_mcs51->exmemReadProc[entryNr] (g_mcs51->exmemDev[entryNr], word_addr);
 	} else {
 		fprintf(stderr, "Read outside of exmem: %04x\n", word_addr);
 		return 0;
@@ -267,8 +270,8 @@ static inline void
 MCS51_WriteExmem(uint8_t val, uint16_t word_addr)
 {
 	unsigned int entryNr = word_addr >> EXMEM_MAP_ENTRY_SHIFT;
-	if (g_mcs51.exmemWriteProc[entryNr]) {
-		return g_mcs51.exmemWriteProc[entryNr] (g_mcs51.exmemDev[entryNr], word_addr, val);
+	if (g_mcs51->exmemWriteProc[entryNr]) {
+		return g_mcs51->exmemWriteProc[entryNr] (g_mcs51->exmemDev[entryNr], word_addr, val);
 	} else {
 		fprintf(stderr, "Write outside of exmem: %04x\n", word_addr);
 	}
@@ -277,82 +280,82 @@ MCS51_WriteExmem(uint8_t val, uint16_t word_addr)
 static inline void
 MCS51_SetAcc(uint8_t val)
 {
-	g_mcs51.regAcc = val;
+	g_mcs51->regAcc = val;
 }
 
 static inline uint8_t
 MCS51_GetAcc(void)
 {
-	return g_mcs51.regAcc;
+	return g_mcs51->regAcc;
 }
 
 static inline uint8_t
 MCS51_GetRegB(void)
 {
-	return g_mcs51.regB;
+	return g_mcs51->regB;
 }
 
 static inline void
 MCS51_SetRegB(uint8_t value)
 {
-	g_mcs51.regB = value;
+	g_mcs51->regB = value;
 }
 
 static inline uint16_t
 MCS51_GetRegDptr(void)
 {
-	return g_mcs51.dptr;
+	return g_mcs51->dptr;
 }
 
 static inline void
 MCS51_SetRegDptr(uint16_t val)
 {
-	g_mcs51.dptr = val;
+	g_mcs51->dptr = val;
 }
 
 static inline uint8_t
 MCS51_GetRegSP(void)
 {
-	return g_mcs51.sp;
+	return g_mcs51->sp;
 }
 
 static inline void
 MCS51_SetRegSP(uint8_t val)
 {
-	g_mcs51.sp = val;
+	g_mcs51->sp = val;
 }
 
 static inline void
 MCS51_SetRegR(uint8_t val, int reg)
 {
-	g_mcs51.r0p[reg] = val;
+	g_mcs51->r0p[reg] = val;
 }
 
 static inline uint8_t
 MCS51_GetRegR(int reg)
 {
-	return g_mcs51.r0p[reg];
+	return g_mcs51->r0p[reg];
 }
 
 static inline void
 MCS51_UpdateSignals(void)
 {
-	//g_mcs51.signals = g_mcs51.signals_raw & g_mcs51.signals_mask;
-	g_mcs51.signals = g_mcs51.signals_raw;
+	//g_mcs51->signals = g_mcs51->signals_raw & g_mcs51->signals_mask;
+	g_mcs51->signals = g_mcs51->signals_raw;
 }
 
 static inline void
 MCS51_PostSignal(uint32_t signal)
 {
-	g_mcs51.signals_raw |= signal;
+	g_mcs51->signals_raw |= signal;
 	MCS51_UpdateSignals();
 }
 
 static inline void
 MCS51_UnpostSignal(uint32_t signal)
 {
-	g_mcs51.signals_raw &= ~signal;
-	g_mcs51.signals = g_mcs51.signals_raw & g_mcs51.signals_mask;
+	g_mcs51->signals_raw &= ~signal;
+	g_mcs51->signals = g_mcs51->signals_raw & g_mcs51->signals_mask;
 }
 
 void
@@ -909,6 +909,19 @@ MCS51_IDecoderNew(unsigned int cycles_multiplicator)
 	uint32_t icode;
 	int j;
 	int num_instr = array_size(instrlist); 
+	static unsigned int decoder_multiplicator;
+	if (mcs51_iProcTab) {
+		/*
+		 * The tables are shared by all MCS51 CPUs. The cycle counts
+		 * are scaled in the instruction list, so they must agree.
+		 */
+		if (cycles_multiplicator != decoder_multiplicator) {
+			fprintf(stderr, "MCS51 CPUs with different cycle_mult are not supported\n");
+			exit(1);
+		}
+		return;
+	}
+	decoder_multiplicator = cycles_multiplicator;
 	mcs51_iProcTab = sg_calloc(sizeof(MCS51_InstructionProc *) * 0x100);
 	mcs51_instrTab = sg_calloc(sizeof(MCS51_Instruction *) * 0x100);
 	for (icode = 0; icode < 256; icode++) {
@@ -0,0 +1,429 @@
+//===-- netcapture.c ----------------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// pcap-ng capture of the frames of an emulated network interface
+///
+/// The ring is a bounded multi producer queue with a sequence number per
+/// slot: the receive path (AsyncManager thread) and the transmit path (CPU
+/// thread) of a MAC model put frames concurrently, the writer thread is
+/// the only consumer. Producers wake the writer only when the ring is half
+/// full, otherwise it looks for new frames every WRITER_PERIOD_MS.
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Main Module Header
+#include "netcapture.h"
+
+// Local/Private Headers
+#include "configfile.h"
+#include "cycletimer.h"
+#include "exithandler.h"
+#include "sgstring.h"
+
+// System headers
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define WRITER_PERIOD_MS	(10)
+#define RING_MASK		(NETCAPTURE_RING_SLOTS - 1)
+
+#define BT_SHB		(0x0A0D0D0A)
+#define BT_IDB		(0x00000001)
+#define BT_ISB		(0x00000005)
+#define BT_EPB		(0x00000006)
+#define BYTE_ORDER_MAGIC	(0x1A2B3C4D)
+#define LINKTYPE_ETHERNET	(1)
+
+#define OPT_ENDOFOPT	(0)
+#define OPT_IF_NAME	(2)
+#define OPT_IF_TSRESOL	(9)
+#define OPT_EPB_FLAGS	(2)
+#define OPT_ISB_IFRECV	(4)
+#define OPT_ISB_IFDROP	(5)
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct CaptureSlot {
+	uint64_t seq;		/* == position + 1 when the frame is ready */
+	uint64_t timestamp;	/* Nanoseconds of emulated time */
+	uint32_t len;
+	uint16_t caplen;
+	uint8_t dir;
+	uint8_t data[NETCAPTURE_SNAPLEN];
+} CaptureSlot;
+
+struct NetCapture {
+	char *path;
+	char *ifname;
+	FILE *file;
+	CycleTimerDomain *domain;
+	CaptureSlot *slot;
+	uint8_t pad0[64];
+	uint64_t head;		/* Next position for a producer */
+	uint8_t pad1[64];
+	uint64_t tail;		/* Written by the writer only */
+	uint8_t pad2[64];
+	uint64_t frames;
+	uint64_t drops;
+	int kicked;
+	int stop;
+	int wakeup[2];
+	pthread_t thread;
+};
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static inline uint32_t
+pad4(uint32_t len)
+{
+	return (len + 3) & ~3;
+}
+
+static void
+put_u32(FILE * file, uint32_t value)
+{
+	fwrite(&value, sizeof(value), 1, file);
+}
+
+static void
+put_u64(FILE * file, uint64_t value)
+{
+	fwrite(&value, sizeof(value), 1, file);
+}
+
+static void
+put_option(FILE * file, uint16_t code, const void *value, uint16_t len)
+{
+	static const uint8_t zero[4];
+	uint16_t hdr[2] = { code, len };
+	fwrite(hdr, sizeof(hdr), 1, file);
+	fwrite(value, len, 1, file);
+	fwrite(zero, pad4(len) - len, 1, file);
+}
+
+static void
+write_section_header(FILE * file)
+{
+	uint16_t version[2] = { 1, 0 };
+	put_u32(file, BT_SHB);
+	put_u32(file, 28);
+	put_u32(file, BYTE_ORDER_MAGIC);
+	fwrite(version, sizeof(version), 1, file);
+	put_u64(file, ~UINT64_C(0));	/* Section length unknown */
+	put_u32(file, 28);
+}
+
+static void
+write_interface_description(FILE * file, const char *ifname)
+{
+	uint16_t namelen = strlen(ifname);
+	uint8_t tsresol = 9;	/* Nanoseconds */
+	uint16_t linktype[2] = { LINKTYPE_ETHERNET, 0 };
+	uint32_t total = 20 + 4 + pad4(namelen) + 4 + 4 + 4;
+	put_u32(file, BT_IDB);
+	put_u32(file, total);
+	fwrite(linktype, sizeof(linktype), 1, file);
+	put_u32(file, NETCAPTURE_SNAPLEN);
+	put_option(file, OPT_IF_NAME, ifname, namelen);
+	put_option(file, OPT_IF_TSRESOL, &tsresol, 1);
+	put_u32(file, OPT_ENDOFOPT);
+	put_u32(file, total);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Enhanced packet block, assembled in place so that it is one fwrite
+ * ------------------------------------------------------------------------
+ */
+static void
+write_packet(FILE * file, CaptureSlot * slot)
+{
+	uint32_t buf[(28 + NETCAPTURE_SNAPLEN + 16) / 4];
+	uint32_t padded = pad4(slot->caplen);
+	uint32_t total = 28 + padded + 8 + 4 + 4;
+	uint32_t *opt = buf + (28 + padded) / 4;
+	buf[0] = BT_EPB;
+	buf[1] = total;
+	buf[2] = 0;		/* Interface */
+	buf[3] = slot->timestamp >> 32;
+	buf[4] = slot->timestamp;
+	buf[5] = slot->caplen;
+	buf[6] = slot->len;
+	buf[(28 + padded) / 4 - 1] = 0;
+	memcpy(buf + 7, slot->data, slot->caplen);
+	opt[0] = OPT_EPB_FLAGS | (4 << 16);
+	opt[1] = slot->dir;	/* Bits 0-1: inbound/outbound */
+	opt[2] = OPT_ENDOFOPT;
+	opt[3] = total;
+	fwrite_unlocked(buf, total, 1, file);
+}
+
+static void
+write_statistics(NetCapture * cap, uint64_t timestamp)
+{
+	uint64_t frames = __atomic_load_n(&cap->frames, __ATOMIC_RELAXED);
+	uint64_t drops = __atomic_load_n(&cap->drops, __ATOMIC_RELAXED);
+	uint32_t total = 20 + 12 + 12 + 4 + 4;
+	put_u32(cap->file, BT_ISB);
+	put_u32(cap->file, total);
+	put_u32(cap->file, 0);
+	put_u32(cap->file, timestamp >> 32);
+	put_u32(cap->file, timestamp);
+	put_option(cap->file, OPT_ISB_IFRECV, &frames, 8);
+	put_option(cap->file, OPT_ISB_IFDROP, &drops, 8);
+	put_u32(cap->file, OPT_ENDOFOPT);
+	put_u32(cap->file, total);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Emulated time of the clock domain of the interface. The counter
+ * belongs to the CPU thread, it is only read here.
+ * ------------------------------------------------------------------------
+ */
+static uint64_t
+emulated_time_ns(NetCapture * cap)
+{
+	uint64_t cycles = __atomic_load_n(&cap->domain->cycleCounter, __ATOMIC_RELAXED);
+	uint64_t rate = cap->domain->rate;
+	if (!rate) {
+		return 0;
+	}
+	return (cycles / rate) * 1000000000 + ((cycles % rate) * 1000000000) / rate;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Write all frames which are ready. Returns the number of frames.
+ * ------------------------------------------------------------------------
+ */
+static unsigned int
+capture_drain(NetCapture * cap)
+{
+	CaptureSlot *slot;
+	uint64_t tail = cap->tail;
+	unsigned int count = 0;
+	while (1) {
+		slot = &cap->slot[tail & RING_MASK];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != (tail + 1)) {
+			break;
+		}
+		write_packet(cap->file, slot);
+		__atomic_store_n(&slot->seq, tail + NETCAPTURE_RING_SLOTS, __ATOMIC_RELEASE);
+		tail++;
+		__atomic_store_n(&cap->tail, tail, __ATOMIC_RELEASE);
+		count++;
+	}
+	return count;
+}
+
+static void *
+capture_writer(void *arg)
+{
+	NetCapture *cap = arg;
+	struct pollfd pfd = { cap->wakeup[0], POLLIN, 0 };
+	char buf[64];
+	while (1) {
+		if (capture_drain(cap)) {
+			fflush(cap->file);
+			continue;
+		}
+		if (__atomic_load_n(&cap->stop, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		if (poll(&pfd, 1, WRITER_PERIOD_MS) > 0) {
+			while (read(cap->wakeup[0], buf, sizeof(buf)) > 0) {
+			}
+		}
+		__atomic_store_n(&cap->kicked, 0, __ATOMIC_RELAXED);
+	}
+	capture_drain(cap);
+	write_statistics(cap, emulated_time_ns(cap));
+	fclose(cap->file);
+	return NULL;
+}
+
+static void
+capture_kick(NetCapture * cap)
+{
+	if (write(cap->wakeup[1], "", 1) < 0) {
+		/* The pipe is full, so the writer wakes up anyway */
+	}
+}
+
+static void
+capture_exit(void *data)
+{
+	NetCapture *cap = data;
+	NetCapture_Close(cap);
+	if (cap->drops) {
+		fprintf(stderr, "Capture %s: %llu of %llu frames dropped\n", cap->path,
+			(unsigned long long)cap->drops, (unsigned long long)cap->frames);
+	}
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+
+/*
+ * ------------------------------------------------------------------------
+ * Put a frame into the ring. Called from the CPU thread and from the
+ * AsyncManager thread, never blocks.
+ * ------------------------------------------------------------------------
+ */
+void
+NetCapture_Put(NetCapture * cap, NetCapture_Direction dir, const void *frame, unsigned int len)
+{
+	CaptureSlot *slot;
+	uint64_t pos = __atomic_load_n(&cap->head, __ATOMIC_RELAXED);
+	uint64_t seq;
+	int64_t diff;
+	__atomic_fetch_add(&cap->frames, 1, __ATOMIC_RELAXED);
+	while (1) {
+		slot = &cap->slot[pos & RING_MASK];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (int64_t) (seq - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&cap->head, &pos, pos + 1, 1,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			/* Full, the writer is behind */
+			__atomic_fetch_add(&cap->drops, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&cap->head, __ATOMIC_RELAXED);
+		}
+	}
+	slot->timestamp = emulated_time_ns(cap);
+	slot->len = len;
+	slot->caplen = (len < NETCAPTURE_SNAPLEN) ? len : NETCAPTURE_SNAPLEN;
+	slot->dir = dir;
+	memcpy(slot->data, frame, slot->caplen);
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	if (((pos - __atomic_load_n(&cap->tail, __ATOMIC_ACQUIRE)) >= (NETCAPTURE_RING_SLOTS / 2))
+	    && !__atomic_exchange_n(&cap->kicked, 1, __ATOMIC_RELAXED)) {
+		capture_kick(cap);
+	}
+}
+
+uint64_t
+NetCapture_Drops(NetCapture * cap)
+{
+	return __atomic_load_n(&cap->drops, __ATOMIC_RELAXED);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Start a capture to a new file. The timestamps are taken from the clock
+ * domain which is selected by the calling thread.
+ * ------------------------------------------------------------------------
+ */
+NetCapture *
+NetCapture_Open(const char *path, const char *ifname)
+{
+	NetCapture *cap = sg_new(NetCapture);
+	unsigned int i;
+	cap->file = fopen(path, "w");
+	if (!cap->file) {
+		perror(path);
+		sg_free(cap);
+		return NULL;
+	}
+	if (pipe(cap->wakeup) < 0) {
+		perror("NetCapture pipe");
+		fclose(cap->file);
+		sg_free(cap);
+		return NULL;
+	}
+	fcntl(cap->wakeup[0], F_SETFL, O_NONBLOCK);
+	fcntl(cap->wakeup[1], F_SETFL, O_NONBLOCK);
+	setvbuf(cap->file, NULL, _IOFBF, 256 * 1024);
+	cap->path = sg_strdup(path);
+	cap->ifname = sg_strdup(ifname);
+	cap->domain = CycleTimers_Domain();
+	cap->slot = sg_calloc(NETCAPTURE_RING_SLOTS * sizeof(CaptureSlot));
+	for (i = 0; i < NETCAPTURE_RING_SLOTS; i++) {
+		cap->slot[i].seq = i;
+	}
+	write_section_header(cap->file);
+	write_interface_description(cap->file, ifname);
+	if (pthread_create(&cap->thread, NULL, capture_writer, cap) != 0) {
+		fprintf(stderr, "Capture %s: can not create the writer thread\n", path);
+		fclose(cap->file);
+		return NULL;
+	}
+	return cap;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Write the remaining frames and close the file. The NetCapture stays
+ * valid, frames put afterwards are dropped.
+ * ------------------------------------------------------------------------
+ */
+void
+NetCapture_Close(NetCapture * cap)
+{
+	if (__atomic_exchange_n(&cap->stop, 1, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+	capture_kick(cap);
+	pthread_join(cap->thread, NULL);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Capture of an emulated network interface if the configfile section
+ * of the interface has a "capture" filename, NULL otherwise.
+ * ------------------------------------------------------------------------
+ */
+NetCapture *
+NetCapture_New(const char *devname)
+{
+	NetCapture *cap;
+	char *path = Config_ReadVar(devname, "capture");
+	if (!path) {
+		return NULL;
+	}
+	cap = NetCapture_Open(path, devname);
+	if (cap) {
+		fprintf(stderr, "%s: capturing frames to %s\n", devname, path);
+		ExitHandler_Register(capture_exit, cap);
+	}
+	return cap;
+}
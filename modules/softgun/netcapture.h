@@ -0,0 +1,88 @@
+//===-- netcapture.h ----------------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// pcap-ng capture of the frames of an emulated network interface
+///
+/// The MAC model hands every received and transmitted frame to
+/// NetCapture_Frame. The frame is copied into a lock-free ring together
+/// with a timestamp in emulated time (CycleCounter of the clock domain
+/// the interface was created in). A writer thread takes the frames from
+/// the ring and writes them to the pcap-ng file, so the CPU thread never
+/// waits for the disk. When the ring is full the frame is not captured
+/// and counted as dropped in the statistics of the file.
+///
+/// Capture is enabled in the configfile section of the interface:
+///
+///	[emac0]
+///	capture: emac0.pcapng
+///
+//===----------------------------------------------------------------------===//
+#ifndef NETCAPTURE_H
+#define NETCAPTURE_H
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// System headers
+#include <stdint.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define NETCAPTURE_SNAPLEN	(2048)
+#define NETCAPTURE_RING_SLOTS	(1024)
+
+typedef enum NetCapture_Direction {
+	NETCAPTURE_RX = 1,
+	NETCAPTURE_TX = 2,
+} NetCapture_Direction;
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct NetCapture NetCapture;
+
+
+//==============================================================================
+//= Functions
+//==============================================================================
+NetCapture *NetCapture_New(const char *devname);
+NetCapture *NetCapture_Open(const char *path, const char *ifname);
+void NetCapture_Close(NetCapture * cap);
+void NetCapture_Put(NetCapture * cap, NetCapture_Direction dir, const void *frame,
+		    unsigned int len);
+uint64_t NetCapture_Drops(NetCapture * cap);
+
+/*
+ * ------------------------------------------------------------------------
+ * Capture a frame if capture is enabled for the interface (cap != NULL)
+ * ------------------------------------------------------------------------
+ */
+static inline void
+NetCapture_Frame(NetCapture * cap, NetCapture_Direction dir, const void *frame,
+		 unsigned int len)
+{
+	if (cap) {
+		NetCapture_Put(cap, dir, frame, len);
+	}
+}
+
+#endif
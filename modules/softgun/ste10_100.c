@@ -61,6 +61,7 @@
 #include "signode.h"
 #include "m93c46.h"
 #include "linux-tap.h"
+#include "netcapture.h"
 #include "cycletimer.h"
 #include "sgstring.h"
 #include "asyncmanager.h"
@@ -213,6 +214,7 @@ typedef struct STE10_100 {
 	int dev_nr;
 
 	int ether_fd;		// file descriptor for the data
+	NetCapture *capture;
 	PollHandle_t *input_fh;
 	int receiver_is_enabled;
 	SigNode *irqNode[4];
@@ -461,10 +463,15 @@ fill_rxfifo(STE10_100 * ste)
 	char buf[2048];
 	if (ste->rxfifo_count) {
 		dbgprintf("Paket loss, rxfifo is full !\n");
-		return read(ste->ether_fd, buf, 2048);
+		result = read(ste->ether_fd, buf, 2048);
+		if (result > 0) {
+			NetCapture_Frame(ste->capture, NETCAPTURE_RX, buf, result);
+		}
+		return result;
 	}
 	result = read(ste->ether_fd, ste->rx_fifo, 2048);
 	if (result > 0) {
+		NetCapture_Frame(ste->capture, NETCAPTURE_RX, ste->rx_fifo, result);
 		ste->rxfifo_count = result;
 	}
 	return result;
@@ -682,6 +689,7 @@ transmit(STE10_100 * ste)
 		if (len1) {
 			dbgprintf("\n");
 			pci_data_read(ste, buf1, data, len1);
+			NetCapture_Frame(ste->capture, NETCAPTURE_TX, data, len1);
 			count = 0;
 			do {
 				int result;
@@ -699,6 +707,7 @@ transmit(STE10_100 * ste)
 		}
 		if (len2 && !chain) {
 			pci_data_read(ste, buf2, data, len2);
+			NetCapture_Frame(ste->capture, NETCAPTURE_TX, data, len2);
 			count = 0;
 			do {
 				int result;
@@ -2010,6 +2019,7 @@ STE_New(const char *devname, PCI_Function * bridge, int dev_nr, int bus_irq)
 	SigNode_Set(ste->edi, SIG_LOW);
 	SigNode_Set(ste->eck, SIG_LOW);
 	ste->ether_fd = Net_CreateInterface(devname);
+	ste->capture = NetCapture_New(devname);
 	ste->input_fh = AsyncManager_PollInit(ste->ether_fd);
 	STE_Reset(ste);
 	XCR(ste) = 0x1000;
@@ -203,6 +203,26 @@ HcMasterRead32(OhciHC * hc, uint32_t addr)
 	}
 }
 
+/*
+ * ------------------------------------------------------------
+ * Read a descriptor with a single block transfer and convert
+ * it to host byte order
+ * ------------------------------------------------------------
+ */
+static inline void
+HcMasterReadDescr(OhciHC * hc, uint32_t * data, uint32_t addr, int words)
+{
+	int i;
+	hc->bus->readblock((uint8_t *) data, addr, words << 2);
+	for (i = 0; i < words; i++) {
+		if (hc->endian == BYTE_ORDER_BIG) {
+			data[i] = HMemRead32((uint8_t *) & data[i]);
+		} else {
+			data[i] = BYTE_Swap32(HMemRead32((uint8_t *) & data[i]));
+		}
+	}
+}
+
 #define RET_SUCCESS        (0)
 #define RET_NONE_AVAILABLE (1)
 #define RET_END_OF_FRAME   (2)
@@ -217,23 +237,27 @@ HcMasterRead32(OhciHC * hc, uint32_t addr)
 static void
 HcReadGTD(OhciHC * hc, GeneralTD * gtd, uint32_t addr)
 {
-	gtd->hwControl = HcMasterRead32(hc, addr);
-	gtd->hwCBP = HcMasterRead32(hc, addr + 4);
-	gtd->hwNextTD = HcMasterRead32(hc, addr + 8);
-	gtd->hwBE = HcMasterRead32(hc, addr + 12);
+	uint32_t data[4];
+	HcMasterReadDescr(hc, data, addr, 4);
+	gtd->hwControl = data[0];
+	gtd->hwCBP = data[1];
+	gtd->hwNextTD = data[2];
+	gtd->hwBE = data[3];
 }
 
 static void
 HcReadITD(OhciHC * hc, IsoTD * itd, uint32_t addr)
 {
-	itd->hwControl = HcMasterRead32(hc, addr);
-	itd->hwBP0 = HcMasterRead32(hc, addr + 4);
-	itd->hwNextTD = HcMasterRead32(hc, addr + 8);
-	itd->hwBE = HcMasterRead32(hc, addr + 12);
-	itd->hwOffset01 = HcMasterRead32(hc, addr + 16);
-	itd->hwOffset23 = HcMasterRead32(hc, addr + 20);
-	itd->hwOffset45 = HcMasterRead32(hc, addr + 24);
-	itd->hwOffset67 = HcMasterRead32(hc, addr + 28);
+	uint32_t data[8];
+	HcMasterReadDescr(hc, data, addr, 8);
+	itd->hwControl = data[0];
+	itd->hwBP0 = data[1];
+	itd->hwNextTD = data[2];
+	itd->hwBE = data[3];
+	itd->hwOffset01 = data[4];
+	itd->hwOffset23 = data[5];
+	itd->hwOffset45 = data[6];
+	itd->hwOffset67 = data[7];
 }
 
 /*
@@ -269,10 +293,12 @@ HcRetireITD(OhciHC * hc, IsoTD * itd, uint32_t itd_address)
 static void
 HcReadED(OhciHC * hc, EndPointDescriptor * ed, uint32_t addr)
 {
-	ed->hwControl = HcMasterRead32(hc, addr);
-	ed->hwTailP = HcMasterRead32(hc, addr + 4);
-	ed->hwHeadP = HcMasterRead32(hc, addr + 8);
-	ed->hwNextED = HcMasterRead32(hc, addr + 12);
+	uint32_t data[4];
+	HcMasterReadDescr(hc, data, addr, 4);
+	ed->hwControl = data[0];
+	ed->hwTailP = data[1];
+	ed->hwHeadP = data[2];
+	ed->hwNextED = data[3];
 }
 
 /*
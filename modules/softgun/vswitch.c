@@ -0,0 +1,568 @@
+//===-- vswitch.c -------------------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Virtual Ethernet switch
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Main Module Header
+#include "vswitch.h"
+
+// Local/Private Headers
+#include "sgstring.h"
+
+// System headers
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define MACTAB_BITS	(10)
+#define MACTAB_SIZE	(1 << MACTAB_BITS)
+#define MACTAB_PROBES	(8)
+#define PORT_BURST	(64)	/* Frames read from one port per wakeup */
+#define PORT_BUFSIZE	(1024 * 1024)
+#define CONNECT_RETRIES	(50)
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct VSwitchPort {
+	char name[32];
+	int fd;			/* Switch end of the port, -1 when closed */
+	VSwitch_PortStats stats;
+} VSwitchPort;
+
+typedef struct MacEntry {
+	uint8_t mac[6];
+	uint8_t valid;
+	uint8_t port;
+} MacEntry;
+
+struct VSwitch {
+	VSwitch *next;
+	char *name;
+	pthread_mutex_t lock;	/* Serializes adding ports */
+	VSwitchPort port[VSWITCH_MAX_PORTS];
+	unsigned int nr_ports;
+	unsigned int nr_remote;
+	int listen_fd;
+	int wakeup[2];
+	int thread_started;
+	pthread_t thread;
+	/* Only used by the forwarding thread */
+	MacEntry mactab[MACTAB_SIZE];
+};
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+static VSwitch *switchList;
+static pthread_mutex_t switchListLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static int
+set_nonblocking(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+	if (flags < 0) {
+		return -1;
+	}
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void
+set_bufsize(int fd)
+{
+	int size = PORT_BUFSIZE;
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * The counters are only written by the forwarding thread
+ * ------------------------------------------------------------------------
+ */
+static inline void
+stat_add(uint64_t * counter, uint64_t value)
+{
+	__atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static inline unsigned int
+mac_hash(const uint8_t * mac)
+{
+	uint32_t h = (mac[2] << 24) | (mac[3] << 16) | (mac[4] << 8) | mac[5];
+	h ^= (mac[0] << 8) | mac[1];
+	h *= 0x9e3779b1;
+	return h >> (32 - MACTAB_BITS);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * MAC learning with open addressing. If all probed entries are used
+ * by other stations the home entry is replaced.
+ * ------------------------------------------------------------------------
+ */
+static void
+mactab_learn(VSwitch * vs, const uint8_t * mac, unsigned int port)
+{
+	unsigned int home = mac_hash(mac);
+	unsigned int i;
+	MacEntry *free_entry = NULL;
+	for (i = 0; i < MACTAB_PROBES; i++) {
+		MacEntry *entry = &vs->mactab[(home + i) & (MACTAB_SIZE - 1)];
+		if (!entry->valid) {
+			if (!free_entry) {
+				free_entry = entry;
+			}
+			continue;
+		}
+		if (memcmp(entry->mac, mac, 6) == 0) {
+			/* The station may have moved */
+			entry->port = port;
+			return;
+		}
+	}
+	if (!free_entry) {
+		free_entry = &vs->mactab[home];
+	}
+	memcpy(free_entry->mac, mac, 6);
+	free_entry->port = port;
+	free_entry->valid = 1;
+}
+
+static int
+mactab_lookup(VSwitch * vs, const uint8_t * mac)
+{
+	unsigned int home = mac_hash(mac);
+	unsigned int i;
+	for (i = 0; i < MACTAB_PROBES; i++) {
+		MacEntry *entry = &vs->mactab[(home + i) & (MACTAB_SIZE - 1)];
+		if (entry->valid && (memcmp(entry->mac, mac, 6) == 0)) {
+			return entry->port;
+		}
+	}
+	return -1;
+}
+
+static void
+mactab_flush_port(VSwitch * vs, unsigned int port)
+{
+	unsigned int i;
+	for (i = 0; i < MACTAB_SIZE; i++) {
+		if (vs->mactab[i].valid && (vs->mactab[i].port == port)) {
+			vs->mactab[i].valid = 0;
+		}
+	}
+}
+
+static void
+port_send(VSwitchPort * port, const uint8_t * frame, size_t len)
+{
+	if (send(port->fd, frame, len, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t) len) {
+		stat_add(&port->stats.tx_frames, 1);
+		stat_add(&port->stats.tx_bytes, len);
+	} else {
+		stat_add(&port->stats.tx_drops, 1);
+	}
+}
+
+static void
+vswitch_forward(VSwitch * vs, unsigned int src, const uint8_t * frame, size_t len,
+		unsigned int nr_ports)
+{
+	unsigned int i;
+	int dst;
+	if (len < 14) {
+		return;
+	}
+	if (!(frame[6] & 1)) {
+		mactab_learn(vs, frame + 6, src);
+	}
+	if (!(frame[0] & 1)) {
+		dst = mactab_lookup(vs, frame);
+		if ((dst >= 0) && (vs->port[dst].fd >= 0)) {
+			if ((unsigned int)dst == src) {
+				stat_add(&vs->port[src].stats.filtered, 1);
+			} else {
+				port_send(&vs->port[dst], frame, len);
+			}
+			return;
+		}
+	}
+	for (i = 0; i < nr_ports; i++) {
+		if ((i != src) && (vs->port[i].fd >= 0)) {
+			port_send(&vs->port[i], frame, len);
+		}
+	}
+}
+
+static void
+vswitch_close_port(VSwitch * vs, unsigned int idx)
+{
+	VSwitchPort *port = &vs->port[idx];
+	fprintf(stderr, "VSwitch %s: port %s closed\n", vs->name, port->name);
+	close(port->fd);
+	port->fd = -1;
+	mactab_flush_port(vs, idx);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Read up to PORT_BURST frames from a port, so a busy port can not
+ * starve the others.
+ * ------------------------------------------------------------------------
+ */
+static void
+vswitch_serve_port(VSwitch * vs, unsigned int idx, unsigned int nr_ports)
+{
+	VSwitchPort *port = &vs->port[idx];
+	uint8_t frame[VSWITCH_MAX_FRAME];
+	ssize_t len;
+	int i;
+	for (i = 0; i < PORT_BURST; i++) {
+		len = recv(port->fd, frame, sizeof(frame), MSG_DONTWAIT);
+		if (len > 0) {
+			stat_add(&port->stats.rx_frames, 1);
+			stat_add(&port->stats.rx_bytes, len);
+			vswitch_forward(vs, idx, frame, len, nr_ports);
+		} else if ((len == 0) || ((errno != EAGAIN) && (errno != EINTR))) {
+			vswitch_close_port(vs, idx);
+			return;
+		} else {
+			return;
+		}
+	}
+}
+
+static int
+vswitch_add_port(VSwitch * vs, const char *portname, int fd)
+{
+	VSwitchPort *port;
+	unsigned int idx;
+	pthread_mutex_lock(&vs->lock);
+	idx = vs->nr_ports;
+	if (idx >= VSWITCH_MAX_PORTS) {
+		pthread_mutex_unlock(&vs->lock);
+		fprintf(stderr, "VSwitch %s: no free port for %s\n", vs->name, portname);
+		return -1;
+	}
+	port = &vs->port[idx];
+	snprintf(port->name, sizeof(port->name), "%s", portname);
+	port->fd = fd;
+	__atomic_store_n(&vs->nr_ports, idx + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&vs->lock);
+	return idx;
+}
+
+static void
+vswitch_accept(VSwitch * vs)
+{
+	char portname[32];
+	int fd = accept(vs->listen_fd, NULL, NULL);
+	if (fd < 0) {
+		return;
+	}
+	set_nonblocking(fd);
+	set_bufsize(fd);
+	snprintf(portname, sizeof(portname), "remote%u", vs->nr_remote++);
+	if (vswitch_add_port(vs, portname, fd) < 0) {
+		close(fd);
+		return;
+	}
+	fprintf(stderr, "VSwitch %s: port %s connected\n", vs->name, portname);
+}
+
+static void *
+vswitch_thread(void *arg)
+{
+	VSwitch *vs = arg;
+	struct pollfd pfd[VSWITCH_MAX_PORTS + 2];
+	unsigned int pfd_port[VSWITCH_MAX_PORTS + 2];
+	unsigned int nr_pfds, nr_ports, i;
+	int listen_fd;
+	char buf[64];
+	while (1) {
+		nr_ports = __atomic_load_n(&vs->nr_ports, __ATOMIC_ACQUIRE);
+		listen_fd = __atomic_load_n(&vs->listen_fd, __ATOMIC_ACQUIRE);
+		nr_pfds = 0;
+		pfd[nr_pfds].fd = vs->wakeup[0];
+		pfd[nr_pfds++].events = POLLIN;
+		if (listen_fd >= 0) {
+			pfd[nr_pfds].fd = listen_fd;
+			pfd[nr_pfds++].events = POLLIN;
+		}
+		for (i = 0; i < nr_ports; i++) {
+			if (vs->port[i].fd >= 0) {
+				pfd_port[nr_pfds] = i;
+				pfd[nr_pfds].fd = vs->port[i].fd;
+				pfd[nr_pfds++].events = POLLIN;
+			}
+		}
+		if (poll(pfd, nr_pfds, -1) < 0) {
+			if (errno != EINTR) {
+				perror("VSwitch poll");
+				sleep(1);
+			}
+			continue;
+		}
+		if (pfd[0].revents & POLLIN) {
+			while (read(vs->wakeup[0], buf, sizeof(buf)) > 0) {
+			}
+		}
+		i = 1;
+		if (listen_fd >= 0) {
+			if (pfd[i].revents & POLLIN) {
+				vswitch_accept(vs);
+			}
+			i++;
+		}
+		for (; i < nr_pfds; i++) {
+			if (pfd[i].revents & POLLIN) {
+				vswitch_serve_port(vs, pfd_port[i], nr_ports);
+			} else if (pfd[i].revents & (POLLHUP | POLLERR)) {
+				vswitch_close_port(vs, pfd_port[i]);
+			}
+		}
+	}
+	return NULL;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Tell the forwarding thread that there is something new to poll. The
+ * thread is started with the first port.
+ * ------------------------------------------------------------------------
+ */
+static int
+vswitch_kick(VSwitch * vs)
+{
+	int result = 0;
+	pthread_mutex_lock(&vs->lock);
+	if (!vs->thread_started) {
+		if (pthread_create(&vs->thread, NULL, vswitch_thread, vs) != 0) {
+			fprintf(stderr, "VSwitch %s: can not create the forwarding thread\n",
+				vs->name);
+			result = -1;
+		} else {
+			vs->thread_started = 1;
+		}
+	}
+	pthread_mutex_unlock(&vs->lock);
+	if (write(vs->wakeup[1], "", 1) < 0) {
+		/* The pipe is full, so the thread wakes up anyway */
+	}
+	return result;
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+
+VSwitch *
+VSwitch_Find(const char *name)
+{
+	VSwitch *vs;
+	pthread_mutex_lock(&switchListLock);
+	for (vs = switchList; vs; vs = vs->next) {
+		if (strcmp(vs->name, name) == 0) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&switchListLock);
+	return vs;
+}
+
+VSwitch *
+VSwitch_New(const char *name)
+{
+	VSwitch *vs = sg_new(VSwitch);
+	if (pipe(vs->wakeup) < 0) {
+		perror("VSwitch pipe");
+		sg_free(vs);
+		return NULL;
+	}
+	set_nonblocking(vs->wakeup[0]);
+	set_nonblocking(vs->wakeup[1]);
+	vs->name = sg_strdup(name);
+	vs->listen_fd = -1;
+	pthread_mutex_init(&vs->lock, NULL);
+	pthread_mutex_lock(&switchListLock);
+	vs->next = switchList;
+	switchList = vs;
+	pthread_mutex_unlock(&switchListLock);
+	return vs;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Create a port and return the fd for the MAC model. The fd is non
+ * blocking, a frame written while the switch is congested is lost.
+ * ------------------------------------------------------------------------
+ */
+int
+VSwitch_Attach(VSwitch * vs, const char *portname)
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+		perror("VSwitch socketpair");
+		return -1;
+	}
+	set_nonblocking(sv[0]);
+	set_nonblocking(sv[1]);
+	set_bufsize(sv[0]);
+	set_bufsize(sv[1]);
+	if (vswitch_add_port(vs, portname, sv[1]) < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	if (vswitch_kick(vs) < 0) {
+		return -1;
+	}
+	return sv[0];
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Accept ports of simulators in other processes on a unix socket
+ * ------------------------------------------------------------------------
+ */
+int
+VSwitch_Listen(VSwitch * vs, const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "VSwitch %s: socket path too long\n", vs->name);
+		return -1;
+	}
+	fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (fd < 0) {
+		perror("VSwitch socket");
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, 8) < 0)) {
+		fprintf(stderr, "VSwitch %s: can not listen on %s: %s\n", vs->name, path,
+			strerror(errno));
+		close(fd);
+		return -1;
+	}
+	set_nonblocking(fd);
+	__atomic_store_n(&vs->listen_fd, fd, __ATOMIC_RELEASE);
+	return vswitch_kick(vs);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Attach a MAC to the switch of another process. The switch may still
+ * be starting, so the connect is retried for a few seconds.
+ * ------------------------------------------------------------------------
+ */
+int
+VSwitch_Connect(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+	int i;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "VSwitch: socket path too long: %s\n", path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	for (i = 0; i < CONNECT_RETRIES; i++) {
+		fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+		if (fd < 0) {
+			perror("VSwitch socket");
+			return -1;
+		}
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+			set_nonblocking(fd);
+			set_bufsize(fd);
+			return fd;
+		}
+		close(fd);
+		usleep(100000);
+	}
+	fprintf(stderr, "VSwitch: can not connect to %s: %s\n", path, strerror(errno));
+	return -1;
+}
+
+int
+VSwitch_GetPortStats(VSwitch * vs, const char *portname, VSwitch_PortStats * stats)
+{
+	unsigned int nr_ports = __atomic_load_n(&vs->nr_ports, __ATOMIC_ACQUIRE);
+	unsigned int i;
+	for (i = 0; i < nr_ports; i++) {
+		VSwitch_PortStats *src = &vs->port[i].stats;
+		if (strcmp(vs->port[i].name, portname) != 0) {
+			continue;
+		}
+		stats->rx_frames = __atomic_load_n(&src->rx_frames, __ATOMIC_RELAXED);
+		stats->rx_bytes = __atomic_load_n(&src->rx_bytes, __ATOMIC_RELAXED);
+		stats->tx_frames = __atomic_load_n(&src->tx_frames, __ATOMIC_RELAXED);
+		stats->tx_bytes = __atomic_load_n(&src->tx_bytes, __ATOMIC_RELAXED);
+		stats->tx_drops = __atomic_load_n(&src->tx_drops, __ATOMIC_RELAXED);
+		stats->filtered = __atomic_load_n(&src->filtered, __ATOMIC_RELAXED);
+		return 0;
+	}
+	return -1;
+}
+
+void
+VSwitch_DumpStats(VSwitch * vs, FILE * file)
+{
+	unsigned int nr_ports = __atomic_load_n(&vs->nr_ports, __ATOMIC_ACQUIRE);
+	VSwitch_PortStats stats;
+	unsigned int i;
+	fprintf(file, "VSwitch %s:\n", vs->name);
+	for (i = 0; i < nr_ports; i++) {
+		VSwitch_GetPortStats(vs, vs->port[i].name, &stats);
+		fprintf(file, "  %-16s rx %llu frames %llu bytes, tx %llu frames %llu bytes, "
+			"%llu drops, %llu filtered\n", vs->port[i].name,
+			(unsigned long long)stats.rx_frames, (unsigned long long)stats.rx_bytes,
+			(unsigned long long)stats.tx_frames, (unsigned long long)stats.tx_bytes,
+			(unsigned long long)stats.tx_drops, (unsigned long long)stats.filtered);
+	}
+}
@@ -0,0 +1,82 @@
+//===-- vswitch.h -------------------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Virtual Ethernet switch
+///
+/// Connects the emulated network interfaces without a TAP device of the
+/// host. Every port is a SOCK_SEQPACKET socket, so a MAC model reads and
+/// writes one frame per call on its fd exactly like on a TAP. The switch
+/// end of the port is served by the forwarding thread of the switch.
+///
+/// The switch learns the source addresses and forwards unicast frames
+/// with a known destination to one port only. Broadcasts, multicasts and
+/// frames to unknown destinations are flooded. A frame which can not be
+/// queued on a port because its receiver is too slow is dropped and
+/// counted, like on a real switch.
+///
+/// A switch can also listen on a unix socket. Simulators in other
+/// processes attach to it with VSwitch_Connect, their frames are carried
+/// by the connection.
+///
+//===----------------------------------------------------------------------===//
+#ifndef VSWITCH_H
+#define VSWITCH_H
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// System headers
+#include <stdint.h>
+#include <stdio.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define VSWITCH_MAX_PORTS	(64)
+#define VSWITCH_MAX_FRAME	(2048)
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct VSwitch VSwitch;
+
+typedef struct VSwitch_PortStats {
+	uint64_t rx_frames;	/* Received from the MAC of the port */
+	uint64_t rx_bytes;
+	uint64_t tx_frames;	/* Delivered to the MAC of the port */
+	uint64_t tx_bytes;
+	uint64_t tx_drops;	/* Receiver of the port was not ready */
+	uint64_t filtered;	/* Destination is on the source port */
+} VSwitch_PortStats;
+
+
+//==============================================================================
+//= Functions
+//==============================================================================
+VSwitch *VSwitch_New(const char *name);
+VSwitch *VSwitch_Find(const char *name);
+int VSwitch_Attach(VSwitch * vs, const char *portname);
+int VSwitch_Listen(VSwitch * vs, const char *path);
+int VSwitch_Connect(const char *path);
+int VSwitch_GetPortStats(VSwitch * vs, const char *portname, VSwitch_PortStats * stats);
+void VSwitch_DumpStats(VSwitch * vs, FILE * file);
+
+#endif
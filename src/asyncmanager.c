@@ -59,6 +59,7 @@ enum req_type {
 enum sreq_type {
     SREQ_WRITE,
     SREQ_POLL_INIT,
+    SREQ_ASYNC_INIT,
     SREQ_NUM,
 };
 
@@ -74,7 +75,8 @@ enum sreq_type {
 //      |     `-- uv_tcp_t    <- TcpStreamHandle_t
 //      |                         `-- TcpServerStreamHandle_t
 //      |                         `-- TcpClientStreamHandle_t
-//      `-- uv_poll_t       <- PollHandle_t
+//      |-- uv_poll_t       <- PollHandle_t
+//      `-- uv_async_t      <- AsyncHandle_t
 struct PollHandle_t {
     union {
         union uv_any_handle any;
@@ -86,6 +88,16 @@ struct PollHandle_t {
     int events;
 };
 
+struct AsyncHandle_t {
+    union {
+        union uv_any_handle any;
+        uv_handle_t handle;
+        uv_async_t async;
+    } uv; // button(inheritance)
+    AsyncManager_async_cb async_cb;
+    void *async_clientdata;
+};
+
 struct TcpServerStreamHandle_t {
     struct {
         union {
@@ -161,6 +173,7 @@ struct Handle_t {
         } uv; // button(inheritance)
         StreamHandle_t stream;
         PollHandle_t poll;
+        AsyncHandle_t async;
     };
 };
 
@@ -258,6 +271,10 @@ static void on_poll(uv_poll_t *handle, int status, int events);
 static int poll_start(PollHandle_t *handle);
 static int poll_stop(PollHandle_t *handle);
 
+// -----------------------------------------------------
+static void on_async(uv_async_t *handle);
+static int async_init(AsyncHandle_t *handle);
+
 
 //==============================================================================
 //= Variables
@@ -397,6 +414,10 @@ static void on_wakeup_sreq(uv_async_t *handle) {
     case SREQ_POLL_INIT:
         req->status = poll_init(req->reqdata, (void *)&req->respdata);
         break;
+    case SREQ_ASYNC_INIT:
+        req->status = async_init(req->reqdata);
+        req->respdata = req->reqdata;
+        break;
     case SREQ_NUM:
         assert(!"on_wakeup_sreq received unknown type");
         /* NOTREACHED */
@@ -599,6 +620,21 @@ static int poll_stop(PollHandle_t *handle) {
     return uv_poll_stop(&handle->uv.poll);
 }
 
+static void on_async(uv_async_t *handle) {
+    AsyncHandle_t *handle_ = handle->data;
+    if (handle_->async_cb) {
+        handle_->async_cb(handle_, handle_->async_clientdata);
+    }
+}
+
+static int async_init(AsyncHandle_t *handle) {
+    int ret;
+    ret = uv_async_init(g_singleton.loop, &handle->uv.async, &on_async);
+    UV_ERRCHECK(ret, return ret);
+    handle->uv.async.data = handle;
+    return ret;
+}
+
 
 //==============================================================================
 //= Function definitions(global)
@@ -865,3 +901,42 @@ int AsyncManager_PollStop(PollHandle_t *handle) {
     }
     return ret;
 }
+
+
+//===----------------------------------------------------------------------===//
+/// Create a handle for waking up the AsyncManager thread.
+///
+/// The callback is called in the AsyncManager thread after
+/// AsyncManager_AsyncSend. Several sends before the callback runs are
+/// coalesced into one call.
+///
+/// @return the handle, NULL on error.
+//===----------------------------------------------------------------------===//
+AsyncHandle_t *AsyncManager_AsyncInit(AsyncManager_async_cb cb,
+                                      void *clientdata) {
+    int ret;
+    AsyncHandle_t *handle = LEIGUN_NEW(handle);
+    AsyncHandle_t *result = NULL;
+    LOG_Info("AM", "%s[%d] %s", __FILE__, __LINE__, __func__);
+    ret = (handle) ? 0 : UV_EAI_MEMORY;
+    UV_ERRCHECK(ret, return NULL);
+    handle->async_cb = cb;
+    handle->async_clientdata = clientdata;
+    // check context == libuv
+    uv_thread_t tid = uv_thread_self();
+    if (uv_thread_equal(&g_singleton.tid, &tid)) {
+        ret = async_init(handle);
+    } else {
+        ret = send_sreq(SREQ_ASYNC_INIT, handle, &result);
+    }
+    UV_ERRCHECK(ret, free(handle); return NULL);
+    return handle;
+}
+
+//===----------------------------------------------------------------------===//
+/// Wake up the AsyncManager thread. Can be called from any thread and
+/// does not block.
+//===----------------------------------------------------------------------===//
+int AsyncManager_AsyncSend(AsyncHandle_t *handle) {
+    return uv_async_send(&handle->uv.async);
+}
@@ -50,10 +50,12 @@ enum {
 //==============================================================================
 //   Handle_t
 //      |-- StreamHandle_t
-//      `-- PollHandle_t
+//      |-- PollHandle_t
+//      `-- AsyncHandle_t
 typedef struct Handle_t Handle_t;
 typedef struct StreamHandle_t StreamHandle_t;
 typedef struct PollHandle_t PollHandle_t;
+typedef struct AsyncHandle_t AsyncHandle_t;
 
 // Collbacks(Handle)
 typedef void (*AsyncManager_close_cb)(Handle_t *handle, void *clientdata);
@@ -71,6 +73,9 @@ typedef void (*AsyncManager_read_cb)(StreamHandle_t *handle, const void *buf,
 typedef void (*AsyncManager_poll_cb)(PollHandle_t *handle, int status,
                                      int events, void *clientdata);
 
+// Collbacks(AsyncHandle)
+typedef void (*AsyncManager_async_cb)(AsyncHandle_t *handle, void *clientdata);
+
 
 //==============================================================================
 //= Functions
@@ -85,6 +90,9 @@ static inline Handle_t *AsyncManager_Stream2Handle(StreamHandle_t *stream) {
 static inline Handle_t *AsyncManager_Poll2Handle(PollHandle_t *poll) {
     return (Handle_t *)poll;
 }
+static inline Handle_t *AsyncManager_Async2Handle(AsyncHandle_t *async) {
+    return (Handle_t *)async;
+}
 /// @}
 
 /// @name Handle
@@ -123,6 +131,13 @@ int AsyncManager_PollStart(PollHandle_t *handle, int events,
 int AsyncManager_PollStop(PollHandle_t *handle);
 /// @}
 
+/// @name Async
+/// @{
+AsyncHandle_t *AsyncManager_AsyncInit(AsyncManager_async_cb cb,
+                                      void *clientdata);
+int AsyncManager_AsyncSend(AsyncHandle_t *handle);
+/// @}
+
 
 #ifdef __cplusplus
 }
@@ -32,6 +32,7 @@
 #include "exithandler.h"
 #include "list.h"
 #include "logging.h"
+#include "snapshot.h"
 
 // External headers
 #include <uv.h>
@@ -135,6 +136,7 @@ Device_MPU_t *Device_CreateMPU(const char *name) {
     LOG_Info(MOD_NAME, "Create MPU %s", name);
     const Device_DrvBase_t device = {.kind = DK_MPU, .name = name};
     Device_DrvMPU_t *result;
+    Device_MPU_t *mpu;
     result = List_Find(&Device_devices.devices,
                        (List_Compare_cb)&Device_compare, &device.liste);
     if (!result) {
@@ -143,7 +145,11 @@ Device_MPU_t *Device_CreateMPU(const char *name) {
     }
     LOG_Info(MOD_NAME, "defaultconfig %s", result->defaultconfig);
     Config_AddString(result->defaultconfig);
-    return result->create();
+    mpu = result->create();
+    if (mpu) {
+        Snapshot_RequireState(name, mpu->self);
+    }
+    return mpu;
 }
 
 
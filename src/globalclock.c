@@ -17,6 +17,15 @@
 //===----------------------------------------------------------------------===//
 ///
 /// @file
+/// Synchronization of the CPU threads.
+///
+/// In the default mode all CPU threads meet at a barrier after every period.
+/// In the relaxed mode every clock runs in quanta of its own length and only
+/// waits when its virtual time is more than the allowed skew ahead of the
+/// slowest clock. The time a clock spends waiting is counted and reported.
+///
+/// Optionally every clock is paced to the real time at the end of its
+/// periods, see GlobalClock_SetRealtime.
 ///
 //===----------------------------------------------------------------------===//
 
@@ -30,6 +39,7 @@
 #include "leigun.h"
 #include "list.h"
 #include "logging.h"
+#include "pacer.h"
 
 // External headers
 #include <uv.h> // for mutex
@@ -37,14 +47,18 @@
 // System headers
 #include <inttypes.h> // for PRId64
 #include <stdbool.h>
+#include <stdio.h> // for snprintf
 #include <stdlib.h> // for malloc
 #include <string.h> // for strerror
+#include <time.h> // for nanosleep
 
 
 //==============================================================================
 //= Constants(also Enumerations)
 //==============================================================================
 static const char *MOD_NAME = "GlobalClock";
+#define NSEC_PER_SEC (UINT64_C(1000000000))
+#define REPORT_INTERVAL_NS (10 * NSEC_PER_SEC)
 
 
 //==============================================================================
@@ -56,10 +70,15 @@ struct GlobalClock_LocalClock_s {
     GlobalClock_Proc_cb proc;
     void *data;
     uint64_t hz;
+    uint64_t period_ns;
     uint64_t period_cnt;
-    uint_fast16_t period_cnt_reminder;
+    uint64_t period_cnt_reminder;
     uint64_t rest_cnt;
-    uint_fast16_t rest_fraction;
+    uint64_t rest_fraction;
+    uint64_t vtime_ns;
+    uint64_t stall_ns;
+    uint64_t stalls;
+    Pacer_t *pacer;
 };
 
 
@@ -73,6 +92,13 @@ static struct {
     uint32_t period_ms;
     uv_barrier_t barrier;
     bool running;
+    bool relaxed;
+    uint64_t quantum_ns;
+    uint64_t max_skew_ns;
+    bool realtime;
+    uint64_t max_lag_ns;
+    uv_mutex_t sync_mutex;
+    uv_cond_t sync_cond;
 } GlobalClock_clock;
 
 
@@ -83,12 +109,19 @@ static void GlobalClock_thread(void *arg);
 static void GlobalClock_createThread(GlobalClock_LocalClock_t *clk);
 static void GlobalClock_setFrequency(GlobalClock_LocalClock_t *clk,
                                      uint64_t hz);
+static uint64_t GlobalClock_minVtime(void);
+static void GlobalClock_waitPeer(GlobalClock_LocalClock_t *clk);
+static void GlobalClock_waitPeriod(GlobalClock_LocalClock_t *clk);
+static void GlobalClock_reportClock(GlobalClock_LocalClock_t *clk);
 
 //==============================================================================
 //= Function definitions(static)
 //==============================================================================
 static void GlobalClock_thread(void *arg) {
     GlobalClock_LocalClock_t *clk = arg;
+    if (clk->pacer) {
+        Pacer_Resync(clk->pacer);
+    }
     clk->proc(clk, clk->data);
 }
 
@@ -100,13 +133,85 @@ static void GlobalClock_createThread(GlobalClock_LocalClock_t *clk) {
 static void GlobalClock_setFrequency(GlobalClock_LocalClock_t *clk,
                                      uint64_t hz) {
     clk->hz = hz;
-    clk->period_cnt = (hz * GlobalClock_clock.period_ms) / 1000;
-    clk->period_cnt_reminder = (hz * GlobalClock_clock.period_ms) % 1000;
+    clk->period_cnt = (hz * clk->period_ns) / NSEC_PER_SEC;
+    clk->period_cnt_reminder = (hz * clk->period_ns) % NSEC_PER_SEC;
     clk->rest_fraction = 0;
     // Don't care rest_cnt
 }
 
 
+//===----------------------------------------------------------------------===//
+/// Virtual time of the slowest clock, called with the sync_mutex held
+//===----------------------------------------------------------------------===//
+static uint64_t GlobalClock_minVtime(void) {
+    List_Element_t *cur;
+    uint64_t min = UINT64_MAX;
+    for (cur = GlobalClock_clock.list.head; cur; cur = cur->next) {
+        GlobalClock_LocalClock_t *clk = (GlobalClock_LocalClock_t *)cur;
+        if (clk->vtime_ns < min) {
+            min = clk->vtime_ns;
+        }
+    }
+    return min;
+}
+
+
+//===----------------------------------------------------------------------===//
+/// Relaxed mode: Wait only if this clock is too far ahead of the slowest one
+//===----------------------------------------------------------------------===//
+static void GlobalClock_waitPeer(GlobalClock_LocalClock_t *clk) {
+    uv_mutex_lock(&GlobalClock_clock.sync_mutex);
+    clk->vtime_ns += clk->period_ns;
+    // This clock might have been the slowest one
+    uv_cond_broadcast(&GlobalClock_clock.sync_cond);
+    while (clk->vtime_ns >
+           GlobalClock_minVtime() + GlobalClock_clock.max_skew_ns) {
+        LOG_Verbose(MOD_NAME, "Wait %08zX:%p", (uintptr_t)clk->proc,
+                    clk->data);
+        uv_cond_wait(&GlobalClock_clock.sync_cond,
+                     &GlobalClock_clock.sync_mutex);
+    }
+    uv_mutex_unlock(&GlobalClock_clock.sync_mutex);
+}
+
+
+static void GlobalClock_waitPeriod(GlobalClock_LocalClock_t *clk) {
+    uint64_t start = uv_hrtime();
+    if (GlobalClock_clock.relaxed) {
+        GlobalClock_waitPeer(clk);
+    } else {
+        LOG_Verbose(MOD_NAME, "Wait %08zX:%p", (uintptr_t)clk->proc,
+                    clk->data);
+        uv_barrier_wait(&GlobalClock_clock.barrier);
+    }
+    __atomic_store_n(&clk->stall_ns, clk->stall_ns + (uv_hrtime() - start),
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&clk->stalls, clk->stalls + 1, __ATOMIC_RELAXED);
+    // The first period is granted before anything was simulated
+    if (clk->pacer && (clk->stalls > 1)) {
+        Pacer_Advance(clk->pacer, clk->period_ns);
+    }
+    clk->rest_cnt += clk->period_cnt;
+    clk->rest_fraction += clk->period_cnt_reminder;
+    if (clk->rest_fraction >= NSEC_PER_SEC) {
+        LOG_Verbose(MOD_NAME, "Add fraction %08zX:%p", (uintptr_t)clk->proc,
+                    clk->data);
+        clk->rest_cnt++;
+        clk->rest_fraction -= NSEC_PER_SEC;
+    }
+}
+
+
+static void GlobalClock_reportClock(GlobalClock_LocalClock_t *clk) {
+    uint64_t stall_ns = __atomic_load_n(&clk->stall_ns, __ATOMIC_RELAXED);
+    uint64_t stalls = __atomic_load_n(&clk->stalls, __ATOMIC_RELAXED);
+    LOG_Info(MOD_NAME, "%08zX:%p quantum[us]: %" PRIu64 "\tsyncs: %" PRIu64
+             "\tstall[ms]: %.3lf",
+             (uintptr_t)clk->proc, clk->data, clk->period_ns / 1000, stalls,
+             stall_ns * 1e-6);
+}
+
+
 //==============================================================================
 //= Function definitions(global)
 //==============================================================================
@@ -121,16 +226,75 @@ int GlobalClock_Init(uint32_t period_ms) {
         return err;
     }
     GlobalClock_clock.period_ms = period_ms;
+    GlobalClock_clock.quantum_ns = (uint64_t)period_ms * 1000000;
     GlobalClock_clock.running = false;
+    GlobalClock_clock.relaxed = false;
+    GlobalClock_clock.realtime = false;
     GlobalClock_clock.list_num = 0;
     return 0;
 }
 
 
+//===----------------------------------------------------------------------===//
+/// Switch to relaxed synchronization. Must be called before the clocks are
+/// registered. quantum_ns is the default quantum of a clock, max_skew_ns the
+/// virtual time a clock may run ahead of the slowest clock.
+//===----------------------------------------------------------------------===//
+int GlobalClock_SetRelaxed(uint64_t quantum_ns, uint64_t max_skew_ns) {
+    int err;
+    if (GlobalClock_clock.running || GlobalClock_clock.list_num) {
+        LOG_Error(MOD_NAME, "Sync mode must be set before registering clocks");
+        return UV_EALREADY;
+    }
+    if (quantum_ns == 0) {
+        return UV_EINVAL;
+    }
+    err = uv_mutex_init(&GlobalClock_clock.sync_mutex);
+    if (err < 0) {
+        LOG_Error(MOD_NAME, "uv_mutex_init failed. %s %s", uv_err_name(err),
+                  uv_strerror(err));
+        return err;
+    }
+    err = uv_cond_init(&GlobalClock_clock.sync_cond);
+    if (err < 0) {
+        LOG_Error(MOD_NAME, "uv_cond_init failed. %s %s", uv_err_name(err),
+                  uv_strerror(err));
+        uv_mutex_destroy(&GlobalClock_clock.sync_mutex);
+        return err;
+    }
+    GlobalClock_clock.quantum_ns = quantum_ns;
+    GlobalClock_clock.max_skew_ns = max_skew_ns;
+    GlobalClock_clock.relaxed = true;
+    LOG_Info(MOD_NAME, "Relaxed sync, quantum[us]: %" PRIu64
+             " max. skew[us]: %" PRIu64, quantum_ns / 1000, max_skew_ns / 1000);
+    return 0;
+}
+
+
+//===----------------------------------------------------------------------===//
+/// Pace every clock to the real time at the end of its periods. Must be
+/// called before the clocks are registered. A lag of up to max_lag_ns is
+/// caught up. The pacing is as fine grained as the period, so use it with a
+/// short quantum in the relaxed mode.
+//===----------------------------------------------------------------------===//
+int GlobalClock_SetRealtime(uint64_t max_lag_ns) {
+    if (GlobalClock_clock.running || GlobalClock_clock.list_num) {
+        LOG_Error(MOD_NAME, "Realtime must be set before registering clocks");
+        return UV_EALREADY;
+    }
+    GlobalClock_clock.realtime = true;
+    GlobalClock_clock.max_lag_ns = max_lag_ns;
+    LOG_Info(MOD_NAME, "Realtime pacing, max. lag[ms]: %" PRIu64,
+             max_lag_ns / 1000000);
+    return 0;
+}
+
+
 int GlobalClock_Start(void) {
     int err = 0;
     uint64_t prev;
     uint64_t now;
+    uint64_t last_report;
     LOG_Info(MOD_NAME, "Start global clock");
     if (GlobalClock_clock.list_num == 0) {
         LOG_Warn(MOD_NAME, "no have registered proc");
@@ -138,24 +302,37 @@ int GlobalClock_Start(void) {
         goto END;
     }
     GlobalClock_clock.running = true;
-    err = uv_barrier_init(&GlobalClock_clock.barrier,
-                          GlobalClock_clock.list_num + 1);
-    if (err < 0) {
-        LOG_Error(MOD_NAME, "uv_barrier_init failed. %s %s", uv_err_name(err),
-                  uv_strerror(err));
-        err = 0;
-        goto END;
+    if (!GlobalClock_clock.relaxed) {
+        err = uv_barrier_init(&GlobalClock_clock.barrier,
+                              GlobalClock_clock.list_num + 1);
+        if (err < 0) {
+            LOG_Error(MOD_NAME, "uv_barrier_init failed. %s %s",
+                      uv_err_name(err), uv_strerror(err));
+            err = 0;
+            goto END;
+        }
     }
     uv_mutex_lock(&GlobalClock_clock.list_mutex);
     List_Map(&GlobalClock_clock.list, (List_Proc_cb)&GlobalClock_createThread);
     uv_mutex_unlock(&GlobalClock_clock.list_mutex);
-    prev = uv_hrtime();
+    prev = last_report = uv_hrtime();
     for (;;) {
-        uv_barrier_wait(&GlobalClock_clock.barrier);
+        if (GlobalClock_clock.relaxed) {
+            // The clocks pace each other, only report the stalls
+            struct timespec ts = {.tv_sec = REPORT_INTERVAL_NS / NSEC_PER_SEC};
+            nanosleep(&ts, NULL);
+        } else {
+            uv_barrier_wait(&GlobalClock_clock.barrier);
+        }
         now = uv_hrtime();
         LOG_Debug(MOD_NAME, "exp[ms]: %" PRId32 "\treal[ms]: %.3lf",
                   GlobalClock_clock.period_ms, (now - prev) * 1e-6);
         prev = now;
+        if ((now - last_report) >= REPORT_INTERVAL_NS) {
+            last_report = now;
+            List_Map(&GlobalClock_clock.list,
+                     (List_Proc_cb)&GlobalClock_reportClock);
+        }
     }
 END:
     return err;
@@ -163,11 +340,26 @@ END:
 
 
 int GlobalClock_Registor(GlobalClock_Proc_cb proc, void *data, uint64_t hz) {
+    return GlobalClock_RegistorQuantum(proc, data, hz, 0);
+}
+
+
+//===----------------------------------------------------------------------===//
+/// Register a clock with its own quantum, 0 selects the global quantum.
+/// Relaxed mode only: A clock with many interactions with its peers should
+/// use a shorter quantum.
+//===----------------------------------------------------------------------===//
+int GlobalClock_RegistorQuantum(GlobalClock_Proc_cb proc, void *data,
+                                uint64_t hz, uint64_t quantum_ns) {
     LOG_Debug(MOD_NAME, "Register %08zX:%p", (uintptr_t)proc, data);
     if (GlobalClock_clock.running) {
         LOG_Error(MOD_NAME, "GlobalClock alreay running");
         return UV_EALREADY;
     }
+    if (quantum_ns && !GlobalClock_clock.relaxed) {
+        LOG_Warn(MOD_NAME, "Per clock quantum needs relaxed sync mode");
+        quantum_ns = 0;
+    }
     GlobalClock_LocalClock_t *clk = LEIGUN_NEW(clk);
     if (!clk) {
         LOG_Error(MOD_NAME, "malloc failed %s", strerror(errno));
@@ -177,7 +369,18 @@ int GlobalClock_Registor(GlobalClock_Proc_cb proc, void *data, uint64_t hz) {
     clk->proc = proc;
     clk->data = data;
     clk->rest_cnt = 0;
+    clk->period_ns = quantum_ns ? quantum_ns : GlobalClock_clock.quantum_ns;
     GlobalClock_setFrequency(clk, hz);
+    if (GlobalClock_clock.realtime) {
+        char name[64];
+        snprintf(name, sizeof(name), "GlobalClock %08zX:%p", (uintptr_t)proc,
+                 data);
+        clk->pacer = Pacer_New(name, GlobalClock_clock.max_lag_ns);
+        if (!clk->pacer) {
+            free(clk);
+            return UV_EAI_MEMORY;
+        }
+    }
     uv_mutex_lock(&GlobalClock_clock.list_mutex);
     List_Push(&GlobalClock_clock.list, &clk->liste);
     GlobalClock_clock.list_num++;
@@ -200,16 +403,15 @@ void GlobalClock_ChangeFrequency(GlobalClock_LocalClock_t *clk, uint64_t hz) {
 
 void GlobalClock_ConsumeCycle(GlobalClock_LocalClock_t *clk, uint32_t cnt) {
     while (clk->rest_cnt < cnt) {
-        LOG_Verbose(MOD_NAME, "Wait %08zX:%p", (uintptr_t)clk->proc, clk->data);
-        uv_barrier_wait(&GlobalClock_clock.barrier);
-        clk->rest_cnt += clk->period_cnt;
-        clk->rest_fraction += clk->period_cnt_reminder;
-        if (clk->rest_fraction >= 1000) {
-            LOG_Verbose(MOD_NAME, "Add fraction %08zX:%p", (uintptr_t)clk->proc,
-                        clk->data);
-            clk->rest_cnt++;
-            clk->rest_fraction -= 1000;
-        }
+        GlobalClock_waitPeriod(clk);
     }
     clk->rest_cnt -= cnt;
 }
+
+
+uint64_t GlobalClock_Quantum(GlobalClock_LocalClock_t *clk) {
+    while (clk->rest_cnt == 0) {
+        GlobalClock_waitPeriod(clk);
+    }
+    return clk->rest_cnt;
+}
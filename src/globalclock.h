@@ -60,11 +60,16 @@ typedef void (*GlobalClock_Proc_cb)(GlobalClock_LocalClock_t *clk, void *data);
 //= Functions
 //==============================================================================
 int GlobalClock_Init(uint32_t period_ms);
+int GlobalClock_SetRelaxed(uint64_t quantum_ns, uint64_t max_skew_ns);
+int GlobalClock_SetRealtime(uint64_t max_lag_ns);
 int GlobalClock_Start(void);
 
 int GlobalClock_Registor(GlobalClock_Proc_cb proc, void *data, uint64_t hz);
+int GlobalClock_RegistorQuantum(GlobalClock_Proc_cb proc, void *data,
+                                uint64_t hz, uint64_t quantum_ns);
 void GlobalClock_ChangeFrequency(GlobalClock_LocalClock_t *clk, uint64_t hz);
 void GlobalClock_ConsumeCycle(GlobalClock_LocalClock_t *clk, uint32_t cnt);
+uint64_t GlobalClock_Quantum(GlobalClock_LocalClock_t *clk);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,165 @@
+//===-- core/pacer.c ----------------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Real-time pacing of a simulation thread
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Main Module Header
+#include "pacer.h"
+
+// Local/Private Headers
+#include "leigun.h"
+#include "logging.h"
+
+// External headers
+
+// System headers
+#include <errno.h>
+#include <inttypes.h> // for PRIu64
+#include <stdlib.h> // for calloc
+#include <string.h> // for strdup
+#include <time.h> // for clock_nanosleep
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+static const char *MOD_NAME = "Pacer";
+#define NSEC_PER_SEC (UINT64_C(1000000000))
+#define REPORT_INTERVAL_NS (10 * NSEC_PER_SEC)
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+struct Pacer_s {
+    char *name;
+    uint64_t deadline_ns; // real time at which the reported vtime is due
+    uint64_t max_lag_ns;
+    // statistics since the last report
+    uint64_t report_start_ns;
+    uint64_t vtime_ns;
+    uint64_t sleep_ns;
+    uint64_t sleeps;
+    uint64_t resyncs;
+};
+
+
+//==============================================================================
+//= Function declarations(static)
+//==============================================================================
+static uint64_t Pacer_now(void);
+static void Pacer_sleepUntil(uint64_t deadline_ns);
+static void Pacer_report(Pacer_t *pacer, uint64_t now);
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static uint64_t Pacer_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+
+static void Pacer_sleepUntil(uint64_t deadline_ns) {
+    struct timespec ts;
+    ts.tv_sec = deadline_ns / NSEC_PER_SEC;
+    ts.tv_nsec = deadline_ns % NSEC_PER_SEC;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+           EINTR) {
+        // Absolute deadline, simply sleep again
+    }
+}
+
+
+static void Pacer_report(Pacer_t *pacer, uint64_t now) {
+    uint64_t real_ns = now - pacer->report_start_ns;
+    LOG_Info(MOD_NAME, "%s speed: %.3lf\tsleep[ms]: %.3lf (%.1lf%%)"
+             "\tsleeps: %" PRIu64 "\tresyncs: %" PRIu64,
+             pacer->name, (double)pacer->vtime_ns / real_ns,
+             pacer->sleep_ns * 1e-6, 100.0 * pacer->sleep_ns / real_ns,
+             pacer->sleeps, pacer->resyncs);
+    pacer->report_start_ns = now;
+    pacer->vtime_ns = 0;
+    pacer->sleep_ns = 0;
+    pacer->sleeps = 0;
+    pacer->resyncs = 0;
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+Pacer_t *Pacer_New(const char *name, uint64_t max_lag_ns) {
+    Pacer_t *pacer = LEIGUN_NEW(pacer);
+    if (!pacer) {
+        LOG_Error(MOD_NAME, "malloc failed %s", strerror(errno));
+        return NULL;
+    }
+    pacer->name = strdup(name);
+    pacer->max_lag_ns = max_lag_ns;
+    pacer->deadline_ns = pacer->report_start_ns = Pacer_now();
+    return pacer;
+}
+
+
+void Pacer_Delete(Pacer_t *pacer) {
+    free(pacer->name);
+    free(pacer);
+}
+
+
+//===----------------------------------------------------------------------===//
+/// Account vtime_ns of simulated time. Sleeps until the real time has caught
+/// up with the virtual time.
+//===----------------------------------------------------------------------===//
+void Pacer_Advance(Pacer_t *pacer, uint64_t vtime_ns) {
+    uint64_t now = Pacer_now();
+    pacer->deadline_ns += vtime_ns;
+    pacer->vtime_ns += vtime_ns;
+    if (pacer->deadline_ns > now) {
+        uint64_t start = now;
+        // Oversleeping is corrected by the next deadline
+        Pacer_sleepUntil(pacer->deadline_ns);
+        now = Pacer_now();
+        pacer->sleep_ns += now - start;
+        pacer->sleeps++;
+    } else if ((now - pacer->deadline_ns) > pacer->max_lag_ns) {
+        pacer->deadline_ns = now;
+        pacer->resyncs++;
+    }
+    if ((now - pacer->report_start_ns) >= REPORT_INTERVAL_NS) {
+        Pacer_report(pacer, now);
+    }
+}
+
+
+//===----------------------------------------------------------------------===//
+/// Forget the lag or lead, for example after the simulation was stopped
+/// by the debugger.
+//===----------------------------------------------------------------------===//
+void Pacer_Resync(Pacer_t *pacer) {
+    pacer->deadline_ns = Pacer_now();
+}
@@ -0,0 +1,70 @@
+//===-- core/pacer.h ----------------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Real-time pacing of a simulation thread
+///
+/// The owner reports the virtual time it has simulated. When the virtual
+/// time is ahead of the real time the pacer sleeps with clock_nanosleep until
+/// the absolute deadline, so a throttled simulator does not burn a host core.
+/// When the simulation falls behind it runs without sleeping to catch up, but
+/// a lag larger than max_lag_ns is forgotten to avoid a long phase of
+/// overspeed. A max_lag_ns of 0 never catches up.
+///
+/// The achieved speed ratio and the sleep time are reported periodically.
+/// A pacer is used by one thread only.
+///
+//===----------------------------------------------------------------------===//
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Local/Private Headers
+
+// External headers
+
+// System headers
+#include <stdint.h> // for uint64_t
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define PACER_DEFAULT_MAX_LAG_NS (UINT64_C(250000000))
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct Pacer_s Pacer_t;
+
+
+//==============================================================================
+//= Functions
+//==============================================================================
+Pacer_t *Pacer_New(const char *name, uint64_t max_lag_ns);
+void Pacer_Delete(Pacer_t *pacer);
+void Pacer_Advance(Pacer_t *pacer, uint64_t vtime_ns);
+void Pacer_Resync(Pacer_t *pacer);
+
+#ifdef __cplusplus
+}
+#endif
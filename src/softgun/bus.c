@@ -46,6 +46,7 @@
 #include <fcntl.h>
 #include "sgstring.h"
 #include "loader.h"
+#include "snapshot.h"
 
 Bus *MainBus;
 /*
@@ -73,6 +74,13 @@ IOHandler **iohandlerMap;
 IOHandler ***iohandlerFlvlMap;
 static unsigned int ioh_flvl_use_count[IOH_FLVL_SZ] = { 0, };
 
+/*
+ * ------------------------------------
+ * 1k IO pages with register handlers
+ * ------------------------------------
+ */
+IOPage ***iohandlerPageDir;
+
 /*
  * -------------------------------------------
  * One level memory translation table vars 
@@ -91,6 +99,35 @@ uint8_t **mem_map_write;
 TwoLevelMMap twoLevelMMap;
 InvalidateCallback *InvalidateProc;
 
+/*
+ * ------------------------------------------------
+ * Bitmap of small pages which are traced because
+ * a CPU has cached predecoded code from them
+ * ------------------------------------------------
+ */
+static uint32_t *codeTraceMap;
+static CodeWriteCallback *CodeWriteProc;
+
+/*
+ * ------------------------------------------------
+ * Dirty maps: Regions with a bitmap of the small
+ * pages written since the last drain
+ * ------------------------------------------------
+ */
+struct BusDirtyMap {
+	struct BusDirtyMap *next;
+	uint32_t start;
+	uint32_t length;
+	uint32_t first_page;
+	uint32_t nr_pages;
+	uint32_t dirty_pages;
+	uint32_t *bitmap;
+	DirtyNotifyProc *notifyProc;
+	void *clientData;
+};
+
+static BusDirtyMap *firstDirtyMap;
+
 static inline uint8_t *
 twolevel_translate_r(uint32_t addr)
 {
@@ -126,7 +163,7 @@ twolevel_translate_w(uint32_t addr)
 		if (unlikely(((unsigned long)base) & PG_TRACED)) {
 			base -= PG_TRACED;
 			slvl_map[index] = base;
-			IO_Write8(0, addr);
+			Mem_TraceHit(addr);
 		}
 		return base + (addr & (twoLevelMMap.scnd_lvl_blockmask));
 	} else {
@@ -276,20 +313,100 @@ Bus_Write8(uint8_t value, uint32_t addr)
 	}
 }
 
+/*
+ * -------------------------------------------------------------
+ * Number of bytes from addr to the end of the translation
+ * block containing it (32k block or small block)
+ * -------------------------------------------------------------
+ */
+static inline uint32_t
+bus_block_remaining(uint32_t addr, uint8_t ** map)
+{
+	if (map[addr >> MEM_MAP_SHIFT]) {
+		return MEM_MAP_BLOCKSIZE - (addr & MEM_MAP_BLOCKMASK);
+	}
+	return twoLevelMMap.scnd_lvl_blocksize - (addr & twoLevelMMap.scnd_lvl_blockmask);
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Bus spans
+ *	Get a host pointer for the longest contiguous part of a
+ *	physical range. Adjacent translation blocks are merged when
+ *	their host memory is contiguous. The return value is the
+ *	length of the span, *hvap is NULL when the span is not
+ *	memory. In this case the span ends at the next small block
+ *	boundary and has to be accessed with the IO functions.
+ *	Write spans trigger the page traces of all blocks in the span.
+ * ----------------------------------------------------------------------
+ */
+uint32_t
+Bus_GetReadSpan(uint32_t addr, uint32_t len, uint8_t ** hvap)
+{
+	uint8_t *hva = Bus_GetHVARead(addr);
+	uint64_t span;
+	*hvap = hva;
+	if (!hva) {
+		span = twoLevelMMap.scnd_lvl_blocksize - (addr & twoLevelMMap.scnd_lvl_blockmask);
+		return span < len ? span : len;
+	}
+	span = bus_block_remaining(addr, mem_map_read);
+	while ((span < len) && ((addr + span) <= UINT32_MAX)) {
+		if (Bus_GetHVARead(addr + span) != hva + span) {
+			break;
+		}
+		span += bus_block_remaining(addr + span, mem_map_read);
+	}
+	return span < len ? span : len;
+}
+
+uint32_t
+Bus_GetWriteSpan(uint32_t addr, uint32_t len, uint8_t ** hvap)
+{
+	uint8_t *hva = Bus_GetHVAWrite(addr);
+	uint64_t span;
+	*hvap = hva;
+	if (!hva) {
+		span = twoLevelMMap.scnd_lvl_blocksize - (addr & twoLevelMMap.scnd_lvl_blockmask);
+		return span < len ? span : len;
+	}
+	span = bus_block_remaining(addr, mem_map_write);
+	while ((span < len) && ((addr + span) <= UINT32_MAX)) {
+		if (Bus_GetHVAWrite(addr + span) != hva + span) {
+			break;
+		}
+		span += bus_block_remaining(addr + span, mem_map_write);
+	}
+	return span < len ? span : len;
+}
+
 /*
  * --------------------------------------------
  * Generic Bus Access Functions for Transfer
  * of any block size. Mainly used for
- * non CPU bus masters.
+ * non CPU bus masters. Memory is copied
+ * span by span, IO is accessed bytewise.
  * --------------------------------------------
  */
 
 void
 Bus_Write(uint32_t addr, uint8_t * buf, uint32_t count)
 {
+	uint8_t *hva;
+	uint32_t len;
 	while (count) {
-		Bus_Write8(*buf++, addr++);
-		count--;
+		len = Bus_GetWriteSpan(addr, count, &hva);
+		if (hva) {
+			memcpy(hva, buf, len);
+			buf += len;
+			addr += len;
+		} else {
+			uint32_t i;
+			for (i = 0; i < len; i++) {
+				IO_Write8(*buf++, addr++);
+			}
+		}
+		count -= len;
 	}
 }
 
@@ -306,10 +423,21 @@ Bus_WriteSwap32(uint32_t addr, uint8_t * buf, int count)
 void
 Bus_Read(uint8_t * buf, uint32_t addr, uint32_t count)
 {
+	uint8_t *hva;
+	uint32_t len;
 	while (count) {
-		*buf = Bus_Read8(addr++);
-		buf++;
-		count--;
+		len = Bus_GetReadSpan(addr, count, &hva);
+		if (hva) {
+			memcpy(buf, hva, len);
+			buf += len;
+			addr += len;
+		} else {
+			uint32_t i;
+			for (i = 0; i < len; i++) {
+				*buf++ = IO_Read8(addr++);
+			}
+		}
+		count -= len;
 	}
 }
 
@@ -438,6 +566,11 @@ Mem_AreaAddMapping(BusDevice * bdev, uint32_t base, uint32_t mapsize, uint32_t f
 	mapping->base = base;
 	mapping->mapsize = mapsize;
 	mapping->flags = flags & bdev->hw_flags;
+	if (!mapping->next) {
+		char what[40];
+		snprintf(what, sizeof(what), "Device at 0x%08x", base);
+		Snapshot_RequireState(what, bdev->owner);
+	}
 
 	bdev->Map(bdev->owner, base, mapping->mapsize, flags);
 	/* Check for traces ??? */
@@ -611,6 +744,242 @@ Mem_UntraceRegion(uint32_t start, uint32_t length)
 	}
 }
 
+/*
+ * --------------------------------------------------------------------
+ * Trace a page containing code which was predecoded by a CPU.
+ * Returns 1 if the page is newly traced, 0 if it already is traced
+ * or is not writable at all and -1 if it is writable but can not be
+ * traced. The caller is responsible for invalidating its own
+ * write TLB if a new trace was set.
+ * --------------------------------------------------------------------
+ */
+int
+Mem_TraceCodePage(uint32_t pgaddr)
+{
+	uint32_t page = pgaddr >> twoLevelMMap.scnd_lvl_shift;
+	uint32_t index;
+	uint8_t *hva;
+	uint8_t **slvl_map;
+	uint8_t *rhva = mem_map_read[pgaddr >> MEM_MAP_SHIFT];
+	uint8_t *whva = mem_map_write[pgaddr >> MEM_MAP_SHIFT];
+	if (!whva && !twoLevelMMap.flvlmap_write[pgaddr >> twoLevelMMap.frst_lvl_shift]) {
+		/* Not writable, nothing can modify the code */
+		return 0;
+	}
+	if (whva && rhva && (whva != rhva)) {
+		/* Can not be split */
+		return -1;
+	}
+	Mem_SplitLargePage(pgaddr);
+	index = pgaddr >> twoLevelMMap.frst_lvl_shift;
+	if (unlikely(!(slvl_map = twoLevelMMap.flvlmap_write[index]))) {
+		return -1;
+	}
+	index = (pgaddr & twoLevelMMap.scnd_lvl_mask) >> twoLevelMMap.scnd_lvl_shift;
+	hva = slvl_map[index];
+	if (!hva) {
+		return 0;
+	}
+	if (!codeTraceMap) {
+		codeTraceMap = sg_calloc(((1 << (32 - twoLevelMMap.scnd_lvl_shift)) + 7) / 8);
+	}
+	codeTraceMap[page >> 5] |= (UINT32_C(1) << (page & 31));
+	if (((unsigned long)hva) & PG_TRACED) {
+		return 0;
+	}
+	slvl_map[index] += PG_TRACED;
+	return 1;
+}
+
+void
+Mem_SetCodeWriteCallback(CodeWriteCallback * proc)
+{
+	CodeWriteProc = proc;
+}
+
+/*
+ * --------------------------------------------------------------------
+ * Called on the first write to a traced page. Notifies the CPU
+ * if it has code from this page and the IO-Handler which
+ * requested the trace.
+ * --------------------------------------------------------------------
+ */
+void
+Mem_TraceHit(uint32_t addr)
+{
+	uint32_t page = addr >> twoLevelMMap.scnd_lvl_shift;
+	BusDirtyMap *dm;
+	int handled = 0;
+	for (dm = firstDirtyMap; dm; dm = dm->next) {
+		uint32_t idx = page - dm->first_page;
+		if ((idx < dm->nr_pages) && !(dm->bitmap[idx >> 5] & (UINT32_C(1) << (idx & 31)))) {
+			dm->bitmap[idx >> 5] |= (UINT32_C(1) << (idx & 31));
+			if (dm->dirty_pages++ == 0) {
+				dm->notifyProc(dm->clientData);
+			}
+			handled = 1;
+		}
+	}
+	if (codeTraceMap && (codeTraceMap[page >> 5] & (UINT32_C(1) << (page & 31)))) {
+		codeTraceMap[page >> 5] &= ~(UINT32_C(1) << (page & 31));
+		if (CodeWriteProc) {
+			CodeWriteProc(addr & ~twoLevelMMap.scnd_lvl_blockmask);
+		}
+		handled = 1;
+	}
+	if (handled && !IOH_Find(addr)) {
+		return;
+	}
+	IO_Write8(0, addr);
+}
+
+/*
+ * -----------------------------------------------------------------
+ * Set/Remove the trace of a small page without complaining about
+ * pages which are already traced for another reason (code).
+ * The caller has to call the InvalidateProc.
+ * -----------------------------------------------------------------
+ */
+static void
+mem_trace_page_quiet(uint32_t pgaddr)
+{
+	uint8_t **slvl_map;
+	uint32_t index;
+	Mem_SplitLargePage(pgaddr);
+	if (!(slvl_map = twoLevelMMap.flvlmap_write[pgaddr >> twoLevelMMap.frst_lvl_shift])) {
+		return;
+	}
+	index = (pgaddr & twoLevelMMap.scnd_lvl_mask) >> twoLevelMMap.scnd_lvl_shift;
+	if (slvl_map[index] && !((unsigned long)slvl_map[index] & PG_TRACED)) {
+		slvl_map[index] += PG_TRACED;
+	}
+}
+
+static void
+mem_untrace_page_quiet(uint32_t pgaddr)
+{
+	uint8_t **slvl_map;
+	uint32_t index;
+	uint32_t page = pgaddr >> twoLevelMMap.scnd_lvl_shift;
+	if (codeTraceMap && (codeTraceMap[page >> 5] & (UINT32_C(1) << (page & 31)))) {
+		/* Still needed for the code trace */
+		return;
+	}
+	if (!(slvl_map = twoLevelMMap.flvlmap_write[pgaddr >> twoLevelMMap.frst_lvl_shift])) {
+		return;
+	}
+	index = (pgaddr & twoLevelMMap.scnd_lvl_mask) >> twoLevelMMap.scnd_lvl_shift;
+	if ((unsigned long)slvl_map[index] & PG_TRACED) {
+		slvl_map[index] -= PG_TRACED;
+	}
+}
+
+/*
+ * -------------------------------------------------------------------------
+ * Create a dirty map for a memory region. All pages start dirty, so the
+ * first drain reports the complete region. notifyProc is called when the
+ * first page gets dirty after a drain.
+ * -------------------------------------------------------------------------
+ */
+BusDirtyMap *
+Mem_DirtyMapNew(uint32_t start, uint32_t length, DirtyNotifyProc * notifyProc, void *clientData)
+{
+	BusDirtyMap *dm = sg_new(BusDirtyMap);
+	uint32_t last_page = (start + length - 1) >> twoLevelMMap.scnd_lvl_shift;
+	dm->start = start;
+	dm->length = length;
+	dm->first_page = start >> twoLevelMMap.scnd_lvl_shift;
+	dm->nr_pages = last_page - dm->first_page + 1;
+	dm->bitmap = sg_calloc(((dm->nr_pages + 31) / 32) * sizeof(uint32_t));
+	memset(dm->bitmap, 0xff, ((dm->nr_pages + 31) / 32) * sizeof(uint32_t));
+	dm->dirty_pages = dm->nr_pages;
+	dm->notifyProc = notifyProc;
+	dm->clientData = clientData;
+	dm->next = firstDirtyMap;
+	firstDirtyMap = dm;
+	notifyProc(clientData);
+	return dm;
+}
+
+void
+Mem_DirtyMapDelete(BusDirtyMap * dm)
+{
+	BusDirtyMap **prev;
+	uint32_t idx;
+	for (prev = &firstDirtyMap; *prev; prev = &(*prev)->next) {
+		if (*prev == dm) {
+			*prev = dm->next;
+			break;
+		}
+	}
+	for (idx = 0; idx < dm->nr_pages; idx++) {
+		if (!(dm->bitmap[idx >> 5] & (UINT32_C(1) << (idx & 31)))) {
+			mem_untrace_page_quiet((dm->first_page + idx) << twoLevelMMap.scnd_lvl_shift);
+		}
+	}
+	if (InvalidateProc) {
+		InvalidateProc();
+	}
+	free(dm->bitmap);
+	free(dm);
+}
+
+/*
+ * --------------------------------------------------------------------------
+ * Report all dirty parts of the region and trace them again.
+ * Consecutive dirty pages are coalesced and reported per host contiguous
+ * span, clipped to the region. The TLBs are invalidated only once.
+ * --------------------------------------------------------------------------
+ */
+void
+Mem_DirtyMapDrain(BusDirtyMap * dm, DirtyRangeProc * proc, void *clientData)
+{
+	uint32_t idx, run_start;
+	uint32_t addr, end, len;
+	uint8_t *hva;
+	if (!dm->dirty_pages) {
+		return;
+	}
+	for (idx = 0; idx < dm->nr_pages;) {
+		if (!dm->bitmap[idx >> 5]) {
+			idx = (idx | 31) + 1;
+			continue;
+		}
+		if (!(dm->bitmap[idx >> 5] & (UINT32_C(1) << (idx & 31)))) {
+			idx++;
+			continue;
+		}
+		run_start = idx;
+		while ((idx < dm->nr_pages) && (dm->bitmap[idx >> 5] & (UINT32_C(1) << (idx & 31)))) {
+			dm->bitmap[idx >> 5] &= ~(UINT32_C(1) << (idx & 31));
+			mem_trace_page_quiet((dm->first_page + idx) << twoLevelMMap.scnd_lvl_shift);
+			idx++;
+		}
+		addr = (dm->first_page + run_start) << twoLevelMMap.scnd_lvl_shift;
+		end = ((dm->first_page + idx) << twoLevelMMap.scnd_lvl_shift) - 1;
+		if (addr < dm->start) {
+			addr = dm->start;
+		}
+		if (end > dm->start + dm->length - 1) {
+			end = dm->start + dm->length - 1;
+		}
+		while (addr <= end) {
+			len = Bus_GetReadSpan(addr, end - addr + 1, &hva);
+			if (hva) {
+				proc(clientData, addr, hva, len);
+			}
+			if (addr + len - 1 == end) {
+				break;
+			}
+			addr += len;
+		}
+	}
+	dm->dirty_pages = 0;
+	if (InvalidateProc) {
+		InvalidateProc();
+	}
+}
+
 /*
  * --------------------------------------------------------------------
  * Take existing mapping and split up a range from large pages
@@ -714,18 +1083,11 @@ Mem_AreaUpdateMappings(BusDevice * bdev)
  */
 #define IOH_HASH(addr) ((addr) + ((addr)>>18))&IOH_HASH_MASK
 
-IOHandler *
-IOH_Find(uint32_t address)
+static inline IOHandler *
+IOH_RegionFind(uint32_t address)
 {
-	IOHandler *cursor;
 	IOHandler **slvl_map;
-	uint32_t hash = IOH_HASH(address);
 	uint32_t index;
-	for (cursor = iohandlerHash[hash]; cursor; cursor = cursor->next) {
-		if (cursor->cpu_addr == address) {
-			return cursor;
-		}
-	}
 	index = (address >> IOH_MAP_SHIFT);
 	if (iohandlerMap[index]) {
 		return (iohandlerMap[index]);
@@ -735,10 +1097,26 @@ IOH_Find(uint32_t address)
 		index = (address & IOH_SLVL_MASK) >> IOH_SLVL_SHIFT;
 		return slvl_map[index];
 	}
-	//fprintf(stderr,"JK: Addr %08x no IOH slevel %p, index %d\n",address,slvl_map,index);
 	return NULL;
 }
 
+/*
+ * ----------------------------------------------------------------
+ * Register handlers are always in an IO page, so the hash is
+ * only needed when handlers are created or deleted.
+ * ----------------------------------------------------------------
+ */
+IOHandler *
+IOH_Find(uint32_t address)
+{
+	IOPage *iop = IOH_FindPage(address);
+	if (iop) {
+		return IOPage_Handler(iop, address);
+	}
+	//fprintf(stderr,"JK: Addr %08x no IOH slevel %p, index %d\n",address,slvl_map,index);
+	return IOH_RegionFind(address);
+}
+
 IOHandler *
 IOH_HashFind(uint32_t address)
 {
@@ -752,6 +1130,83 @@ IOH_HashFind(uint32_t address)
 	return NULL;
 }
 
+/*
+ * ------------------------------------------------------------
+ * Resolve the handler of an address without the IO pages:
+ * register handlers have precedence over IO regions.
+ * ------------------------------------------------------------
+ */
+static IOHandler *
+IOH_SlowFind(uint32_t address)
+{
+	IOHandler *h = IOH_HashFind(address);
+	if (h) {
+		return h;
+	}
+	return IOH_RegionFind(address);
+}
+
+static void
+IOPage_Refresh(IOPage * iop, uint32_t pgaddr)
+{
+	uint32_t offs;
+	for (offs = 0; offs < IOH_PAGE_SIZE; offs++) {
+		iop->handler[offs] = IOH_SlowFind(pgaddr + offs);
+	}
+}
+
+/*
+ * -------------------------------------------------------------
+ * Update the IO page entry of a register handler address.
+ * The page is created when it has no IO page yet.
+ * -------------------------------------------------------------
+ */
+static void
+IOPage_Update(uint32_t address)
+{
+	IOPage **pagetab;
+	IOPage *iop;
+	uint32_t pgaddr = address & ~IOH_PAGE_MASK;
+	pagetab = iohandlerPageDir[address >> IOH_PAGEDIR_SHIFT];
+	if (!pagetab) {
+		pagetab = iohandlerPageDir[address >> IOH_PAGEDIR_SHIFT] =
+		    sg_calloc(sizeof(IOPage *) * IOH_PAGETAB_SZ);
+	}
+	iop = pagetab[(address >> IOH_PAGE_SHIFT) & (IOH_PAGETAB_SZ - 1)];
+	if (!iop) {
+		iop = pagetab[(address >> IOH_PAGE_SHIFT) & (IOH_PAGETAB_SZ - 1)] =
+		    sg_new(IOPage);
+		IOPage_Refresh(iop, pgaddr);
+	} else {
+		iop->handler[address & IOH_PAGE_MASK] = IOH_SlowFind(address);
+	}
+}
+
+/*
+ * ------------------------------------------------------------------
+ * Update the existing IO pages overlapping a changed IO region.
+ * IO pages are never freed because TLBs may hold a pointer to them.
+ * ------------------------------------------------------------------
+ */
+static void
+IOPage_UpdateRange(uint32_t addr, uint32_t length)
+{
+	uint32_t pgaddr;
+	uint32_t end = addr + length - 1;
+	IOPage *iop;
+	if (!length) {
+		return;
+	}
+	for (pgaddr = addr & ~IOH_PAGE_MASK;; pgaddr += IOH_PAGE_SIZE) {
+		if ((iop = IOH_FindPage(pgaddr))) {
+			IOPage_Refresh(iop, pgaddr);
+		}
+		if ((end - pgaddr) < IOH_PAGE_SIZE) {
+			break;
+		}
+	}
+}
+
 static void
 IOH_New(uint32_t cpu_addr, IOReadProc * readproc, IOWriteProc * writeproc, void *clientData,
 	int len, uint32_t flags)
@@ -787,6 +1242,7 @@ IOH_New(uint32_t cpu_addr, IOReadProc * readproc, IOWriteProc * writeproc, void
 	h->flags = flags;
 	h->len = len;
 	iohandlerHash[hash] = h;
+	IOPage_Update(cpu_addr);
 }
 
 void
@@ -882,6 +1338,8 @@ IOH_NewRegion(uint32_t addr, uint32_t length, IOReadProc * readproc, IOWriteProc
 	      int flags, void *clientData)
 {
 	IOHandler *h;
+	uint32_t start = addr;
+	uint32_t size = length;
 	int swap_endian;
 	int byteorder;
 	if (flags & IOH_FLG_BIG_ENDIAN) {
@@ -917,6 +1375,7 @@ IOH_NewRegion(uint32_t addr, uint32_t length, IOReadProc * readproc, IOWriteProc
 			exit(34245);
 		}
 	}
+	IOPage_UpdateRange(start, size);
 }
 
 static inline void
@@ -960,6 +1419,8 @@ IOH_UnMap2LvlBlock(uint32_t addr)
 void
 IOH_DeleteRegion(uint32_t addr, uint32_t length)
 {
+	uint32_t start = addr;
+	uint32_t size = length;
 	// fprintf(stderr,"JK Delete Region %08x size 0x%08x\n",addr,length);
 	while (length) {
 		if (!(addr & IOH_MAP_BLOCKMASK) && (length >= IOH_MAP_BLOCKSIZE)) {
@@ -975,10 +1436,10 @@ IOH_DeleteRegion(uint32_t addr, uint32_t length)
 			fprintf(stderr,
 				"IOH_DeleteRegion: only IO regions with alignment to 0x%08x allowed\n",
 				IOH_SLVL_BLOCKSIZE);
-			return;
+			break;
 		}
 	}
-
+	IOPage_UpdateRange(start, size - length);
 }
 
 uint32_t
@@ -997,6 +1458,7 @@ IOH_Delete(uint32_t address)
 			}
 			flags = cursor->flags;
 			free(cursor);
+			IOPage_Update(address);
 			return flags;
 		}
 	}
@@ -1054,9 +1516,8 @@ IO_Write64(uint64_t value, uint32_t addr)
 }
 
 void
-IO_Write32(uint32_t value, uint32_t addr)
+IOH_Write32(IOHandler * h, uint32_t value, uint32_t addr)
 {
-	IOHandler *h = IOH_Find(addr);
 	if (!h || !h->writeproc) {
 		fprintf(stderr, "Write: No Handler for %08x, value %08x\n", addr, value);
 		return;
@@ -1093,9 +1554,8 @@ IO_Write32(uint32_t value, uint32_t addr)
 }
 
 void
-IO_Write16(uint16_t value, uint32_t addr)
+IOH_Write16(IOHandler * h, uint16_t value, uint32_t addr)
 {
-	IOHandler *h = IOH_Find(addr);
 	if (!h || !h->writeproc) {
 		//fprintf(stderr,"No handler for %08x\n",addr);
 		return;
@@ -1124,9 +1584,8 @@ IO_Write16(uint16_t value, uint32_t addr)
 
 //include "cpu_m32c.h"
 void
-IO_Write8(uint8_t value, uint32_t addr)
+IOH_Write8(IOHandler * h, uint8_t value, uint32_t addr)
 {
-	IOHandler *h = IOH_Find(addr);
     uint32_t val32; 
     //fprintf(stderr, "write8 %08x: %08x\n",addr, value);
 	if (!h || !h->writeproc) {
@@ -1179,11 +1638,9 @@ IO_Read64(uint32_t addr)
 }
 
 uint32_t
-IO_Read32(uint32_t addr)
+IOH_Read32(IOHandler * h, uint32_t addr)
 {
-	IOHandler *h;
 	uint32_t value;
-	h = IOH_Find(addr);
 	if (!h || !h->readproc) {
 		return 0;
 	}
@@ -1233,9 +1690,8 @@ IO_Read32(uint32_t addr)
 }
 
 uint16_t
-IO_Read16(uint32_t addr)
+IOH_Read16(IOHandler * h, uint32_t addr)
 {
-	IOHandler *h = IOH_Find(addr);
 	uint32_t value;
 	if (!h || !h->readproc) {
 		return 0;
@@ -1277,9 +1733,8 @@ IO_Read16(uint32_t addr)
 }
 
 uint8_t
-IO_Read8(uint32_t addr)
+IOH_Read8(IOHandler * h, uint32_t addr)
 {
-	IOHandler *h = IOH_Find(addr);
 	uint32_t value;
 	if (!h || !h->readproc) {
 		return 0;
@@ -1319,6 +1774,42 @@ IO_Read8(uint32_t addr)
 	return value;
 }
 
+void
+IO_Write32(uint32_t value, uint32_t addr)
+{
+	IOH_Write32(IOH_Find(addr), value, addr);
+}
+
+void
+IO_Write16(uint16_t value, uint32_t addr)
+{
+	IOH_Write16(IOH_Find(addr), value, addr);
+}
+
+void
+IO_Write8(uint8_t value, uint32_t addr)
+{
+	IOH_Write8(IOH_Find(addr), value, addr);
+}
+
+uint32_t
+IO_Read32(uint32_t addr)
+{
+	return IOH_Read32(IOH_Find(addr), addr);
+}
+
+uint16_t
+IO_Read16(uint32_t addr)
+{
+	return IOH_Read16(IOH_Find(addr), addr);
+}
+
+uint8_t
+IO_Read8(uint32_t addr)
+{
+	return IOH_Read8(IOH_Find(addr), addr);
+}
+
 static struct Bus mainBus = {
 	.read32 = Bus_Read32,
 	.read16 = Bus_Read16,
@@ -1419,6 +1910,7 @@ Bus_Init(InvalidateCallback * invalidate, uint32_t min_memblocksize)
 
 	iohandlerMap = sg_calloc(sizeof(IOHandler *) * IOH_MAP_ENTRIES);
 	iohandlerFlvlMap = sg_calloc(sizeof(IOHandler **) * IOH_FLVL_SZ);
+	iohandlerPageDir = sg_calloc(sizeof(IOPage **) * IOH_PAGEDIR_SZ);
 	MainBus = &mainBus;
 	Loader_RegisterBus("bus", load_to_bus, NULL);
 	fprintf(stderr, "MemMap and IO-Handler Hash initialized\n");
@@ -25,6 +25,8 @@
 /* The one level map */
 extern uint8_t **mem_map_read, **mem_map_write;
 
+void Mem_TraceHit(uint32_t addr);
+
 #define IOH_FLG_BIG_ENDIAN	(1)
 #define IOH_FLG_LITTLE_ENDIAN	(2)
 #define IOH_FLG_HOST_ENDIAN	(4)
@@ -72,6 +74,22 @@ extern uint8_t **mem_map_read, **mem_map_write;
 #define IOH_SLVL_BLOCKMASK	(0x1ff)
 #define IOH_SLVL_BLOCKSIZE      (0x200)
 
+/*
+ * ------------------------------------------------------------
+ * 1k IO pages: Dispatch table with the resolved handler for
+ * every byte address of a page. Allocated for every page
+ * which has a register handler, so a register access needs
+ * a single indexed load once the page is known.
+ * The page size matches the 1k granularity of the MMU TLBs.
+ * ------------------------------------------------------------
+ */
+#define IOH_PAGE_SHIFT		(10)
+#define IOH_PAGE_SIZE		(1 << IOH_PAGE_SHIFT)
+#define IOH_PAGE_MASK		(IOH_PAGE_SIZE - 1)
+#define IOH_PAGEDIR_SZ		(4096)
+#define IOH_PAGEDIR_SHIFT	(20)
+#define IOH_PAGETAB_SZ		(1 << (IOH_PAGEDIR_SHIFT - IOH_PAGE_SHIFT))
+
 /*
  * ---------------------------
  * One level 32kB blocks 
@@ -122,6 +140,37 @@ typedef struct IOHandler {
 } IOHandler;
 extern IOHandler **iohandlerHash;
 
+typedef struct IOPage {
+	IOHandler *handler[IOH_PAGE_SIZE];
+} IOPage;
+
+extern IOPage ***iohandlerPageDir;
+
+/*
+ * ------------------------------------------------------------------
+ * Find the IO page of an address. Returns NULL when the page
+ * has no register handlers (nothing or only IO regions mapped).
+ * IO pages are never freed, so the result can be cached in a TLB.
+ * ------------------------------------------------------------------
+ */
+static inline IOPage *
+IOH_FindPage(uint32_t addr)
+{
+	IOPage **pagetab = iohandlerPageDir[addr >> IOH_PAGEDIR_SHIFT];
+	if (!pagetab) {
+		return NULL;
+	}
+	return pagetab[(addr >> IOH_PAGE_SHIFT) & (IOH_PAGETAB_SZ - 1)];
+}
+
+static inline IOHandler *
+IOPage_Handler(IOPage * iop, uint32_t addr)
+{
+	return iop->handler[addr & IOH_PAGE_MASK];
+}
+
+IOHandler *IOH_Find(uint32_t address);
+
 void IOH_New8f(uint32_t cpu_addr, IOReadProc * readproc, IOWriteProc * writeproc, void *clientData,
 	       uint32_t flags);
 void IOH_New32f(uint32_t address, IOReadProc * readproc, IOWriteProc * writeproc, void *clientData,
@@ -164,6 +213,14 @@ uint32_t IO_Read32(uint32_t addr);
 uint16_t IO_Read16(uint32_t addr);
 uint8_t IO_Read8(uint32_t addr);
 
+/* Access with an already known handler, for example from an IO page cached in a TLB */
+void IOH_Write32(IOHandler * h, uint32_t value, uint32_t addr);
+void IOH_Write16(IOHandler * h, uint16_t value, uint32_t addr);
+void IOH_Write8(IOHandler * h, uint8_t value, uint32_t addr);
+uint32_t IOH_Read32(IOHandler * h, uint32_t addr);
+uint16_t IOH_Read16(IOHandler * h, uint32_t addr);
+uint8_t IOH_Read8(IOHandler * h, uint32_t addr);
+
 /*
  * ----------------------------------------------
  * MemMapping 
@@ -291,7 +348,7 @@ Bus_GetHVAWrite(uint32_t addr)
 			if (unlikely(((long)base) & PG_TRACED)) {
 				base -= PG_TRACED;
 				slvl_map[index] = base;
-				IO_Write8(0, addr);
+				Mem_TraceHit(addr);
 			}
 			return base + (addr & (twoLevelMMap.scnd_lvl_blockmask));
 		} else {
@@ -410,6 +467,8 @@ void Bus_Write(uint32_t addr, uint8_t * buf, uint32_t count);
 void Bus_Read(uint8_t * buf, uint32_t addr, uint32_t count);
 void Bus_WriteSwap32(uint32_t addr, uint8_t * buf, int count);
 void Bus_ReadSwap32(uint8_t * buf, uint32_t addr, int count);
+uint32_t Bus_GetReadSpan(uint32_t addr, uint32_t len, uint8_t ** hvap);
+uint32_t Bus_GetWriteSpan(uint32_t addr, uint32_t len, uint8_t ** hvap);
 
 typedef void InvalidateCallback(void);
 void Bus_Init(InvalidateCallback *, uint32_t min_blocksize);
@@ -420,6 +479,33 @@ void Mem_TraceRegion(uint32_t start, uint32_t length);
 void Mem_UntracePage(uint32_t pgaddr);
 void Mem_UntraceRegion(uint32_t start, uint32_t length);
 
+/*
+ * ------------------------------------------------------------------
+ * Code page tracing
+ *	Used by CPU cores which cache predecoded instructions.
+ *	The callback is invoked with the small page address on the
+ *	first write to a traced code page, the trace is removed then.
+ * ------------------------------------------------------------------
+ */
+typedef void CodeWriteCallback(uint32_t pgaddr);
+void Mem_SetCodeWriteCallback(CodeWriteCallback *);
+int Mem_TraceCodePage(uint32_t pgaddr);
+
+/*
+ * ------------------------------------------------------------------
+ * Dirty maps
+ *	Track writes to a memory region (for example a framebuffer)
+ *	with a bitmap of small pages. Only the first write to a page
+ *	after a drain takes the trace path.
+ * ------------------------------------------------------------------
+ */
+typedef struct BusDirtyMap BusDirtyMap;
+typedef void DirtyNotifyProc(void *clientData);
+typedef void DirtyRangeProc(void *clientData, uint32_t addr, uint8_t * hva, uint32_t len);
+BusDirtyMap *Mem_DirtyMapNew(uint32_t start, uint32_t length, DirtyNotifyProc *, void *clientData);
+void Mem_DirtyMapDelete(BusDirtyMap *);
+void Mem_DirtyMapDrain(BusDirtyMap *, DirtyRangeProc *, void *clientData);
+
 static inline int
 Mem_SmallPageSize()
 {
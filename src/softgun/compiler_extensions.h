@@ -24,6 +24,16 @@
 #  define __NORETURN__
 #  define __attribute__(...)
 #endif
+/*
+ * Thread local variables in the hot path (the current CPU of a thread).
+ * The modules are loaded with dlopen, the initial exec model avoids a
+ * __tls_get_addr call per access.
+ */
+#if defined(_MSC_VER)
+#  define __THREAD_LOCAL__ __declspec(thread)
+#else
+#  define __THREAD_LOCAL__ __thread __attribute__((tls_model("initial-exec")))
+#endif
 #define clz32	__builtin_clz
 #define clz64	__builtin_clzll
 
@@ -41,24 +41,124 @@
 
 #include <cycletimer.h>
 #include "clock.h"
+#include "globalclock.h"
+#include "sgstring.h"
+#include <stdio.h>
 #include <xy_tree.h>
 
+#ifndef CYCLETIMER_XYTREE
 /*
- * ----------------------------------------------
- * We only have one global Cycle timer Tree
- * If we emulate more than one CPU they should 
- * have the same frequency 
- * ----------------------------------------------
+ * -------------------------------------------------------------------------
+ * Hierarchical timer wheel
+ *
+ * The wheel has 8 levels with 256 slots each, one level for every byte
+ * of the 64 Bit timeout. A timer is stored in the level of the highest
+ * byte in which its timeout differs from the wheel time "now", in the
+ * slot given by the value of this byte. So all timers of a level expire
+ * before the timers of the next level and inside a level the slots are
+ * ordered. The first timer is always in the lowest used slot of the
+ * lowest used level. When it expires the slot is cascaded down relative
+ * to the new wheel time. Adding and removing a timer is O(1). The
+ * firstTimeout of the domain stays exact, only removing the first timer
+ * rescans one slot.
+ * -------------------------------------------------------------------------
+ */
+#define CTW_LEVEL_BITS	(8)
+#define CTW_LEVEL_SIZE	(1 << CTW_LEVEL_BITS)
+#define CTW_LEVELS	(8)
+#define CTW_WORDS	(CTW_LEVEL_SIZE / 64)
+
+typedef struct WheelSlot {
+	CycleTimer *head;
+	CycleTimer *tail;
+} WheelSlot;
+#endif
+
+/* Request posted by CycleTimer_Remove, all other values are cycles */
+#define CT_REQUEST_CANCEL	(~(uint64_t) 0)
+
+/*
+ * ----------------------------------------------------------------
+ * The timer queue of a clock domain. The public part has to be
+ * the first member.
+ * ----------------------------------------------------------------
+ */
+typedef struct CycleTimerQueue {
+	CycleTimerDomain dom;
+	CycleTimer *inbox;
+	int *owner;		/* Thread mark of the CPU thread */
+	Clock_t *cpuClk;
+	CycleTimer quantumTimer;
+	uint64_t quantumStart;
+	struct CycleTimerQueue *nextQueue;	/* in the order of creation */
+#ifdef CYCLETIMER_XYTREE
+	xy_node *firstNode;
+	XY_Tree tree;
+#else
+	WheelSlot wheelSlot[CTW_LEVELS * CTW_LEVEL_SIZE];
+	uint64_t wheelBitmap[CTW_LEVELS][CTW_WORDS];
+	uint32_t wheelLevelMask;
+	uint64_t wheelNow;
+#endif
+} CycleTimerQueue;
+
+/*
+ * ----------------------------------------------------------------
+ * The first CPU uses the static queue, so the threads without a
+ * CPU always have a valid domain.
+ * ----------------------------------------------------------------
+ */
+static CycleTimerQueue primaryQueue = {
+	.dom = {
+		.firstTimeout = ~(uint64_t) 0,
+	},
+};
+static int primaryQueueUsed;
+static CycleTimerQueue *lastQueue = &primaryQueue;
+
+__THREAD_LOCAL__ CycleTimerDomain *currentCycleTimerDomain = &primaryQueue.dom;
+
+/* Only the address is used, it identifies the thread */
+static __THREAD_LOCAL__ int threadMark;
+
+static inline CycleTimerQueue *
+domain_queue(CycleTimerDomain * domain)
+{
+	return (CycleTimerQueue *) domain;
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * Before the CPU runs all domains belong to the thread which builds
+ * the board.
+ * ---------------------------------------------------------------------
  */
+static inline int
+queue_is_owner(CycleTimerQueue * q)
+{
+	int *owner = __atomic_load_n(&q->owner, __ATOMIC_ACQUIRE);
+	return !owner || (owner == &threadMark);
+}
 
-CycleTimer *firstCycleTimer = 0;
-xy_node *firstCycleTimerNode = 0;
-XY_Tree CycleTimerTree;
-uint64_t firstCycleTimerTimeout = ~(uint64_t) 0;
-uint64_t CycleCounter = 0;
-uint32_t CycleTimerRate;
-static Clock_t *ct_CpuClk;
+/*
+ * ---------------------------------------------------------------------
+ * Every write of firstTimeout by the owner rechecks the inbox. A thread
+ * which posts a request pushes it before it clears firstTimeout, so
+ * either the owner sees the request here or the clear comes after the
+ * write of the owner. In both cases the next CycleTimers_Check of the
+ * owner drains the inbox.
+ * ---------------------------------------------------------------------
+ */
+static inline void
+queue_set_first(CycleTimerQueue * q, uint64_t timeout)
+{
+	__atomic_store_n(&q->dom.firstTimeout, timeout, __ATOMIC_SEQ_CST);
+	if (unlikely(__atomic_load_n(&q->inbox, __ATOMIC_SEQ_CST) != NULL)) {
+		__atomic_store_n(&q->dom.firstTimeout, 0, __ATOMIC_SEQ_CST);
+	}
+}
 
+#ifdef CYCLETIMER_XYTREE
 /*
  * -----------------------------------------------
  * returns true if time1 is later then time2
@@ -76,27 +176,73 @@ is_later(const void *t1, const void *t2)
 	}
 }
 
+static void
+queue_init(CycleTimerQueue * q)
+{
+	XY_InitTree(&q->tree, is_later, NULL, NULL, NULL);
+}
+
+static void queue_update_first(CycleTimerQueue * q);
+
+/*
+ * -------------------------------------------------------------
+ * Expire the first timer if it is due
+ * -------------------------------------------------------------
+ */
+static void
+queue_expire(CycleTimerQueue * q)
+{
+	xy_node *node = q->firstNode;
+	if (!node) {
+		queue_set_first(q, ~(uint64_t) 0);
+		return;
+	}
+	/* firstTimeout may have been cleared by a post, check the node */
+	if (((CycleTimer *) XY_NodeValue(node))->timeout > q->dom.cycleCounter) {
+		queue_update_first(q);
+		return;
+	}
+	if (node) {
+		CycleTimer *timer = (CycleTimer *) XY_NodeValue(node);
+		CycleTimer_Proc *proc;
+		q->firstNode = XY_NextTreeNode(&q->tree, q->firstNode);
+		if (q->firstNode) {
+			CycleTimer *next = (CycleTimer *) XY_NodeValue(q->firstNode);
+			queue_set_first(q, next->timeout);
+		} else {
+			// Never
+			queue_set_first(q, ~0ULL);
+		}
+		XY_DeleteTreeNode(&q->tree, node);
+		proc = timer->proc;
+		timer->isactive = 0;
+		if (likely(proc))
+			proc(timer->clientData);
+	} else {
+		fprintf(stderr, "Bug in timertree\n");
+	}
+}
+
 /*
  * ----------------------------------------------------------
- * Remove Timer from linked list
+ * Remove Timer from the tree
  * ----------------------------------------------------------
  */
-
-void
-CycleTimer_Remove(CycleTimer * timer)
+static void
+queue_remove(CycleTimerQueue * q, CycleTimer * timer)
 {
 	if (unlikely(!timer->isactive))
 		return;
-	XY_DeleteTreeNode(&CycleTimerTree, &timer->node);
+	XY_DeleteTreeNode(&q->tree, &timer->node);
 	timer->isactive = 0;
-	if (timer == XY_NodeValue(firstCycleTimerNode)) {
+	if (timer == XY_NodeValue(q->firstNode)) {
 		CycleTimer *timer;
-		firstCycleTimerNode = XY_NextTreeNode(&CycleTimerTree, firstCycleTimerNode);
-		if (firstCycleTimerNode) {
-			timer = XY_NodeValue(firstCycleTimerNode);
-			firstCycleTimerTimeout = timer->timeout;
+		q->firstNode = XY_NextTreeNode(&q->tree, q->firstNode);
+		if (q->firstNode) {
+			timer = XY_NodeValue(q->firstNode);
+			queue_set_first(q, timer->timeout);
 		} else {
-			firstCycleTimerTimeout = ~(uint64_t) 0;
+			queue_set_first(q, ~(uint64_t) 0);
 		}
 	}
 }
@@ -106,27 +252,363 @@ CycleTimer_Remove(CycleTimer * timer)
  * Insert timer into the tree
  ***************************************************
  */
+static void
+queue_add(CycleTimerQueue * q, CycleTimer * timer, uint64_t cycles)
+{
+	timer->isactive = 1;
+	timer->timeout = q->dom.cycleCounter + cycles;
+	XY_AddTreeNode(&q->tree, &timer->node, &timer->timeout, timer);
+	if (q->firstNode) {
+		CycleTimer *first_timer = XY_NodeValue(q->firstNode);
+		if (timer->timeout < first_timer->timeout) {
+			q->firstNode = &timer->node;
+			queue_set_first(q, timer->timeout);
+		}
+	} else {
+		q->firstNode = &timer->node;
+		queue_set_first(q, timer->timeout);
+	}
+}
+
+static void
+queue_update_first(CycleTimerQueue * q)
+{
+	if (q->firstNode) {
+		CycleTimer *timer = XY_NodeValue(q->firstNode);
+		queue_set_first(q, timer->timeout);
+	} else {
+		queue_set_first(q, ~(uint64_t) 0);
+	}
+}
+
+#else
+
+static void
+queue_init(CycleTimerQueue * q)
+{
+	q->wheelNow = q->dom.cycleCounter;
+}
+
+static void
+wheel_insert(CycleTimerQueue * q, CycleTimer * timer)
+{
+	uint64_t diff;
+	uint32_t level, idx;
+	WheelSlot *ws;
+	if (unlikely(timer->timeout < q->wheelNow)) {
+		/* Already expired, fire it on the next check */
+		timer->timeout = q->wheelNow;
+	}
+	diff = timer->timeout ^ q->wheelNow;
+	if (diff) {
+		level = (uint32_t) (63 - __builtin_clzll(diff)) / CTW_LEVEL_BITS;
+	} else {
+		level = 0;
+	}
+	idx = (uint32_t) (timer->timeout >> (level * CTW_LEVEL_BITS)) & (CTW_LEVEL_SIZE - 1);
+	timer->slot = level * CTW_LEVEL_SIZE + idx;
+	ws = &q->wheelSlot[timer->slot];
+	timer->next = NULL;
+	timer->prev = ws->tail;
+	if (ws->tail) {
+		ws->tail->next = timer;
+	} else {
+		ws->head = timer;
+	}
+	ws->tail = timer;
+	q->wheelBitmap[level][idx >> 6] |= UINT64_C(1) << (idx & 63);
+	q->wheelLevelMask |= 1U << level;
+}
+
+static void
+wheel_unlink(CycleTimerQueue * q, CycleTimer * timer)
+{
+	WheelSlot *ws = &q->wheelSlot[timer->slot];
+	uint32_t level, idx, i;
+	if (timer->prev) {
+		timer->prev->next = timer->next;
+	} else {
+		ws->head = timer->next;
+	}
+	if (timer->next) {
+		timer->next->prev = timer->prev;
+	} else {
+		ws->tail = timer->prev;
+	}
+	if (ws->head) {
+		return;
+	}
+	level = timer->slot / CTW_LEVEL_SIZE;
+	idx = timer->slot % CTW_LEVEL_SIZE;
+	q->wheelBitmap[level][idx >> 6] &= ~(UINT64_C(1) << (idx & 63));
+	for (i = 0; i < CTW_WORDS; i++) {
+		if (q->wheelBitmap[level][i]) {
+			return;
+		}
+	}
+	q->wheelLevelMask &= ~(1U << level);
+}
+
+/*
+ * ------------------------------------------------------------
+ * Find the lowest used slot of the lowest used level.
+ * Returns -1 if the wheel is empty.
+ * ------------------------------------------------------------
+ */
+static int
+wheel_first_slot(CycleTimerQueue * q)
+{
+	uint32_t level, i;
+	if (!q->wheelLevelMask) {
+		return -1;
+	}
+	level = (uint32_t) __builtin_ctz(q->wheelLevelMask);
+	for (i = 0; i < CTW_WORDS; i++) {
+		uint64_t word = q->wheelBitmap[level][i];
+		if (word) {
+			return (int)(level * CTW_LEVEL_SIZE + i * 64 + (uint32_t) __builtin_ctzll(word));
+		}
+	}
+	fprintf(stderr, "Bug in timer wheel\n");
+	return -1;
+}
+
+/*
+ * ------------------------------------------------------------
+ * The earliest timeout in a slot. The timers of a level 0 slot
+ * all have the same timeout.
+ * ------------------------------------------------------------
+ */
+static uint64_t
+wheel_slot_first(CycleTimerQueue * q, int slot)
+{
+	CycleTimer *cursor = q->wheelSlot[slot].head;
+	uint64_t first = cursor->timeout;
+	if (slot >= CTW_LEVEL_SIZE) {
+		for (cursor = cursor->next; cursor; cursor = cursor->next) {
+			if (cursor->timeout < first) {
+				first = cursor->timeout;
+			}
+		}
+	}
+	return first;
+}
+
+static void
+queue_update_first(CycleTimerQueue * q)
+{
+	int slot = wheel_first_slot(q);
+	if (slot < 0) {
+		queue_set_first(q, ~(uint64_t) 0);
+		return;
+	}
+	queue_set_first(q, wheel_slot_first(q, slot));
+}
+
+/*
+ * -------------------------------------------------------------
+ * Expire the first timer if it is due.
+ * Timers with the same timeout expire in the order of insertion.
+ * The due time is taken from the wheel and not from firstTimeout,
+ * another thread may have cleared that one to announce a post.
+ * -------------------------------------------------------------
+ */
+static void
+queue_expire(CycleTimerQueue * q)
+{
+	CycleTimer *timer;
+	CycleTimer_Proc *proc;
+	uint64_t due;
+	int slot;
+	while (1) {
+		slot = wheel_first_slot(q);
+		if (slot < 0) {
+			queue_set_first(q, ~(uint64_t) 0);
+			return;
+		}
+		due = wheel_slot_first(q, slot);
+		if (due > q->dom.cycleCounter) {
+			queue_set_first(q, due);
+			return;
+		}
+		if (slot >= CTW_LEVEL_SIZE) {
+			/*
+			 * Cascade the slot down relative to its first timer,
+			 * which lands in level 0
+			 */
+			if (due > q->wheelNow) {
+				q->wheelNow = due;
+			}
+			timer = q->wheelSlot[slot].head;
+			while (timer) {
+				CycleTimer *next = timer->next;
+				wheel_unlink(q, timer);
+				wheel_insert(q, timer);
+				timer = next;
+			}
+			continue;
+		}
+		timer = q->wheelSlot[slot].head;
+		q->wheelNow = timer->timeout;
+		wheel_unlink(q, timer);
+		timer->isactive = 0;
+		queue_update_first(q);
+		proc = timer->proc;
+		if (likely(proc)) {
+			proc(timer->clientData);
+		}
+		return;
+	}
+}
+
+static void
+queue_remove(CycleTimerQueue * q, CycleTimer * timer)
+{
+	if (unlikely(!timer->isactive))
+		return;
+	wheel_unlink(q, timer);
+	timer->isactive = 0;
+	if (timer->timeout == q->dom.firstTimeout) {
+		queue_update_first(q);
+	}
+}
+
+static void
+queue_add(CycleTimerQueue * q, CycleTimer * timer, uint64_t cycles)
+{
+	timer->isactive = 1;
+	timer->timeout = q->dom.cycleCounter + cycles;
+	wheel_insert(q, timer);
+	if (timer->timeout < q->dom.firstTimeout) {
+		queue_set_first(q, timer->timeout);
+	}
+}
+#endif
+
+/*
+ * ---------------------------------------------------------------------
+ * Multi producer push into the inbox of a domain. A timer is in the
+ * inbox at most once, a newer request only replaces the value. The
+ * request has to be stored before pending is tested, and the owner
+ * clears pending before it reads the request, so either the owner sees
+ * the new request or the timer is pushed again.
+ * ---------------------------------------------------------------------
+ */
+static void
+queue_post(CycleTimerQueue * q, CycleTimer * timer, uint64_t request)
+{
+	CycleTimer *head;
+	__atomic_store_n(&timer->request, request, __ATOMIC_SEQ_CST);
+	if (__atomic_exchange_n(&timer->pending, 1, __ATOMIC_SEQ_CST)) {
+		return;
+	}
+	head = __atomic_load_n(&q->inbox, __ATOMIC_RELAXED);
+	do {
+		timer->inbox_next = head;
+	} while (!__atomic_compare_exchange_n(&q->inbox, &head, timer, 1,
+					      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+	/* Make the next CycleTimers_Check of the owner drain the inbox */
+	__atomic_store_n(&q->dom.firstTimeout, 0, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * ---------------------------------------------------------------------
+ * Apply the requests of the inbox in the order they were posted
+ * ---------------------------------------------------------------------
+ */
+static void
+queue_drain(CycleTimerQueue * q)
+{
+	CycleTimer *timer;
+	CycleTimer *next;
+	CycleTimer *fifo = NULL;
+	uint64_t request;
+	timer = __atomic_exchange_n(&q->inbox, NULL, __ATOMIC_SEQ_CST);
+	for (; timer; timer = next) {
+		next = timer->inbox_next;
+		timer->inbox_next = fifo;
+		fifo = timer;
+	}
+	for (timer = fifo; timer; timer = next) {
+		next = timer->inbox_next;
+		__atomic_store_n(&timer->pending, 0, __ATOMIC_SEQ_CST);
+		request = __atomic_load_n(&timer->request, __ATOMIC_SEQ_CST);
+		queue_remove(q, timer);
+		if (request != CT_REQUEST_CANCEL) {
+			queue_add(q, timer, request);
+		}
+	}
+	queue_update_first(q);
+}
+
+/*
+ * -------------------------------------------------------------
+ * Called from CycleTimers_Check when the first timer expired
+ * or when another thread posted a request.
+ * -------------------------------------------------------------
+ */
+void
+CycleTimers_Expire(void)
+{
+	CycleTimerQueue *q = domain_queue(currentCycleTimerDomain);
+	if (unlikely(__atomic_load_n(&q->inbox, __ATOMIC_RELAXED) != NULL)) {
+		queue_drain(q);
+	}
+	queue_expire(q);
+}
 
+/*
+ * ---------------------------------------------------------------------
+ * Start a timer in the given domain. The timer is bound to the domain
+ * by its first use and stays there. This is the way to send an event
+ * to a device of another CPU.
+ * ---------------------------------------------------------------------
+ */
 void
-CycleTimer_Add(CycleTimer * timer, uint64_t cycles, CycleTimer_Proc * proc, void *clientData)
+CycleTimer_AddToDomain(CycleTimerDomain * domain, CycleTimer * timer, uint64_t cycles,
+		       CycleTimer_Proc * proc, void *clientData)
 {
+	CycleTimerQueue *q = domain_queue(domain);
 	if (unlikely(!proc))
 		return;
-
+	if (unlikely(timer->domain && (timer->domain != domain))) {
+		fprintf(stderr, "CycleTimer can not move to another clock domain\n");
+		return;
+	}
 	timer->proc = proc;
-	timer->isactive = 1;
 	timer->clientData = clientData;
-	timer->timeout = CycleCounter + cycles;
-	XY_AddTreeNode(&CycleTimerTree, &timer->node, &timer->timeout, timer);
-	if (firstCycleTimerNode) {
-		CycleTimer *first_timer = XY_NodeValue(firstCycleTimerNode);
-		if (timer->timeout < first_timer->timeout) {
-			firstCycleTimerNode = &timer->node;
-			firstCycleTimerTimeout = timer->timeout;
-		}
+	timer->domain = domain;
+	if (cycles == CT_REQUEST_CANCEL) {
+		cycles--;
+	}
+	if (queue_is_owner(q) && !__atomic_load_n(&timer->pending, __ATOMIC_SEQ_CST)) {
+		queue_add(q, timer, cycles);
+	} else {
+		queue_post(q, timer, cycles);
+	}
+}
+
+void
+CycleTimer_Add(CycleTimer * timer, uint64_t cycles, CycleTimer_Proc * proc, void *clientData)
+{
+	if (!timer->domain) {
+		timer->domain = currentCycleTimerDomain;
+	}
+	CycleTimer_AddToDomain(timer->domain, timer, cycles, proc, clientData);
+}
+
+void
+CycleTimer_Remove(CycleTimer * timer)
+{
+	CycleTimerQueue *q;
+	if (!timer->domain) {
+		return;
+	}
+	q = domain_queue(timer->domain);
+	if (queue_is_owner(q) && !__atomic_load_n(&timer->pending, __ATOMIC_SEQ_CST)) {
+		queue_remove(q, timer);
 	} else {
-		firstCycleTimerNode = &timer->node;
-		firstCycleTimerTimeout = timer->timeout;
+		queue_post(q, timer, CT_REQUEST_CANCEL);
 	}
 }
 
@@ -138,16 +620,132 @@ CycleTimer_Add(CycleTimer * timer, uint64_t cycles, CycleTimer_Proc * proc, void
 static void
 CpuClock_Trace(struct Clock *clock, void *clientData)
 {
-	CycleTimerRate = Clock_Freq(clock);
+	CycleTimerQueue *q = clientData;
+	q->dom.rate = Clock_Freq(clock);
 }
 
-void
+/*
+ * -----------------------------------------------------------------------
+ * Create the clock domain of a CPU and select it for the calling
+ * thread. The devices created next bind their timers to this domain.
+ * -----------------------------------------------------------------------
+ */
+CycleTimerDomain *
 CycleTimers_Init(const char *cpu_name, uint32_t freq_hz)
 {
-	CycleTimerRate = freq_hz;
-	ct_CpuClk = Clock_New("%s.clk", cpu_name);
-	Clock_SetFreq(ct_CpuClk, freq_hz);
-	XY_InitTree(&CycleTimerTree, is_later, NULL, NULL, NULL);
-	Clock_Trace(ct_CpuClk, CpuClock_Trace, NULL);
-	Clock_MakeSystemMaster(ct_CpuClk);
+	CycleTimerQueue *q;
+	if (!primaryQueueUsed) {
+		/* Keep the timers which were added before the first CPU */
+		q = &primaryQueue;
+		primaryQueueUsed = 1;
+	} else {
+		q = sg_new(CycleTimerQueue);
+		q->dom.firstTimeout = ~(uint64_t) 0;
+		lastQueue->nextQueue = q;
+		lastQueue = q;
+	}
+	q->dom.rate = freq_hz;
+	q->cpuClk = Clock_New("%s.clk", cpu_name);
+	Clock_SetFreq(q->cpuClk, freq_hz);
+	queue_init(q);
+	Clock_Trace(q->cpuClk, CpuClock_Trace, q);
+	Clock_MakeSystemMaster(q->cpuClk);
+	currentCycleTimerDomain = &q->dom;
+	return &q->dom;
+}
+
+/*
+ * -----------------------------------------------------------------------
+ * Go back to the domain of the first CPU after creating the devices
+ * of the other CPUs in this thread
+ * -----------------------------------------------------------------------
+ */
+void
+CycleTimers_SelectPrimaryDomain(void)
+{
+	currentCycleTimerDomain = &primaryQueue.dom;
+}
+
+/*
+ * -----------------------------------------------------------------------
+ * Iterate the clock domains in the order of their creation, the
+ * domain of the first CPU comes first. NULL starts the iteration.
+ * -----------------------------------------------------------------------
+ */
+CycleTimerDomain *
+CycleTimers_NextDomain(CycleTimerDomain * domain)
+{
+	CycleTimerQueue *q;
+	if (!domain) {
+		return &primaryQueue.dom;
+	}
+	q = domain_queue(domain)->nextQueue;
+	return q ? &q->dom : NULL;
+}
+
+/*
+ * -----------------------------------------------------------------------
+ * The CPU runs for a quantum of cycles which ends at the next
+ * synchronization point of its GlobalClock. At the end of the quantum
+ * all cycles executed since its start are consumed in one call.
+ * Cycles skipped by an idle CPU are accounted in the same way.
+ * -----------------------------------------------------------------------
+ */
+static void
+quantum_timeout(void *clientData)
+{
+	GlobalClock_LocalClock_t *clk = clientData;
+	CycleTimerQueue *q = domain_queue(currentCycleTimerDomain);
+	uint64_t cycles = q->dom.cycleCounter - q->quantumStart;
+	while (cycles > UINT32_MAX) {
+		GlobalClock_ConsumeCycle(clk, UINT32_MAX);
+		cycles -= UINT32_MAX;
+	}
+	GlobalClock_ConsumeCycle(clk, (uint32_t) cycles);
+	q->quantumStart = q->dom.cycleCounter;
+	queue_add(q, &q->quantumTimer, GlobalClock_Quantum(clk));
+}
+
+/*
+ * -----------------------------------------------------------------------
+ * Called by the CPU from its GlobalClock thread before entering the
+ * main loop: The thread selects and owns the domain of the CPU from
+ * now on, and the quantum based accounting is started.
+ * -----------------------------------------------------------------------
+ */
+void
+CycleTimers_SyncGlobalClock(CycleTimerDomain * domain, GlobalClock_LocalClock_t *clk)
+{
+	CycleTimerQueue *q = domain_queue(domain);
+	currentCycleTimerDomain = domain;
+	__atomic_store_n(&q->owner, &threadMark, __ATOMIC_RELEASE);
+	queue_remove(q, &q->quantumTimer);
+	q->quantumStart = q->dom.cycleCounter;
+	CycleTimer_Init(&q->quantumTimer, quantum_timeout, clk);
+	queue_add(q, &q->quantumTimer, GlobalClock_Quantum(clk));
+	/* Apply what was posted before the owner was set */
+	CycleTimers_Expire();
+}
+
+/*
+ * -----------------------------------------------------------------------
+ * Idle fast-forward for a CPU which waits for an interrupt: Jump the
+ * CycleCounter to the next timeout and expire the timer instead of
+ * executing the idle cycles one by one. The skipped cycles are consumed
+ * by the quantum timer, so the GlobalClock and the throttle still pace
+ * the CPU in real time.
+ * Returns 0 if no timer is pending. Nothing can wake up the CPU then.
+ * -----------------------------------------------------------------------
+ */
+int
+CycleTimers_FastForward(void)
+{
+	if (firstCycleTimerTimeout == ~(uint64_t) 0) {
+		return 0;
+	}
+	if (CycleCounter < firstCycleTimerTimeout) {
+		CycleCounter = firstCycleTimerTimeout;
+	}
+	CycleTimers_Expire();
+	return 1;
 }
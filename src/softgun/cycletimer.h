@@ -23,61 +23,84 @@
 typedef void CycleTimer_Proc(void *clientData);
 typedef uint64_t CycleCounter_t;
 
+/*
+ * ----------------------------------------------------------------
+ * The timers are kept in a hierarchical timer wheel. The old
+ * red-black tree backend can be selected with CYCLETIMER_XYTREE
+ * for comparison.
+ * ----------------------------------------------------------------
+ */
+
 // All fields of CycleTimer are private !
 typedef struct CycleTimer {
+#ifdef CYCLETIMER_XYTREE
 	xy_node node;
+#else
+	struct CycleTimer *next;	// list of the timer wheel slot
+	struct CycleTimer *prev;
+	uint32_t slot;
+#endif
 	uint64_t timeout;	// absolute cycles of timeout
 	CycleTimer_Proc *proc;
 	void *clientData;
 	int isactive;
+	struct CycleTimerDomain *domain;	// bound by the first Init or Add
+	struct CycleTimer *inbox_next;	// requests posted by other threads
+	uint64_t request;
+	int pending;
 } CycleTimer;
 
 /*
- * ----------------------------------------------
- * We only have one global Cycle timer Tree
- * If we emulate more than one CPU they should be
- * in sync
- * ----------------------------------------------
+ * ----------------------------------------------------------------------
+ * Every CPU has its own clock domain: a CycleCounter, a timer queue
+ * and the CycleTimerRate. The domain is selected per thread, so the
+ * CycleCounter seen by the CPU main loop and by the devices is the
+ * one of the CPU which runs in this thread. CycleTimers_Init creates a
+ * domain and selects it, so the devices created after a CPU bind their
+ * timers to the domain of this CPU. Threads without a CPU (AsyncManager)
+ * see the domain of the first CPU. The main thread selects it again
+ * with CycleTimers_SelectPrimaryDomain when the board is complete.
+ *
+ * A domain is owned by the thread of its CPU after
+ * CycleTimers_SyncGlobalClock. Adding or removing a timer from another
+ * thread (another CPU, the AsyncManager) posts the request into a
+ * lock-free inbox of the domain. The owner applies it on its next
+ * CycleTimers_Check, the cycles are counted from this moment in the
+ * target domain. If several requests for a timer are posted before they
+ * are applied the last one wins. CycleTimer_IsActive reflects posted
+ * requests only after they are applied.
+ * ----------------------------------------------------------------------
  */
-extern CycleTimer *firstCycleTimer;
-extern xy_node *firstCycleTimerNode;
-extern XY_Tree CycleTimerTree;
-extern uint64_t firstCycleTimerTimeout;
-extern uint64_t CycleCounter;
-extern uint32_t CycleTimerRate;
+// Only the first fields are public, the queue follows in cycletimer.c
+typedef struct CycleTimerDomain {
+	uint64_t cycleCounter;
+	uint64_t firstTimeout;
+	uint32_t rate;
+} CycleTimerDomain;
+
+extern __THREAD_LOCAL__ CycleTimerDomain *currentCycleTimerDomain;
+
+#define CycleCounter		(currentCycleTimerDomain->cycleCounter)
+#define firstCycleTimerTimeout	(currentCycleTimerDomain->firstTimeout)
+#define CycleTimerRate		(currentCycleTimerDomain->rate)
 
 /*
  * -------------------------------------------------
  * This function is called from the CPU main loop
  * after every instruction. So Its inline
+ * The synchronization with the GlobalClock is also
+ * done from a timer, so the CPU main loop only has
+ * to update the CycleCounter.
  * -------------------------------------------------
  */
 
+void CycleTimers_Expire(void);
+
 static inline void
 CycleTimers_Check()
 {
 	if (unlikely(CycleCounter >= firstCycleTimerTimeout)) {
-		xy_node *node = firstCycleTimerNode;
-		if (node) {
-			CycleTimer *timer = (CycleTimer *) XY_NodeValue(node);
-			CycleTimer_Proc *proc;
-			firstCycleTimerNode = XY_NextTreeNode(&CycleTimerTree, firstCycleTimerNode);
-			if (firstCycleTimerNode) {
-				CycleTimer *next =
-				    (CycleTimer *) XY_NodeValue(firstCycleTimerNode);
-				firstCycleTimerTimeout = next->timeout;
-			} else {
-				// Never
-				firstCycleTimerTimeout = ~0ULL;
-			}
-			XY_DeleteTreeNode(&CycleTimerTree, node);
-			proc = timer->proc;
-			timer->isactive = 0;
-			if (likely(proc))
-				proc(timer->clientData);
-		} else {
-			fprintf(stderr, "Bug in timertree\n");
-		}
+		CycleTimers_Expire();
 	}
 }
 
@@ -139,6 +162,8 @@ CycleTimer_Init(CycleTimer * timer, CycleTimer_Proc * proc, void *clientData)
 	timer->isactive = 0;
 	timer->proc = proc;
 	timer->clientData = clientData;
+	timer->domain = currentCycleTimerDomain;
+	timer->pending = 0;
 }
 
 void
@@ -166,10 +191,31 @@ CycleTimer_GetRemaining(CycleTimer * timer)
 	if (!timer->isactive) {
 		return 0;
 	} else {
-		return timer->timeout - CycleCounter_Get();
+		return timer->timeout - timer->domain->cycleCounter;
 	}
 }
 
-void CycleTimers_Init(const char *cpu_name, uint32_t cpu_clock);
+CycleTimerDomain *CycleTimers_Init(const char *cpu_name, uint32_t cpu_clock);
+void CycleTimers_SelectPrimaryDomain(void);
+CycleTimerDomain *CycleTimers_NextDomain(CycleTimerDomain * domain);
+
+static inline CycleTimerDomain *
+CycleTimers_Domain(void)
+{
+	return currentCycleTimerDomain;
+}
+
+static inline void
+CycleTimers_SelectDomain(CycleTimerDomain * domain)
+{
+	currentCycleTimerDomain = domain;
+}
+
+void CycleTimer_AddToDomain(CycleTimerDomain * domain, CycleTimer *, uint64_t cycles,
+			    CycleTimer_Proc *, void *clientData);
+
+struct GlobalClock_LocalClock_s;
+void CycleTimers_SyncGlobalClock(CycleTimerDomain * domain, struct GlobalClock_LocalClock_s *clk);
+int CycleTimers_FastForward(void);
 
 #endif
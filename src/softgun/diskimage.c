@@ -48,7 +48,10 @@
 #include <string.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
 #ifdef __unix__
+#include <pthread.h>
 #include <sys/file.h>
 #include <sys/mman.h>
 #else
@@ -60,6 +63,8 @@
 #include <sys/types.h>
 
 #include "sgstring.h"
+#include "configfile.h"
+#include "exithandler.h"
 
 #ifndef O_LARGEFILE
  /* O_LARGEFILE is not defined or needed on FreeBSD,
@@ -67,11 +72,90 @@
 #define O_LARGEFILE 0
 #endif
 
+/*
+ * ------------------------------------------------------------------------
+ * Copy-on-write overlays:
+ * The base image is opened read only with a shared lock, so many
+ * simulator instances can use it at the same time. Every instance
+ * writes into its own sparse delta file. The delta file starts with
+ * a header and a bitmap with one bit per block. The data of block n
+ * is at data_ofs + n * block_size, blocks which were never written
+ * are holes in the delta file.
+ * ------------------------------------------------------------------------
+ */
+#define OVL_MAGIC	"LGOVLAY1"
+#define OVL_BLOCKSIZE	(4096)
+#define OVL_HDRSIZE	(64)
+
+typedef struct OverlayHeader {
+	char magic[8];
+	uint32_t block_size;
+	uint32_t reserved;
+	uint64_t size;
+	uint64_t base_size;
+	uint64_t data_ofs;
+} OverlayHeader;
+
+/*
+ * ------------------------------------------------------------------------
+ * Block cache:
+ * Images opened with DI_CACHE keep recently used blocks in an LRU
+ * cache. A miss directly behind the previous access fetches a growing
+ * read-ahead window with one pread. Writes only mark the cached block
+ * dirty. A dirty block is written back when it is evicted, together
+ * with the dirty blocks next to it, or by DiskImage_Sync and
+ * DiskImage_Close.
+ * ------------------------------------------------------------------------
+ */
+#define DC_BLOCKSIZE		(4096)
+#define DC_DEFAULT_KB		(1024)
+#define DC_MAX_RUN		(16)	/* Read-ahead and write-back coalescing in blocks */
+#define DC_NO_BLOCK		(~(uint64_t) 0)
+
+typedef struct CacheBlock {
+	struct CacheBlock *hnext;
+	struct CacheBlock *lru_prev;
+	struct CacheBlock *lru_next;
+	uint64_t block;
+	int dirty;
+	uint8_t *data;
+} CacheBlock;
+
+typedef struct BlockCache {
+	CacheBlock *blocks;
+	uint32_t nr_blocks;
+	CacheBlock **hash;
+	uint32_t hash_mask;
+	CacheBlock *mru;
+	CacheBlock *lru;
+	uint64_t next_ofs;	/* End of the last read for detecting sequential access */
+	uint32_t ra_blocks;
+	uint8_t *runbuf;	/* Read-ahead */
+	uint8_t *wbbuf;		/* Write-back, a write back can happen during a read-ahead */
+	uint8_t *mem;
+} BlockCache;
+
 struct DiskImage {
 	int fd;
 	int flags;
 	uint64_t size;
 	void *map;
+	/* Overlay, base_fd is -1 if there is no base image */
+	int overlay;
+	int base_fd;
+	uint64_t base_size;
+	uint8_t *bitmap;
+	uint32_t block_size;
+	uint64_t data_ofs;
+	uint8_t emptyval;
+	/* Block cache, NULL if not enabled with DI_CACHE */
+	BlockCache *cache;
+	/* Queue of asynchronous requests */
+	struct IORequest *io_head;
+	struct IORequest *io_tail;
+	struct DiskImage *io_runq_next;
+	uint32_t io_pending;
+	int io_queued;
 #ifdef __unix__
 #else
 	HANDLE hHandle;
@@ -184,12 +268,1006 @@ blockdev_get_size(DiskImage * di)
 	return 0;
 }
 
+
+static int
+pread_full(int fd, uint8_t * buf, size_t count, off_t ofs)
+{
+	size_t cnt;
+	ssize_t result;
+	for (cnt = 0; cnt < count;) {
+		result = pread(fd, buf + cnt, count - cnt, ofs + cnt);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		} else if (result == 0) {
+			break;
+		}
+		cnt += result;
+	}
+	return cnt;
+}
+
+static int
+pwrite_full(int fd, const uint8_t * buf, size_t count, off_t ofs)
+{
+	size_t cnt;
+	ssize_t result;
+	for (cnt = 0; cnt < count;) {
+		result = pwrite(fd, buf + cnt, count - cnt, ofs + cnt);
+		if (result <= 0) {
+			if ((result < 0) && (errno == EINTR)) {
+				continue;
+			}
+			return -1;
+		}
+		cnt += result;
+	}
+	return cnt;
+}
+
+static inline int
+ovl_block_present(DiskImage * di, uint64_t block)
+{
+	return (di->bitmap[block >> 3] >> (block & 7)) & 1;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Read a block from the base image. The part beyond the end of the
+ * base image is filled with the empty value.
+ * ------------------------------------------------------------------------
+ */
+static int
+ovl_read_base(DiskImage * di, uint64_t ofs, uint8_t * buf, uint32_t count)
+{
+	int result = 0;
+	if ((di->base_fd >= 0) && (ofs < di->base_size)) {
+		uint32_t avail = count;
+		if (ofs + count > di->base_size) {
+			avail = di->base_size - ofs;
+		}
+		result = pread_full(di->base_fd, buf, avail, ofs);
+		if (result < 0) {
+			return -1;
+		}
+	}
+	memset(buf + result, di->emptyval, count - result);
+	return 0;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Mark a block as present in the delta and write the changed byte
+ * of the bitmap back.
+ * ------------------------------------------------------------------------
+ */
+static int
+ovl_set_present(DiskImage * di, uint64_t block)
+{
+	uint64_t idx = block >> 3;
+	di->bitmap[idx] |= 1 << (block & 7);
+	if (pwrite_full(di->fd, &di->bitmap[idx], 1, OVL_HDRSIZE + idx) != 1) {
+		return -1;
+	}
+	return 0;
+}
+
+static int
+ovl_read(DiskImage * di, uint64_t ofs, uint8_t * buf, int count)
+{
+	int cnt = 0;
+	if (ofs >= di->size) {
+		return 0;
+	}
+	if (ofs + count > di->size) {
+		count = di->size - ofs;
+	}
+	while (cnt < count) {
+		uint64_t block = ofs / di->block_size;
+		uint32_t blkofs = ofs % di->block_size;
+		uint32_t len = di->block_size - blkofs;
+		if (len > (uint32_t) (count - cnt)) {
+			len = count - cnt;
+		}
+		if (ovl_block_present(di, block)) {
+			if (pread_full(di->fd, buf + cnt, len, di->data_ofs + ofs) != (int)len) {
+				return cnt ? cnt : -EIO;
+			}
+		} else if (ovl_read_base(di, ofs, buf + cnt, len) < 0) {
+			return cnt ? cnt : -EIO;
+		}
+		cnt += len;
+		ofs += len;
+	}
+	return cnt;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Write to the delta. A partially written block is copied up from
+ * the base image first.
+ * ------------------------------------------------------------------------
+ */
+static int
+ovl_write(DiskImage * di, uint64_t ofs, const uint8_t * buf, int count)
+{
+	uint8_t *blkbuf = NULL;
+	int cnt = 0;
+	if (ofs >= di->size) {
+		return 0;
+	}
+	if (ofs + count > di->size) {
+		count = di->size - ofs;
+	}
+	while (cnt < count) {
+		uint64_t block = ofs / di->block_size;
+		uint32_t blkofs = ofs % di->block_size;
+		uint32_t len = di->block_size - blkofs;
+		if (len > (uint32_t) (count - cnt)) {
+			len = count - cnt;
+		}
+		if (!ovl_block_present(di, block) && (len != di->block_size)) {
+			if (!blkbuf) {
+				blkbuf = alloca(di->block_size);
+			}
+			if (ovl_read_base(di, block * di->block_size, blkbuf, di->block_size) < 0) {
+				break;
+			}
+			memcpy(blkbuf + blkofs, buf + cnt, len);
+			if (pwrite_full(di->fd, blkbuf, di->block_size,
+					di->data_ofs + block * di->block_size) < 0) {
+				break;
+			}
+		} else if (pwrite_full(di->fd, buf + cnt, len, di->data_ofs + ofs) < 0) {
+			break;
+		}
+		if (!ovl_block_present(di, block) && (ovl_set_present(di, block) < 0)) {
+			break;
+		}
+		cnt += len;
+		ofs += len;
+	}
+	if (cnt == 0) {
+		return -EIO;
+	}
+	return cnt;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * A mapped overlay is a private anonymous mapping filled with the
+ * contents of the base and the delta. Writes to the mapping do not
+ * reach any file. ovl_sync_map compares the mapping with the blocks
+ * it was filled from and writes only the changed blocks to the delta,
+ * so unchanged blocks of the base image stay holes.
+ * ------------------------------------------------------------------------
+ */
+static void *
+ovl_map(DiskImage * di)
+{
+	uint8_t *map;
+	uint64_t ofs;
+	int count;
+	map = mmap(0, di->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == (void *)-1) {
+		return map;
+	}
+	for (ofs = 0; ofs < di->size; ofs += count) {
+		count = 1024 * 1024;
+		if (ofs + count > di->size) {
+			count = di->size - ofs;
+		}
+		if (ovl_read(di, ofs, map + ofs, count) != count) {
+			munmap(map, di->size);
+			return (void *)-1;
+		}
+	}
+	return map;
+}
+
+static int
+ovl_sync_map(DiskImage * di)
+{
+	uint8_t *blkbuf = alloca(di->block_size);
+	uint8_t *map = di->map;
+	uint64_t ofs;
+	int count;
+	for (ofs = 0; ofs < di->size; ofs += count) {
+		count = di->block_size;
+		if (ofs + count > di->size) {
+			count = di->size - ofs;
+		}
+		if (ovl_read(di, ofs, blkbuf, count) != count) {
+			return -1;
+		}
+		if (memcmp(blkbuf, map + ofs, count) == 0) {
+			continue;
+		}
+		if (ovl_write(di, ofs, map + ofs, count) != count) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Uncached positional access to the image or the overlay
+ * ------------------------------------------------------------------------
+ */
+static int
+backend_read(DiskImage * di, uint64_t ofs, uint8_t * buf, int count)
+{
+	if (di->overlay) {
+		return ovl_read(di, ofs, buf, count);
+	}
+	return pread_full(di->fd, buf, count, ofs);
+}
+
+static int
+backend_write(DiskImage * di, uint64_t ofs, const uint8_t * buf, int count)
+{
+	if (di->overlay) {
+		return ovl_write(di, ofs, buf, count);
+	}
+	return pwrite_full(di->fd, buf, count, ofs);
+}
+
+static inline uint32_t
+cache_hash(BlockCache * bc, uint64_t block)
+{
+	return (uint32_t) (block ^ (block >> 17)) & bc->hash_mask;
+}
+
+static CacheBlock *
+cache_lookup(BlockCache * bc, uint64_t block)
+{
+	CacheBlock *cb;
+	for (cb = bc->hash[cache_hash(bc, block)]; cb; cb = cb->hnext) {
+		if (cb->block == block) {
+			return cb;
+		}
+	}
+	return NULL;
+}
+
+static void
+lru_unlink(BlockCache * bc, CacheBlock * cb)
+{
+	if (cb->lru_prev) {
+		cb->lru_prev->lru_next = cb->lru_next;
+	} else {
+		bc->mru = cb->lru_next;
+	}
+	if (cb->lru_next) {
+		cb->lru_next->lru_prev = cb->lru_prev;
+	} else {
+		bc->lru = cb->lru_prev;
+	}
+}
+
+static void
+lru_touch(BlockCache * bc, CacheBlock * cb)
+{
+	if (bc->mru == cb) {
+		return;
+	}
+	lru_unlink(bc, cb);
+	cb->lru_prev = NULL;
+	cb->lru_next = bc->mru;
+	bc->mru->lru_prev = cb;
+	bc->mru = cb;
+}
+
+static void
+hash_remove(BlockCache * bc, CacheBlock * cb)
+{
+	CacheBlock **pp = &bc->hash[cache_hash(bc, cb->block)];
+	while (*pp) {
+		if (*pp == cb) {
+			*pp = cb->hnext;
+			break;
+		}
+		pp = &(*pp)->hnext;
+	}
+	cb->block = DC_NO_BLOCK;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Write back the run of dirty blocks around cb with one pwrite
+ * ------------------------------------------------------------------------
+ */
+static int
+cache_writeback(DiskImage * di, CacheBlock * cb)
+{
+	BlockCache *bc = di->cache;
+	CacheBlock *run[DC_MAX_RUN];
+	CacheBlock *other;
+	uint64_t first = cb->block;
+	uint64_t ofs;
+	uint32_t n, i;
+	int len;
+	while ((first > 0) && (cb->block - first < DC_MAX_RUN / 2)) {
+		other = cache_lookup(bc, first - 1);
+		if (!other || !other->dirty) {
+			break;
+		}
+		first--;
+	}
+	for (n = 0; n < DC_MAX_RUN; n++) {
+		other = cache_lookup(bc, first + n);
+		if (!other || !other->dirty) {
+			break;
+		}
+		run[n] = other;
+		memcpy(bc->wbbuf + n * DC_BLOCKSIZE, other->data, DC_BLOCKSIZE);
+	}
+	ofs = first * DC_BLOCKSIZE;
+	len = n * DC_BLOCKSIZE;
+	if (ofs + len > di->size) {
+		len = di->size - ofs;
+	}
+	if (backend_write(di, ofs, bc->wbbuf, len) != len) {
+		fprintf(stderr, "Diskimage: write back failed\n");
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		run[i]->dirty = 0;
+	}
+	return 0;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Take the least recently used block for a new block number. Returns
+ * NULL if the old contents of a dirty block can not be written back.
+ * ------------------------------------------------------------------------
+ */
+static CacheBlock *
+cache_alloc(DiskImage * di, uint64_t block)
+{
+	BlockCache *bc = di->cache;
+	CacheBlock *cb = bc->lru;
+	uint32_t h;
+	if (cb->dirty && (cache_writeback(di, cb) < 0)) {
+		return NULL;
+	}
+	if (cb->block != DC_NO_BLOCK) {
+		hash_remove(bc, cb);
+	}
+	cb->block = block;
+	h = cache_hash(bc, block);
+	cb->hnext = bc->hash[h];
+	bc->hash[h] = cb;
+	lru_touch(bc, cb);
+	return cb;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Fetch a missing block. Sequential misses double the read-ahead
+ * window up to DC_MAX_RUN blocks, a random miss resets it. Returns
+ * NULL if the block can not be read, nothing is inserted then.
+ * ------------------------------------------------------------------------
+ */
+static CacheBlock *
+cache_fill(DiskImage * di, uint64_t block, int sequential)
+{
+	BlockCache *bc = di->cache;
+	uint64_t last_block = (di->size - 1) / DC_BLOCKSIZE;
+	CacheBlock *cb = NULL;
+	uint32_t n, i;
+	int result;
+	if (sequential) {
+		if (bc->ra_blocks < DC_MAX_RUN) {
+			bc->ra_blocks = bc->ra_blocks ? bc->ra_blocks * 2 : 2;
+		}
+	} else {
+		bc->ra_blocks = 1;
+	}
+	for (n = 1; n < bc->ra_blocks; n++) {
+		if ((block + n > last_block) || cache_lookup(bc, block + n)) {
+			break;
+		}
+	}
+	if (n > bc->nr_blocks / 2) {
+		n = 1;
+	}
+	result = backend_read(di, block * DC_BLOCKSIZE, bc->runbuf, n * DC_BLOCKSIZE);
+	if (result < 0) {
+		bc->ra_blocks = 0;
+		return NULL;
+	}
+	/* The part beyond the end of a short file reads as zero */
+	if (result < (int)(n * DC_BLOCKSIZE)) {
+		memset(bc->runbuf + result, 0, n * DC_BLOCKSIZE - result);
+	}
+	/* The read-ahead blocks are older than the requested one */
+	for (i = n; i > 0; i--) {
+		cb = cache_alloc(di, block + i - 1);
+		if (!cb) {
+			return NULL;
+		}
+		memcpy(cb->data, bc->runbuf + (i - 1) * DC_BLOCKSIZE, DC_BLOCKSIZE);
+	}
+	return cb;
+}
+
+static int
+cache_read(DiskImage * di, uint64_t ofs, uint8_t * buf, int count)
+{
+	BlockCache *bc = di->cache;
+	CacheBlock *cb;
+	int sequential = (ofs == bc->next_ofs);
+	int cnt = 0;
+	if (ofs >= di->size) {
+		return 0;
+	}
+	if (ofs + count > di->size) {
+		count = di->size - ofs;
+	}
+	while (cnt < count) {
+		uint64_t block = ofs / DC_BLOCKSIZE;
+		uint32_t blkofs = ofs % DC_BLOCKSIZE;
+		uint32_t len = DC_BLOCKSIZE - blkofs;
+		if (len > (uint32_t) (count - cnt)) {
+			len = count - cnt;
+		}
+		cb = cache_lookup(bc, block);
+		if (cb) {
+			lru_touch(bc, cb);
+		} else {
+			cb = cache_fill(di, block, sequential);
+			sequential = 1;
+		}
+		if (!cb) {
+			bc->next_ofs = DC_NO_BLOCK;
+			return cnt ? cnt : -EIO;
+		}
+		memcpy(buf + cnt, cb->data + blkofs, len);
+		cnt += len;
+		ofs += len;
+	}
+	bc->next_ofs = ofs;
+	return cnt;
+}
+
+static int
+cache_write(DiskImage * di, uint64_t ofs, const uint8_t * buf, int count)
+{
+	BlockCache *bc = di->cache;
+	CacheBlock *cb;
+	int cnt = 0;
+	if (ofs >= di->size) {
+		return 0;
+	}
+	if (ofs + count > di->size) {
+		count = di->size - ofs;
+	}
+	while (cnt < count) {
+		uint64_t block = ofs / DC_BLOCKSIZE;
+		uint32_t blkofs = ofs % DC_BLOCKSIZE;
+		uint32_t len = DC_BLOCKSIZE - blkofs;
+		if (len > (uint32_t) (count - cnt)) {
+			len = count - cnt;
+		}
+		cb = cache_lookup(bc, block);
+		if (cb) {
+			lru_touch(bc, cb);
+		} else if (len == DC_BLOCKSIZE) {
+			cb = cache_alloc(di, block);
+		} else {
+			cb = cache_fill(di, block, 0);
+		}
+		if (!cb) {
+			return cnt ? cnt : -EIO;
+		}
+		memcpy(cb->data + blkofs, buf + cnt, len);
+		cb->dirty = 1;
+		cnt += len;
+		ofs += len;
+	}
+	return cnt;
+}
+
+static int
+cache_flush(DiskImage * di)
+{
+	BlockCache *bc = di->cache;
+	uint32_t i;
+	int result = 0;
+	for (i = 0; i < bc->nr_blocks; i++) {
+		if (bc->blocks[i].dirty && (cache_writeback(di, &bc->blocks[i]) < 0)) {
+			result = -1;
+		}
+	}
+	return result;
+}
+
+static void io_drain(DiskImage * di);
+
+static void
+cache_exit(void *data)
+{
+	io_drain(data);
+	cache_flush(data);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Create the block cache. The size is "diskimage_cache_kb" from the
+ * global section. Dirty blocks are written back on exit.
+ * ------------------------------------------------------------------------
+ */
+static void
+cache_init(DiskImage * di)
+{
+	BlockCache *bc;
+	uint32_t cache_kb = DC_DEFAULT_KB;
+	uint32_t i;
+	Config_ReadUInt32(&cache_kb, "global", "diskimage_cache_kb");
+	if (cache_kb * 1024 < 2 * DC_MAX_RUN * DC_BLOCKSIZE) {
+		cache_kb = 2 * DC_MAX_RUN * DC_BLOCKSIZE / 1024;
+	}
+	bc = sg_new(BlockCache);
+	bc->nr_blocks = cache_kb * 1024 / DC_BLOCKSIZE;
+	for (i = 1; i < bc->nr_blocks; i <<= 1) ;
+	bc->hash_mask = i - 1;
+	bc->hash = sg_calloc(sizeof(CacheBlock *) * i);
+	bc->blocks = sg_calloc(sizeof(CacheBlock) * bc->nr_blocks);
+	bc->mem = sg_calloc((size_t) bc->nr_blocks * DC_BLOCKSIZE);
+	bc->runbuf = sg_calloc(DC_MAX_RUN * DC_BLOCKSIZE);
+	bc->wbbuf = sg_calloc(DC_MAX_RUN * DC_BLOCKSIZE);
+	bc->next_ofs = DC_NO_BLOCK;
+	for (i = 0; i < bc->nr_blocks; i++) {
+		CacheBlock *cb = &bc->blocks[i];
+		cb->block = DC_NO_BLOCK;
+		cb->data = bc->mem + (size_t) i *DC_BLOCKSIZE;
+		cb->lru_prev = i ? &bc->blocks[i - 1] : NULL;
+		cb->lru_next = (i + 1 < bc->nr_blocks) ? &bc->blocks[i + 1] : NULL;
+	}
+	bc->mru = &bc->blocks[0];
+	bc->lru = &bc->blocks[bc->nr_blocks - 1];
+	di->cache = bc;
+	ExitHandler_Register(cache_exit, di);
+}
+
+static void
+cache_free(DiskImage * di)
+{
+	BlockCache *bc = di->cache;
+	if (!bc) {
+		return;
+	}
+	cache_flush(di);
+	ExitHandler_Unregister(cache_exit, di);
+	sg_free(bc->runbuf);
+	sg_free(bc->wbbuf);
+	sg_free(bc->mem);
+	sg_free(bc->blocks);
+	sg_free(bc->hash);
+	sg_free(bc);
+	di->cache = NULL;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Asynchronous I/O:
+ * DiskImage_ReadAsync/WriteAsync/FillAsync queue a request for a pool
+ * of worker threads. The requests of one image are executed in order
+ * by one worker at a time, different images run in parallel. The
+ * completion proc is called from a CycleTimer "cycles" after the
+ * submission, so the device busy time does not depend on the host.
+ * If the host is slower the CPU thread waits for the request in the
+ * timer proc. The synchronous calls first wait until the queue of the
+ * image is empty.
+ * The number of workers is "diskimage_io_threads" from the global
+ * section, 0 executes the requests immediately in the CPU thread.
+ * ------------------------------------------------------------------------
+ */
+#define IO_DEFAULT_THREADS	(2)
+#define IO_FILL_CHUNK		(65536)
+
+enum io_op {
+	IO_READ,
+	IO_WRITE,
+	IO_FILL,
+};
+
+typedef struct IORequest {
+	struct IORequest *next;
+	DiskImage *di;
+	enum io_op op;
+	uint64_t ofs;
+	uint64_t count;
+	uint8_t *buf;
+	uint8_t fillval;
+	int result;
+	int done;
+	DiskImage_DoneProc *proc;
+	void *clientData;
+	CycleTimer completionTimer;
+} IORequest;
+
+static struct {
+	int initialized;
+	int nr_threads;
+#ifdef __unix__
+	pthread_mutex_t lock;
+	pthread_cond_t workCond;
+	pthread_cond_t doneCond;
+#endif
+	DiskImage *runq_head;
+	DiskImage *runq_tail;
+	uint32_t pending;
+} ioPool;
+
+static int
+di_read(DiskImage * di, uint64_t ofs, uint8_t * buf, int count)
+{
+	if (di->cache) {
+		return cache_read(di, ofs, buf, count);
+	}
+	return backend_read(di, ofs, buf, count);
+}
+
+static int
+di_write(DiskImage * di, uint64_t ofs, const uint8_t * buf, int count)
+{
+	if (di->cache) {
+		return cache_write(di, ofs, buf, count);
+	}
+	return backend_write(di, ofs, buf, count);
+}
+
+static void
+io_execute(IORequest * req)
+{
+	DiskImage *di = req->di;
+	uint8_t fillbuf[IO_FILL_CHUNK];
+	uint64_t done = 0;
+	int len, result;
+	switch (req->op) {
+	    case IO_READ:
+		    req->result = di_read(di, req->ofs, req->buf, req->count);
+		    break;
+	    case IO_WRITE:
+		    req->result = di_write(di, req->ofs, req->buf, req->count);
+		    break;
+	    case IO_FILL:
+		    memset(fillbuf, req->fillval, sizeof(fillbuf));
+		    while (done < req->count) {
+			    len = (req->count - done > IO_FILL_CHUNK) ?
+				IO_FILL_CHUNK : req->count - done;
+			    result = di_write(di, req->ofs + done, fillbuf, len);
+			    if (result <= 0) {
+				    break;
+			    }
+			    done += result;
+		    }
+		    req->result = (done == req->count) ? 0 : -1;
+		    break;
+	    default:
+		    fprintf(stderr, "Diskimage: Unknown I/O request type %d\n", req->op);
+		    req->result = -EINVAL;
+		    break;
+	}
+	if (!req->proc && ((req->op == IO_FILL) ? (req->result < 0) :
+			   (req->result < (int)req->count))) {
+		fprintf(stderr, "Diskimage: Background I/O at %" PRIu64 " failed\n", req->ofs);
+	}
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Called from the CycleTimer when the busy time of the device is over
+ * ------------------------------------------------------------------------
+ */
+static void
+io_complete(void *eventData)
+{
+	IORequest *req = eventData;
+#ifdef __unix__
+	if (ioPool.nr_threads) {
+		pthread_mutex_lock(&ioPool.lock);
+		while (!req->done) {
+			pthread_cond_wait(&ioPool.doneCond, &ioPool.lock);
+		}
+		pthread_mutex_unlock(&ioPool.lock);
+	}
+#endif
+	req->proc(req->clientData, req->result);
+	sg_free(req);
+}
+
+#ifdef __unix__
+static void *
+io_worker(void *arg)
+{
+	DiskImage *di;
+	IORequest *req;
+	pthread_mutex_lock(&ioPool.lock);
+	while (1) {
+		while (!ioPool.runq_head) {
+			pthread_cond_wait(&ioPool.workCond, &ioPool.lock);
+		}
+		di = ioPool.runq_head;
+		ioPool.runq_head = di->io_runq_next;
+		if (!ioPool.runq_head) {
+			ioPool.runq_tail = NULL;
+		}
+		/* The request stays in the queue until it is done */
+		while ((req = di->io_head)) {
+			pthread_mutex_unlock(&ioPool.lock);
+			io_execute(req);
+			pthread_mutex_lock(&ioPool.lock);
+			di->io_head = req->next;
+			if (!di->io_head) {
+				di->io_tail = NULL;
+			}
+			di->io_pending--;
+			ioPool.pending--;
+			req->done = 1;
+			if (!req->proc) {
+				sg_free(req);
+			}
+			pthread_cond_broadcast(&ioPool.doneCond);
+		}
+		di->io_queued = 0;
+	}
+	return NULL;
+}
+#endif
+
+/*
+ * ------------------------------------------------------------------------
+ * Wait until all requests of an image, or of all images if di is NULL,
+ * are executed.
+ * ------------------------------------------------------------------------
+ */
+static void
+io_drain(DiskImage * di)
+{
+#ifdef __unix__
+	if (!ioPool.nr_threads) {
+		return;
+	}
+	pthread_mutex_lock(&ioPool.lock);
+	while (di ? di->io_pending : ioPool.pending) {
+		pthread_cond_wait(&ioPool.doneCond, &ioPool.lock);
+	}
+	pthread_mutex_unlock(&ioPool.lock);
+#endif
+}
+
+static void
+io_exit(void *data)
+{
+	io_drain(NULL);
+}
+
+static void
+io_init(void)
+{
+#ifdef __unix__
+	uint32_t nr_threads = IO_DEFAULT_THREADS;
+	pthread_t thread;
+	uint32_t i;
+	Config_ReadUInt32(&nr_threads, "global", "diskimage_io_threads");
+	pthread_mutex_init(&ioPool.lock, NULL);
+	pthread_cond_init(&ioPool.workCond, NULL);
+	pthread_cond_init(&ioPool.doneCond, NULL);
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&thread, NULL, io_worker, NULL) != 0) {
+			fprintf(stderr, "Diskimage: Can not create I/O thread\n");
+			break;
+		}
+		pthread_detach(thread);
+	}
+	ioPool.nr_threads = i;
+	ExitHandler_Register(io_exit, NULL);
+#endif
+	ioPool.initialized = 1;
+}
+
+static int
+io_submit(IORequest * req, CycleCounter_t cycles)
+{
+	DiskImage *di = req->di;
+	if (!ioPool.initialized) {
+		io_init();
+	}
+	if (req->proc) {
+		CycleTimer_Init(&req->completionTimer, io_complete, req);
+		CycleTimer_Add(&req->completionTimer, cycles, io_complete, req);
+	}
+	if (!ioPool.nr_threads) {
+		io_execute(req);
+		req->done = 1;
+		if (!req->proc) {
+			sg_free(req);
+		}
+		return 0;
+	}
+#ifdef __unix__
+	pthread_mutex_lock(&ioPool.lock);
+	if (di->io_tail) {
+		di->io_tail->next = req;
+	} else {
+		di->io_head = req;
+	}
+	di->io_tail = req;
+	di->io_pending++;
+	ioPool.pending++;
+	if (!di->io_queued) {
+		di->io_queued = 1;
+		di->io_runq_next = NULL;
+		if (ioPool.runq_tail) {
+			ioPool.runq_tail->io_runq_next = di;
+		} else {
+			ioPool.runq_head = di;
+		}
+		ioPool.runq_tail = di;
+		pthread_cond_signal(&ioPool.workCond);
+	}
+	pthread_mutex_unlock(&ioPool.lock);
+#endif
+	return 0;
+}
+
+static IORequest *
+io_new_request(DiskImage * di, enum io_op op, uint64_t ofs, uint64_t count, size_t bufsize,
+	       DiskImage_DoneProc * proc, void *clientData)
+{
+	IORequest *req = sg_calloc(sizeof(IORequest) + bufsize);
+	req->di = di;
+	req->op = op;
+	req->ofs = ofs;
+	req->count = count;
+	req->proc = proc;
+	req->clientData = clientData;
+	if (bufsize) {
+		req->buf = (uint8_t *) (req + 1);
+	}
+	return req;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Open a base image read only and a private delta file for the
+ * writes. The delta is created if it does not exist. A missing base
+ * image reads as empty.
+ * ------------------------------------------------------------------------
+ */
+DiskImage *
+DiskImage_OpenOverlay(const char *basename, const char *deltaname, uint64_t size, int flags)
+{
+	DiskImage *di;
+	OverlayHeader hdr;
+	struct stat stat;
+	uint64_t nr_blocks;
+	uint32_t bitmap_size;
+	di = sg_new(DiskImage);
+	di->size = size;
+	di->flags = flags;
+	di->overlay = 1;
+	di->block_size = OVL_BLOCKSIZE;
+	if ((flags & DI_CREAT_FF) && !(flags & DI_SPARSE)) {
+		di->emptyval = 0xff;
+	} else {
+		di->emptyval = 0;
+	}
+	di->base_fd = open(basename, O_RDONLY | O_LARGEFILE);
+	if (di->base_fd >= 0) {
+#ifdef __unix__
+		if (flock(di->base_fd, LOCK_SH | LOCK_NB) < 0) {
+			fprintf(stderr, "Base image \"%s\" is opened for writing\n", basename);
+			goto err_base;
+		}
+#endif
+		if (fstat(di->base_fd, &stat) < 0) {
+			goto err_base;
+		}
+		di->base_size = stat.st_size;
+	} else if (!(flags & (DI_CREAT_FF | DI_CREAT_00))) {
+		fprintf(stderr, "Can't open base image \"%s\" ", basename);
+		perror("");
+		free(di);
+		return NULL;
+	}
+	nr_blocks = (size + di->block_size - 1) / di->block_size;
+	bitmap_size = (nr_blocks + 7) / 8;
+	di->data_ofs = (OVL_HDRSIZE + bitmap_size + di->block_size - 1) & ~(di->block_size - 1);
+	di->bitmap = sg_calloc(bitmap_size + 1);
+	di->fd = open(deltaname, O_RDWR | O_CREAT | O_LARGEFILE, 0644);
+	if (di->fd < 0) {
+		fprintf(stderr, "Can't open delta image \"%s\" ", deltaname);
+		perror("");
+		goto err_base;
+	}
+#ifdef __unix__
+	if (flock(di->fd, LOCK_EX | LOCK_NB) < 0) {
+		fprintf(stderr, "Can't get lock for delta image \"%s\"\n", deltaname);
+		goto err_delta;
+	}
+#endif
+	if (fstat(di->fd, &stat) < 0) {
+		goto err_delta;
+	}
+	if (stat.st_size == 0) {
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, OVL_MAGIC, sizeof(hdr.magic));
+		hdr.block_size = di->block_size;
+		hdr.size = size;
+		hdr.base_size = di->base_size;
+		hdr.data_ofs = di->data_ofs;
+		if ((pwrite_full(di->fd, (uint8_t *) & hdr, sizeof(hdr), 0) < 0)
+		    || (ftruncate(di->fd, di->data_ofs + size) < 0)) {
+			perror("Creating the delta image failed");
+			goto err_delta;
+		}
+	} else {
+		if ((pread_full(di->fd, (uint8_t *) & hdr, sizeof(hdr), 0) != sizeof(hdr))
+		    || memcmp(hdr.magic, OVL_MAGIC, sizeof(hdr.magic))
+		    || (hdr.block_size != di->block_size) || (hdr.size != size)
+		    || (hdr.data_ofs != di->data_ofs)) {
+			fprintf(stderr, "\"%s\" is not a delta image of size %" PRIu64 "\n",
+				deltaname, size);
+			goto err_delta;
+		}
+		if (hdr.base_size != di->base_size) {
+			fprintf(stderr, "Base image \"%s\" was changed after creating \"%s\"\n",
+				basename, deltaname);
+			goto err_delta;
+		}
+		if (pread_full(di->fd, di->bitmap, bitmap_size, OVL_HDRSIZE) < 0) {
+			goto err_delta;
+		}
+	}
+	fprintf(stderr, "Diskimage \"%s\" with overlay \"%s\"\n", basename, deltaname);
+	if ((flags & DI_CACHE) && size) {
+		cache_init(di);
+	}
+	return di;
+
+ err_delta:
+	close(di->fd);
+ err_base:
+	if (di->base_fd >= 0) {
+		close(di->base_fd);
+	}
+	sg_free(di->bitmap);
+	free(di);
+	return NULL;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * With "diskimage_overlay_dir" in the global section all writable
+ * images are opened as base of an overlay. The delta files are
+ * created in the overlay directory with the suffix ".delta".
+ * ------------------------------------------------------------------------
+ */
 DiskImage *
 DiskImage_Open(const char *name, uint64_t size, int flags)
 {
 	DiskImage *di;
 	struct stat stat;
+	const char *overlay_dir;
+	overlay_dir = Config_ReadVar("global", "diskimage_overlay_dir");
+	if (overlay_dir && (flags & DI_RDWR) && size) {
+		const char *filename = strrchr(name, '/');
+		char *deltaname;
+		filename = filename ? filename + 1 : name;
+		deltaname = alloca(strlen(overlay_dir) + strlen(filename) + 10);
+		sprintf(deltaname, "%s/%s.delta", overlay_dir, filename);
+		return DiskImage_OpenOverlay(name, deltaname, size, flags);
+	}
 	di = sg_new(DiskImage);
+	di->base_fd = -1;
 	di->size = size;
 	di->flags = flags;
 	if (flags & DI_RDWR) {
@@ -242,59 +1320,104 @@ DiskImage_Open(const char *name, uint64_t size, int flags)
 	} else {
 		fprintf(stderr, "Diskimage \"%s\" is of unknown type\n", name);
 	}
+	if ((flags & DI_CACHE) && size) {
+		cache_init(di);
+	}
 	return di;
 }
 
 int
 DiskImage_Read(DiskImage * di, off_t ofs, uint8_t * buf, int count)
 {
-	int result;
-	int cnt;
-	if (lseek(di->fd, ofs, SEEK_SET) != ofs) {
-		return -EINVAL;
-	}
-	for (cnt = 0; cnt < count;) {
-		result = read(di->fd, buf + cnt, count);
-		if (result <= 0) {
-			if (cnt) {
-				return cnt;
-			} else {
-				return result;
-			}
-		}
-		cnt += result;
-	}
-	return cnt;
-
+	io_drain(di);
+	return di_read(di, ofs, buf, count);
 }
 
 int
 DiskImage_Write(DiskImage * di, off_t ofs, const uint8_t * buf, int count)
 {
-	int result;
-	int cnt;
-	if (lseek(di->fd, ofs, SEEK_SET) != ofs) {
-		return -EINVAL;
+	io_drain(di);
+	return di_write(di, ofs, buf, count);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Read into buf in the background. buf must stay valid until proc
+ * is called "cycles" after the submission with the number of bytes read.
+ * ------------------------------------------------------------------------
+ */
+int
+DiskImage_ReadAsync(DiskImage * di, off_t ofs, uint8_t * buf, int count,
+		    CycleCounter_t cycles, DiskImage_DoneProc * proc, void *clientData)
+{
+	IORequest *req = io_new_request(di, IO_READ, ofs, count, 0, proc, clientData);
+	req->buf = buf;
+	return io_submit(req, cycles);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Write in the background. The data is copied, proc may be NULL.
+ * ------------------------------------------------------------------------
+ */
+int
+DiskImage_WriteAsync(DiskImage * di, off_t ofs, const uint8_t * buf, int count,
+		     CycleCounter_t cycles, DiskImage_DoneProc * proc, void *clientData)
+{
+	IORequest *req = io_new_request(di, IO_WRITE, ofs, count, count, proc, clientData);
+	memcpy(req->buf, buf, count);
+	return io_submit(req, cycles);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Fill a range with a value in the background, for example for an erase.
+ * The result is 0 on success and -1 on error.
+ * ------------------------------------------------------------------------
+ */
+int
+DiskImage_FillAsync(DiskImage * di, off_t ofs, uint8_t value, uint64_t count,
+		    CycleCounter_t cycles, DiskImage_DoneProc * proc, void *clientData)
+{
+	IORequest *req = io_new_request(di, IO_FILL, ofs, count, 0, proc, clientData);
+	req->fillval = value;
+	return io_submit(req, cycles);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Write back the dirty blocks of the cache and sync the file
+ * ------------------------------------------------------------------------
+ */
+int
+DiskImage_Sync(DiskImage * di)
+{
+	int result = 0;
+	io_drain(di);
+	if (di->cache && (cache_flush(di) < 0)) {
+		result = -1;
 	}
-	for (cnt = 0; cnt < count;) {
-		result = write(di->fd, buf + cnt, count);
-		if (result <= 0) {
-			if (cnt) {
-				return cnt;
-			} else {
-				return result;
-			}
-		}
-		cnt += result;
+#ifdef __unix__
+	if (di->map && di->overlay && (ovl_sync_map(di) < 0)) {
+		result = -1;
 	}
-	return cnt;
+	if (fdatasync(di->fd) < 0) {
+		result = -1;
+	}
+#endif
+	return result;
 }
 
 void *
 DiskImage_Mmap(DiskImage * di)
 {
+	/* The mapping bypasses the cache */
+	io_drain(di);
+	cache_free(di);
 #ifdef __unix__
-	if (di->flags & DI_RDWR) {
+	if (di->overlay) {
+		di->map = ovl_map(di);
+	} else if (di->flags & DI_RDWR) {
 		di->map = mmap(0, di->size, PROT_READ | PROT_WRITE, MAP_SHARED, di->fd, 0);
 	} else {
 		di->map = mmap(0, di->size, PROT_READ, MAP_SHARED, di->fd, 0);
@@ -322,17 +1445,29 @@ DiskImage_Mmap(DiskImage * di)
 void
 DiskImage_Close(DiskImage * di)
 {
+	io_drain(di);
+	cache_free(di);
 #ifdef __unix__
 	if (di->map) {
+		if (di->overlay && (ovl_sync_map(di) < 0)) {
+			perror("Writing the mapped overlay to the delta failed");
+		}
 		munmap(di->map, di->size);
 		di->map = NULL;
 	}
 	flock(di->fd, LOCK_UN);
+	if (di->base_fd >= 0) {
+		flock(di->base_fd, LOCK_UN);
+	}
 #else
 	if (di->map) {
 
 	}
 #endif
+	if (di->base_fd >= 0) {
+		close(di->base_fd);
+	}
 	close(di->fd);
+	sg_free(di->bitmap);
 	free(di);
 }
@@ -13,6 +13,7 @@
 #ifndef DISKIMAGE_H
 #define DISKIMAGE_H
 #include "compiler_extensions.h"
+#include "cycletimer.h"
 #include <stdint.h>
 
 #define DI_RDONLY	(0)
@@ -20,13 +21,25 @@
 #define DI_CREAT_FF	(1)
 #define	DI_CREAT_00	(2)
 #define DI_SPARSE	(4)
+#define DI_CACHE	(32)	/* Block cache with read-ahead and write-back */
 typedef struct DiskImage DiskImage;
+typedef void DiskImage_DoneProc(void *clientData, int result);
 
 void DiskImage_Close(DiskImage * di);
 DiskImage *DiskImage_Open(const char *name, uint64_t size, int flags);
+DiskImage *DiskImage_OpenOverlay(const char *basename, const char *deltaname, uint64_t size,
+				 int flags);
 void *DiskImage_Mmap(DiskImage * di);
 
 int DiskImage_Read(DiskImage * di, off_t ofs, uint8_t * buf, int count);
 int DiskImage_Write(DiskImage * di, off_t ofs, const uint8_t * buf, int count);
+int DiskImage_Sync(DiskImage * di);
+
+int DiskImage_ReadAsync(DiskImage * di, off_t ofs, uint8_t * buf, int count,
+			CycleCounter_t cycles, DiskImage_DoneProc * proc, void *clientData);
+int DiskImage_WriteAsync(DiskImage * di, off_t ofs, const uint8_t * buf, int count,
+			 CycleCounter_t cycles, DiskImage_DoneProc * proc, void *clientData);
+int DiskImage_FillAsync(DiskImage * di, off_t ofs, uint8_t value, uint64_t count,
+			CycleCounter_t cycles, DiskImage_DoneProc * proc, void *clientData);
 
 #endif
@@ -50,6 +50,7 @@
 #include "configfile.h"
 #include "dram.h"
 #include "sgstring.h"
+#include "snapshot.h"
 
 /* all times in nanoseconds, all clocks in cycles */
 typedef struct DRamTiming {
@@ -452,8 +453,9 @@ DRam_New(char *dram_name)
 		/* Skip DRAM initialisation */
 		dram->cycletype = SDRCYC_NORMAL;
 	}
-	dram->host_mem = sg_calloc(size);
+	dram->host_mem = Snapshot_AllocMemory(size);
 	memset(dram->host_mem, 0xff, size);
+	Snapshot_RegisterMemory(dram_name, dram, dram->host_mem, size);
 	dram->size = size;
 	dram->bdev.first_mapping = NULL;
 	dram->bdev.Map = DRam_Map;
@@ -0,0 +1,104 @@
+//===-- softgun/hosttime.c ----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Time of day for the simulated devices and the deterministic run mode
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Main Module Header
+#include "hosttime.h"
+
+// Leigun Core Headers
+#include "configfile.h"
+#include "cycletimer.h"
+#include "logging.h"
+
+// System headers
+#include <inttypes.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define MOD_NAME "HostTime"
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+static bool deterministic = false;
+static uint64_t startTime = HOSTTIME_DEFAULT_START;
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+
+/*
+ * ----------------------------------------------------------------------
+ * Read the run mode from the global section of the configuration file.
+ * Has to be called before the devices are created.
+ * ----------------------------------------------------------------------
+ */
+void
+HostTime_Init(void)
+{
+	uint32_t value = 0;
+	Config_ReadUInt32(&value, "global", "deterministic");
+	deterministic = (value != 0);
+	if (!deterministic) {
+		return;
+	}
+	Config_ReadUInt64(&startTime, "global", "start_time");
+	LOG_Info(MOD_NAME, "Deterministic run mode, virtual start time %" PRIu64, startTime);
+}
+
+bool
+HostTime_Deterministic(void)
+{
+	return deterministic;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Time of day as seen by the simulated devices. In the deterministic
+ * mode it is derived from the CycleCounter.
+ * ----------------------------------------------------------------------
+ */
+void
+HostTime_Get(struct timeval *tv)
+{
+	uint64_t usecs;
+	if (!deterministic) {
+		gettimeofday(tv, NULL);
+		return;
+	}
+	if (CycleTimerRate_Get() >= 1000) {
+		usecs = CyclesToMicroseconds(CycleCounter_Get());
+	} else {
+		usecs = 0;
+	}
+	tv->tv_sec = startTime + usecs / 1000000;
+	tv->tv_usec = usecs % 1000000;
+}
@@ -0,0 +1,56 @@
+//===-- softgun/hosttime.h ----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Time of day for the simulated devices and the deterministic run mode
+///
+/// Devices which need the time of day (RTCs, noise for ADCs) read it with
+/// HostTime_Get instead of gettimeofday. In the deterministic run mode
+/// ("deterministic: 1" in the global section) this is a virtual time of day
+/// which starts at "start_time" (seconds since the epoch) and advances with
+/// the CycleCounter. All couplings to the real time (throttles, realtime
+/// clock pacing) are disabled in this mode, so the simulation runs as fast
+/// as possible and two runs produce the same cycle counts.
+///
+//===----------------------------------------------------------------------===//
+#ifndef HOSTTIME_H
+#define HOSTTIME_H
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// System headers
+#include <stdbool.h>
+#include <sys/time.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+/* Sat Jan  1 00:00:00 UTC 2000 */
+#define HOSTTIME_DEFAULT_START	(946684800)
+
+
+//==============================================================================
+//= Functions
+//==============================================================================
+void HostTime_Init(void);
+bool HostTime_Deterministic(void);
+void HostTime_Get(struct timeval *tv);
+
+#endif
@@ -173,7 +173,7 @@ program_page(NandFlash * nf)
 	for (i = 0; i < nf->pageSize; i++) {
 		tmpBuf[i] &= nf->pageCache[i];
 	}
-	DiskImage_Write(nf->diskimage, addr, tmpBuf, nf->pageSize);
+	DiskImage_WriteAsync(nf->diskimage, addr, tmpBuf, nf->pageSize, 0, NULL, NULL);
 //      fprintf(stderr,"Program page 0x%02x, %02x\n",nf->rowAddr,nf->rowAddr/32);
 }
 
@@ -188,16 +188,11 @@ erase_block(NandFlash * nf)
 {
 	uint32_t block_nr;
 	uint64_t imgAddr;
-	uint64_t addr;
-	uint32_t i;
 	block_nr = nf->rowAddr >> (nf->blockBits - nf->colBits - 1);
 	//fprintf(stderr,"Erase block 0x%x, row 0x%x, col 0x%x, bs 0x%x ps 0x%x\n",block_nr,nf->rowAddr,nf->colAddr,nf->blockSize,nf->pageSize);
 	imgAddr = (uint64_t) block_nr *nf->blockSize;
 	memset(nf->pageCache, 0xff, nf->pageSize);
-	for (i = 0; i < nf->blockSize; i += nf->pageSize) {
-		addr = imgAddr + i;
-		DiskImage_Write(nf->diskimage, addr, nf->pageCache, nf->pageSize);
-	}
+	DiskImage_FillAsync(nf->diskimage, imgAddr, 0xff, nf->blockSize, 0, NULL, NULL);
 	make_busy(nf, nf->us_busy_erase);
 }
 
@@ -686,7 +681,8 @@ NandFlash_New(const char *name)
 	nf->dataBlockSize = fld->dataPageSize * fld->pagesPerBlock;
 	nf->blockSize = (fld->dataPageSize + fld->sparePageSize) * fld->pagesPerBlock;
 	nf->id = fld->id;
-	nf->diskimage = DiskImage_Open(filename, nf->rawSize, DI_RDWR | DI_CREAT_FF | DI_SPARSE);
+	nf->diskimage =
+	    DiskImage_Open(filename, nf->rawSize, DI_RDWR | DI_CREAT_FF | DI_SPARSE | DI_CACHE);
 	nf->pageCache = sg_calloc(nf->pageSize);
 	fprintf(stderr, "NAND flash \"%s\" of type %s created\n", name, type);
 	return nf;
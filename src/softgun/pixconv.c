@@ -0,0 +1,418 @@
+//===-- softgun/pixconv.c -----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Row conversion between framebuffer pixel formats
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Main Module Header
+#include "pixconv.h"
+
+// Local/Private Headers
+#include "byteorder.h"
+#include "sgstring.h"
+
+// System headers
+#include <stdio.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PIXCONV_X86
+#include <immintrin.h>
+#endif
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+
+/*
+ * ------------------------------------------------------------------------
+ * Store a destination pixel which is already in memory order
+ * ------------------------------------------------------------------------
+ */
+static inline void
+store_pixel(uint8_t * dst, uint32_t word, unsigned int dst_bypp)
+{
+	switch (dst_bypp) {
+	    case 1:
+		    dst[0] = word;
+		    break;
+	    case 2:
+		    memcpy(dst, &word, 2);
+		    break;
+	    case 3:
+		    /* Do not use a 32 Bit store because of alignment traps */
+		    memcpy(dst, &word, 3);
+		    break;
+	    default:
+		    memcpy(dst, &word, 4);
+		    break;
+	}
+}
+
+static inline uint32_t
+memory_order(const PixConv * pc, uint32_t pixval)
+{
+	if (!pc->swap) {
+		return pixval;
+	}
+	if (pc->dst_bypp == 2) {
+		return BYTE_Swap16(pixval);
+	}
+	return BYTE_Swap32(pixval);
+}
+
+static inline uint32_t
+chan_pixval(const PixConv * pc, uint32_t srcval)
+{
+	const PixConvFormat *src = &pc->src;
+	uint8_t red = (srcval >> src->red_shift) & src->red_max;
+	uint8_t green = (srcval >> src->green_shift) & src->green_max;
+	uint8_t blue = (srcval >> src->blue_shift) & src->blue_max;
+	return pc->trans_red[red] | pc->trans_green[green] | pc->trans_blue[blue];
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Scalar kernels. The inline functions are instantiated for every
+ * source and destination pixel size, so the compiler can drop the
+ * switches out of the loop.
+ * ------------------------------------------------------------------------
+ */
+static inline void
+lut_row(const PixConv * pc, uint8_t * dst, const uint8_t * src, unsigned int count,
+	unsigned int src_bypp, unsigned int dst_bypp)
+{
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		uint32_t idx = (src_bypp == 2) ? (src[0] | (src[1] << 8)) : src[0];
+		store_pixel(dst, pc->lut[idx], dst_bypp);
+		src += src_bypp;
+		dst += dst_bypp;
+	}
+}
+
+static inline void
+chan32_row(const PixConv * pc, uint8_t * dst, const uint8_t * src, unsigned int count,
+	   unsigned int dst_bypp)
+{
+	unsigned int i;
+	for (i = 0; i < count; i++) {
+		uint32_t srcval = src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t) src[3] << 24);
+		store_pixel(dst, memory_order(pc, chan_pixval(pc, srcval)), dst_bypp);
+		src += 4;
+		dst += dst_bypp;
+	}
+}
+
+#define LUT_ROW(sb, db) \
+static void \
+lut##sb##_row##db(const PixConv * pc, uint8_t * dst, const uint8_t * src, unsigned int count) \
+{ \
+	lut_row(pc, dst, src, count, sb / 8, db); \
+}
+
+LUT_ROW(8, 1)
+LUT_ROW(8, 2)
+LUT_ROW(8, 3)
+LUT_ROW(8, 4)
+LUT_ROW(16, 1)
+LUT_ROW(16, 2)
+LUT_ROW(16, 3)
+LUT_ROW(16, 4)
+
+#define CHAN32_ROW(db) \
+static void \
+chan32_row##db(const PixConv * pc, uint8_t * dst, const uint8_t * src, unsigned int count) \
+{ \
+	chan32_row(pc, dst, src, count, db); \
+}
+
+CHAN32_ROW(1)
+CHAN32_ROW(2)
+CHAN32_ROW(3)
+CHAN32_ROW(4)
+
+static PixConv_RowProc *lutRows8[4] = { lut8_row1, lut8_row2, lut8_row3, lut8_row4 };
+static PixConv_RowProc *lutRows16[4] = { lut16_row1, lut16_row2, lut16_row3, lut16_row4 };
+static PixConv_RowProc *chan32Rows[4] = { chan32_row1, chan32_row2, chan32_row3, chan32_row4 };
+
+#ifdef PIXCONV_X86
+/*
+ * ------------------------------------------------------------------------
+ * SIMD kernels for 16 Bit sources to 32 Bit destinations with 8 Bit
+ * channels. A channel is scaled with mulhi(c * pre, mul), PixConv_Setup
+ * selected the factors so that this is exactly c * 255 / max.
+ * ------------------------------------------------------------------------
+ */
+__attribute__((target("sse2")))
+static void
+simd16_row4_sse2(const PixConv * pc, uint8_t * dst, const uint8_t * src, unsigned int count)
+{
+	const PixConvFormat *sf = &pc->src;
+	const __m128i rpre = _mm_set1_epi16(pc->pre[0]);
+	const __m128i gpre = _mm_set1_epi16(pc->pre[1]);
+	const __m128i bpre = _mm_set1_epi16(pc->pre[2]);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rmask = _mm_set1_epi16(sf->red_max);
+	const __m128i gmask = _mm_set1_epi16(sf->green_max);
+	const __m128i bmask = _mm_set1_epi16(sf->blue_max);
+	const __m128i rmul = _mm_set1_epi16(pc->mul[0]);
+	const __m128i gmul = _mm_set1_epi16(pc->mul[1]);
+	const __m128i bmul = _mm_set1_epi16(pc->mul[2]);
+	const __m128i rsrc = _mm_cvtsi32_si128(sf->red_shift);
+	const __m128i gsrc = _mm_cvtsi32_si128(sf->green_shift);
+	const __m128i bsrc = _mm_cvtsi32_si128(sf->blue_shift);
+	const __m128i rdst = _mm_cvtsi32_si128(pc->dst_shift[0]);
+	const __m128i gdst = _mm_cvtsi32_si128(pc->dst_shift[1]);
+	const __m128i bdst = _mm_cvtsi32_si128(pc->dst_shift[2]);
+	unsigned int i;
+	for (i = 0; i + 8 <= count; i += 8) {
+		__m128i p = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+		__m128i r = _mm_and_si128(_mm_srl_epi16(p, rsrc), rmask);
+		__m128i g = _mm_and_si128(_mm_srl_epi16(p, gsrc), gmask);
+		__m128i b = _mm_and_si128(_mm_srl_epi16(p, bsrc), bmask);
+		__m128i lo, hi;
+		r = _mm_mulhi_epu16(_mm_mullo_epi16(r, rpre), rmul);
+		g = _mm_mulhi_epu16(_mm_mullo_epi16(g, gpre), gmul);
+		b = _mm_mulhi_epu16(_mm_mullo_epi16(b, bpre), bmul);
+		lo = _mm_or_si128(_mm_sll_epi32(_mm_unpacklo_epi16(r, zero), rdst),
+				  _mm_sll_epi32(_mm_unpacklo_epi16(g, zero), gdst));
+		lo = _mm_or_si128(lo, _mm_sll_epi32(_mm_unpacklo_epi16(b, zero), bdst));
+		hi = _mm_or_si128(_mm_sll_epi32(_mm_unpackhi_epi16(r, zero), rdst),
+				  _mm_sll_epi32(_mm_unpackhi_epi16(g, zero), gdst));
+		hi = _mm_or_si128(hi, _mm_sll_epi32(_mm_unpackhi_epi16(b, zero), bdst));
+		_mm_storeu_si128((__m128i *) (dst + 4 * i), lo);
+		_mm_storeu_si128((__m128i *) (dst + 4 * i + 16), hi);
+	}
+	lut_row(pc, dst + 4 * i, src + 2 * i, count - i, 2, 4);
+}
+
+__attribute__((target("avx2")))
+static void
+simd16_row4_avx2(const PixConv * pc, uint8_t * dst, const uint8_t * src, unsigned int count)
+{
+	const PixConvFormat *sf = &pc->src;
+	const __m256i rpre = _mm256_set1_epi16(pc->pre[0]);
+	const __m256i gpre = _mm256_set1_epi16(pc->pre[1]);
+	const __m256i bpre = _mm256_set1_epi16(pc->pre[2]);
+	const __m256i rmask = _mm256_set1_epi16(sf->red_max);
+	const __m256i gmask = _mm256_set1_epi16(sf->green_max);
+	const __m256i bmask = _mm256_set1_epi16(sf->blue_max);
+	const __m256i rmul = _mm256_set1_epi16(pc->mul[0]);
+	const __m256i gmul = _mm256_set1_epi16(pc->mul[1]);
+	const __m256i bmul = _mm256_set1_epi16(pc->mul[2]);
+	const __m128i rsrc = _mm_cvtsi32_si128(sf->red_shift);
+	const __m128i gsrc = _mm_cvtsi32_si128(sf->green_shift);
+	const __m128i bsrc = _mm_cvtsi32_si128(sf->blue_shift);
+	const __m128i rdst = _mm_cvtsi32_si128(pc->dst_shift[0]);
+	const __m128i gdst = _mm_cvtsi32_si128(pc->dst_shift[1]);
+	const __m128i bdst = _mm_cvtsi32_si128(pc->dst_shift[2]);
+	unsigned int i;
+	for (i = 0; i + 16 <= count; i += 16) {
+		__m256i p = _mm256_loadu_si256((const __m256i *)(src + 2 * i));
+		__m256i r = _mm256_and_si256(_mm256_srl_epi16(p, rsrc), rmask);
+		__m256i g = _mm256_and_si256(_mm256_srl_epi16(p, gsrc), gmask);
+		__m256i b = _mm256_and_si256(_mm256_srl_epi16(p, bsrc), bmask);
+		__m256i lo, hi;
+		r = _mm256_mulhi_epu16(_mm256_mullo_epi16(r, rpre), rmul);
+		g = _mm256_mulhi_epu16(_mm256_mullo_epi16(g, gpre), gmul);
+		b = _mm256_mulhi_epu16(_mm256_mullo_epi16(b, bpre), bmul);
+		/* Widen the halves in order, unpack would interleave the lanes */
+		lo = _mm256_or_si256(_mm256_sll_epi32
+				     (_mm256_cvtepu16_epi32(_mm256_castsi256_si128(r)), rdst),
+				     _mm256_sll_epi32(_mm256_cvtepu16_epi32
+						      (_mm256_castsi256_si128(g)), gdst));
+		lo = _mm256_or_si256(lo, _mm256_sll_epi32(_mm256_cvtepu16_epi32
+							  (_mm256_castsi256_si128(b)), bdst));
+		hi = _mm256_or_si256(_mm256_sll_epi32
+				     (_mm256_cvtepu16_epi32(_mm256_extracti128_si256(r, 1)), rdst),
+				     _mm256_sll_epi32(_mm256_cvtepu16_epi32
+						      (_mm256_extracti128_si256(g, 1)), gdst));
+		hi = _mm256_or_si256(hi, _mm256_sll_epi32(_mm256_cvtepu16_epi32
+							  (_mm256_extracti128_si256(b, 1)), bdst));
+		_mm256_storeu_si256((__m256i *) (dst + 4 * i), lo);
+		_mm256_storeu_si256((__m256i *) (dst + 4 * i + 32), hi);
+	}
+	lut_row(pc, dst + 4 * i, src + 2 * i, count - i, 2, 4);
+}
+#endif
+
+/*
+ * ------------------------------------------------------------------------
+ * Find factors with mulhi(c * pre, mul) == c * 255 / max for every
+ * channel value c. For a given pre every c limits mul to an interval,
+ * the first pre where the intervals overlap wins.
+ * Returns 0 if there are none.
+ * ------------------------------------------------------------------------
+ */
+static int
+find_mul(unsigned int max, uint16_t * pre_ret, uint16_t * mul_ret)
+{
+	uint32_t pre, c;
+	if ((max == 0) || (max > 255)) {
+		return 0;
+	}
+	for (pre = 1; pre * max < 65536; pre++) {
+		uint64_t lo = 0;
+		uint64_t hi = 65536;
+		for (c = 1; c <= max; c++) {
+			uint64_t q = c * 255 / max;
+			uint64_t div = c * pre;
+			uint64_t clo = (q * 65536 + div - 1) / div;
+			uint64_t chi = ((q + 1) * 65536 + div - 1) / div;
+			if (clo > lo) {
+				lo = clo;
+			}
+			if (chi < hi) {
+				hi = chi;
+			}
+		}
+		if (lo < hi) {
+			*pre_ret = pre;
+			*mul_ret = lo;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Check if one of the SIMD kernels can do the conversion and set up
+ * its parameters. The shifts of the destination channels are taken
+ * after the byte swap.
+ * ------------------------------------------------------------------------
+ */
+static int
+simd_setup(PixConv * pc, const PixConvFormat * dst)
+{
+	const uint8_t shifts[3] = { dst->red_shift, dst->green_shift, dst->blue_shift };
+	const uint16_t maxes[3] = { dst->red_max, dst->green_max, dst->blue_max };
+	const uint16_t src_maxes[3] = { pc->src.red_max, pc->src.green_max, pc->src.blue_max };
+	int i;
+	if ((pc->src.bits_per_pixel != 16) || (pc->dst_bypp != 4)) {
+		return 0;
+	}
+	for (i = 0; i < 3; i++) {
+		if ((maxes[i] != 255) || (shifts[i] & 7) || (shifts[i] > 24)) {
+			return 0;
+		}
+		pc->dst_shift[i] = pc->swap ? 24 - shifts[i] : shifts[i];
+		if (!find_mul(src_maxes[i], &pc->pre[i], &pc->mul[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void
+build_trans(uint32_t * trans, unsigned int src_max, unsigned int dst_max, unsigned int shift)
+{
+	unsigned int c;
+	for (c = 0; c <= src_max; c++) {
+		trans[c] = (c * dst_max / src_max) << shift;
+	}
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+
+//===----------------------------------------------------------------------===//
+/// Select the kernel for a conversion and build its tables.
+///
+/// @return 0 on success, -1 if the pixel sizes are not supported. rowProc
+/// is NULL after a failed setup.
+//===----------------------------------------------------------------------===//
+int
+PixConv_Setup(PixConv * pc, const PixConvFormat * src, const PixConvFormat * dst,
+	      unsigned int dst_bypp, int swap, int flags)
+{
+	unsigned int i;
+	pc->rowProc = NULL;
+	pc->kernel = NULL;
+	if ((dst_bypp < 1) || (dst_bypp > 4)) {
+		fprintf(stderr, "PixConv: %d bytes per pixel not implemented\n", dst_bypp);
+		return -1;
+	}
+	if ((src->red_max > 255) || (src->green_max > 255) || (src->blue_max > 255)
+	    || !src->red_max || !src->green_max || !src->blue_max) {
+		fprintf(stderr, "PixConv: Unsupported source format\n");
+		return -1;
+	}
+	pc->src = *src;
+	pc->dst_bypp = dst_bypp;
+	pc->swap = swap;
+	build_trans(pc->trans_red, src->red_max, dst->red_max, dst->red_shift);
+	build_trans(pc->trans_green, src->green_max, dst->green_max, dst->green_shift);
+	build_trans(pc->trans_blue, src->blue_max, dst->blue_max, dst->blue_shift);
+	switch (src->bits_per_pixel) {
+	    case 8:
+	    case 16:
+		    if (pc->lut_size != (1U << src->bits_per_pixel)) {
+			    sg_free(pc->lut);
+			    pc->lut_size = 1U << src->bits_per_pixel;
+			    pc->lut = sg_calloc(pc->lut_size * sizeof(uint32_t));
+		    }
+		    for (i = 0; i < pc->lut_size; i++) {
+			    pc->lut[i] = memory_order(pc, chan_pixval(pc, i));
+		    }
+		    if (src->bits_per_pixel == 8) {
+			    pc->rowProc = lutRows8[dst_bypp - 1];
+		    } else {
+			    pc->rowProc = lutRows16[dst_bypp - 1];
+		    }
+		    pc->kernel = "lut";
+		    break;
+	    case 32:
+		    pc->rowProc = chan32Rows[dst_bypp - 1];
+		    pc->kernel = "channel";
+		    break;
+	    default:
+		    fprintf(stderr, "PixConv: %d bits per pixel not implemented\n",
+			    src->bits_per_pixel);
+		    return -1;
+	}
+#ifdef PIXCONV_X86
+	if (!(flags & PIXCONV_NO_SIMD) && simd_setup(pc, dst)) {
+		if (__builtin_cpu_supports("avx2")) {
+			pc->rowProc = simd16_row4_avx2;
+			pc->kernel = "avx2";
+		} else if (__builtin_cpu_supports("sse2")) {
+			pc->rowProc = simd16_row4_sse2;
+			pc->kernel = "sse2";
+		}
+	}
+#endif
+	return 0;
+}
+
+void
+PixConv_Free(PixConv * pc)
+{
+	sg_free(pc->lut);
+	pc->lut = NULL;
+	pc->lut_size = 0;
+}
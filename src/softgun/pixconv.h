@@ -0,0 +1,103 @@
+//===-- softgun/pixconv.h -----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Row conversion between framebuffer pixel formats
+///
+/// A PixConv converts rows of pixels from a little endian source format
+/// (the framebuffer of an LCD controller) to a destination format (for
+/// example the pixel format of a VNC client). Every color channel is
+/// scaled with c * dst_max / src_max. The destination pixels are written
+/// in host byte order, or byte swapped if "swap" is set, with 1 to 4 bytes
+/// per pixel.
+///
+/// The kernel is selected once in PixConv_Setup:
+///  - 16 Bit sources to 32 Bit destinations with 8 Bit channels on byte
+///    boundaries use an AVX2 or SSE2 kernel if the CPU has it.
+///  - Other 8 and 16 Bit sources use a lookup table with one entry per
+///    source pixel value.
+///  - 32 Bit sources use one table per color channel.
+///
+//===----------------------------------------------------------------------===//
+#ifndef PIXCONV_H
+#define PIXCONV_H
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// System headers
+#include <stdint.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define PIXCONV_NO_SIMD		(1)	/* Do not select a SIMD kernel */
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct PixConvFormat {
+	uint8_t bits_per_pixel;
+	uint16_t red_max;
+	uint16_t green_max;
+	uint16_t blue_max;
+	uint8_t red_shift;
+	uint8_t green_shift;
+	uint8_t blue_shift;
+} PixConvFormat;
+
+typedef struct PixConv PixConv;
+typedef void PixConv_RowProc(const PixConv * pc, uint8_t * dst, const uint8_t * src,
+			     unsigned int count);
+
+struct PixConv {
+	PixConv_RowProc *rowProc;
+	const char *kernel;
+	PixConvFormat src;
+	unsigned int dst_bypp;
+	int swap;
+	/* Per channel tables for 32 Bit sources */
+	uint32_t trans_red[256];
+	uint32_t trans_green[256];
+	uint32_t trans_blue[256];
+	/* Destination pixels as stored in memory, for 8 and 16 Bit sources */
+	uint32_t *lut;
+	unsigned int lut_size;
+	/* Parameters of the SIMD kernels */
+	uint16_t pre[3];
+	uint16_t mul[3];
+	uint8_t dst_shift[3];
+};
+
+
+//==============================================================================
+//= Functions
+//==============================================================================
+int PixConv_Setup(PixConv * pc, const PixConvFormat * src, const PixConvFormat * dst,
+		  unsigned int dst_bypp, int swap, int flags);
+void PixConv_Free(PixConv * pc);
+
+static inline void
+PixConv_Row(const PixConv * pc, uint8_t * dst, const uint8_t * src, unsigned int count)
+{
+	pc->rowProc(pc, dst, src, count);
+}
+
+#endif
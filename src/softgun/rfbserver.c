@@ -57,6 +57,7 @@
 #include "byteorder.h"
 #include "configfile.h"
 #include "fbdisplay.h"
+#include "pixconv.h"
 #include "sgstring.h"
 #include "sglib.h"
 
@@ -138,6 +139,7 @@ typedef struct RLEncoder {
 } RLEncoder;
 
 #define UDRECT_FIFOSIZE (256)
+#define SHADOW_TILESIZE (64)
 /*
  * -----------------------------------------------------------------------------
  * RfbConnection structure contains the state information
@@ -152,10 +154,13 @@ typedef struct RfbConnection {
   StreamHandle_t *handle;
 
   PixelFormat pixfmt;
-  /* translation table belongs to the pixel format */
-  uint32_t trans_red[256];
-  uint32_t trans_green[256];
-  uint32_t trans_blue[256];
+  /*
+   * Row converters belong to the pixel format: pixconv writes the
+   * pixels for the RAW encoding, valconv the pixel values for the
+   * ZRLE run length encoder
+   */
+  PixConv pixconv;
+  PixConv valconv;
 
   FrameBufferInfo *fbi;	/* points to fbi of RfbServer */
   struct RfbConnection *next;
@@ -171,9 +176,23 @@ typedef struct RfbConnection {
   UpdateRectangle udrect_fifo[UDRECT_FIFOSIZE];
   uint64_t udrect_wp;
   uint64_t udrect_rp;
+  /*
+   * The encoded update is written from obuf with uv_write. While the
+   * write is in flight obuf belongs to it and further updates are
+   * merged into the dirty lines and the rectangle fifo.
+   */
   uint8_t *obuf;
   int obuf_wp;
   int obuf_size;
+  int write_pending;
+  /*
+   * Copy of the framebuffer as the client has seen it and the lines
+   * which might have changed since the last update
+   */
+  uint8_t *shadow;
+  int shadow_size;
+  unsigned int dirty_y0;
+  unsigned int dirty_y1;
 } RfbConnection;
 
 struct RfbServer {
@@ -189,9 +208,27 @@ struct RfbServer {
   pid_t viewerpid;
 #endif
   RfbConnection *con_head;
-  /* Servers native FBI (window info & Pixelformat */
+  /*
+   * Servers native FBI (window info & Pixelformat). It is only used
+   * in the AsyncManager thread, the framebuffer is the snapshot the
+   * updates are encoded from.
+   */
   FrameBufferInfo fbi;
   uint32_t exit_on_close;
+  /*
+   * The framebuffer written by the display user (LCD controller) and
+   * the lines changed since the last snapshot. Protected by pub_lock.
+   */
+  uv_mutex_t pub_lock;
+  AsyncHandle_t *wakeup;
+  uint8_t *pub_fb;
+  unsigned int pub_size;
+  unsigned int pub_linebytes;
+  unsigned int pub_height;
+  unsigned int pub_y0;
+  unsigned int pub_y1;
+  int pub_fbf_changed;
+  FbFormat pub_fbf;
 };
 
 /*
@@ -207,30 +244,36 @@ pixfmt_update_bits(PixelFormat * pixfmt) {
 
 }
 
+static void
+pixconv_format(PixConvFormat * pcf, PixelFormat * pixf) {
+  pcf->bits_per_pixel = pixf->bits_per_pixel;
+  pcf->red_max = pixf->red_max;
+  pcf->green_max = pixf->green_max;
+  pcf->blue_max = pixf->blue_max;
+  pcf->red_shift = pixf->red_shift;
+  pcf->green_shift = pixf->green_shift;
+  pcf->blue_shift = pixf->blue_shift;
+}
+
+/*
+ *******************************************************************
+ * Select the row converters for the framebuffer and connection
+ * pixel formats. A failed setup leaves rowProc NULL and the
+ * encoders skip the update.
+ *******************************************************************
+ */
 static void
 pixfmt_update_translation(RfbConnection * rcon) {
-  uint32_t red, green, blue;
   FrameBufferInfo *fbi = rcon->fbi;
   PixelFormat *pixf = &rcon->pixfmt;
   PixelFormat *fbpixf = &fbi->pixfmt;
-  for (red = 0; red <= fbpixf->red_max; red++) {
-    uint32_t trans;
-    trans = red * pixf->red_max / fbpixf->red_max;
-    trans <<= pixf->red_shift;
-    rcon->trans_red[red] = trans;
-  }
-  for (green = 0; green <= fbpixf->green_max; green++) {
-    uint32_t trans;
-    trans = green * pixf->green_max / fbpixf->green_max;
-    trans <<= pixf->green_shift;
-    rcon->trans_green[green] = trans;
-  }
-  for (blue = 0; blue <= fbpixf->blue_max; blue++) {
-    uint32_t trans;
-    trans = blue * pixf->blue_max / fbpixf->blue_max;
-    trans <<= pixf->blue_shift;
-    rcon->trans_blue[blue] = trans;
-  }
+  PixConvFormat src, dst;
+  int swap = (pixf->big_endian_flag != fbpixf->big_endian_flag);
+  pixconv_format(&src, fbpixf);
+  pixconv_format(&dst, pixf);
+  PixConv_Setup(&rcon->pixconv, &src, &dst, pixf->bits_per_pixel >> 3, swap, 0);
+  PixConv_Setup(&rcon->valconv, &src, &dst, 4, 0, 0);
+  dbgprintf("RFB pixel conversion kernel %s\n", rcon->pixconv.kernel);
 }
 
 static void free_rcon(Handle_t *handle, void *clientdata) {
@@ -252,6 +295,11 @@ static void free_rcon(Handle_t *handle, void *clientdata) {
   if (rcon->obuf) {
     free(rcon->obuf);
   }
+  if (rcon->shadow) {
+    free(rcon->shadow);
+  }
+  PixConv_Free(&rcon->pixconv);
+  PixConv_Free(&rcon->valconv);
   free(rcon);
   if (rfbserv->exit_on_close && !rfbserv->con_head) {
     fprintf(stderr, "Exiting after termination of last VNC connection\n");
@@ -271,10 +319,35 @@ rfbsrv_disconnect(RfbConnection * rcon) {
   AsyncManager_Close((Handle_t *)rcon->handle, &free_rcon, rcon);
 }
 
+static void
+rfbcon_written(int status, StreamHandle_t *handle, void *clientdata) {
+  free(clientdata);
+}
+
+/*
+ * --------------------------------------------------------------------------
+ * rfbcon_write
+ *	Queue a copy of a message for the client. The AsyncManager thread
+ *	never waits for the socket, the messages stay in order with the
+ *	framebuffer updates in the write queue of the stream.
+ * --------------------------------------------------------------------------
+ */
+static int
+rfbcon_write(RfbConnection * rcon, const void *data, unsigned int len) {
+  void *buf = sg_calloc(len);
+  int result;
+  memcpy(buf, data, len);
+  result = AsyncManager_Write(rcon->handle, buf, len, &rfbcon_written, buf);
+  if (result < 0) {
+    free(buf);
+  }
+  return result;
+}
+
 static int
 Msg_ProtocolVersion(RfbConnection *rcon) {
   char *msg = "RFB 003.003\n";
-  return AsyncManager_WriteSync(rcon->handle, msg, strlen(msg));
+  return rfbcon_write(rcon, msg, strlen(msg));
 }
 
 /*
@@ -308,7 +381,7 @@ CheckProtocolVersion(RfbConnection * rcon) {
 static int
 Msg_Auth(RfbConnection *rcon) {
   char msg[] = { 0, 0, 0, 1 };	/* no authentication required */
-  return AsyncManager_WriteSync(rcon->handle, msg, 4);
+  return rfbcon_write(rcon, msg, 4);
 }
 
 /**
@@ -437,7 +510,7 @@ Msg_ServerInitialisation(RfbConnection * rcon) {
   p += 4;
   memcpy(p, fbi->name_string, fbi->name_length);
   p += fbi->name_length;
-  return AsyncManager_WriteSync(rcon->handle, msg, p - msg);
+  return rfbcon_write(rcon, msg, p - msg);
 }
 
 /*
@@ -481,125 +554,11 @@ Msg_ServerInitialisation(RfbConnection * rcon) {
 #define write16(addr,value) (*(uint16_t*)(addr) = (value))
 #define write32(addr,value) (*(uint32_t*)(addr) = (value))
 
-  /*
-   * ------------------------------------------------------------------------------
-   * Convert a single pixel stored in a src buffer from the framebuffer
-   * pixel format into a destination pixel format which is connection specific
-   * ------------------------------------------------------------------------------
-   */
-
-static inline uint32_t
-encode_pixval(RfbConnection * rcon, void *src, PixelFormat * pixf, PixelFormat * fbpixf) {
-  uint32_t pixval;
-  uint8_t red, green, blue;
-
-  switch (fbpixf->bits_per_pixel) {
-  case 32:
-    pixval = BYTE_LeToH32(*(uint32_t *)src);
-    break;
-  case 16:
-    pixval = BYTE_LeToH16(*(uint16_t *)src);
-    break;
-  case 8:
-    pixval = *(uint8_t *)src;
-    break;
-  default:
-    pixval = 0;
-  }
-  red = (pixval >> fbpixf->red_shift) & fbpixf->red_max;
-  green = (pixval >> fbpixf->green_shift) & fbpixf->green_max;
-  blue = (pixval >> fbpixf->blue_shift) & fbpixf->blue_max;
-  return rcon->trans_red[red] | rcon->trans_green[green] | rcon->trans_blue[blue];
-}
-
 /*
  * ---------------------------------------------------------------
  * write a pixel value into a buffer
  * ---------------------------------------------------------------
  */
-static int
-write_pixel8(uint8_t * dst, uint32_t pixval) {
-  dst[0] = pixval;
-  return 1;
-}
-
-static int
-write_pixel16_swap(uint8_t * dst, uint32_t pixval) {
-  write16(dst, BYTE_Swap16(pixval));
-  return 2;
-}
-
-static int
-write_pixel16(uint8_t * dst, uint32_t pixval) {
-  write16(dst, pixval);
-  return 2;
-}
-
-static int
-write_pixel24_swap(uint8_t * dst, uint32_t pixval) {
-  uint8_t *pix = (uint8_t *)& pixval;
-  dst[0] = pix[3];
-  dst[1] = pix[2];
-  dst[2] = pix[1];
-  return 3;
-}
-
-static int
-write_pixel24(uint8_t * dst, uint32_t pixval) {
-  /* Do not use write32 because of alignment traps */
-  uint8_t *pix = (uint8_t *)& pixval;
-  dst[0] = pix[0];
-  dst[1] = pix[1];
-  dst[2] = pix[2];
-  return 3;
-}
-
-static int
-write_pixel32_swap(uint8_t * dst, uint32_t pixval) {
-  write32(dst, BYTE_Swap32(pixval));
-  return 4;
-}
-
-static int
-write_pixel32(uint8_t * dst, uint32_t pixval) {
-  write32(dst, pixval);
-  return 4;
-}
-
-typedef int WritePixelProc(uint8_t * dst, uint32_t pixval);
-
-static WritePixelProc *
-GetWritePixelProc(int con_bypp, int swap) {
-  switch (con_bypp) {
-  case 1:
-    return write_pixel8;
-  case 2:
-    if (swap) {
-      return write_pixel16_swap;
-    } else {
-      return write_pixel16;
-    }
-    break;
-  case 3:
-    if (swap) {
-      return write_pixel24_swap;
-    } else {
-      return write_pixel24;
-    }
-    break;
-  case 4:
-    if (swap) {
-      return write_pixel32_swap;
-    } else {
-      return write_pixel32;
-    }
-    break;
-  default:
-    fprintf(stderr, "%d bytes per pixel not implemented\n", con_bypp);
-    return NULL;
-  }
-}
-
 static inline int
 write_pixel(int con_bypp, int swap, uint8_t * dst, uint32_t pixval) {
   switch (con_bypp) {
@@ -708,6 +667,34 @@ rle_flush(RLEncoder * rle, int con_bypp, int swap, uint8_t * dst) {
   return retval;
 }
 
+static void trigger_fb_update(RfbConnection * rcon);
+
+/*
+ * ------------------------------------------------------------------------
+ * srv_fb_update_written
+ *	The client has the last update, send the changes which were
+ *	collected in the meantime if it already asked for them
+ * ------------------------------------------------------------------------
+ */
+static void
+srv_fb_update_written(int status, StreamHandle_t *handle, void *clientdata) {
+  RfbConnection *rcon = clientdata;
+  rcon->write_pending = 0;
+  if (status < 0) {
+    /* Connection is closed or being closed */
+    return;
+  }
+  trigger_fb_update(rcon);
+}
+
+static void
+srv_fb_write_update(RfbConnection * rcon, int len) {
+  rcon->write_pending = 1;
+  if (AsyncManager_Write(rcon->handle, rcon->obuf, len, &srv_fb_update_written, rcon) < 0) {
+    rcon->write_pending = 0;
+  }
+}
+
 /*
  * ------------------------------------------------------------------------
  * srv_encode_update_raw
@@ -716,23 +703,18 @@ rle_flush(RLEncoder * rle, int con_bypp, int swap, uint8_t * dst) {
  */
 static inline void
 srv_fb_encode_update_raw(RfbConnection * rcon) {
-  WritePixelProc *wpProc;
   FrameBufferInfo *fbi = rcon->fbi;
   PixelFormat *pixf = &rcon->pixfmt;
-  PixelFormat *fbpixf = &fbi->pixfmt;
   int con_bypp = pixf->bits_per_pixel >> 3;
   int fb_bypp = fbi->pixfmt.bits_per_pixel >> 3;
   uint8_t *reply;
   uint8_t *data;
-  int x, y;
-  int swap;
+  int y;
   reply = rcon->obuf;
   data = reply;
   data += add_update_header(data, rcon->udrect_wp - rcon->udrect_rp);
 
-  swap = (pixf->big_endian_flag != fbpixf->big_endian_flag);
-  wpProc = GetWritePixelProc(con_bypp, swap);
-  if (!wpProc) {
+  if (!rcon->pixconv.rowProc) {
     return;
   }
   while (rcon->udrect_rp < rcon->udrect_wp) {
@@ -740,7 +722,7 @@ srv_fb_encode_update_raw(RfbConnection * rcon) {
     UpdateRectangle *udrect = &rcon->udrect_fifo[rcon->udrect_rp % UDRECT_FIFOSIZE];
 
     rcon->udrect_rp++;
-    memsize = udrect->width * udrect->height * con_bypp + 16;
+    memsize = (data - reply) + udrect->width * udrect->height * con_bypp + 16;
     if (rcon->obuf_size < memsize) {
       rcon->obuf_size = memsize;
       reply = realloc(rcon->obuf, rcon->obuf_size);
@@ -761,16 +743,11 @@ srv_fb_encode_update_raw(RfbConnection * rcon) {
 
     for (y = udrect->y; y < (udrect->y + udrect->height); y++) {
       int ofs = (y * fbi->fb_width + udrect->x) * fb_bypp;
-      for (x = udrect->x; x < (udrect->x + udrect->width); x++) {
-        uint32_t pixval =
-          encode_pixval(rcon, &fbi->framebuffer[ofs], pixf, fbpixf);
-        data += wpProc(data, pixval);
-        ofs += fb_bypp;
-      }
+      PixConv_Row(&rcon->pixconv, data, (uint8_t *)&fbi->framebuffer[ofs], udrect->width);
+      data += udrect->width * con_bypp;
     }
-    AsyncManager_WriteSync(rcon->handle, reply, data - reply);
-    data = reply;
   }
+  srv_fb_write_update(rcon, data - reply);
   return;
 }
 
@@ -790,11 +767,16 @@ srv_fb_encode_update_zrle(RfbConnection * rcon) {
   int fb_bypp = fbi->pixfmt.bits_per_pixel >> 3;
   uint8_t *tileBuf = alloca(1 + 64 * 64 * 5);
   uint8_t *tileBufEnd;
+  uint32_t rowBuf[64];
   int lengthP;
   int ofs;
   int x0, y0, x1, y1, y;
+  int tile_width;
   RLEncoder *rle = &rcon->rle;
   z_stream *zs = &rcon->zs;
+  if (!rcon->valconv.rowProc) {
+    return;
+  }
   rcon->obuf_wp = add_update_header(rcon->obuf, rcon->udrect_wp - rcon->udrect_rp);
   while (rcon->udrect_rp < rcon->udrect_wp) {
     UpdateRectangle *udrect = &rcon->udrect_fifo[rcon->udrect_rp % UDRECT_FIFOSIZE];
@@ -822,17 +804,19 @@ srv_fb_encode_update_zrle(RfbConnection * rcon) {
         tileBufEnd = tileBuf;
         *tileBufEnd++ = 128;	/* Plain RLE */
         rle_init(rle);
+        tile_width = udrect->width - x0;
+        if (tile_width > 64) {
+          tile_width = 64;
+        }
         for (y1 = 0; (y1 < 64) && ((y0 + y1) < udrect->height); y1++) {
           y = y0 + y1 + udrect->y;
           ofs = (y * fbi->fb_width + (x0 + udrect->x)) * fb_bypp;
-          for (x1 = 0; (x1 < 64) && ((x1 + x0) < udrect->width); x1++) {
-            uint32_t pixval =
-              encode_pixval(rcon, &fbi->framebuffer[ofs],
-                pixf, fbpixf);
+          PixConv_Row(&rcon->valconv, (uint8_t *)rowBuf,
+            (uint8_t *)&fbi->framebuffer[ofs], tile_width);
+          for (x1 = 0; x1 < tile_width; x1++) {
             tileBufEnd +=
               rle_add_pixval(rle, con_bypp, swap, tileBufEnd,
-                pixval);
-            ofs += fb_bypp;
+                rowBuf[x1]);
           }
         }
         //fprintf(stderr,"Tile at %d %d, %d %d\n",x0+udrect->x,y0+udrect->y,x1,y1);
@@ -858,9 +842,9 @@ srv_fb_encode_update_zrle(RfbConnection * rcon) {
     //fprintf(stderr,"total out %lu av out %lu bpp %d bytes %d\n",zs->total_out,zs->avail_out,fbpixf->bits_per_pixel,con_bypp);
     write32be(rcon->obuf + lengthP, zs->total_out);
     rcon->obuf_wp += zs->total_out;
-    AsyncManager_WriteSync(rcon->handle, rcon->obuf, rcon->obuf_wp);
-    rcon->obuf_wp = 0;
   }
+  srv_fb_write_update(rcon, rcon->obuf_wp);
+  rcon->obuf_wp = 0;
   return;
 }
 #endif
@@ -893,15 +877,125 @@ srv_fb_update(RfbConnection * rcon) {
   }
 }
 
+static void write_udrect_to_fifo(RfbConnection * rcon, UpdateRectangle * udrect);
+
+/*
+ * -------------------------------------------------------------------------
+ * shadow_copy_rect
+ *	Remember the contents of a rectangle which is sent to the client
+ * -------------------------------------------------------------------------
+ */
+static void
+shadow_copy_rect(RfbConnection * rcon, UpdateRectangle * udrect) {
+  FrameBufferInfo *fbi = rcon->fbi;
+  unsigned int bypp = fbi->pixfmt.bypp;
+  unsigned int y;
+  if (rcon->shadow_size != fbi->fb_size) {
+    return;
+  }
+  for (y = udrect->y; y < (udrect->y + udrect->height); y++) {
+    unsigned int ofs = (y * fbi->fb_width + udrect->x) * bypp;
+    memcpy(rcon->shadow + ofs, fbi->framebuffer + ofs, udrect->width * bypp);
+  }
+}
+
+/*
+ * -------------------------------------------------------------------------
+ * shadow_diff_tiles
+ *	Compare the dirty lines tile by tile with the shadow framebuffer.
+ *	Only changed tiles are copied to the shadow and queued for the
+ *	update, neighboring tiles of a tile row are merged into one
+ *	rectangle.
+ * -------------------------------------------------------------------------
+ */
+static void
+shadow_diff_tiles(RfbConnection * rcon) {
+  FrameBufferInfo *fbi = rcon->fbi;
+  unsigned int bypp = fbi->pixfmt.bypp;
+  unsigned int tx, ty, tw, th, y, ofs;
+  UpdateRectangle udrect;
+  if (rcon->dirty_y0 >= rcon->dirty_y1) {
+    return;
+  }
+  if (rcon->shadow_size != fbi->fb_size) {
+    /* New framebuffer format: send everything */
+    rcon->shadow = realloc(rcon->shadow, fbi->fb_size);
+    if (!rcon->shadow) {
+      fprintf(stderr, "RFB-Server: No memory\n");
+      exit(1);
+    }
+    rcon->shadow_size = fbi->fb_size;
+    memcpy(rcon->shadow, fbi->framebuffer, fbi->fb_size);
+    udrect.x = 0;
+    udrect.y = 0;
+    udrect.width = fbi->fb_width;
+    udrect.height = fbi->fb_height;
+    write_udrect_to_fifo(rcon, &udrect);
+    rcon->dirty_y0 = rcon->dirty_y1 = 0;
+    return;
+  }
+  for (ty = rcon->dirty_y0 - (rcon->dirty_y0 % SHADOW_TILESIZE); ty < rcon->dirty_y1;
+    ty += SHADOW_TILESIZE) {
+    th = fbi->fb_height - ty;
+    if (th > SHADOW_TILESIZE) {
+      th = SHADOW_TILESIZE;
+    }
+    udrect.width = 0;
+    for (tx = 0; tx < fbi->fb_width; tx += SHADOW_TILESIZE) {
+      tw = fbi->fb_width - tx;
+      if (tw > SHADOW_TILESIZE) {
+        tw = SHADOW_TILESIZE;
+      }
+      for (y = ty; y < (ty + th); y++) {
+        ofs = (y * fbi->fb_width + tx) * bypp;
+        if (memcmp(rcon->shadow + ofs, fbi->framebuffer + ofs, tw * bypp)) {
+          break;
+        }
+      }
+      if (y == (ty + th)) {
+        /* Tile unchanged */
+        if (udrect.width) {
+          write_udrect_to_fifo(rcon, &udrect);
+          udrect.width = 0;
+        }
+        continue;
+      }
+      /* The lines above y are equal */
+      for (; y < (ty + th); y++) {
+        ofs = (y * fbi->fb_width + tx) * bypp;
+        memcpy(rcon->shadow + ofs, fbi->framebuffer + ofs, tw * bypp);
+      }
+      if (udrect.width) {
+        udrect.width += tw;
+      } else {
+        udrect.x = tx;
+        udrect.y = ty;
+        udrect.width = tw;
+        udrect.height = th;
+      }
+    }
+    if (udrect.width) {
+      write_udrect_to_fifo(rcon, &udrect);
+    }
+  }
+  rcon->dirty_y0 = rcon->dirty_y1 = 0;
+}
+
 /*
  * -------------------------------------------------------------------------
  * trigger_fb_update
- *	Start an update if there is something in the rectangle fifo
+ *	Start an update if the client waits for one and there is something
+ *	in the rectangle fifo or in the changed tiles. While the previous
+ *	update is still being written the changes are only collected.
  * -------------------------------------------------------------------------
  */
-static inline void
+static void
 trigger_fb_update(RfbConnection * rcon) {
-  if ((rcon->udrect_wp != rcon->udrect_rp) && rcon->update_outstanding) {
+  if (!rcon->update_outstanding || rcon->write_pending) {
+    return;
+  }
+  shadow_diff_tiles(rcon);
+  if (rcon->udrect_wp != rcon->udrect_rp) {
     rcon->update_outstanding = 0;
     srv_fb_update(rcon);
   }
@@ -973,7 +1067,7 @@ srv_set_8bit_color_map_entries(RfbConnection * rcon, PixelFormat * pixf) {
     write16be(wp, blue);
     wp += 2;
   }
-  AsyncManager_WriteSync(rcon->handle, reply, wp - reply);
+  rfbcon_write(rcon, reply, wp - reply);
 }
 
 static void
@@ -1090,6 +1184,10 @@ clnt_fb_update_req(RfbConnection * rcon, uint8_t * data, int len) {
   dbgprintf("Got updaterequest from Client\n");
   if (!incremental) {
     write_udrect_to_fifo(rcon, &udrect);
+    if (((udrect.y + udrect.height) <= rcon->fbi->fb_height) &&
+      ((udrect.x + udrect.width) <= rcon->fbi->fb_width)) {
+      shadow_copy_rect(rcon, &udrect);
+    }
     rcon->update_outstanding = 1;
     trigger_fb_update(rcon);
   } else {
@@ -1352,24 +1450,17 @@ rfbsrv_accept(int status, StreamHandle_t *handle, const char *host, int port, vo
 
 /*
  * -----------------------------------------------------------------------
- * rfbserv_set_fbformat
- *	Set the framebuffer format. Called by a user of the display
- *	(For example a LCD controller emulator) to tell the rfbserver
- *	about memory layout.
+ * rfbserv_apply_fbformat
+ *	Switch the snapshot framebuffer to a new format. Called in the
+ *	AsyncManager thread.
  * -----------------------------------------------------------------------
  */
-
 static void
-rfbserv_set_fbformat(struct FbDisplay *fbdisp, FbFormat * fbf) {
+rfbserv_apply_fbformat(RfbServer * rfbserv, FbFormat * fbf) {
   int fb_size;
-  RfbServer *rfbserv = fbdisp->owner;
   FrameBufferInfo *fbi = &rfbserv->fbi;
   PixelFormat *pixf = &fbi->pixfmt;
-  if ((fbf->red_bits > 8) || (fbf->green_bits > 8) || (fbf->blue_bits > 8)) {
-    fprintf(stderr,
-      "Framebuffer format with more than 8 Bit per color not supported\n");
-    exit(1);
-  }
+  RfbConnection *rcon;
   pixf->red_max = (1 << fbf->red_bits) - 1;
   pixf->red_bits = fbf->red_bits;
   pixf->red_shift = fbf->red_shift;
@@ -1398,56 +1489,146 @@ rfbserv_set_fbformat(struct FbDisplay *fbdisp, FbFormat * fbf) {
       exit(1);
     }
   }
-  RfbConnection *rcon;
   for (rcon = rfbserv->con_head; rcon; rcon = rcon->next) {
     pixfmt_update_translation(rcon);
   }
+}
+
+/*
+ * -----------------------------------------------------------------------
+ * rfbserv_set_fbformat
+ *	Set the framebuffer format. Called by a user of the display
+ *	(For example a LCD controller emulator) to tell the rfbserver
+ *	about memory layout. The snapshot side takes over the
+ *	format in the AsyncManager thread.
+ * -----------------------------------------------------------------------
+ */
+
+static void
+rfbserv_set_fbformat(struct FbDisplay *fbdisp, FbFormat * fbf) {
+  RfbServer *rfbserv = fbdisp->owner;
+  FrameBufferInfo *fbi = &rfbserv->fbi;
+  unsigned int bypp;
+  unsigned int pub_size;
+  if ((fbf->red_bits > 8) || (fbf->green_bits > 8) || (fbf->blue_bits > 8)) {
+    fprintf(stderr,
+      "Framebuffer format with more than 8 Bit per color not supported\n");
+    exit(1);
+  }
+  bypp = (fbf->bits_per_pixel + 7) / 8;
+  pub_size = fbi->fb_width * fbi->fb_height * bypp;
+  uv_mutex_lock(&rfbserv->pub_lock);
+  if (pub_size != rfbserv->pub_size) {
+    rfbserv->pub_size = pub_size;
+    rfbserv->pub_fb = realloc(rfbserv->pub_fb, pub_size);
+    if (!rfbserv->pub_fb) {
+      fprintf(stderr, "OOM: realloc of framebuffer %d bytes failed\n", pub_size);
+      exit(1);
+    }
+  }
+  rfbserv->pub_linebytes = fbi->fb_width * bypp;
+  rfbserv->pub_fbf = *fbf;
+  rfbserv->pub_fbf_changed = 1;
+  rfbserv->pub_y0 = 0;
+  rfbserv->pub_y1 = rfbserv->pub_height;
+  uv_mutex_unlock(&rfbserv->pub_lock);
+  AsyncManager_AsyncSend(rfbserv->wakeup);
+}
 
+/*
+ * -----------------------------------------------------------------------
+ * rfbserv_wakeup
+ *	Called in the AsyncManager thread after the display user published
+ *	changes. Copies the changed lines to the snapshot framebuffer and
+ *	encodes the updates for the connections which are waiting for one.
+ * -----------------------------------------------------------------------
+ */
+static void
+rfbserv_wakeup(AsyncHandle_t *handle, void *clientdata) {
+  RfbServer *rfbserv = clientdata;
+  FrameBufferInfo *fbi = &rfbserv->fbi;
+  RfbConnection *rcon;
+  unsigned int y0, y1;
+  uv_mutex_lock(&rfbserv->pub_lock);
+  if (rfbserv->pub_fbf_changed) {
+    rfbserv->pub_fbf_changed = 0;
+    rfbserv_apply_fbformat(rfbserv, &rfbserv->pub_fbf);
+  }
+  y0 = rfbserv->pub_y0;
+  y1 = rfbserv->pub_y1;
+  if (y0 < y1) {
+    memcpy(fbi->framebuffer + y0 * fbi->fb_linebytes,
+      rfbserv->pub_fb + y0 * fbi->fb_linebytes, (y1 - y0) * fbi->fb_linebytes);
+  }
+  rfbserv->pub_y0 = rfbserv->pub_y1 = 0;
+  uv_mutex_unlock(&rfbserv->pub_lock);
+  if (y0 >= y1) {
+    return;
+  }
+  for (rcon = rfbserv->con_head; rcon; rcon = rcon->next) {
+    if (rcon->dirty_y0 >= rcon->dirty_y1) {
+      rcon->dirty_y0 = y0;
+      rcon->dirty_y1 = y1;
+    } else {
+      if (y0 < rcon->dirty_y0) {
+        rcon->dirty_y0 = y0;
+      }
+      if (y1 > rcon->dirty_y1) {
+        rcon->dirty_y1 = y1;
+      }
+    }
+    trigger_fb_update(rcon);
+  }
 }
 
 /*
  * ----------------------------------------------------------------
  * rfbserv_update_display
  *	Called for example from a LCD controller emulator
- *	when it detects some change in framebuffer memory
+ *	when it detects some change in framebuffer memory.
+ *	The data is only published with the range of changed lines,
+ *	the comparison with the shadow framebuffers, the encoding and
+ *	the sending is done in the AsyncManager thread, so a slow
+ *	client does not stall the CPU.
  * ----------------------------------------------------------------
  */
 static int
 rfbserv_update_display(struct FbDisplay *fbdisp, FbUpdateRequest * fbudreq) {
   RfbServer *rfbserv = fbdisp->owner;
-  RfbConnection *rcon;
-  UpdateRectangle udrect;
-  FrameBufferInfo *fbi = &rfbserv->fbi;
   unsigned int start = fbudreq->offset;
   unsigned int count = fbudreq->count;
-  if (start > fbi->fb_size) {
+  unsigned int y0, y1;
+  uv_mutex_lock(&rfbserv->pub_lock);
+  if (start > rfbserv->pub_size) {
+    uv_mutex_unlock(&rfbserv->pub_lock);
     return -1;
   }
-  if (start + count > fbi->fb_size) {
-    count = fbi->fb_size - start;
+  if (start + count > rfbserv->pub_size) {
+    count = rfbserv->pub_size - start;
   }
-  /*
-   * Would be better to check the differences before overwriting
-   * also comparing differences should be delayed to time of sending the
-   * the data in a fileevent handler
-   */
-  memcpy(fbi->framebuffer + start, fbudreq->fbdata, count);
-  udrect.x = 0;
-  udrect.y = (start / fbi->fb_linebytes);
-  udrect.width = fbi->fb_width;
-  udrect.height = (count + fbi->fb_linebytes - 1) / (fbi->fb_linebytes);
-  if (udrect.height + udrect.y > fbi->fb_height) {
-    udrect.height = fbi->fb_height - udrect.y;
+  memcpy(rfbserv->pub_fb + start, fbudreq->fbdata, count);
+  y0 = start / rfbserv->pub_linebytes;
+  y1 = (start + count + rfbserv->pub_linebytes - 1) / rfbserv->pub_linebytes;
+  if (y1 > rfbserv->pub_height) {
+    y1 = rfbserv->pub_height;
   }
 #if 0
-  fprintf(stderr, "Got update request from LCD controller x %d ,y %d, w %d h %d\n", udrect.x,
-    udrect.y, udrect.width, udrect.height);
-  fprintf(stderr, "linebytes %d count %d\n", fbi->fb_linebytes, count);
+  fprintf(stderr, "Got update request from LCD controller y0 %d, y1 %d\n", y0, y1);
+  fprintf(stderr, "linebytes %d count %d\n", rfbserv->pub_linebytes, count);
 #endif
-  for (rcon = rfbserv->con_head; rcon; rcon = rcon->next) {
-    write_udrect_to_fifo(rcon, &udrect);
-    trigger_fb_update(rcon);
+  if (rfbserv->pub_y0 >= rfbserv->pub_y1) {
+    rfbserv->pub_y0 = y0;
+    rfbserv->pub_y1 = y1;
+  } else {
+    if (y0 < rfbserv->pub_y0) {
+      rfbserv->pub_y0 = y0;
+    }
+    if (y1 > rfbserv->pub_y1) {
+      rfbserv->pub_y1 = y1;
+    }
   }
+  uv_mutex_unlock(&rfbserv->pub_lock);
+  AsyncManager_AsyncSend(rfbserv->wakeup);
   return 0;
 }
 
@@ -1529,10 +1710,19 @@ RfbServer_New(const char *name, FbDisplay ** displayPP, Keyboard ** keyboardPP,
   pixf->blue_shift = 0;
   pixfmt_update_bits(pixf);
 
+  rfbserv->pub_size = fbi->fb_size;
+  rfbserv->pub_linebytes = fbi->fb_linebytes;
+  rfbserv->pub_height = fbi->fb_height;
+  rfbserv->pub_fb = sg_calloc(rfbserv->pub_size);
+  uv_mutex_init(&rfbserv->pub_lock);
+  rfbserv->wakeup = AsyncManager_AsyncInit(&rfbserv_wakeup, rfbserv);
+  if (!rfbserv->wakeup) {
+    fprintf(stderr, "Can not create RFB server\n");
+    exit(1);
+  }
   result = AsyncManager_InitTcpServer(host, port, 5, 1, &rfbsrv_accept, rfbserv);
   if (result < 0) {
     sg_free(fbi->framebuffer);
-    sg_free(rfbserv);
     fprintf(stderr, "Can not create RFB server\n");
     return;
   }
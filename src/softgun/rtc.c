@@ -8,6 +8,7 @@
 #include <time.h>
 #include <stdio.h>
 #include "rtc.h"
+#include "hosttime.h"
 
 static const uint16_t daysSinceJan1st[2][13] = {
     {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365},   // 365 days, non-leap
@@ -95,7 +96,7 @@ RTime_DiffToHostTime(const RTime *rtime)
         return 0;
     }
 
-    gettimeofday(&now, NULL);
+    HostTime_Get(&now);
     sys_utc_time = now.tv_sec;
 
     offset = ((int64_t) rtc_time - (int64_t) sys_utc_time) * (int64_t) 1000000;
@@ -118,7 +119,7 @@ RTime_ReadWithOffset(RTime *rtime, RTimeHostOfsUs timeOffsetUs)
     time_t time;
     struct tm tm;
     int32_t usec;
-    gettimeofday(&host_tv, NULL);
+    HostTime_Get(&host_tv);
     time = host_tv.tv_sec;
     time += (timeOffsetUs / (int64_t) 1000000);
     usec = host_tv.tv_usec + (timeOffsetUs % 1000000);
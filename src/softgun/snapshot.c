@@ -0,0 +1,696 @@
+//===-- softgun/snapshot.c ----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Whole machine snapshots
+///
+/// File layout: Header, one directory entry per module, the module states
+/// and then the RAM banks, each starting on a page boundary.
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Main Module Header
+#include "snapshot.h"
+
+// Leigun Core Headers
+#include "configfile.h"
+#include "logging.h"
+#include "sgstring.h"
+
+// System headers
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define MOD_NAME "Snapshot"
+
+#define SNAPSHOT_MAGIC		"LGSNAP\r\n"
+#define SNAPSHOT_VERSION	(2)
+
+#define ENTRY_STATE	(1)
+#define ENTRY_MEMORY	(2)
+#define ENTRY_CLOCKS	(3)	/* The CycleCounters of all clock domains */
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct SnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_entries;
+	uint64_t cycles;
+	uint32_t cycle_rate;
+	uint32_t page_size;
+} SnapshotHeader;
+
+typedef struct SnapshotEntry {
+	char name[SNAPSHOT_NAME_LEN];
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+} SnapshotEntry;
+
+/* A registered module state or RAM bank */
+typedef struct SnapshotItem {
+	struct SnapshotItem *next;
+	char name[SNAPSHOT_NAME_LEN];
+	uint32_t type;
+	Snapshot_SaveProc *saveProc;
+	Snapshot_LoadProc *loadProc;
+	void *owner;
+	uint8_t *host_mem;
+	uint32_t size;
+} SnapshotItem;
+
+/* The serialized state of one module */
+struct Snapshot_s {
+	uint8_t *data;
+	size_t len;
+	size_t size;
+	size_t pos;
+};
+
+/* A CPU or device which has to register its state for a restore */
+typedef struct SnapshotRequirement {
+	struct SnapshotRequirement *next;
+	void *owner;
+	char *what;
+} SnapshotRequirement;
+
+typedef struct SavedTimer {
+	uint32_t isactive;
+	uint32_t reserved;
+	uint64_t remaining;
+} SavedTimer;
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+static SnapshotItem *itemHead = NULL;
+static SnapshotItem *itemTail = NULL;
+static SnapshotRequirement *requirements = NULL;
+static bool restored = false;
+static CycleTimer saveTimer;
+static char *saveFile = NULL;
+static uint32_t saveExit = 0;
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static uint64_t
+page_align(uint64_t offset, uint32_t page_size)
+{
+	return (offset + page_size - 1) & ~((uint64_t) page_size - 1);
+}
+
+static SnapshotItem *
+item_new(const char *name, uint32_t type)
+{
+	SnapshotItem *item;
+	if (strlen(name) >= SNAPSHOT_NAME_LEN) {
+		LOG_Error(MOD_NAME, "Name \"%s\" is too long", name);
+		exit(1);
+	}
+	for (item = itemHead; item; item = item->next) {
+		if (strcmp(item->name, name) == 0) {
+			LOG_Error(MOD_NAME, "\"%s\" is registered twice", name);
+			exit(1);
+		}
+	}
+	item = sg_new(SnapshotItem);
+	strcpy(item->name, name);
+	item->type = type;
+	if (itemTail) {
+		itemTail->next = item;
+	} else {
+		itemHead = item;
+	}
+	itemTail = item;
+	return item;
+}
+
+static const SnapshotEntry *
+find_entry(const SnapshotEntry *dir, uint32_t nr_entries, const SnapshotItem *item)
+{
+	uint32_t i;
+	for (i = 0; i < nr_entries; i++) {
+		if ((dir[i].type == item->type) && (strcmp(dir[i].name, item->name) == 0)) {
+			return &dir[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Every required owner needs a registered state or RAM bank. All
+ * missing ones are reported before the restore is refused.
+ * ----------------------------------------------------------------------
+ */
+static int
+check_requirements(void)
+{
+	SnapshotRequirement *req;
+	SnapshotItem *item;
+	int result = 0;
+	for (req = requirements; req; req = req->next) {
+		for (item = itemHead; item; item = item->next) {
+			if (item->owner == req->owner) {
+				break;
+			}
+		}
+		if (!item) {
+			LOG_Error(MOD_NAME, "%s has no snapshot support", req->what);
+			result = -1;
+		}
+	}
+	return result;
+}
+
+static uint32_t
+count_domains(void)
+{
+	CycleTimerDomain *domain;
+	uint32_t count = 0;
+	for (domain = CycleTimers_NextDomain(NULL); domain;
+	     domain = CycleTimers_NextDomain(domain)) {
+		count++;
+	}
+	return count;
+}
+
+static int
+write_all(int fd, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	while (len) {
+		ssize_t result = write(fd, p, len);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += result;
+		len -= result;
+	}
+	return 0;
+}
+
+static int
+pread_all(int fd, void *data, size_t len, uint64_t offset)
+{
+	uint8_t *p = data;
+	while (len) {
+		ssize_t result = pread(fd, p, len, offset);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		} else if (result == 0) {
+			errno = EIO;
+			return -1;
+		}
+		p += result;
+		offset += result;
+		len -= result;
+	}
+	return 0;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Copy-on-write mapping of a RAM bank from the snapshot file.
+ * Falls back to reading if the bank is not page aligned.
+ * ----------------------------------------------------------------------
+ */
+static int
+restore_memory(int fd, SnapshotItem *item, const SnapshotEntry *entry, uint32_t page_size)
+{
+	void *addr;
+	if ((((uintptr_t) item->host_mem) & (page_size - 1)) == 0) {
+		addr = mmap(item->host_mem, item->size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_FIXED, fd, entry->offset);
+		if (addr == item->host_mem) {
+			return 0;
+		}
+		LOG_Warn(MOD_NAME, "mmap of \"%s\" failed: %s", item->name, strerror(errno));
+	}
+	return pread_all(fd, item->host_mem, item->size, entry->offset);
+}
+
+static void
+save_timeout(void *clientData)
+{
+	if (Snapshot_Save(saveFile) < 0) {
+		LOG_Error(MOD_NAME, "Saving the snapshot to \"%s\" failed", saveFile);
+		exit(1);
+	}
+	if (saveExit) {
+		exit(0);
+	}
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+
+/*
+ * ----------------------------------------------------------------------
+ * Read the snapshot options from the global section and arm the
+ * timer for saving. Called after the board is created.
+ * ----------------------------------------------------------------------
+ */
+void
+Snapshot_Init(void)
+{
+	uint32_t snapshot_ms;
+	uint64_t cycles;
+	saveFile = Config_ReadVar("global", "snapshot_file");
+	if (!saveFile) {
+		return;
+	}
+	if (Config_ReadUInt32(&snapshot_ms, "global", "snapshot_ms") < 0) {
+		LOG_Error(MOD_NAME, "snapshot_file without snapshot_ms");
+		exit(1);
+	}
+	Config_ReadUInt32(&saveExit, "global", "snapshot_exit");
+	cycles = MillisecondsToCycles(snapshot_ms);
+	if (cycles < CycleCounter_Get()) {
+		LOG_Warn(MOD_NAME, "snapshot_ms is before the restored snapshot");
+		return;
+	}
+	CycleTimer_Init(&saveTimer, save_timeout, NULL);
+	CycleTimer_Add(&saveTimer, cycles - CycleCounter_Get(), save_timeout, NULL);
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Register the state of a module. The save proc writes the state
+ * with Snapshot_Write, the load proc reads it back in the same order.
+ * The name has to be unique and the same in every run.
+ * ----------------------------------------------------------------------
+ */
+void
+Snapshot_RegisterState(const char *name, Snapshot_SaveProc *save_proc,
+		       Snapshot_LoadProc *load_proc, void *owner)
+{
+	SnapshotItem *item = item_new(name, ENTRY_STATE);
+	item->saveProc = save_proc;
+	item->loadProc = load_proc;
+	item->owner = owner;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Register a RAM bank. Banks allocated with Snapshot_AllocMemory are
+ * restored by a copy-on-write mapping, other banks are read.
+ * ----------------------------------------------------------------------
+ */
+void
+Snapshot_RegisterMemory(const char *name, void *owner, uint8_t *host_mem, uint32_t size)
+{
+	SnapshotItem *item = item_new(name, ENTRY_MEMORY);
+	item->owner = owner;
+	item->host_mem = host_mem;
+	item->size = size;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Declare that the owner is a part of the machine which has to be
+ * restored. Called for every CPU and every memory mapped device, the
+ * owner has to register a state or a RAM bank with the same owner.
+ * ----------------------------------------------------------------------
+ */
+void
+Snapshot_RequireState(const char *what, void *owner)
+{
+	SnapshotRequirement *req;
+	for (req = requirements; req; req = req->next) {
+		if (req->owner == owner) {
+			return;
+		}
+	}
+	req = sg_new(SnapshotRequirement);
+	req->owner = owner;
+	req->what = sg_strdup(what);
+	req->next = requirements;
+	requirements = req;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Page aligned zeroed memory for RAM banks
+ * ----------------------------------------------------------------------
+ */
+uint8_t *
+Snapshot_AllocMemory(uint32_t size)
+{
+	void *mem = mmap(NULL, size ? size : 1, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		sg_oom(__FILE__, __LINE__);
+	}
+	return mem;
+}
+
+void
+Snapshot_Write(Snapshot_t *ss, const void *data, size_t len)
+{
+	if (ss->len + len > ss->size) {
+		ss->size = (ss->len + len) * 2;
+		ss->data = sg_realloc(ss->data, ss->size);
+	}
+	memcpy(ss->data + ss->len, data, len);
+	ss->len += len;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Returns -1 if the saved state is shorter than requested, for
+ * example because the module was saved by an older version.
+ * ----------------------------------------------------------------------
+ */
+int
+Snapshot_Read(Snapshot_t *ss, void *data, size_t len)
+{
+	if (ss->pos + len > ss->len) {
+		return -1;
+	}
+	memcpy(data, ss->data + ss->pos, len);
+	ss->pos += len;
+	return 0;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * A CycleTimer is saved with the cycles remaining until its timeout.
+ * The timer is restored with the proc and clientData it already has,
+ * so it has to be initialized with CycleTimer_Init when the module
+ * is created.
+ * ----------------------------------------------------------------------
+ */
+void
+Snapshot_WriteTimer(Snapshot_t *ss, CycleTimer *timer)
+{
+	SavedTimer st;
+	memset(&st, 0, sizeof(st));
+	st.isactive = CycleTimer_IsActive(timer) ? 1 : 0;
+	st.remaining = CycleTimer_GetRemaining(timer);
+	Snapshot_Write(ss, &st, sizeof(st));
+}
+
+int
+Snapshot_ReadTimer(Snapshot_t *ss, CycleTimer *timer)
+{
+	SavedTimer st;
+	if (Snapshot_Read(ss, &st, sizeof(st)) < 0) {
+		return -1;
+	}
+	CycleTimer_Remove(timer);
+	if (st.isactive) {
+		CycleTimer_Add(timer, st.remaining, timer->proc, timer->clientData);
+	}
+	return 0;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Write a snapshot of the machine. Has to be called from the CPU
+ * thread between two instructions, for example from a CycleTimer.
+ * Other CPUs are not stopped, their state is at most one GlobalClock
+ * quantum apart. The file is written under a temporary name and renamed, so a
+ * concurrently starting instance never maps a half written snapshot.
+ * ----------------------------------------------------------------------
+ */
+int
+Snapshot_Save(const char *path)
+{
+	SnapshotHeader hdr;
+	SnapshotEntry *dir;
+	Snapshot_t *states;
+	SnapshotItem *item;
+	CycleTimerDomain *domain;
+	uint64_t *counters;
+	uint32_t nr_domains = count_domains();
+	uint32_t nr_entries = 0;
+	uint32_t page_size = (uint32_t) sysconf(_SC_PAGESIZE);
+	uint64_t offset;
+	uint32_t i;
+	char *tmppath;
+	int fd;
+	int result = -1;
+
+	for (item = itemHead; item; item = item->next) {
+		nr_entries++;
+	}
+	/* The last directory entry holds the CycleCounters */
+	dir = sg_calloc(sizeof(*dir) * (nr_entries + 1));
+	states = sg_calloc(sizeof(*states) * (nr_entries + 1));
+	counters = sg_calloc(sizeof(*counters) * (nr_domains + 1));
+	for (i = 0, domain = CycleTimers_NextDomain(NULL); domain;
+	     domain = CycleTimers_NextDomain(domain), i++) {
+		counters[i] = domain->cycleCounter;
+	}
+	offset = sizeof(hdr) + sizeof(*dir) * (nr_entries + 1);
+	strcpy(dir[nr_entries].name, "clock domains");
+	dir[nr_entries].type = ENTRY_CLOCKS;
+	dir[nr_entries].offset = offset;
+	dir[nr_entries].size = sizeof(*counters) * nr_domains;
+	offset += dir[nr_entries].size;
+	for (i = 0, item = itemHead; item; item = item->next, i++) {
+		strcpy(dir[i].name, item->name);
+		dir[i].type = item->type;
+		if (item->type == ENTRY_STATE) {
+			item->saveProc(item->owner, &states[i]);
+			dir[i].offset = offset;
+			dir[i].size = states[i].len;
+			offset += states[i].len;
+		}
+	}
+	for (i = 0, item = itemHead; item; item = item->next, i++) {
+		if (item->type == ENTRY_MEMORY) {
+			offset = page_align(offset, page_size);
+			dir[i].offset = offset;
+			dir[i].size = item->size;
+			offset += item->size;
+		}
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+	hdr.version = SNAPSHOT_VERSION;
+	hdr.nr_entries = nr_entries + 1;
+	hdr.cycles = CycleCounter_Get();
+	hdr.cycle_rate = CycleTimerRate_Get();
+	hdr.page_size = page_size;
+
+	tmppath = alloca(strlen(path) + 8);
+	sprintf(tmppath, "%s.tmp", path);
+	fd = open(tmppath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		LOG_Error(MOD_NAME, "Can not open \"%s\": %s", tmppath, strerror(errno));
+		goto out;
+	}
+	if ((write_all(fd, &hdr, sizeof(hdr)) < 0)
+	    || (write_all(fd, dir, sizeof(*dir) * (nr_entries + 1)) < 0)
+	    || (write_all(fd, counters, dir[nr_entries].size) < 0)) {
+		goto out_close;
+	}
+	for (i = 0, item = itemHead; item; item = item->next, i++) {
+		if ((item->type == ENTRY_STATE)
+		    && (write_all(fd, states[i].data, states[i].len) < 0)) {
+			goto out_close;
+		}
+	}
+	for (i = 0, item = itemHead; item; item = item->next, i++) {
+		if ((item->type == ENTRY_MEMORY)
+		    && ((lseek(fd, dir[i].offset, SEEK_SET) < 0)
+			|| (write_all(fd, item->host_mem, item->size) < 0))) {
+			goto out_close;
+		}
+	}
+	if (rename(tmppath, path) < 0) {
+		goto out_close;
+	}
+	LOG_Info(MOD_NAME, "Saved \"%s\" at cycle %" PRIu64, path, hdr.cycles);
+	result = 0;
+ out_close:
+	if (result < 0) {
+		LOG_Error(MOD_NAME, "Writing \"%s\" failed: %s", tmppath, strerror(errno));
+		unlink(tmppath);
+	}
+	close(fd);
+ out:
+	for (i = 0; i < nr_entries; i++) {
+		sg_free(states[i].data);
+	}
+	sg_free(states);
+	sg_free(counters);
+	sg_free(dir);
+	return result;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * Restore a snapshot. Called after the board is created and before
+ * the clocks are started. Refused if a CPU or a memory mapped device
+ * has not registered its state. The CycleCounters of all clock domains
+ * are restored first, so the load procs can rearm their timers
+ * relative to them. Remaining timers without saved state, like the
+ * throttle timers, expire once right after the restore.
+ * ----------------------------------------------------------------------
+ */
+int
+Snapshot_Restore(const char *path)
+{
+	SnapshotHeader hdr;
+	SnapshotEntry *dir;
+	const SnapshotEntry *entry;
+	SnapshotItem *item;
+	Snapshot_t ss;
+	CycleTimerDomain *domain;
+	uint64_t *counters;
+	uint32_t nr_domains = count_domains();
+	uint32_t i;
+	int result = -1;
+	int fd;
+	if (check_requirements() < 0) {
+		LOG_Error(MOD_NAME, "The board can not be restored from a snapshot");
+		return -1;
+	}
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		LOG_Error(MOD_NAME, "Can not open \"%s\": %s", path, strerror(errno));
+		return -1;
+	}
+	if (pread_all(fd, &hdr, sizeof(hdr), 0) < 0) {
+		LOG_Error(MOD_NAME, "Can not read \"%s\"", path);
+		close(fd);
+		return -1;
+	}
+	if (memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic))
+	    || (hdr.version != SNAPSHOT_VERSION)) {
+		LOG_Error(MOD_NAME, "\"%s\" is not a snapshot of this version", path);
+		close(fd);
+		return -1;
+	}
+	if (hdr.cycle_rate != CycleTimerRate_Get()) {
+		LOG_Warn(MOD_NAME, "CPU clock was %" PRIu32 " Hz, now %" PRIu32 " Hz",
+			 hdr.cycle_rate, CycleTimerRate_Get());
+	}
+	dir = sg_calloc(sizeof(*dir) * (hdr.nr_entries + 1));
+	if (pread_all(fd, dir, sizeof(*dir) * hdr.nr_entries, sizeof(hdr)) < 0) {
+		LOG_Error(MOD_NAME, "Can not read the directory of \"%s\"", path);
+		goto out;
+	}
+	for (i = 0; i < hdr.nr_entries; i++) {
+		dir[i].name[SNAPSHOT_NAME_LEN - 1] = 0;
+	}
+	for (i = 0; i < hdr.nr_entries; i++) {
+		if (dir[i].type == ENTRY_CLOCKS) {
+			break;
+		}
+	}
+	if ((i == hdr.nr_entries) || (dir[i].size != sizeof(*counters) * nr_domains)) {
+		LOG_Error(MOD_NAME, "The clock domains of \"%s\" do not match the board", path);
+		goto out;
+	}
+	counters = sg_calloc(dir[i].size + 1);
+	if (pread_all(fd, counters, dir[i].size, dir[i].offset) < 0) {
+		LOG_Error(MOD_NAME, "Can not read the CycleCounters of \"%s\"", path);
+		sg_free(counters);
+		goto out;
+	}
+	for (i = 0, domain = CycleTimers_NextDomain(NULL); domain;
+	     domain = CycleTimers_NextDomain(domain), i++) {
+		domain->cycleCounter = counters[i];
+	}
+	sg_free(counters);
+	for (item = itemHead; item; item = item->next) {
+		entry = find_entry(dir, hdr.nr_entries, item);
+		if (!entry) {
+			LOG_Error(MOD_NAME, "\"%s\" is not in the snapshot", item->name);
+			goto out;
+		}
+		if (item->type == ENTRY_MEMORY) {
+			if (entry->size != item->size) {
+				LOG_Error(MOD_NAME, "Size of \"%s\" does not match", item->name);
+				goto out;
+			}
+			if (restore_memory(fd, item, entry, hdr.page_size) < 0) {
+				LOG_Error(MOD_NAME, "Can not restore \"%s\": %s", item->name,
+					  strerror(errno));
+				goto out;
+			}
+			continue;
+		}
+		memset(&ss, 0, sizeof(ss));
+		ss.len = ss.size = entry->size;
+		ss.data = sg_calloc(ss.size + 1);
+		if (pread_all(fd, ss.data, ss.len, entry->offset) < 0) {
+			LOG_Error(MOD_NAME, "Can not read \"%s\"", item->name);
+			sg_free(ss.data);
+			goto out;
+		}
+		if (item->loadProc(item->owner, &ss) < 0) {
+			LOG_Error(MOD_NAME, "Restoring \"%s\" failed", item->name);
+			sg_free(ss.data);
+			goto out;
+		}
+		sg_free(ss.data);
+	}
+	restored = true;
+	result = 0;
+	LOG_Info(MOD_NAME, "Restored \"%s\" at cycle %" PRIu64, path, hdr.cycles);
+ out:
+	sg_free(dir);
+	close(fd);
+	return result;
+}
+
+/*
+ * ----------------------------------------------------------------------
+ * True if the machine was restored from a snapshot. The CPUs do not
+ * set their start address then.
+ * ----------------------------------------------------------------------
+ */
+bool
+Snapshot_Restored(void)
+{
+	return restored;
+}
@@ -0,0 +1,88 @@
+//===-- softgun/snapshot.h ----------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Whole machine snapshots
+///
+/// A snapshot file contains the CycleCounter of every clock domain, the
+/// state of every registered module (CPU, MMU, devices) and the contents of
+/// the registered RAM banks. The board is created from the configuration
+/// file as usual, then "-r <snapshot>" overwrites the reset state with the
+/// saved state. The CPUs and the memory mapped devices are required to
+/// register their state, the restore fails if one of them did not, instead
+/// of continuing with a device in reset state.
+///
+/// The RAM contents are stored page aligned. On restore they are mapped
+/// copy-on-write (MAP_PRIVATE) over the RAM banks, so parallel instances
+/// restored from one snapshot share the unmodified pages.
+///
+/// A snapshot is written when the virtual time reaches "snapshot_ms" in the
+/// global section. It goes to "snapshot_file", "snapshot_exit: 1" ends the
+/// simulator afterwards.
+///
+//===----------------------------------------------------------------------===//
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+// Leigun Core Headers
+#include "cycletimer.h"
+
+// System headers
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define SNAPSHOT_NAME_LEN	(48)
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct Snapshot_s Snapshot_t;
+
+typedef void Snapshot_SaveProc(void *owner, Snapshot_t *ss);
+typedef int Snapshot_LoadProc(void *owner, Snapshot_t *ss);
+
+
+//==============================================================================
+//= Functions
+//==============================================================================
+void Snapshot_Init(void);
+void Snapshot_RegisterState(const char *name, Snapshot_SaveProc *save_proc,
+			    Snapshot_LoadProc *load_proc, void *owner);
+void Snapshot_RegisterMemory(const char *name, void *owner, uint8_t *host_mem, uint32_t size);
+void Snapshot_RequireState(const char *what, void *owner);
+uint8_t *Snapshot_AllocMemory(uint32_t size);
+
+void Snapshot_Write(Snapshot_t *ss, const void *data, size_t len);
+int Snapshot_Read(Snapshot_t *ss, void *data, size_t len);
+void Snapshot_WriteTimer(Snapshot_t *ss, CycleTimer *timer);
+int Snapshot_ReadTimer(Snapshot_t *ss, CycleTimer *timer);
+
+int Snapshot_Save(const char *path);
+int Snapshot_Restore(const char *path);
+bool Snapshot_Restored(void);
+
+#endif
@@ -61,11 +61,15 @@
 
 #include "asyncmanager.h"
 #include "byteorder.h"
+#include "cycletimer.h"
 #include "device.h"
 #include "exithandler.h"
 #include "globalclock.h"
 #include "lib.h"
 #include "logging.h"
+#include "pacer.h"
+#include "hosttime.h"
+#include "snapshot.h"
 
 typedef struct LoadChainEntry {
 	struct LoadChainEntry *next;
@@ -78,6 +82,7 @@ typedef struct LoadChainEntry {
 static const char *configfpath = NULL;
 static const char *configname = "defaultboard";
 static LoadChainEntry *loadChainHead = NULL;
+static const char *snapshotPath = NULL;
 
 static void
 LoadChain_Append(const char *addr_string, const char *filename)
@@ -167,6 +172,7 @@ help()
 	fprintf(stderr, "-l <loadaddr | region> <file>:  Load a file to address or region\n");
 	fprintf(stderr, "-c <configfile_path>:           Use alternate configfile\n");
 	fprintf(stderr, "-g <startaddr>:                 Use non default startaddress\n");
+	fprintf(stderr, "-r <snapshot>:                  Restore the machine from a snapshot\n");
 	fprintf(stderr,
 		"-d                              Debug: Do not start. Wait for gdb connection\n");
 	fprintf(stderr, "\n");
@@ -254,6 +260,18 @@ parse_commandline(int argc, char *argv[])
 				    }
 				    break;
 
+			    case 'r':
+				    if (argc > 1) {
+					    snapshotPath = argv[1];
+					    argc--;
+					    argv++;
+				    } else {
+					    LOG_Error("MAIN", "Missing name of snapshot file");
+					    help();
+					    exit(245);
+				    }
+				    break;
+
 			    default:
 				    LOG_Error("MAIN", "unknown argument \"%s\"", argv[0]);
 				    help();
@@ -278,6 +296,8 @@ int
 main(int argc, char *argv[])
 {
 	const char *boardname;
+	uint32_t clock_skew_us;
+	uint32_t clock_realtime = 0;
 #ifdef __unix
 	struct timeval tv;
 	uint64_t seedval;
@@ -313,9 +333,35 @@ main(int argc, char *argv[])
 	DbgVars_Init();
 #endif
 	read_configfile();
+	HostTime_Init();
+	/* The deterministic run mode uses lockstep clocks without pacing */
+	if (!HostTime_Deterministic()
+	    && (Config_ReadUInt32(&clock_skew_us, "global", "clock_skew_us") >= 0)) {
+		/* Relaxed synchronization of the CPUs with bounded skew */
+		uint32_t quantum_us = 1000;
+		Config_ReadUInt32(&quantum_us, "global", "clock_quantum_us");
+		if (GlobalClock_SetRelaxed((uint64_t)quantum_us * 1000,
+					   (uint64_t)clock_skew_us * 1000) < 0) {
+			LOG_Error("MAIN", "GlobalClock_SetRelaxed failed.");
+			exit(1);
+		}
+	}
+	Config_ReadUInt32(&clock_realtime, "global", "clock_realtime");
+	if (clock_realtime && !HostTime_Deterministic()) {
+		/* Pace the clocks to the real time by sleeping */
+		uint32_t catchup_ms = PACER_DEFAULT_MAX_LAG_NS / 1000000;
+		Config_ReadUInt32(&catchup_ms, "global", "clock_catchup_ms");
+		if (GlobalClock_SetRealtime((uint64_t)catchup_ms * 1000000) < 0) {
+			LOG_Error("MAIN", "GlobalClock_SetRealtime failed.");
+			exit(1);
+		}
+	}
 #ifdef __unix
 	if (Config_ReadUInt64(&seedval, "global", "random_seed") >= 0) {
 		LOG_Info("MAIN", "Random Seed from Configuration file: %" PRIu64, seedval);
+	} else if (HostTime_Deterministic()) {
+		seedval = 0;
+		LOG_Info("MAIN", "Fixed Random Seed %" PRIu64, seedval);
 	} else {
 		gettimeofday(&tv, NULL);
 		seedval = tv.tv_usec + ((uint64_t) tv.tv_sec << 20);
@@ -335,11 +381,20 @@ main(int argc, char *argv[])
 		LOG_Error("MAIN", "Board(%s) Not Found", boardname);
 		exit(1);
 	}
+	/* Loading and the snapshot timer work in the domain of the first CPU */
+	CycleTimers_SelectPrimaryDomain();
 	LoadChain_Resolve();
-	if (LoadChain_Load() < 0) {
+	if (snapshotPath) {
+		/* The snapshot replaces the loaded images and the boot */
+		if (Snapshot_Restore(snapshotPath) < 0) {
+			LOG_Error("MAIN", "Restoring snapshot %s failed", snapshotPath);
+			exit(1);
+		}
+	} else if (LoadChain_Load() < 0) {
 		LOG_Error("MAIN", "Loading failed");
 		exit(1);
 	}
+	Snapshot_Init();
 #ifdef __unix
 	Senseless_Init();
 #endif
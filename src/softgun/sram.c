@@ -40,6 +40,7 @@
 #include "bus.h"
 #include "configfile.h"
 #include "sgstring.h"
+#include "snapshot.h"
 
 typedef struct SRam {
 	BusDevice bdev;
@@ -105,8 +106,9 @@ SRam_New(char *sram_name)
 		return NULL;
 	}
 	sram = sg_new(SRam);
-	sram->host_mem = sg_calloc(size);
+	sram->host_mem = Snapshot_AllocMemory(size);
 	memset(sram->host_mem, 0xff, size);
+	Snapshot_RegisterMemory(sram_name, sram, sram->host_mem, size);
 	sram->size = size;
 	sram->bdev.first_mapping = NULL;
 	sram->bdev.Map = SRam_Map;
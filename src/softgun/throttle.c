@@ -42,13 +42,15 @@
 #include "sgstring.h"
 #include "throttle.h"
 #include "configfile.h"
+#include "pacer.h"
+#include "hosttime.h"
+
+#define THROTTLES_PER_SECOND	(100)
 
 struct Throttle {
-	struct timespec tv_last_throttle;
+	Pacer_t *pacer;
 	CycleCounter_t last_throttle_cycles;
 	CycleTimer throttle_timer;
-	int64_t cycles_ahead;	/* Number of cycles ahead of real cpu */
-	uint32_t sleepsPerSecond;
 	/* Control loop for the sound */
 	SigNode *sigSpeedUp;
 	SigNode *sigSpeedDown;
@@ -57,8 +59,8 @@ struct Throttle {
 /**
  ******************************************************************
  * \fn static void throttle_proc(void *clientData)
- * Timer handler checking if the cpu cycles is ahead of the
- * excpected cycle counter. If yes sleep for some time. 
+ * Timer handler passing the simulated time to the pacer which
+ * sleeps if the CPU is ahead of the real time.
  * The CPU speed can be varied by some percent using a "Speed Up"
  * and "Speed Down" signal from outside. This is used by the
  * sound backend for adjusting the CPU speed exactly to the
@@ -69,63 +71,32 @@ static void
 throttle_proc(void *clientData)
 {
 	Throttle *th = (Throttle *) clientData;
-	struct timespec tv_now;
-	uint32_t nsecs;
-	uint32_t sleepCnt = 0;
-	int64_t exp_cpu_cycles, done_cpu_cycles;
-	done_cpu_cycles = CycleCounter_Get() - th->last_throttle_cycles;
-	th->cycles_ahead += done_cpu_cycles;
-	do {
-		struct timespec tout;
-		tout.tv_nsec = 200 * 1000; /* 0.2 ms */
-		tout.tv_sec = 0;
-
-#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
-		timespec_get(&tv_now, TIME_UTC);
-#else
-		clock_gettime(CLOCK_MONOTONIC, &tv_now);
-#endif
-		nsecs = (tv_now.tv_nsec - th->tv_last_throttle.tv_nsec) +
-		    (int64_t) 1000000000 * (tv_now.tv_sec - th->tv_last_throttle.tv_sec);
-		exp_cpu_cycles = NanosecondsToCycles(nsecs);
-		if (SigNode_Val(th->sigSpeedUp) == SIG_HIGH) {
-			exp_cpu_cycles += exp_cpu_cycles >> 4;
-		} else if (SigNode_Val(th->sigSpeedDown) == SIG_HIGH) {
-			exp_cpu_cycles -= exp_cpu_cycles >> 4;
-		}
-		if (th->cycles_ahead > exp_cpu_cycles) {
-			//FIXME: FIO_WaitEventTimeout(&tout);
-			sleepCnt++;
-		}
-	} while (th->cycles_ahead > exp_cpu_cycles);
-	th->cycles_ahead -= exp_cpu_cycles;
-	th->last_throttle_cycles = CycleCounter_Get();
-	th->tv_last_throttle = tv_now;
-	/*  
-	 **********************************************************
-	 * Forget about catch up if CPU is more than on second 
-	 * behind to avoid a longer phase of overspeed. Sound
-	 * doesn't like it !
-	 **********************************************************
-	 */
-	if (-th->cycles_ahead > (CycleTimerRate_Get() >> 2)) {
-		th->cycles_ahead = 0;
+	int64_t nsecs;
+	nsecs = CyclesToNanoseconds(CycleCounter_Get() - th->last_throttle_cycles);
+	if (SigNode_Val(th->sigSpeedUp) == SIG_HIGH) {
+		nsecs -= nsecs >> 4;
+	} else if (SigNode_Val(th->sigSpeedDown) == SIG_HIGH) {
+		nsecs += nsecs >> 4;
 	}
-	if(sleepCnt > 1) {
-		th->sleepsPerSecond = th->sleepsPerSecond + 1 + (th->sleepsPerSecond >> 8);
-	//	fprintf(stderr,"SleepCnt is %u, sps %u\n",sleepCnt,th->sleepsPerSecond);
-	} else if((sleepCnt == 0) && (th->sleepsPerSecond > 40)) {
-		th->sleepsPerSecond--;
-	//fprintf(stderr,"SleepCnt is %u, sps %u\n",sleepCnt,th->sleepsPerSecond);
-	}
-	CycleTimer_Mod(&th->throttle_timer, CycleTimerRate_Get() / th->sleepsPerSecond);
-	return;
+	th->last_throttle_cycles = CycleCounter_Get();
+	Pacer_Advance(th->pacer, nsecs);
+	CycleTimer_Mod(&th->throttle_timer, CycleTimerRate_Get() / THROTTLES_PER_SECOND);
 }
 
+/*
+ * ------------------------------------------------------------------
+ * Configuration in the section of the CPU:
+ *	throttle: 0 disables the throttle. Always disabled in the
+ *		deterministic run mode.
+ *	throttle_catchup_ms: the lag which is caught up by overspeed.
+ *		The default of 250 ms is short enough for the sound.
+ * ------------------------------------------------------------------
+ */
 Throttle *
 Throttle_New(const char *name)
 {
 	uint32_t throttle_enable = 1;
+	uint32_t catchup_ms = PACER_DEFAULT_MAX_LAG_NS / 1000000;
 	Throttle *th = sg_new(Throttle);
 	th->sigSpeedUp = SigNode_New("%s.throttle.speedUp", name);
 	th->sigSpeedDown = SigNode_New("%s.throttle.speedDown", name);
@@ -135,16 +106,16 @@ Throttle_New(const char *name)
 	}
 	SigNode_Set(th->sigSpeedUp, SIG_PULLDOWN);
 	SigNode_Set(th->sigSpeedDown, SIG_PULLDOWN);
-#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
-	timespec_get(&th->tv_last_throttle, TIME_UTC);
-#else
-	clock_gettime(CLOCK_MONOTONIC, &th->tv_last_throttle);
-#endif
-	th->last_throttle_cycles = 0;
-	th->sleepsPerSecond = 100; /* Start Value, Sleep 100 times per second */
+	Config_ReadUInt32(&catchup_ms, name, "throttle_catchup_ms");
+	th->pacer = Pacer_New(name, (uint64_t) catchup_ms * 1000000);
+	if (!th->pacer) {
+		exit(1);
+	}
+	th->last_throttle_cycles = CycleCounter_Get();
 	Config_ReadUInt32(&throttle_enable, name, "throttle");
-	if (throttle_enable) {
-		CycleTimer_Add(&th->throttle_timer, CycleTimerRate_Get() / 40, throttle_proc, th);
+	if (throttle_enable && !HostTime_Deterministic()) {
+		CycleTimer_Add(&th->throttle_timer, CycleTimerRate_Get() / THROTTLES_PER_SECOND,
+			       throttle_proc, th);
 	}
 	return th;
 }
@@ -17,6 +17,7 @@
 //===----------------------------------------------------------------------===//
 ///
 /// @file
+/// List of timers counted down by the thread which owns the list
 ///
 //===----------------------------------------------------------------------===//
 
@@ -28,70 +29,166 @@
 
 // Local/Private Headers
 #include "leigun.h"
-#include "list.h"
 
 // External headers
 #include <uv.h>
 
 // System headers
-#include <stdlib.h> // for malloc
+#include <stdbool.h>
+#include <stdlib.h> // for calloc
 
 
 //==============================================================================
 //= Constants(also Enumerations)
 //==============================================================================
+// Request posted by TimerList_Remove, all other values are counts
+#define TIMERLIST_CANCEL (~(uint64_t)0)
 
 
 //==============================================================================
 //= Types
 //==============================================================================
-typedef struct TimerList_Element_s {
-    List_Element_t liste;
-    uint64_t cnt;
-    TimerList_cb cb;
-    void *data;
-} TimerList_Element_t;
-
 struct TimerList_s {
-    List_t list;
-    uv_mutex_t list_mutex;
+    TimerList_Timer_t *head;
+    TimerList_Timer_t *tail;
+    uint64_t now;
+    TimerList_Timer_t *inbox;
+    uv_thread_t owner;
+    int owned;
 };
 
 
 //==============================================================================
 //= Function declarations(static)
 //==============================================================================
-static int TimerList_insert(TimerList_Element_t *e, TimerList_Element_t *cur);
+static bool TimerList_isOwner(TimerList_t *l);
+static void TimerList_unlink(TimerList_t *l, TimerList_Timer_t *t);
+static void TimerList_link(TimerList_t *l, TimerList_Timer_t *t, uint64_t cnt);
+static void TimerList_post(TimerList_t *l, TimerList_Timer_t *t,
+                           uint64_t request);
+static void TimerList_drain(TimerList_t *l);
 
 
 //==============================================================================
 //= Variables
-//==============================================================================d
+//==============================================================================
 
 
 //==============================================================================
 //= Function definitions(static)
 //==============================================================================
+//===----------------------------------------------------------------------===//
+/// The owner is bound by the first call of TimerList_Fire. Before that all
+/// requests go through the inbox.
+//===----------------------------------------------------------------------===//
+static bool TimerList_isOwner(TimerList_t *l) {
+    uv_thread_t self;
+    if (!__atomic_load_n(&l->owned, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    self = uv_thread_self();
+    return uv_thread_equal(&l->owner, &self) != 0;
+}
+
 //===----------------------------------------------------------------------===//
 ///
 //===----------------------------------------------------------------------===//
-static int TimerList_insert(TimerList_Element_t *e, TimerList_Element_t *cur) {
-    if (!cur) {
-        return -1;
+static void TimerList_unlink(TimerList_t *l, TimerList_Timer_t *t) {
+    if (!t->queued) {
+        return;
+    }
+    if (t->prev) {
+        t->prev->next = t->next;
+    } else {
+        l->head = t->next;
     }
-    if (e->cnt < cur->cnt) {
-        cur->cnt -= e->cnt;
-        return -1;
+    if (t->next) {
+        t->next->prev = t->prev;
+    } else {
+        l->tail = t->prev;
     }
-    e->cnt -= cur->cnt;
-    return 1;
+    t->next = t->prev = NULL;
+    t->queued = 0;
 }
 
 //===----------------------------------------------------------------------===//
-///
+/// The list is sorted by the absolute expire count. Timers are mostly
+/// inserted with a later expire count than the present ones, so the search
+/// starts at the tail. Timers with the same count fire in insertion order.
+//===----------------------------------------------------------------------===//
+static void TimerList_link(TimerList_t *l, TimerList_Timer_t *t, uint64_t cnt) {
+    TimerList_Timer_t *cur;
+    TimerList_unlink(l, t);
+    t->expire = l->now + cnt;
+    if (t->expire < l->now) {
+        t->expire = UINT64_MAX;
+    }
+    for (cur = l->tail; cur && (cur->expire > t->expire); cur = cur->prev) {
+    }
+    t->prev = cur;
+    if (cur) {
+        t->next = cur->next;
+        cur->next = t;
+    } else {
+        t->next = l->head;
+        l->head = t;
+    }
+    if (t->next) {
+        t->next->prev = t;
+    } else {
+        l->tail = t;
+    }
+    t->queued = 1;
+}
+
+//===----------------------------------------------------------------------===//
+/// Multi producer push into the inbox. A timer is in the inbox at most once,
+/// a newer request only replaces the value. The request has to be stored
+/// before pending is tested, and the owner clears pending before it reads
+/// the request, so either the owner sees the new request or the timer is
+/// pushed again.
+//===----------------------------------------------------------------------===//
+static void TimerList_post(TimerList_t *l, TimerList_Timer_t *t,
+                           uint64_t request) {
+    TimerList_Timer_t *head;
+    __atomic_store_n(&t->request, request, __ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&t->pending, 1, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    head = __atomic_load_n(&l->inbox, __ATOMIC_RELAXED);
+    do {
+        t->inbox_next = head;
+    } while (!__atomic_compare_exchange_n(&l->inbox, &head, t, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+//===----------------------------------------------------------------------===//
+/// Apply the requests of the inbox in the order they were posted
 //===----------------------------------------------------------------------===//
-static int TimerList_compare(TimerList_Element_t *e, TimerList_Element_t *cur) {
-    return ((e->cb == cur->cb) && (e->data == cur->data));
+static void TimerList_drain(TimerList_t *l) {
+    TimerList_Timer_t *t;
+    TimerList_Timer_t *next;
+    TimerList_Timer_t *fifo = NULL;
+    uint64_t request;
+    if (!__atomic_load_n(&l->inbox, __ATOMIC_RELAXED)) {
+        return;
+    }
+    t = __atomic_exchange_n(&l->inbox, NULL, __ATOMIC_ACQUIRE);
+    for (; t; t = next) {
+        next = t->inbox_next;
+        t->inbox_next = fifo;
+        fifo = t;
+    }
+    for (t = fifo; t; t = next) {
+        next = t->inbox_next;
+        __atomic_store_n(&t->pending, 0, __ATOMIC_SEQ_CST);
+        request = __atomic_load_n(&t->request, __ATOMIC_SEQ_CST);
+        if (request == TIMERLIST_CANCEL) {
+            TimerList_unlink(l, t);
+        } else {
+            TimerList_link(l, t, request);
+        }
+    }
 }
 
 
@@ -104,10 +201,6 @@ static int TimerList_compare(TimerList_Element_t *e, TimerList_Element_t *cur) {
 //===----------------------------------------------------------------------===//
 TimerList_t *TimerList_New(void) {
     TimerList_t *l = LEIGUN_NEW(l);
-    if (l) {
-        List_Init(&l->list);
-        uv_mutex_init(&l->list_mutex);
-    }
     return l;
 }
 
@@ -115,56 +208,60 @@ TimerList_t *TimerList_New(void) {
 //===----------------------------------------------------------------------===//
 ///
 //===----------------------------------------------------------------------===//
-int TimerList_Insert(TimerList_t *l, uint64_t cnt, TimerList_cb cb,
-                     void *data) {
-    TimerList_Element_t *e = LEIGUN_NEW(e);
-    if (!e) {
-        return UV_EAI_MEMORY;
-    }
-    List_InitElement(&e->liste);
-    e->cnt = cnt;
-    e->cb = cb;
-    e->data = data;
-    uv_mutex_lock(&l->list_mutex);
-    List_Insert(&l->list, (List_Insert_cb)&TimerList_insert, &e->liste);
-    uv_mutex_unlock(&l->list_mutex);
-    return 0;
+void TimerList_InitTimer(TimerList_Timer_t *t, TimerList_cb cb, void *data) {
+    t->next = t->prev = t->inbox_next = NULL;
+    t->expire = 0;
+    t->request = 0;
+    t->pending = 0;
+    t->queued = 0;
+    t->cb = cb;
+    t->data = data;
 }
 
 
 //===----------------------------------------------------------------------===//
-///
+/// Start the timer, it fires after cnt counts. An active timer is restarted.
 //===----------------------------------------------------------------------===//
-void TimerList_Remove(TimerList_t *l, TimerList_cb cb, void *data) {
-    TimerList_Element_t e = {.cb = cb, .data = data};
-    TimerList_Element_t *cur;
-    uv_mutex_lock(&l->list_mutex);
-    cur = List_PopBy(&l->list, (List_Compare_cb)&TimerList_compare, &e.liste);
-    uv_mutex_unlock(&l->list_mutex);
-    free(cur);
+void TimerList_Insert(TimerList_t *l, TimerList_Timer_t *t, uint64_t cnt) {
+    if (cnt == TIMERLIST_CANCEL) {
+        cnt--;
+    }
+    if (TimerList_isOwner(l) && !__atomic_load_n(&t->pending, __ATOMIC_SEQ_CST)) {
+        TimerList_link(l, t, cnt);
+    } else {
+        TimerList_post(l, t, cnt);
+    }
 }
 
 
 //===----------------------------------------------------------------------===//
 ///
 //===----------------------------------------------------------------------===//
+void TimerList_Remove(TimerList_t *l, TimerList_Timer_t *t) {
+    if (TimerList_isOwner(l) && !__atomic_load_n(&t->pending, __ATOMIC_SEQ_CST)) {
+        TimerList_unlink(l, t);
+    } else {
+        TimerList_post(l, t, TIMERLIST_CANCEL);
+    }
+}
+
+
+//===----------------------------------------------------------------------===//
+/// Advance the list by inc counts and fire the expired timers. Must always be
+/// called from the same thread.
+//===----------------------------------------------------------------------===//
 void TimerList_Fire(TimerList_t *l, uint64_t inc) {
-    TimerList_Element_t e = {.cnt = inc};
-    TimerList_Element_t *cur;
-    int ret;
-    for (;;) {
-        uv_mutex_lock(&l->list_mutex);
-        cur = List_Head(&l->list);
-        ret = TimerList_insert(&e, cur);
-        if (ret < 0) {
-            uv_mutex_unlock(&l->list_mutex);
-            break;
-        }
-        List_Pop(&l->list);
-        uv_mutex_unlock(&l->list_mutex);
-        if (cur->cb) {
-            cur->cb(cur->data);
+    TimerList_Timer_t *t;
+    if (!l->owned) {
+        l->owner = uv_thread_self();
+        __atomic_store_n(&l->owned, 1, __ATOMIC_RELEASE);
+    }
+    TimerList_drain(l);
+    l->now += inc;
+    while ((t = l->head) && (t->expire <= l->now)) {
+        TimerList_unlink(l, t);
+        if (t->cb) {
+            t->cb(t->data);
         }
-        free(cur);
     }
 }
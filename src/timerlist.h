@@ -17,6 +17,13 @@
 //===----------------------------------------------------------------------===//
 ///
 /// @file
+/// List of timers counted down by the thread which owns the list
+///
+/// The timers are intrusive, the caller provides the memory. The owner is the
+/// thread calling TimerList_Fire. It inserts and removes timers directly
+/// without locking. Other threads post their requests into a lock-free inbox
+/// which is applied by the owner on the next TimerList_Fire. If several
+/// requests for a timer are posted before they are applied, the last one wins.
 ///
 //===----------------------------------------------------------------------===//
 #pragma once
@@ -44,6 +51,20 @@ extern "C" {
 //==============================================================================
 typedef void (*TimerList_cb)(void *data);
 typedef struct TimerList_s TimerList_t;
+typedef struct TimerList_Timer_s TimerList_Timer_t;
+
+// All fields of TimerList_Timer_t are private !
+struct TimerList_Timer_s {
+    TimerList_Timer_t *next;
+    TimerList_Timer_t *prev;
+    TimerList_Timer_t *inbox_next;
+    uint64_t expire;
+    uint64_t request;
+    int pending;
+    int queued;
+    TimerList_cb cb;
+    void *data;
+};
 
 
 //==============================================================================
@@ -60,8 +81,9 @@ typedef struct TimerList_s TimerList_t;
 //= Functions
 //==============================================================================
 TimerList_t *TimerList_New(void);
-int TimerList_Insert(TimerList_t *l, uint64_t cnt, TimerList_cb cb, void *data);
-void TimerList_Remove(TimerList_t *l, TimerList_cb cb, void *data);
+void TimerList_InitTimer(TimerList_Timer_t *t, TimerList_cb cb, void *data);
+void TimerList_Insert(TimerList_t *l, TimerList_Timer_t *t, uint64_t cnt);
+void TimerList_Remove(TimerList_t *l, TimerList_Timer_t *t);
 void TimerList_Fire(TimerList_t *l, uint64_t inc);
 
 #ifdef __cplusplus
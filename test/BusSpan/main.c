@@ -0,0 +1,174 @@
+//===-- test/BusSpan/main.c ---------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Throughput benchmark for a 1 MB DMA copy through the bus
+///
+/// Compares the word by word copy of the DMA controllers with a copy
+/// through bus spans. The destination is mapped in small blocks so that
+/// the spans have to be merged from the two level map.
+///
+///   cc -O2 -Isrc -Isrc/softgun test/BusSpan/main.c src/softgun/bus.c
+///      src/softgun/sgstring.c -o busspan
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+#include "bus.h"
+#include "loader.h"
+#include "snapshot.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define COPY_SIZE	(1024 * 1024)
+#define ROUNDS		(50)
+#define SRC_ADDR	(0x20000000)
+#define DST_ADDR	(0x30000000)
+#define MIN_BLOCKSIZE	(1024)
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+static uint8_t *srcMem;
+static uint8_t *dstMem;
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static double
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void
+copy_words(uint32_t dst, uint32_t src, uint32_t len)
+{
+	uint32_t i;
+	for (i = 0; i < len; i += 4) {
+		Bus_Write32(Bus_Read32(src + i), dst + i);
+	}
+}
+
+static void
+copy_spans(uint32_t dst, uint32_t src, uint32_t len)
+{
+	uint32_t rlen, wlen;
+	uint8_t *s, *d;
+	while (len) {
+		rlen = Bus_GetReadSpan(src, len, &s);
+		wlen = Bus_GetWriteSpan(dst, len, &d);
+		if (!s || !d) {
+			fprintf(stderr, "Span is not memory\n");
+			exit(1);
+		}
+		if (wlen < rlen) {
+			rlen = wlen;
+		}
+		memmove(d, s, rlen);
+		src += rlen;
+		dst += rlen;
+		len -= rlen;
+	}
+}
+
+static int
+check(const char *name, double ms)
+{
+	if (memcmp(srcMem, dstMem, COPY_SIZE)) {
+		fprintf(stderr, "%s: copied data differs\n", name);
+		return 1;
+	}
+	printf("%-12s %8.1f MB/s\n", name, (double)COPY_SIZE * ROUNDS / (ms * 1e3));
+	memset(dstMem, 0, COPY_SIZE);
+	return 0;
+}
+
+/*
+ * -------------------------------------------------------
+ * Stub for the parts of the simulator the bus depends on
+ * -------------------------------------------------------
+ */
+int
+Loader_RegisterBus(const char *name, LoadProc * proc, void *clientData)
+{
+	return 0;
+}
+
+void
+Snapshot_RequireState(const char *what, void *owner)
+{
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+int
+main(void)
+{
+	uint32_t addr;
+	double start;
+	int errors = 0;
+	int i;
+	Bus_Init(NULL, MIN_BLOCKSIZE);
+	srcMem = malloc(COPY_SIZE);
+	dstMem = calloc(1, COPY_SIZE);
+	for (i = 0; i < COPY_SIZE; i++) {
+		srcMem[i] = rand();
+	}
+	Mem_MapRange(SRC_ADDR, srcMem, COPY_SIZE, COPY_SIZE,
+		     MEM_FLAG_READABLE | MEM_FLAG_WRITABLE);
+	for (addr = 0; addr < COPY_SIZE; addr += MIN_BLOCKSIZE) {
+		Mem_MapRange(DST_ADDR + addr, dstMem + addr, MIN_BLOCKSIZE, MIN_BLOCKSIZE,
+			     MEM_FLAG_READABLE | MEM_FLAG_WRITABLE);
+	}
+
+	start = now_ms();
+	for (i = 0; i < ROUNDS; i++) {
+		copy_words(DST_ADDR, SRC_ADDR, COPY_SIZE);
+	}
+	errors += check("word loop", now_ms() - start);
+
+	start = now_ms();
+	for (i = 0; i < ROUNDS; i++) {
+		Bus_Read(dstMem, SRC_ADDR, COPY_SIZE);
+	}
+	errors += check("Bus_Read", now_ms() - start);
+
+	start = now_ms();
+	for (i = 0; i < ROUNDS; i++) {
+		copy_spans(DST_ADDR, SRC_ADDR, COPY_SIZE);
+	}
+	errors += check("spans", now_ms() - start);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,412 @@
+//===-- test/CycleTimer/main.c ------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Microbenchmark for the CycleTimer backends
+///
+/// Simulates a CPU main loop with a peripheral like timer mix: UART
+/// timeouts which are re-armed before they expire, periodic system timers,
+/// long watchdog timeouts and short one shot delays (DMA, IO completion).
+/// Build it once for the timer wheel and once for the XY_Tree backend:
+///
+///   cc -O2 -Isrc -Isrc/softgun test/CycleTimer/main.c
+///      src/softgun/cycletimer.c src/softgun/xy_tree.c src/softgun/sgstring.c
+///      -lpthread -o ct_wheel
+///   cc -O2 -DCYCLETIMER_XYTREE ... -o ct_tree
+///
+/// Both binaries have to print the same number of expired timers.
+///
+/// Afterwards a second clock domain runs in its own thread, like a second
+/// CPU. The main thread posts, re-arms and cancels timers of this domain
+/// while it runs. Every timer which is not cancelled has to expire once,
+/// in the thread of its domain and not before its timeout.
+///
+/// Finally a third domain runs a re-arming timer whose period reaches
+/// beyond level 1 of the wheel, while the main thread keeps posting
+/// re-arms of other timers of this domain the whole time. The timers
+/// have to expire in the order of their timeouts, never early, and the
+/// periodic timer has to keep its rate.
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+#include "cycletimer.h"
+#include "clock.h"
+#include "globalclock.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define NR_UARTS	(8)
+#define NR_PERIODIC	(4)
+#define NR_WATCHDOGS	(16)
+#define NR_ONESHOTS	(64)
+#define NR_POSTED	(1000)
+#define NR_FLOOD	(64)
+#define FLOOD_PERIOD	(70000)	/* Cascaded from level 2 */
+#define FLOOD_PERIODS	(2000)
+#ifndef INSTRUCTIONS
+#define INSTRUCTIONS	(UINT64_C(100000000))
+#endif
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+static CycleTimer uartTimer[NR_UARTS];
+static CycleTimer periodicTimer[NR_PERIODIC];
+static CycleTimer watchdogTimer[NR_WATCHDOGS];
+static CycleTimer oneshotTimer[NR_ONESHOTS];
+static uint64_t periodicCycles[NR_PERIODIC] = { 10000, 33333, 200000, 2000000 };
+
+static CycleTimer postedTimer[NR_POSTED];
+static CycleTimerDomain *remoteDomain;
+static int remoteRunning;
+static int postingDone;
+static uint64_t postedExpired;
+
+static CycleTimer floodTimer[NR_FLOOD];
+static CycleTimer floodPeriodic;
+static CycleTimerDomain *floodDomain;
+static int floodRunning;
+static int floodDone;
+static uint64_t floodLast;
+static uint64_t floodExpired;
+static uint64_t floodPeriods;
+static uint64_t floodErrors;
+
+static uint64_t expired;
+static uint64_t errors;
+static uint64_t maxLate;
+static uint32_t lcg = 1;
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static inline uint32_t
+rnd(void)
+{
+	lcg = lcg * 1103515245 + 12345;
+	return lcg >> 8;
+}
+
+static void
+check_expire(CycleTimer * timer)
+{
+	/*
+	 * Only one timer expires per check, so timers with the same
+	 * timeout are a few cycles late. But never early.
+	 */
+	if (CycleCounter < timer->timeout) {
+		errors++;
+	} else if (CycleCounter - timer->timeout > maxLate) {
+		maxLate = CycleCounter - timer->timeout;
+	}
+	expired++;
+}
+
+static void
+uart_timeout(void *clientData)
+{
+	check_expire(clientData);
+}
+
+static void
+periodic_timeout(void *clientData)
+{
+	CycleTimer *timer = clientData;
+	check_expire(timer);
+	CycleTimer_Add(timer, periodicCycles[timer - periodicTimer], periodic_timeout, timer);
+}
+
+static void
+watchdog_timeout(void *clientData)
+{
+	check_expire(clientData);
+}
+
+static void
+oneshot_timeout(void *clientData)
+{
+	check_expire(clientData);
+}
+
+static void
+posted_timeout(void *clientData)
+{
+	if (CycleTimers_Domain() != remoteDomain) {
+		errors++;
+	}
+	check_expire(clientData);
+	postedExpired++;
+}
+
+/*
+ * ----------------------------------------------------------------
+ * The second CPU: owns its domain and runs until the main thread
+ * has posted everything and all timeouts have passed.
+ * ----------------------------------------------------------------
+ */
+static void *
+remote_cpu(void *arg)
+{
+	uint64_t i;
+	CycleTimers_SyncGlobalClock(remoteDomain, NULL);
+	__atomic_store_n(&remoteRunning, 1, __ATOMIC_SEQ_CST);
+	while (!__atomic_load_n(&postingDone, __ATOMIC_SEQ_CST)) {
+		CycleCounter += 2;
+		CycleTimers_Check();
+	}
+	for (i = 0; i < 1000000; i++) {
+		CycleCounter += 2;
+		CycleTimers_Check();
+	}
+	return NULL;
+}
+
+static int
+test_cross_domain(void)
+{
+	CycleTimerDomain *local = CycleTimers_Domain();
+	pthread_t thread;
+	int n, k;
+	int cancelled = 0;
+	remoteDomain = CycleTimers_Init("remote", 100000000);
+	CycleTimers_SelectDomain(local);
+	expired = errors = 0;
+	if (pthread_create(&thread, NULL, remote_cpu, NULL) != 0) {
+		return -1;
+	}
+	while (!__atomic_load_n(&remoteRunning, __ATOMIC_SEQ_CST)) {
+	}
+	for (n = 0; n < NR_POSTED; n++) {
+		CycleTimer_AddToDomain(remoteDomain, &postedTimer[n], UINT64_C(1) << 40,
+				       posted_timeout, &postedTimer[n]);
+	}
+	for (k = 0; k < 4; k++) {
+		for (n = 0; n < NR_POSTED; n++) {
+			CycleTimer_Mod(&postedTimer[n], 1000 + (rnd() & 0xffff));
+		}
+	}
+	for (n = 0; n < NR_POSTED; n += 10) {
+		CycleTimer_Remove(&postedTimer[n]);
+		cancelled++;
+	}
+	__atomic_store_n(&postingDone, 1, __ATOMIC_SEQ_CST);
+	pthread_join(thread, NULL);
+	printf("Cross domain: posted: %d, cancelled: %d, expired: %" PRIu64
+	       ", errors: %" PRIu64 "\n", NR_POSTED, cancelled, postedExpired, errors);
+	if (errors || (postedExpired != (uint64_t) (NR_POSTED - cancelled))) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * ----------------------------------------------------------------
+ * Timers of the flood domain have to expire in timeout order
+ * ----------------------------------------------------------------
+ */
+static void
+flood_check(CycleTimer * timer)
+{
+	if ((CycleCounter < timer->timeout) || (timer->timeout < floodLast)) {
+		floodErrors++;
+	}
+	floodLast = timer->timeout;
+}
+
+static void
+flood_timeout(void *clientData)
+{
+	flood_check(clientData);
+	floodExpired++;
+}
+
+static void
+flood_periodic(void *clientData)
+{
+	flood_check(clientData);
+	floodPeriods++;
+	CycleTimer_Add(&floodPeriodic, FLOOD_PERIOD, flood_periodic, &floodPeriodic);
+}
+
+static void *
+flood_cpu(void *arg)
+{
+	CycleTimers_SyncGlobalClock(floodDomain, NULL);
+	CycleTimer_Add(&floodPeriodic, FLOOD_PERIOD, flood_periodic, &floodPeriodic);
+	__atomic_store_n(&floodRunning, 1, __ATOMIC_SEQ_CST);
+	while (CycleCounter < (uint64_t) FLOOD_PERIOD * FLOOD_PERIODS) {
+		CycleCounter += 2;
+		CycleTimers_Check();
+	}
+	__atomic_store_n(&floodDone, 1, __ATOMIC_SEQ_CST);
+	return NULL;
+}
+
+/*
+ * ----------------------------------------------------------------
+ * Post re-arms as fast as possible while the owner cascades the
+ * higher levels of its wheel
+ * ----------------------------------------------------------------
+ */
+static int
+test_cascade_flood(void)
+{
+	CycleTimerDomain *local = CycleTimers_Domain();
+	pthread_t thread;
+	uint64_t posts = 0;
+	int n;
+	floodDomain = CycleTimers_Init("flood", 100000000);
+	CycleTimers_SelectDomain(local);
+	if (pthread_create(&thread, NULL, flood_cpu, NULL) != 0) {
+		return -1;
+	}
+	while (!__atomic_load_n(&floodRunning, __ATOMIC_SEQ_CST)) {
+	}
+	while (!__atomic_load_n(&floodDone, __ATOMIC_SEQ_CST)) {
+		n = rnd() % NR_FLOOD;
+		CycleTimer_AddToDomain(floodDomain, &floodTimer[n], 1000 + (rnd() & 0x3ffff),
+				       flood_timeout, &floodTimer[n]);
+		posts++;
+	}
+	pthread_join(thread, NULL);
+	printf("Cascade flood: posts: %" PRIu64 ", expired: %" PRIu64 ", periods: %" PRIu64
+	       ", errors: %" PRIu64 "\n", posts, floodExpired, floodPeriods, floodErrors);
+	if (floodErrors || (floodPeriods != FLOOD_PERIODS)) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * ----------------------------------------------------------------
+ * Stubs for the parts of the simulator the CycleTimers depend on
+ * ----------------------------------------------------------------
+ */
+Clock_t *
+Clock_New(const char *format, ...)
+{
+	return calloc(1, sizeof(Clock_t));
+}
+
+void
+Clock_SetFreq(Clock_t * clock, uint64_t hz)
+{
+}
+
+ClockTrace_t *
+Clock_Trace(Clock_t * clock, ClockTraceProc * proc, void *traceData)
+{
+	return NULL;
+}
+
+void
+Clock_MakeSystemMaster(Clock_t * clock)
+{
+}
+
+void
+GlobalClock_ConsumeCycle(GlobalClock_LocalClock_t *clk, uint32_t cnt)
+{
+}
+
+uint64_t
+GlobalClock_Quantum(GlobalClock_LocalClock_t *clk)
+{
+	return ~UINT64_C(0) >> 1;
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+int
+main(void)
+{
+	struct timespec start, end;
+	uint64_t i;
+	uint64_t ops = 0;
+	double nsecs;
+	int n;
+	CycleTimers_Init("bench", 200000000);
+	for (n = 0; n < NR_UARTS; n++) {
+		CycleTimer_Init(&uartTimer[n], uart_timeout, &uartTimer[n]);
+	}
+	for (n = 0; n < NR_PERIODIC; n++) {
+		CycleTimer_Add(&periodicTimer[n], periodicCycles[n], periodic_timeout,
+			       &periodicTimer[n]);
+	}
+	for (n = 0; n < NR_WATCHDOGS; n++) {
+		CycleTimer_Init(&watchdogTimer[n], watchdog_timeout, &watchdogTimer[n]);
+	}
+	for (n = 0; n < NR_ONESHOTS; n++) {
+		CycleTimer_Init(&oneshotTimer[n], oneshot_timeout, &oneshotTimer[n]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < INSTRUCTIONS; i++) {
+		CycleCounter += 2;
+		CycleTimers_Check();
+		if ((i & 63) == 0) {
+			/* A character is received, restart the receive timeout */
+			CycleTimer_Mod(&uartTimer[rnd() % NR_UARTS], 20000 + (rnd() & 0x3fff));
+			ops++;
+		}
+		if ((i & 255) == 0) {
+			CycleTimer *timer = &oneshotTimer[rnd() % NR_ONESHOTS];
+			if (!CycleTimer_IsActive(timer)) {
+				CycleTimer_Mod(timer, 100 + (rnd() & 0x7ff));
+				ops++;
+			}
+		}
+		if ((i & 1023) == 0) {
+			/* Feed a watchdog */
+			CycleTimer_Mod(&watchdogTimer[rnd() % NR_WATCHDOGS], 50000000);
+			ops++;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	nsecs = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+#ifdef CYCLETIMER_XYTREE
+	printf("Backend: XY_Tree\n");
+#else
+	printf("Backend: timer wheel\n");
+#endif
+	printf("Instructions: %" PRIu64 ", re-arms: %" PRIu64 ", expired: %" PRIu64
+	       ", errors: %" PRIu64 ", max. late: %" PRIu64 "\n", INSTRUCTIONS, ops, expired,
+	       errors, maxLate);
+	printf("%.3f ns per instruction, %.1f ms total\n", nsecs / INSTRUCTIONS, nsecs / 1e6);
+	if (errors) {
+		return 1;
+	}
+	if (test_cross_domain() < 0) {
+		return 1;
+	}
+	return test_cascade_flood() < 0 ? 1 : 0;
+}
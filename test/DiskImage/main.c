@@ -0,0 +1,361 @@
+//===-- test/DiskImage/main.c -------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Throughput benchmark for diskimage access with and without block cache
+///
+/// Reads and writes an image in 512 Byte and 64 kB requests, sequential
+/// and at random offsets, like a guest filesystem on an SD card. The data
+/// read through the cache is compared with the data read without it.
+/// The asynchronous writes are completed by CycleTimers of a simulated
+/// CPU loop and are synced to disk at the end. Finally random writes and
+/// sequential reads are mixed on a cached image and on an uncached
+/// reference image, so that dirty blocks are evicted during read-ahead,
+/// and both have to return the same data.
+///
+///   cc -O2 -Isrc -Isrc/softgun test/DiskImage/main.c src/softgun/diskimage.c
+///      src/softgun/configfile.c src/softgun/sgstring.c src/softgun/cycletimer.c
+///      src/softgun/xy_tree.c -lpthread -o diskimage
+///   ./diskimage [imagefile]
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+#include "diskimage.h"
+#include "clock.h"
+#include "cycletimer.h"
+#include "exithandler.h"
+#include "globalclock.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define IMAGE_SIZE	(32 * 1024 * 1024)
+#define RANDOM_SPAN	(512 * 1024)
+#define RANDOM_OPS	(20000)
+#define ASYNC_BUSY	(2000)	/* Cycles until an asynchronous write completes */
+#define MIXED_SPAN	(8 * 1024 * 1024)	/* Larger than the default cache */
+#define MIXED_OPS	(20000)
+#define MIXED_MAXLEN	(16384)
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+static const char *imageName = "/tmp/leigun-diskimage-bench.img";
+static const char *refName = "/tmp/leigun-diskimage-ref.img";
+static uint8_t *refData;
+static uint8_t *readData;
+static uint32_t completed;
+static uint32_t asyncErrors;
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static double
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void
+report(const char *name, int flags, uint64_t bytes, double ms)
+{
+	printf("%-20s %-8s %8.1f MB/s\n", name, (flags & DI_CACHE) ? "cached" : "direct",
+	       (double)bytes / (ms * 1e3));
+}
+
+static int
+seq_read(int flags, uint32_t reqsize)
+{
+	DiskImage *di = DiskImage_Open(imageName, IMAGE_SIZE, DI_RDWR | flags);
+	char name[32];
+	double start;
+	uint32_t ofs;
+	int errors = 0;
+	if (!di) {
+		return 1;
+	}
+	start = now_ms();
+	for (ofs = 0; ofs < IMAGE_SIZE; ofs += reqsize) {
+		DiskImage_Read(di, ofs, readData + ofs, reqsize);
+	}
+	snprintf(name, sizeof(name), "seq read %u", reqsize);
+	report(name, flags, IMAGE_SIZE, now_ms() - start);
+	if (memcmp(readData, refData, IMAGE_SIZE)) {
+		fprintf(stderr, "%s: data differs\n", name);
+		errors++;
+	}
+	DiskImage_Close(di);
+	return errors;
+}
+
+static int
+random_read(int flags, uint32_t reqsize)
+{
+	DiskImage *di = DiskImage_Open(imageName, IMAGE_SIZE, DI_RDWR | flags);
+	char name[32];
+	double start;
+	uint32_t ofs;
+	int errors = 0;
+	int i;
+	if (!di) {
+		return 1;
+	}
+	srand(1);
+	start = now_ms();
+	for (i = 0; i < RANDOM_OPS; i++) {
+		ofs = (rand() % (RANDOM_SPAN / reqsize)) * reqsize;
+		DiskImage_Read(di, ofs, readData, reqsize);
+		if (memcmp(readData, refData + ofs, reqsize)) {
+			errors++;
+		}
+	}
+	snprintf(name, sizeof(name), "random read %u", reqsize);
+	report(name, flags, (uint64_t) RANDOM_OPS * reqsize, now_ms() - start);
+	if (errors) {
+		fprintf(stderr, "%s: data differs\n", name);
+	}
+	DiskImage_Close(di);
+	return errors ? 1 : 0;
+}
+
+static int
+seq_write(int flags, uint32_t reqsize)
+{
+	DiskImage *di = DiskImage_Open(imageName, IMAGE_SIZE, DI_RDWR | flags);
+	char name[32];
+	double start;
+	uint32_t ofs;
+	if (!di) {
+		return 1;
+	}
+	start = now_ms();
+	for (ofs = 0; ofs < IMAGE_SIZE; ofs += reqsize) {
+		DiskImage_Write(di, ofs, refData + ofs, reqsize);
+	}
+	DiskImage_Close(di);
+	snprintf(name, sizeof(name), "seq write %u", reqsize);
+	report(name, flags, IMAGE_SIZE, now_ms() - start);
+	return 0;
+}
+
+static void
+write_done(void *clientData, int result)
+{
+	uint32_t *expected = clientData;
+	if (result != (int)*expected) {
+		asyncErrors++;
+	}
+	completed++;
+}
+
+static int
+async_write(int flags, uint32_t reqsize)
+{
+	DiskImage *di = DiskImage_Open(imageName, IMAGE_SIZE, DI_RDWR | flags);
+	char name[32];
+	double start;
+	uint32_t ofs;
+	uint32_t submitted = 0;
+	if (!di) {
+		return 1;
+	}
+	completed = asyncErrors = 0;
+	start = now_ms();
+	for (ofs = 0; ofs < IMAGE_SIZE; ofs += reqsize) {
+		DiskImage_WriteAsync(di, ofs, refData + ofs, reqsize, ASYNC_BUSY, write_done,
+				     &reqsize);
+		submitted++;
+		/* The CPU runs while the card is busy */
+		while (completed < submitted) {
+			CycleCounter += 10;
+			CycleTimers_Check();
+		}
+	}
+	DiskImage_Sync(di);
+	DiskImage_Close(di);
+	snprintf(name, sizeof(name), "async write %u", reqsize);
+	report(name, flags, IMAGE_SIZE, now_ms() - start);
+	if (asyncErrors) {
+		fprintf(stderr, "%s: %u writes failed\n", name, asyncErrors);
+	}
+	return asyncErrors ? 1 : 0;
+}
+
+static int
+compare_images(DiskImage * cached, DiskImage * direct, uint64_t ofs, uint32_t len)
+{
+	int result1 = DiskImage_Read(cached, ofs, readData, len);
+	int result2 = DiskImage_Read(direct, ofs, readData + len, len);
+	if ((result1 != (int)len) || (result2 != (int)len)
+	    || memcmp(readData, readData + len, len)) {
+		return 1;
+	}
+	return 0;
+}
+
+static int
+mixed_rw(void)
+{
+	DiskImage *cached, *direct;
+	uint32_t ofs, len, i, j;
+	int errors = 0;
+	unlink(refName);
+	direct = DiskImage_Open(refName, IMAGE_SIZE, DI_RDWR | DI_CREAT_00);
+	cached = DiskImage_Open(imageName, IMAGE_SIZE, DI_RDWR | DI_CACHE);
+	if (!direct || !cached) {
+		return 1;
+	}
+	DiskImage_Write(direct, 0, refData, IMAGE_SIZE);
+	DiskImage_Write(cached, 0, refData, IMAGE_SIZE);
+	srand(2);
+	for (i = 0; i < MIXED_OPS; i++) {
+		ofs = rand() % (MIXED_SPAN - MIXED_MAXLEN);
+		len = 1 + rand() % MIXED_MAXLEN;
+		if (rand() & 1) {
+			const uint8_t *data = refData + rand() % (IMAGE_SIZE - MIXED_MAXLEN);
+			DiskImage_Write(direct, ofs, data, len);
+			DiskImage_Write(cached, ofs, data, len);
+			continue;
+		}
+		/* A sequential run grows the read-ahead window */
+		for (j = 0; j < 8; j++, ofs += len) {
+			errors += compare_images(cached, direct, ofs, len);
+		}
+	}
+	DiskImage_Close(cached);
+	DiskImage_Close(direct);
+	/* Everything has to be written back */
+	cached = DiskImage_Open(imageName, IMAGE_SIZE, DI_RDWR);
+	direct = DiskImage_Open(refName, IMAGE_SIZE, DI_RDWR);
+	if (!direct || !cached) {
+		return 1;
+	}
+	for (ofs = 0; ofs < IMAGE_SIZE; ofs += 65536) {
+		errors += compare_images(cached, direct, ofs, 65536);
+	}
+	DiskImage_Close(cached);
+	DiskImage_Close(direct);
+	unlink(refName);
+	if (errors) {
+		fprintf(stderr, "mixed read/write: %d reads differ from the uncached image\n",
+			errors);
+	}
+	return errors ? 1 : 0;
+}
+
+/*
+ * -------------------------------------------------------
+ * Stub for the parts of the simulator the diskimage
+ * and the CycleTimers depend on
+ * -------------------------------------------------------
+ */
+Clock_t *
+Clock_New(const char *format, ...)
+{
+	return calloc(1, sizeof(Clock_t));
+}
+
+void
+Clock_SetFreq(Clock_t * clock, uint64_t hz)
+{
+}
+
+ClockTrace_t *
+Clock_Trace(Clock_t * clock, ClockTraceProc * proc, void *traceData)
+{
+	return NULL;
+}
+
+void
+Clock_MakeSystemMaster(Clock_t * clock)
+{
+}
+
+void
+GlobalClock_ConsumeCycle(GlobalClock_LocalClock_t *clk, uint32_t cnt)
+{
+}
+
+uint64_t
+GlobalClock_Quantum(GlobalClock_LocalClock_t *clk)
+{
+	return ~UINT64_C(0) >> 1;
+}
+
+int
+ExitHandler_Register(ExitHandler_Callback_cb proc, void *data)
+{
+	return 0;
+}
+
+int
+ExitHandler_Unregister(ExitHandler_Callback_cb proc, void *data)
+{
+	return 0;
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+int
+main(int argc, char *argv[])
+{
+	static const int modes[] = { 0, DI_CACHE };
+	int errors = 0;
+	uint32_t i;
+	if (argc > 1) {
+		imageName = argv[1];
+	}
+	refData = malloc(IMAGE_SIZE);
+	readData = malloc(IMAGE_SIZE);
+	for (i = 0; i < IMAGE_SIZE; i++) {
+		refData[i] = rand();
+	}
+	CycleTimers_Init("bench", 200000000);
+	unlink(imageName);
+	for (i = 0; i < 2; i++) {
+		errors += seq_write(modes[i] | DI_CREAT_00, 512);
+		errors += seq_read(modes[i], 512);
+		errors += seq_read(modes[i], 65536);
+		errors += random_read(modes[i], 512);
+		errors += random_read(modes[i], 65536);
+		errors += seq_write(modes[i], 65536);
+		errors += seq_read(modes[i], 65536);
+		errors += async_write(modes[i], 65536);
+		errors += seq_read(modes[i], 65536);
+	}
+	errors += mixed_rw();
+	unlink(imageName);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,322 @@
+//===-- test/FrameRing/main.c -------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Packets per second benchmark for the frame rings of the MAC models
+///
+/// A peer thread streams frames over a SOCK_SEQPACKET pair like the one a
+/// virtual switch port uses. The receive side is measured once with one
+/// read per frame, like the MAC models did before, and once with a
+/// FrameRing draining all pending frames per wakeup. The transmit side
+/// compares one write per frame with the sendmmsg batches of a FrameRing.
+/// The frames have to arrive in order and complete.
+///
+///   cc -O2 -D_GNU_SOURCE -Isrc -Isrc/softgun -Imodules/softgun
+///      test/FrameRing/main.c modules/softgun/framering.c modules/softgun/netcapture.c
+///      src/softgun/cycletimer.c src/softgun/xy_tree.c src/softgun/sgstring.c
+///      -lpthread -o framering
+///   ./framering
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+#include "framering.h"
+#include "clock.h"
+#include "configfile.h"
+#include "exithandler.h"
+#include "globalclock.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define FRAMES		(200000)
+#define RING_FRAMES	(64)
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct Stream {
+	int fd;
+	unsigned int len;
+	uint64_t frames;
+	uint64_t errors;
+} Stream;
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static double
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void
+make_frame(uint8_t * frame, unsigned int len, uint32_t seq)
+{
+	memset(frame, 0xff, 6);
+	memset(frame + 6, 0x02, 6);
+	frame[12] = 0x88;
+	frame[13] = 0xb5;
+	memcpy(frame + 14, &seq, 4);
+}
+
+static int
+check_frame(Stream * st, const uint8_t * frame, unsigned int len)
+{
+	uint32_t seq;
+	memcpy(&seq, frame + 14, 4);
+	if ((len != st->len) || (seq != st->frames)) {
+		st->errors++;
+		return -1;
+	}
+	st->frames++;
+	return 0;
+}
+
+static void
+wait_fd(int fd, short events)
+{
+	struct pollfd pfd = { fd, events, 0 };
+	poll(&pfd, 1, 100);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * The peer waits for space instead of losing frames, so both receive
+ * variants see the same stream.
+ * ------------------------------------------------------------------------
+ */
+static void *
+sender(void *arg)
+{
+	Stream *st = arg;
+	uint8_t frame[FRAMERING_FRAME_SIZE];
+	uint32_t seq;
+	memset(frame, 0, sizeof(frame));
+	for (seq = 0; seq < FRAMES; seq++) {
+		make_frame(frame, st->len, seq);
+		while (write(st->fd, frame, st->len) != (ssize_t) st->len) {
+			wait_fd(st->fd, POLLOUT);
+		}
+	}
+	return NULL;
+}
+
+static void *
+receiver(void *arg)
+{
+	Stream *st = arg;
+	uint8_t frame[FRAMERING_FRAME_SIZE];
+	ssize_t len;
+	while (st->frames < FRAMES) {
+		len = read(st->fd, frame, sizeof(frame));
+		if (len < 0) {
+			if (errno != EAGAIN) {
+				break;
+			}
+			wait_fd(st->fd, POLLIN);
+			continue;
+		}
+		check_frame(st, frame, len);
+	}
+	return NULL;
+}
+
+static void
+report(const char *name, unsigned int len, uint64_t frames, double ms, uint64_t batches)
+{
+	fprintf(stderr, "%-10s %4u bytes: %8.0f frames/s, %6.1f frames/syscall\n",
+		name, len, frames / ms * 1000.0, batches ? (double)frames / batches : 1.0);
+}
+
+static int
+bench_receive(int fdMac, int fdPeer, unsigned int len, int batched)
+{
+	Stream peer = { fdPeer, len, 0, 0 };
+	Stream mac = { fdMac, len, 0, 0 };
+	FrameRing *ring = FrameRing_New(fdMac, RING_FRAMES);
+	FrameRing_Stats stats;
+	pthread_t thread;
+	uint8_t *frame;
+	unsigned int flen;
+	double start, ms;
+	pthread_create(&thread, NULL, sender, &peer);
+	start = now_ms();
+	if (!batched) {
+		receiver(&mac);
+	} else {
+		while (mac.frames < FRAMES) {
+			if (FrameRing_Receive(ring) <= 0) {
+				wait_fd(fdMac, POLLIN);
+				continue;
+			}
+			while ((frame = FrameRing_Peek(ring, &flen))) {
+				check_frame(&mac, frame, flen);
+				FrameRing_Pop(ring);
+			}
+		}
+	}
+	ms = now_ms() - start;
+	pthread_join(thread, NULL);
+	FrameRing_GetStats(ring, &stats);
+	report(batched ? "rx ring" : "rx read", len, mac.frames, ms, stats.batches);
+	return mac.errors ? -1 : 0;
+}
+
+static int
+bench_transmit(int fdMac, int fdPeer, unsigned int len, int batched)
+{
+	Stream peer = { fdPeer, len, 0, 0 };
+	FrameRing *ring = FrameRing_New(fdMac, RING_FRAMES);
+	FrameRing_Stats stats;
+	pthread_t thread;
+	uint8_t frame[FRAMERING_FRAME_SIZE];
+	double start, ms;
+	uint32_t seq;
+	/* Never expires in this test, the ring is written when it is full */
+	FrameRing_SetFlushDelay(ring, 1000000000);
+	memset(frame, 0, sizeof(frame));
+	pthread_create(&thread, NULL, receiver, &peer);
+	start = now_ms();
+	for (seq = 0; seq < FRAMES; seq++) {
+		make_frame(frame, len, seq);
+		if (!batched) {
+			while (write(fdMac, frame, len) != (ssize_t) len) {
+				wait_fd(fdMac, POLLOUT);
+			}
+			continue;
+		}
+		if ((seq % RING_FRAMES) == 0) {
+			/* A MAC model drops what the backend does not take */
+			wait_fd(fdMac, POLLOUT);
+		}
+		FrameRing_Queue(ring, frame, len);
+	}
+	FrameRing_Flush(ring);
+	pthread_join(thread, NULL);
+	ms = now_ms() - start;
+	FrameRing_GetStats(ring, &stats);
+	report(batched ? "tx ring" : "tx write", len, peer.frames, ms, stats.batches);
+	if (stats.drops) {
+		fprintf(stderr, "%llu frames dropped by the backend\n",
+			(unsigned long long)stats.drops);
+	}
+	return (peer.errors || stats.drops) ? -1 : 0;
+}
+
+/*
+ * ----------------------------------------------------------------
+ * Stubs for the parts of the simulator the CycleTimers and the
+ * capture depend on
+ * ----------------------------------------------------------------
+ */
+char *
+Config_ReadVar(const char *section, const char *name)
+{
+	return NULL;
+}
+
+int
+ExitHandler_Register(ExitHandler_Callback_cb proc, void *data)
+{
+	return 0;
+}
+
+Clock_t *
+Clock_New(const char *format, ...)
+{
+	return calloc(1, sizeof(Clock_t));
+}
+
+void
+Clock_SetFreq(Clock_t * clock, uint64_t hz)
+{
+}
+
+ClockTrace_t *
+Clock_Trace(Clock_t * clock, ClockTraceProc * proc, void *traceData)
+{
+	return NULL;
+}
+
+void
+Clock_MakeSystemMaster(Clock_t * clock)
+{
+}
+
+void
+GlobalClock_ConsumeCycle(GlobalClock_LocalClock_t *clk, uint32_t cnt)
+{
+}
+
+uint64_t
+GlobalClock_Quantum(GlobalClock_LocalClock_t *clk)
+{
+	return ~UINT64_C(0) >> 1;
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+int
+main(void)
+{
+	static const unsigned int sizes[] = { 60, 1514 };
+	int bufsize = 1024 * 1024;
+	int fds[2];
+	unsigned int i;
+	int errors = 0;
+	CycleTimers_Init("bench", 200000000);
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fds) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+	setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		errors += bench_receive(fds[0], fds[1], sizes[i], 0) < 0;
+		errors += bench_receive(fds[0], fds[1], sizes[i], 1) < 0;
+		errors += bench_transmit(fds[0], fds[1], sizes[i], 0) < 0;
+		errors += bench_transmit(fds[0], fds[1], sizes[i], 1) < 0;
+	}
+	if (errors) {
+		fprintf(stderr, "%d errors\n", errors);
+		return 1;
+	}
+	fprintf(stderr, "All frames arrived in order\n");
+	return 0;
+}
@@ -0,0 +1,339 @@
+//===-- test/NetCapture/main.c ------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Test for the pcap-ng capture of the emulated network interfaces
+///
+/// A CPU thread transmits frames and advances the emulated time while a
+/// second thread receives frames like the AsyncManager. Both put their
+/// frames into the same capture, once at a rate of a busy 100 MBit link
+/// and once as fast as they can, so that the ring overflows. Afterwards
+/// the file is read back: every frame which was not dropped has to be
+/// there once, in order, with the right direction and contents, and the
+/// statistics block has to account for the dropped frames. The cost of a
+/// capture call on the producer side is printed.
+///
+///   cc -O2 -D_GNU_SOURCE -Isrc -Isrc/softgun -Imodules/softgun
+///      test/NetCapture/main.c modules/softgun/netcapture.c src/softgun/cycletimer.c
+///      src/softgun/xy_tree.c src/softgun/sgstring.c -lpthread -o netcapture
+///   ./netcapture
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+#include "netcapture.h"
+#include "clock.h"
+#include "configfile.h"
+#include "cycletimer.h"
+#include "exithandler.h"
+#include "globalclock.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define FRAMES		(200000)
+#define CAPTURE_PATH	"/tmp/netcapture-test.pcapng"
+#define CPU_HZ		(100000000)
+#define CYCLES_PER_FRAME	(1000)
+#define LINK_RATE_NS	(10000)	/* Between two frames of one direction */
+#define BURST		(32)	/* Frames sent back to back */
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct Producer {
+	NetCapture *cap;
+	NetCapture_Direction dir;
+	uint32_t period_ns;
+	double nsecs;
+} Producer;
+
+typedef struct Expect {
+	uint32_t seq;
+	uint64_t timestamp;
+} Expect;
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static double
+now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+sleep_until(double ns)
+{
+	struct timespec ts;
+	ts.tv_sec = ns / 1e9;
+	ts.tv_nsec = ns - ts.tv_sec * 1e9;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static unsigned int
+frame_len(uint32_t seq)
+{
+	return 60 + (seq * 7) % (1514 - 60);
+}
+
+static void
+make_frame(uint8_t * frame, NetCapture_Direction dir, uint32_t seq)
+{
+	unsigned int i;
+	memcpy(frame, &seq, 4);
+	frame[4] = dir;
+	for (i = 5; i < 1514; i++) {
+		frame[i] = i;
+	}
+}
+
+static void *
+producer(void *arg)
+{
+	Producer *pr = arg;
+	uint8_t frame[1514];
+	uint32_t seq;
+	double start = now_ns();
+	double busy = 0;
+	double t;
+	make_frame(frame, pr->dir, 0);
+	for (seq = 0; seq < FRAMES; seq++) {
+		if (pr->period_ns && ((seq % BURST) == 0)) {
+			sleep_until(start + (double)seq * pr->period_ns);
+		}
+		memcpy(frame, &seq, 4);
+		if (pr->dir == NETCAPTURE_TX) {
+			/* This thread is the CPU */
+			CycleCounter += CYCLES_PER_FRAME;
+		}
+		t = now_ns();
+		NetCapture_Frame(pr->cap, pr->dir, frame, frame_len(seq));
+		busy += now_ns() - t;
+	}
+	pr->nsecs = busy / FRAMES;
+	return NULL;
+}
+
+static uint32_t
+get_u32(const uint8_t * p)
+{
+	uint32_t value;
+	memcpy(&value, p, 4);
+	return value;
+}
+
+static uint64_t
+get_u64(const uint8_t * p)
+{
+	uint64_t value;
+	memcpy(&value, p, 8);
+	return value;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Read the file back and check the blocks. Returns the number of errors.
+ * ------------------------------------------------------------------------
+ */
+static int
+check_file(const char *path, uint64_t drops)
+{
+	static uint8_t block[4096];
+	uint8_t expected[1514];
+	Expect next[3] = { {0, 0}, {0, 0}, {0, 0} };
+	uint64_t packets = 0, recv = 0, ifdrop = ~UINT64_C(0);
+	uint32_t type, total, caplen, flags, seq;
+	uint64_t timestamp;
+	unsigned int nr_blocks = 0;
+	int errors = 0;
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		perror(path);
+		return 1;
+	}
+	while (fread(block, 8, 1, file) == 1) {
+		type = get_u32(block);
+		total = get_u32(block + 4);
+		if ((total < 12) || (total > sizeof(block)) || (total & 3)
+		    || (fread(block + 8, total - 8, 1, file) != 1)
+		    || (get_u32(block + total - 4) != total)) {
+			fprintf(stderr, "Broken block %u\n", nr_blocks);
+			errors++;
+			break;
+		}
+		if ((nr_blocks == 0) && ((type != 0x0A0D0D0A) || (get_u32(block + 8) != 0x1A2B3C4D))) {
+			fprintf(stderr, "No section header\n");
+			errors++;
+		}
+		if ((nr_blocks == 1) && ((type != 1) || (block[8] != 1))) {
+			fprintf(stderr, "No ethernet interface\n");
+			errors++;
+		}
+		nr_blocks++;
+		if (type == 5) {
+			recv = get_u64(block + 24);
+			ifdrop = get_u64(block + 36);
+			continue;
+		}
+		if (type != 6) {
+			continue;
+		}
+		timestamp = ((uint64_t) get_u32(block + 12) << 32) | get_u32(block + 16);
+		caplen = get_u32(block + 20);
+		flags = get_u32(block + 28 + ((caplen + 3) & ~3) + 4);
+		seq = get_u32(block + 28);
+		if ((flags != NETCAPTURE_RX) && (flags != NETCAPTURE_TX)) {
+			fprintf(stderr, "Frame without direction\n");
+			errors++;
+			continue;
+		}
+		make_frame(expected, flags, seq);
+		if ((seq < next[flags].seq) || (timestamp < next[flags].timestamp)
+		    || (caplen != frame_len(seq)) || (get_u32(block + 24) != caplen)
+		    || memcmp(block + 28, expected, caplen)) {
+			fprintf(stderr, "Bad frame %u of direction %u\n", seq, flags);
+			errors++;
+		}
+		next[flags].seq = seq + 1;
+		next[flags].timestamp = timestamp;
+		packets++;
+	}
+	fclose(file);
+	if ((recv != 2 * FRAMES) || (ifdrop != drops) || (packets + drops != 2 * FRAMES)) {
+		fprintf(stderr, "Statistics: %llu frames, %llu dropped, %llu in the file\n",
+			(unsigned long long)recv, (unsigned long long)ifdrop,
+			(unsigned long long)packets);
+		errors++;
+	}
+	/* 10 us per frame at 100 MHz */
+	if (next[NETCAPTURE_TX].timestamp > (uint64_t) FRAMES * 10000) {
+		fprintf(stderr, "Timestamps are not in emulated time\n");
+		errors++;
+	}
+	return errors;
+}
+
+static int
+run_capture(const char *name, uint32_t period_ns)
+{
+	Producer rx = { NULL, NETCAPTURE_RX, period_ns, 0 };
+	Producer tx = { NULL, NETCAPTURE_TX, period_ns, 0 };
+	pthread_t rxThread, txThread;
+	uint64_t drops;
+	int errors;
+	CycleCounter = 0;
+	rx.cap = tx.cap = NetCapture_Open(CAPTURE_PATH, "eth0");
+	if (!rx.cap) {
+		return 1;
+	}
+	pthread_create(&rxThread, NULL, producer, &rx);
+	pthread_create(&txThread, NULL, producer, &tx);
+	pthread_join(rxThread, NULL);
+	pthread_join(txThread, NULL);
+	NetCapture_Close(rx.cap);
+	drops = NetCapture_Drops(rx.cap);
+	fprintf(stderr, "%-6s rx %4.0f ns/frame, tx %4.0f ns/frame, %6llu of %u dropped\n",
+		name, rx.nsecs, tx.nsecs, (unsigned long long)drops, 2 * FRAMES);
+	errors = check_file(CAPTURE_PATH, drops);
+	unlink(CAPTURE_PATH);
+	return errors;
+}
+
+/*
+ * ----------------------------------------------------------------
+ * Stubs for the parts of the simulator the capture depends on
+ * ----------------------------------------------------------------
+ */
+char *
+Config_ReadVar(const char *section, const char *name)
+{
+	return NULL;
+}
+
+int
+ExitHandler_Register(ExitHandler_Callback_cb proc, void *data)
+{
+	return 0;
+}
+
+Clock_t *
+Clock_New(const char *format, ...)
+{
+	return calloc(1, sizeof(Clock_t));
+}
+
+void
+Clock_SetFreq(Clock_t * clock, uint64_t hz)
+{
+}
+
+ClockTrace_t *
+Clock_Trace(Clock_t * clock, ClockTraceProc * proc, void *traceData)
+{
+	return NULL;
+}
+
+void
+Clock_MakeSystemMaster(Clock_t * clock)
+{
+}
+
+void
+GlobalClock_ConsumeCycle(GlobalClock_LocalClock_t *clk, uint32_t cnt)
+{
+}
+
+uint64_t
+GlobalClock_Quantum(GlobalClock_LocalClock_t *clk)
+{
+	return ~UINT64_C(0) >> 1;
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+int
+main(void)
+{
+	int errors = 0;
+	CycleTimers_Init("cpu", CPU_HZ);
+	errors += run_capture("link", LINK_RATE_NS);
+	errors += run_capture("flood", 0);
+	if (errors) {
+		fprintf(stderr, "%d errors\n", errors);
+		return 1;
+	}
+	fprintf(stderr, "Capture file is complete and in order\n");
+	return 0;
+}
@@ -0,0 +1,323 @@
+//===-- test/PixConv/main.c ---------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Benchmark for the framebuffer pixel conversion kernels
+///
+/// Converts a 800x480 framebuffer from the formats of the LCD controllers
+/// (imx21_lcdc, at91_lcdc, uze_video) into typical VNC client formats.
+/// The reference is the former per pixel path of the RFB server: a
+/// translation table lookup per channel and a WritePixelProc call per
+/// pixel. Every kernel is checked against the reference.
+///
+///   cc -O2 -Isrc -Isrc/softgun test/PixConv/main.c src/softgun/pixconv.c
+///      src/softgun/sgstring.c -o pixconv
+///   ./pixconv
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+#include "pixconv.h"
+#include "byteorder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define WIDTH	(800)
+#define HEIGHT	(480)
+#define LOOPS	(50)
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef int WritePixelProc(uint8_t * dst, uint32_t pixval);
+
+typedef struct TestCase {
+	const char *name;
+	PixConvFormat src;
+	PixConvFormat dst;
+	int swap;
+} TestCase;
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+static const TestCase testCases[] = {
+	{"565/16 -> 888/32", {16, 31, 63, 31, 11, 5, 0}, {32, 255, 255, 255, 16, 8, 0}, 0},
+	{"565/16 -> 888/32 swap", {16, 31, 63, 31, 11, 5, 0}, {32, 255, 255, 255, 16, 8, 0}, 1},
+	{"444/16 -> 888/32", {16, 15, 15, 15, 8, 4, 0}, {32, 255, 255, 255, 16, 8, 0}, 0},
+	{"565/16 -> 565/16", {16, 31, 63, 31, 11, 5, 0}, {16, 31, 63, 31, 11, 5, 0}, 0},
+	{"565/16 -> 888/24", {16, 31, 63, 31, 11, 5, 0}, {32, 255, 255, 255, 16, 8, 0}, 0},
+	{"565/16 -> 332/8", {16, 31, 63, 31, 11, 5, 0}, {8, 7, 7, 3, 5, 2, 0}, 0},
+	{"666/32 -> 888/32", {32, 63, 63, 63, 2, 10, 18}, {32, 255, 255, 255, 16, 8, 0}, 0},
+	{"332/8 -> 888/32", {8, 7, 7, 3, 0, 3, 6}, {32, 255, 255, 255, 16, 8, 0}, 0},
+};
+
+/* Destination bytes per pixel, the 24 Bit case uses a 32 Bit layout */
+static const unsigned int testBypp[] = { 4, 4, 4, 2, 3, 1, 4, 4 };
+
+static uint32_t trans_red[256];
+static uint32_t trans_green[256];
+static uint32_t trans_blue[256];
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static double
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * The reference: encode_pixval and the WritePixelProcs of the RFB server
+ * ------------------------------------------------------------------------
+ */
+static void
+ref_setup(const PixConvFormat * src, const PixConvFormat * dst)
+{
+	unsigned int c;
+	for (c = 0; c <= src->red_max; c++) {
+		trans_red[c] = (c * dst->red_max / src->red_max) << dst->red_shift;
+	}
+	for (c = 0; c <= src->green_max; c++) {
+		trans_green[c] = (c * dst->green_max / src->green_max) << dst->green_shift;
+	}
+	for (c = 0; c <= src->blue_max; c++) {
+		trans_blue[c] = (c * dst->blue_max / src->blue_max) << dst->blue_shift;
+	}
+}
+
+static inline uint32_t
+encode_pixval(const void *src, const PixConvFormat * fbpixf)
+{
+	uint32_t pixval;
+	uint8_t red, green, blue;
+
+	switch (fbpixf->bits_per_pixel) {
+	    case 32:
+		    pixval = BYTE_LeToH32(*(uint32_t *) src);
+		    break;
+	    case 16:
+		    pixval = BYTE_LeToH16(*(uint16_t *) src);
+		    break;
+	    case 8:
+		    pixval = *(uint8_t *) src;
+		    break;
+	    default:
+		    pixval = 0;
+	}
+	red = (pixval >> fbpixf->red_shift) & fbpixf->red_max;
+	green = (pixval >> fbpixf->green_shift) & fbpixf->green_max;
+	blue = (pixval >> fbpixf->blue_shift) & fbpixf->blue_max;
+	return trans_red[red] | trans_green[green] | trans_blue[blue];
+}
+
+static int
+write_pixel8(uint8_t * dst, uint32_t pixval)
+{
+	dst[0] = pixval;
+	return 1;
+}
+
+static int
+write_pixel16_swap(uint8_t * dst, uint32_t pixval)
+{
+	*(uint16_t *) dst = BYTE_Swap16(pixval);
+	return 2;
+}
+
+static int
+write_pixel16(uint8_t * dst, uint32_t pixval)
+{
+	*(uint16_t *) dst = pixval;
+	return 2;
+}
+
+static int
+write_pixel24_swap(uint8_t * dst, uint32_t pixval)
+{
+	uint8_t *pix = (uint8_t *) & pixval;
+	dst[0] = pix[3];
+	dst[1] = pix[2];
+	dst[2] = pix[1];
+	return 3;
+}
+
+static int
+write_pixel24(uint8_t * dst, uint32_t pixval)
+{
+	uint8_t *pix = (uint8_t *) & pixval;
+	dst[0] = pix[0];
+	dst[1] = pix[1];
+	dst[2] = pix[2];
+	return 3;
+}
+
+static int
+write_pixel32_swap(uint8_t * dst, uint32_t pixval)
+{
+	*(uint32_t *) dst = BYTE_Swap32(pixval);
+	return 4;
+}
+
+static int
+write_pixel32(uint8_t * dst, uint32_t pixval)
+{
+	*(uint32_t *) dst = pixval;
+	return 4;
+}
+
+static WritePixelProc *
+get_write_pixel_proc(unsigned int bypp, int swap)
+{
+	switch (bypp) {
+	    case 1:
+		    return write_pixel8;
+	    case 2:
+		    return swap ? write_pixel16_swap : write_pixel16;
+	    case 3:
+		    return swap ? write_pixel24_swap : write_pixel24;
+	    default:
+		    return swap ? write_pixel32_swap : write_pixel32;
+	}
+}
+
+static void
+ref_convert(const TestCase * tc, unsigned int bypp, uint8_t * dst, const uint8_t * src)
+{
+	WritePixelProc *wpProc = get_write_pixel_proc(bypp, tc->swap);
+	unsigned int src_bypp = tc->src.bits_per_pixel >> 3;
+	unsigned int x, y;
+	for (y = 0; y < HEIGHT; y++) {
+		for (x = 0; x < WIDTH; x++) {
+			dst += wpProc(dst, encode_pixval(src, &tc->src));
+			src += src_bypp;
+		}
+	}
+}
+
+static void
+kernel_convert(const PixConv * pc, unsigned int bypp, uint8_t * dst, const uint8_t * src)
+{
+	unsigned int src_bypp = pc->src.bits_per_pixel >> 3;
+	unsigned int y;
+	for (y = 0; y < HEIGHT; y++) {
+		PixConv_Row(pc, dst, src, WIDTH);
+		src += WIDTH * src_bypp;
+		dst += WIDTH * bypp;
+	}
+}
+
+static void
+report(const char *kernel, double ms, double ref_ms)
+{
+	double mpix = (double)WIDTH * HEIGHT * LOOPS / (ms * 1000.0);
+	fprintf(stderr, "    %-8s %8.1f Mpixel/s %6.2fx\n", kernel, mpix, ref_ms / ms);
+}
+
+static int
+run_test(const TestCase * tc, unsigned int bypp, const uint8_t * src)
+{
+	static const int flags[2] = { PIXCONV_NO_SIMD, 0 };
+	size_t dst_size = (size_t) WIDTH * HEIGHT * bypp;
+	uint8_t *ref = calloc(1, dst_size);
+	uint8_t *out = calloc(1, dst_size);
+	PixConv pc;
+	PixConv_RowProc *scalarProc = NULL;
+	double start, ref_ms;
+	int i, k;
+	int errors = 0;
+
+	memset(&pc, 0, sizeof(pc));
+	fprintf(stderr, "%s (%u bytes)\n", tc->name, bypp);
+	ref_setup(&tc->src, &tc->dst);
+	start = now_ms();
+	for (i = 0; i < LOOPS; i++) {
+		ref_convert(tc, bypp, ref, src);
+	}
+	ref_ms = now_ms() - start;
+	report("ref", ref_ms, ref_ms);
+	for (k = 0; k < 2; k++) {
+		if (PixConv_Setup(&pc, &tc->src, &tc->dst, bypp, tc->swap, flags[k]) < 0) {
+			errors++;
+			continue;
+		}
+		if ((k == 1) && (pc.rowProc == scalarProc)) {
+			/* No SIMD kernel for this format */
+			continue;
+		}
+		scalarProc = pc.rowProc;
+		memset(out, 0, dst_size);
+		start = now_ms();
+		for (i = 0; i < LOOPS; i++) {
+			kernel_convert(&pc, bypp, out, src);
+		}
+		report(pc.kernel, now_ms() - start, ref_ms);
+		if (memcmp(ref, out, dst_size)) {
+			fprintf(stderr, "    %s: output differs from the reference\n", pc.kernel);
+			errors++;
+		}
+	}
+	PixConv_Free(&pc);
+	free(ref);
+	free(out);
+	return errors;
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+int
+main(int argc, char *argv[])
+{
+	size_t src_size = (size_t) WIDTH * HEIGHT * 4;
+	uint8_t *src = malloc(src_size);
+	unsigned int i;
+	int errors = 0;
+
+	srandom(1);
+	for (i = 0; i < src_size; i++) {
+		src[i] = random();
+	}
+	for (i = 0; i < sizeof(testCases) / sizeof(testCases[0]); i++) {
+		errors += run_test(&testCases[i], testBypp[i], src);
+	}
+	free(src);
+	if (errors) {
+		fprintf(stderr, "%d errors\n", errors);
+		return 1;
+	}
+	fprintf(stderr, "All kernels match the reference\n");
+	return 0;
+}
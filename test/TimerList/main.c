@@ -0,0 +1,210 @@
+//===-- test/TimerList/main.c -------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Test of the TimerList with concurrent insert, remove and fire
+///
+///   cc -O2 -Isrc test/TimerList/main.c src/timerlist.c -luv -o timerlist_test
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+#include "timerlist.h"
+
+#include <uv.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define NR_PRODUCERS 4
+#define TIMERS_PER_PRODUCER 64
+#define REQUESTS_PER_PRODUCER 200000
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct TestTimer_s {
+    TimerList_Timer_t timer;
+    uint64_t expire; // owner only test: expected expire count
+    uint64_t fires;
+    uint64_t fires_at_insert;
+    int last_op_insert;
+} TestTimer_t;
+
+typedef struct Producer_s {
+    uv_thread_t tid;
+    TestTimer_t timers[TIMERS_PER_PRODUCER];
+    uint32_t seed;
+} Producer_t;
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+static TimerList_t *list;
+static uint64_t now;
+static int errors;
+static Producer_t producers[NR_PRODUCERS];
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static uint32_t rnd(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static void fire_ordered(void *data) {
+    TestTimer_t *t = data;
+    if (t->expire != now) {
+        fprintf(stderr, "timer expected at %" PRIu64 " fired at %" PRIu64 "\n",
+                t->expire, now);
+        errors++;
+    }
+    t->fires++;
+}
+
+static void fire_counted(void *data) {
+    TestTimer_t *t = data;
+    __atomic_add_fetch(&t->fires, 1, __ATOMIC_RELAXED);
+}
+
+//===----------------------------------------------------------------------===//
+/// Timers inserted and removed by the owner fire exactly at their count
+//===----------------------------------------------------------------------===//
+static void test_owner(void) {
+    static TestTimer_t timers[256];
+    uint32_t seed = 1;
+    int i;
+    list = TimerList_New();
+    now = 0;
+    TimerList_Fire(list, 0);
+    for (i = 0; i < 256; i++) {
+        TimerList_InitTimer(&timers[i].timer, fire_ordered, &timers[i]);
+        timers[i].expire = 1 + rnd(&seed) % 1000;
+        TimerList_Insert(list, &timers[i].timer, timers[i].expire);
+    }
+    for (i = 0; i < 256; i += 4) {
+        TimerList_Remove(list, &timers[i].timer);
+    }
+    for (now = 1; now <= 1000; now++) {
+        TimerList_Fire(list, 1);
+    }
+    for (i = 0; i < 256; i++) {
+        uint64_t expected = (i % 4) ? 1 : 0;
+        if (timers[i].fires != expected) {
+            fprintf(stderr, "timer %d fired %" PRIu64 " times\n", i,
+                    timers[i].fires);
+            errors++;
+        }
+    }
+    free(list);
+}
+
+static void producer_thread(void *arg) {
+    Producer_t *p = arg;
+    int i;
+    for (i = 0; i < REQUESTS_PER_PRODUCER; i++) {
+        TestTimer_t *t = &p->timers[rnd(&p->seed) % TIMERS_PER_PRODUCER];
+        if (rnd(&p->seed) % 4) {
+            t->fires_at_insert = __atomic_load_n(&t->fires, __ATOMIC_RELAXED);
+            t->last_op_insert = 1;
+            TimerList_Insert(list, &t->timer, rnd(&p->seed) % 5000);
+        } else {
+            t->last_op_insert = 0;
+            TimerList_Remove(list, &t->timer);
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+/// Producer threads insert and remove timers while the owner fires
+//===----------------------------------------------------------------------===//
+static void test_concurrent(void) {
+    uint64_t fires;
+    int i, j;
+    list = TimerList_New();
+    TimerList_Fire(list, 0);
+    for (i = 0; i < NR_PRODUCERS; i++) {
+        producers[i].seed = (uint32_t)i + 1;
+        for (j = 0; j < TIMERS_PER_PRODUCER; j++) {
+            TestTimer_t *t = &producers[i].timers[j];
+            TimerList_InitTimer(&t->timer, fire_counted, t);
+        }
+        uv_thread_create(&producers[i].tid, producer_thread, &producers[i]);
+    }
+    for (i = 0; i < 1000000; i++) {
+        TimerList_Fire(list, 3);
+    }
+    for (i = 0; i < NR_PRODUCERS; i++) {
+        uv_thread_join(&producers[i].tid);
+    }
+    TimerList_Fire(list, 0);
+    TimerList_Fire(list, UINT64_MAX / 2);
+    for (i = 0; i < NR_PRODUCERS; i++) {
+        for (j = 0; j < TIMERS_PER_PRODUCER; j++) {
+            TestTimer_t *t = &producers[i].timers[j];
+            if (t->last_op_insert && (t->fires == t->fires_at_insert)) {
+                fprintf(stderr, "inserted timer %d/%d did not fire\n", i, j);
+                errors++;
+            }
+        }
+    }
+    /* All timers have fired or were removed, nothing may be left */
+    fires = 0;
+    for (i = 0; i < NR_PRODUCERS; i++) {
+        for (j = 0; j < TIMERS_PER_PRODUCER; j++) {
+            fires += producers[i].timers[j].fires;
+        }
+    }
+    TimerList_Fire(list, UINT64_MAX / 2);
+    for (i = 0; i < NR_PRODUCERS; i++) {
+        for (j = 0; j < TIMERS_PER_PRODUCER; j++) {
+            fires -= producers[i].timers[j].fires;
+        }
+    }
+    if (fires) {
+        fprintf(stderr, "timers left in the list\n");
+        errors++;
+    }
+    free(list);
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+int main(void) {
+    test_owner();
+    test_concurrent();
+    if (errors) {
+        fprintf(stderr, "TimerList test failed with %d errors\n", errors);
+        return 1;
+    }
+    fprintf(stderr, "TimerList test passed\n");
+    return 0;
+}
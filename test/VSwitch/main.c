@@ -0,0 +1,274 @@
+//===-- test/VSwitch/main.c ---------------------------------------*- C -*-===//
+//
+//              The Leigun Embedded System Simulator Platform
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+//===----------------------------------------------------------------------===//
+///
+/// @file
+/// Throughput test for the virtual Ethernet switch
+///
+/// Two simulated boards are attached to a switch, a third port only
+/// listens. After both boards have sent one frame the switch has learned
+/// their addresses, so the unicast traffic between them must not reach
+/// the third port. Then board A streams frames of several sizes to board
+/// B, in one run over a port of the same process and in one run over a
+/// unix socket connection like from another simulator process. The switch
+/// may drop frames when the receiver is too slow, so lost frames are only
+/// counted. Frames with the wrong length or address and frames out of
+/// order are errors.
+///
+///   cc -O2 -Isrc/softgun -Imodules/softgun test/VSwitch/main.c
+///      modules/softgun/vswitch.c src/softgun/sgstring.c -lpthread -o vswitch
+///   ./vswitch
+///
+//===----------------------------------------------------------------------===//
+
+//==============================================================================
+//= Dependencies
+//==============================================================================
+#include "vswitch.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+//==============================================================================
+//= Constants(also Enumerations)
+//==============================================================================
+#define FRAMES		(200000)
+#define SOCKET_PATH	"/tmp/vswitch-test.sock"
+
+
+//==============================================================================
+//= Types
+//==============================================================================
+typedef struct Stream {
+	int fd;
+	unsigned int len;
+	uint64_t frames;
+	uint64_t lost;
+	uint64_t errors;
+	uint32_t expected;	/* Sequence number of the next frame */
+} Stream;
+
+
+//==============================================================================
+//= Variables
+//==============================================================================
+static const uint8_t macA[6] = { 0x02, 0, 0, 0, 0, 0x0a };
+static const uint8_t macB[6] = { 0x02, 0, 0, 0, 0, 0x0b };
+static const uint8_t macBroadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+
+//==============================================================================
+//= Function definitions(static)
+//==============================================================================
+static double
+now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void
+make_frame(uint8_t * frame, unsigned int len, const uint8_t * dst, const uint8_t * src,
+	   uint32_t seq)
+{
+	memset(frame, 0, len);
+	memcpy(frame, dst, 6);
+	memcpy(frame + 6, src, 6);
+	frame[12] = 0x88;
+	frame[13] = 0xb5;
+	memcpy(frame + 14, &seq, 4);
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * The fds are non blocking like for a MAC model. The test waits for
+ * space instead of losing frames.
+ * ------------------------------------------------------------------------
+ */
+static void
+send_frame(int fd, const uint8_t * frame, unsigned int len)
+{
+	struct pollfd pfd = { fd, POLLOUT, 0 };
+	while (write(fd, frame, len) != (ssize_t) len) {
+		poll(&pfd, 1, 100);
+	}
+}
+
+static int
+recv_frame(int fd, uint8_t * frame, int timeout_ms)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	ssize_t len;
+	while ((len = read(fd, frame, VSWITCH_MAX_FRAME)) < 0) {
+		if ((errno != EAGAIN) || (poll(&pfd, 1, timeout_ms) <= 0)) {
+			return -1;
+		}
+	}
+	return len;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * A gap in the sequence numbers is counted as lost frames. The stream
+ * ends with the last frame or, if the last frames were dropped, when
+ * nothing arrives for a second.
+ * ------------------------------------------------------------------------
+ */
+static void *
+receiver(void *arg)
+{
+	Stream *st = arg;
+	uint8_t frame[VSWITCH_MAX_FRAME];
+	uint32_t seq;
+	int len;
+	while (st->expected < FRAMES) {
+		len = recv_frame(st->fd, frame, 1000);
+		if (len < 0) {
+			break;
+		}
+		memcpy(&seq, frame + 14, 4);
+		if ((len != (int)st->len) || memcmp(frame, macB, 6) || (seq < st->expected)) {
+			st->errors++;
+			continue;
+		}
+		st->lost += seq - st->expected;
+		st->expected = seq + 1;
+		st->frames++;
+	}
+	st->lost += FRAMES - st->expected;
+	return NULL;
+}
+
+static int
+run_stream(const char *name, int fdA, int fdB, unsigned int len)
+{
+	uint8_t frame[VSWITCH_MAX_FRAME];
+	Stream st = { fdB, len, 0, 0, 0, 0 };
+	pthread_t thread;
+	double start, ms;
+	uint32_t seq;
+	pthread_create(&thread, NULL, receiver, &st);
+	start = now_ms();
+	for (seq = 0; seq < FRAMES; seq++) {
+		make_frame(frame, len, macB, macA, seq);
+		send_frame(fdA, frame, len);
+	}
+	pthread_join(thread, NULL);
+	ms = now_ms() - start;
+	fprintf(stderr, "%-8s %4u bytes: %8.0f frames/s %8.1f MBit/s, %llu lost, %llu errors\n",
+		name, len, st.frames / ms * 1000.0, st.frames * len * 8.0 / ms / 1000.0,
+		(unsigned long long)st.lost, (unsigned long long)st.errors);
+	/* A switch may drop frames only when the receiver is too slow */
+	return st.errors ? -1 : 0;
+}
+
+/*
+ * ------------------------------------------------------------------------
+ * Both boards announce themselves, afterwards the unicast traffic is
+ * only forwarded to the destination port.
+ * ------------------------------------------------------------------------
+ */
+static int
+test_learning(VSwitch * vs, int fdA, int fdB, int fdC)
+{
+	uint8_t frame[VSWITCH_MAX_FRAME];
+	VSwitch_PortStats stats;
+	int errors = 0;
+	make_frame(frame, 60, macBroadcast, macB, 0);
+	send_frame(fdB, frame, 60);
+	if ((recv_frame(fdA, frame, 1000) != 60) || (recv_frame(fdC, frame, 1000) != 60)) {
+		fprintf(stderr, "Broadcast was not flooded\n");
+		errors++;
+	}
+	make_frame(frame, 60, macB, macA, 0);
+	send_frame(fdA, frame, 60);
+	if (recv_frame(fdB, frame, 1000) != 60) {
+		fprintf(stderr, "Unicast to a learned address was lost\n");
+		errors++;
+	}
+	make_frame(frame, 60, macA, macB, 0);
+	send_frame(fdB, frame, 60);
+	if (recv_frame(fdA, frame, 1000) != 60) {
+		fprintf(stderr, "Unicast to a learned address was lost\n");
+		errors++;
+	}
+	if (recv_frame(fdC, frame, 100) >= 0) {
+		fprintf(stderr, "Unicast to a learned address was flooded\n");
+		errors++;
+	}
+	VSwitch_GetPortStats(vs, "boardA", &stats);
+	if ((stats.rx_frames != 1) || (stats.tx_frames != 2)) {
+		fprintf(stderr, "Wrong counters for boardA\n");
+		errors++;
+	}
+	return errors;
+}
+
+
+//==============================================================================
+//= Function definitions(global)
+//==============================================================================
+int
+main(int argc, char *argv[])
+{
+	static const unsigned int sizes[] = { 60, 512, 1514 };
+	VSwitch *vs = VSwitch_New("lan");
+	int fdA, fdB, fdC, fdR;
+	unsigned int i;
+	int errors = 0;
+
+	fdA = VSwitch_Attach(vs, "boardA");
+	fdB = VSwitch_Attach(vs, "boardB");
+	fdC = VSwitch_Attach(vs, "monitor");
+	if ((fdA < 0) || (fdB < 0) || (fdC < 0)) {
+		return 1;
+	}
+	errors += test_learning(vs, fdA, fdB, fdC);
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (run_stream("local", fdA, fdB, sizes[i]) < 0) {
+			errors++;
+		}
+	}
+	if (VSwitch_Listen(vs, SOCKET_PATH) < 0) {
+		return 1;
+	}
+	fdR = VSwitch_Connect(SOCKET_PATH);
+	if (fdR < 0) {
+		return 1;
+	}
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (run_stream("remote", fdR, fdB, sizes[i]) < 0) {
+			errors++;
+		}
+	}
+	unlink(SOCKET_PATH);
+	VSwitch_DumpStats(vs, stderr);
+	if (errors) {
+		fprintf(stderr, "%d errors\n", errors);
+		return 1;
+	}
+	fprintf(stderr, "Switch forwards and learns correctly\n");
+	return 0;
+}